@@ -0,0 +1,67 @@
+// Renders the plugin editor offscreen and replays a recorded event stream against it,
+// reporting frame time percentiles and snapshot differences.
+//
+// usage: headless [-n iterations] [-o output dir] [-r reference dir] [-t tolerance] stream.txt
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../IPlugEffect.h"
+#include "IGraphicsBench.h"
+
+#ifndef RESOURCE_PATH
+  #define RESOURCE_PATH ".."
+#endif
+
+int main(int argc, char** argv)
+{
+  int iterations = 1, tolerance = 0;
+  const char* outputDir = 0;
+  const char* referenceDir = 0;
+  const char* streamFile = 0;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) iterations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) outputDir = argv[++i];
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) referenceDir = argv[++i];
+    else if (!strcmp(argv[i], "-t") && i + 1 < argc) tolerance = atoi(argv[++i]);
+    else if (argv[i][0] != '-' && !streamFile) streamFile = argv[i];
+    else
+    {
+      fprintf(stderr, "usage: %s [-n iterations] [-o output dir] [-r reference dir] [-t tolerance] stream.txt\n", argv[0]);
+      return 1;
+    }
+  }
+  if (!streamFile)
+  {
+    fprintf(stderr, "no event stream given\n");
+    return 1;
+  }
+
+  IPlug* pPlug = MakePlug(RESOURCE_PATH);
+  IGraphicsBench bench(pPlug);
+  if (outputDir) bench.SetOutputDir(outputDir);
+  if (referenceDir) bench.SetReferenceDir(referenceDir);
+  bench.SetTolerance(tolerance);
+
+  int rc = 0;
+  if (!bench.LoadStream(streamFile))
+  {
+    fprintf(stderr, "can't read %s\n", streamFile);
+    rc = 1;
+  }
+  else if (!bench.Run(iterations))
+  {
+    fprintf(stderr, "%s: %s\n", streamFile, bench.GetError());
+    rc = 1;
+  }
+  else
+  {
+    bench.Report(stdout);
+    if (bench.NFailedSnapshots()) rc = 2;
+  }
+
+  delete pPlug;
+  return rc;
+}
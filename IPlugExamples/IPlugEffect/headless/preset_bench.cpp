@@ -0,0 +1,236 @@
+// Times a preset library kept in a bank file (see IPresetBank.h): writing and loading the bank,
+// then switching presets by index, by name and by bank index, counting the heap allocations
+// each switch makes. By default 5000 presets of 200 params, the first 128 of them programs.
+//
+// usage: preset_bench [-b bank presets] [-n programs] [-p params]
+
+// Only this file is built with the trap, it counts every malloc()/free() while a switch runs.
+#define WDL_RT_MALLOC_TRAP
+#define WDL_RT_MALLOC_TRAP_IMPLEMENT
+#define WDL_RT_MALLOC_TRAP_HANDLER(what, size) g_nAllocs++;
+static volatile int g_nAllocs;
+#include "../rtalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "IPlugHeadless.h"
+#include "IPresetBank.h"
+#include "IRedrawScheduler.h"
+
+class PresetBenchPlug : public IPlugHeadless
+{
+public:
+  PresetBenchPlug(IPlugInstanceInfo instanceInfo, int nParams, int nPrograms)
+    : IPlugHeadless(instanceInfo, nParams, "2-2", nPrograms, "PresetBench", "PresetBench", "IPlug", 0x10000, 'PbPl', 'Ipl_')
+  {
+    char name[32];
+    for (int i = 0; i < nParams; ++i)
+    {
+      sprintf(name, "p%d", i);
+      switch (i % 4)
+      {
+        case 0: GetParam(i)->InitBool(name, false); break;
+        case 1: GetParam(i)->InitEnum(name, 0, 8); break;
+        case 2: GetParam(i)->InitInt(name, 64, 0, 127); break;
+        default: GetParam(i)->InitDouble(name, 0.5, 0., 1., 0.0001); break;
+      }
+    }
+    MakeDefaultPreset("Init", nPrograms);
+  }
+
+  void Scramble()
+  {
+    for (int i = 0; i < NParams(); ++i)
+    {
+      GetParam(i)->SetNormalized((double) rand() / RAND_MAX);
+    }
+  }
+};
+
+// Marks this thread the way the plugin APIs mark the audio thread.
+struct CountAllocs
+{
+  CountAllocs() { g_nAllocs = 0; ++WDL_RT_ThreadDepth(); }
+  ~CountAllocs() { --WDL_RT_ThreadDepth(); }
+};
+
+static bool SameParams(PresetBenchPlug* pPlug, const double* pValues)
+{
+  for (int i = 0; i < pPlug->NParams(); ++i)
+  {
+    if (pPlug->GetParam(i)->Value() != pValues[i]) return false;
+  }
+  return true;
+}
+
+static void Report(const char* what, double ms, int n, int nAllocs, bool ok)
+{
+  printf("%-28s %9.2f us %6d allocations %s\n", what, ms * 1000. / n, nAllocs, ok ? "" : "FAILED");
+}
+
+int main(int argc, char** argv)
+{
+  int nBank = 5000, nPrograms = 128, nParams = 200;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc) nBank = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc) nPrograms = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) nParams = atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [-b bank presets] [-n programs] [-p params]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (nPrograms < 1 || nBank <= nPrograms || nParams < 4)
+  {
+    fprintf(stderr, "need at least 1 program, more bank presets than programs and 4 params\n");
+    return 1;
+  }
+
+  {
+    CountAllocs count;
+    free(malloc(16));
+    if (g_nAllocs != 2)
+    {
+      fprintf(stderr, "the allocation trap isn't active\n");
+      return 1;
+    }
+  }
+
+  IPlugInstanceInfo info;
+  PresetBenchPlug plug(info, nParams, nPrograms);
+
+  char path[64], name[32];
+  snprintf(path, sizeof(path), "/tmp/preset_bench_%d.ipb", (int) getpid());
+  WDL_TypedBuf<double> values;
+  double* pValues = values.Resize(nBank * nParams);
+  int i, rc = 0;
+  srand(1);
+
+  double t0 = IRedrawScheduler::GetTimeMs();
+  {
+    IPresetBankWriter writer;
+    for (i = 0; i < nBank; ++i)
+    {
+      ByteChunk state;
+      plug.Scramble();
+      plug.SnapshotParams(pValues + i * nParams);
+      plug.SerializeState(&state);
+      sprintf(name, "preset %d", i);
+      writer.Add(name, (i % 3 ? "lead" : "bass, lead"), state.GetBytes(), state.Size());
+    }
+    if (!writer.Write(path, plug.GetUniqueID()))
+    {
+      fprintf(stderr, "can't write %s\n", path);
+      return 1;
+    }
+  }
+  double t1 = IRedrawScheduler::GetTimeMs();
+  bool ok = plug.LoadPresetBank(path);
+  double t2 = IRedrawScheduler::GetTimeMs();
+  unlink(path); // The mapping stays valid.
+  if (!ok)
+  {
+    fprintf(stderr, "can't load %s\n", path);
+    return 1;
+  }
+  printf("%d bank presets (%d programs), %d params\n", nBank, nPrograms, nParams);
+  printf("%-28s %9.2f ms\n", "write bank", t1 - t0);
+  printf("%-28s %9.2f ms\n", "load bank", t2 - t1);
+
+  // Warm up, so every page of the bank is in memory.
+  for (i = 0; i < nBank; ++i)
+  {
+    plug.RestorePresetFromBank(i);
+  }
+
+  const int rounds = 10;
+  int nAllocs;
+  ok = true;
+  {
+    CountAllocs count;
+    t0 = IRedrawScheduler::GetTimeMs();
+    for (int r = 0; r < rounds; ++r)
+    {
+      for (i = 0; i < nPrograms; ++i) ok &= plug.RestorePreset(i);
+    }
+    t1 = IRedrawScheduler::GetTimeMs();
+    nAllocs = g_nAllocs;
+  }
+  ok &= SameParams(&plug, pValues + (nPrograms - 1) * nParams);
+  Report("RestorePreset(idx)", t1 - t0, rounds * nPrograms, nAllocs, ok);
+  rc |= !ok || nAllocs;
+
+  // Names are made up front, sprintf() may allocate.
+  WDL_PtrList<char> names;
+  for (i = 0; i < nBank; ++i)
+  {
+    sprintf(name, "preset %d", i);
+    names.Add(strdup(name));
+  }
+
+  ok = true;
+  {
+    CountAllocs count;
+    t0 = IRedrawScheduler::GetTimeMs();
+    for (int r = 0; r < rounds; ++r)
+    {
+      for (i = 0; i < nPrograms; ++i) ok &= plug.RestorePreset(names.Get(i));
+    }
+    t1 = IRedrawScheduler::GetTimeMs();
+    nAllocs = g_nAllocs;
+  }
+  ok &= SameParams(&plug, pValues + (nPrograms - 1) * nParams);
+  Report("RestorePreset(program name)", t1 - t0, rounds * nPrograms, nAllocs, ok);
+  rc |= !ok || nAllocs;
+
+  ok = true;
+  {
+    CountAllocs count;
+    t0 = IRedrawScheduler::GetTimeMs();
+    for (i = nPrograms; i < nBank; ++i) ok &= plug.RestorePreset(names.Get(i));
+    t1 = IRedrawScheduler::GetTimeMs();
+    nAllocs = g_nAllocs;
+  }
+  ok &= SameParams(&plug, pValues + (nBank - 1) * nParams);
+  Report("RestorePreset(bank name)", t1 - t0, nBank - nPrograms, nAllocs, ok);
+  rc |= !ok || nAllocs;
+
+  ok = true;
+  {
+    CountAllocs count;
+    t0 = IRedrawScheduler::GetTimeMs();
+    for (i = 0; i < nBank; ++i) ok &= plug.RestorePresetFromBank(i);
+    t1 = IRedrawScheduler::GetTimeMs();
+    nAllocs = g_nAllocs;
+  }
+  ok &= SameParams(&plug, pValues + (nBank - 1) * nParams);
+  Report("RestorePresetFromBank(idx)", t1 - t0, nBank, nAllocs, ok);
+  rc |= !ok || nAllocs;
+
+  ok = true;
+  {
+    CountAllocs count;
+    t0 = IRedrawScheduler::GetTimeMs();
+    for (i = 0; i < nBank; ++i) ok &= !plug.RestorePreset("no such preset");
+    t1 = IRedrawScheduler::GetTimeMs();
+    nAllocs = g_nAllocs;
+  }
+  Report("RestorePreset(missing name)", t1 - t0, nBank, nAllocs, ok);
+  rc |= !ok || nAllocs;
+
+  // A renamed program is found by its new name, its old one no longer finds the bank's copy.
+  plug.RestorePreset(1);
+  plug.ModifyCurrentPreset("renamed");
+  plug.RestorePreset(0);
+  ok = plug.RestorePreset("renamed") && plug.GetCurrentPresetIdx() == 1 && !plug.RestorePreset(names.Get(1)) &&
+       SameParams(&plug, pValues + nParams);
+  if (!ok) printf("rename FAILED\n");
+  rc |= !ok;
+
+  names.Empty(true, free);
+  return rc;
+}
@@ -0,0 +1,171 @@
+// Runs IPlugEffect in a sandbox worker process (this same executable, see IPlugSandbox.h) behind a
+// shim plugin, checks the output against IPlugEffect running in-process, and reports the per-block
+// round trip to the worker.
+//
+// usage: sandbox_bench [-n blocks] [-b block size] [-k block to kill the worker at] [-s block to stop the worker at]
+//   -s sends the worker SIGSTOP, the block should come out silent within its deadline rather than
+//   hold up the audio thread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../IPlugEffect.h"
+#include "IPlugSandbox.h"
+#include "IRedrawScheduler.h"
+
+#ifndef RESOURCE_PATH
+  #define RESOURCE_PATH ".."
+#endif
+
+// What the host loads instead of IPlugEffect: the same parameters, and no DSP of its own.
+class SandboxShim : public IPlugHeadless
+{
+public:
+  SandboxShim(IPlugInstanceInfo instanceInfo, const char* workerPath, int blockSize)
+    : IPlugHeadless(instanceInfo, 1, "2-2", 1, "SandboxShim", "SandboxShim", "IPlug", 0x10000, 'SbSh', 'Ipl_')
+    , mSandbox(workerPath, 2, 2, NParams(), blockSize)
+  {
+    GetParam(0)->InitDouble("Gain", 50., 0., 100.0, 0.01, "%");
+    GetParam(0)->SetShape(2.);
+  }
+
+  // A restarted worker gets the values OnParamChange() passed on from Start() itself.
+  bool StartSandbox() { return mSandbox.Start(GetSampleRate()); }
+
+  void OnParamChange(int paramIdx) { mSandbox.SetParameter(paramIdx, GetParam(paramIdx)->Value()); }
+  void ProcessMidiMsg(IMidiMsg* pMsg) { mSandbox.SendMidi(pMsg); }
+  void ProcessDoubleReplacing(double** inputs, double** outputs, int nFrames) { mSandbox.ProcessBlock(inputs, outputs, nFrames); }
+
+  IPlugSandboxHost mSandbox;
+};
+
+int main(int argc, char** argv)
+{
+  const char* uniq = IPlugSandboxWorker::GetSandboxArg(argc, argv);
+  if (uniq)
+  {
+    IPlugHeadless* pPlug = MakePlug(RESOURCE_PATH);
+    int rc;
+    {
+      IPlugSandboxWorker worker(pPlug);
+      rc = worker.Run(uniq);
+    }
+    delete pPlug;
+    return rc;
+  }
+
+  int nBlocks = 20000, blockSize = 128, killAt = -1, stopAt = -1;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) nBlocks = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) blockSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-k") && i + 1 < argc) killAt = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) stopAt = atoi(argv[++i]);
+    else nBlocks = 0, i = argc;
+  }
+  if (nBlocks < 1 || blockSize < 1)
+  {
+    fprintf(stderr, "usage: %s [-n blocks] [-b block size] [-k block to kill the worker at] [-s block to stop the worker at]\n", argv[0]);
+    return 1;
+  }
+
+  char workerPath[4096];
+  int len = (int) readlink("/proc/self/exe", workerPath, sizeof(workerPath) - 1);
+  if (len <= 0)
+  {
+    fprintf(stderr, "can't find own executable\n");
+    return 1;
+  }
+  workerPath[len] = 0;
+
+  IPlugInstanceInfo info;
+  info.mResourcePath.Set(RESOURCE_PATH);
+  SandboxShim shim(info, workerPath, blockSize);
+  IPlugHeadless* pRef = MakePlug(RESOURCE_PATH);
+  shim.SetSampleRate(44100.);
+  pRef->SetSampleRate(44100.);
+  pRef->SetBlockSize(blockSize);
+  pRef->Reset();
+
+  double t0 = IRedrawScheduler::GetTimeMs();
+  if (!shim.StartSandbox())
+  {
+    fprintf(stderr, "worker didn't start\n");
+    return 1;
+  }
+  printf("worker %d started in %.1f ms\n", shim.mSandbox.GetWorkerPid(), IRedrawScheduler::GetTimeMs() - t0);
+
+  WDL_TypedBuf<double> buf;
+  double* pBuf = buf.Resize(blockSize * 6);
+  double* inputs[2] = { pBuf, pBuf + blockSize };
+  double* outputs[2] = { pBuf + blockSize * 2, pBuf + blockSize * 3 };
+  double* refOutputs[2] = { pBuf + blockSize * 4, pBuf + blockSize * 5 };
+
+  int i, mismatches = 0, silenced = 0;
+  double refMs = 0.;
+  srand(1);
+  for (int b = 0; b < nBlocks; ++b)
+  {
+    if (b % 50 == 0)
+    {
+      double v = (double) rand() / RAND_MAX;
+      shim.SetParameterFromHost(0, v);
+      pRef->SetParameterFromHost(0, v);
+    }
+    if (b % 10 == 0)
+    {
+      IMidiMsg msg;
+      msg.MakeNoteOnMsg(60, 100, b % blockSize);
+      shim.ProcessMidiMsg(&msg);
+    }
+    for (i = 0; i < blockSize * 2; ++i) pBuf[i] = (double) rand() / RAND_MAX * 2. - 1.;
+
+    if (b == killAt)
+    {
+      printf("killing worker %d at block %d\n", shim.mSandbox.GetWorkerPid(), b);
+      kill(shim.mSandbox.GetWorkerPid(), SIGKILL);
+    }
+    if (b == stopAt)
+    {
+      printf("stopping worker %d at block %d\n", shim.mSandbox.GetWorkerPid(), b);
+      kill(shim.mSandbox.GetWorkerPid(), SIGSTOP);
+    }
+
+    t0 = IRedrawScheduler::GetTimeMs();
+    shim.LockMutexAndProcessDoubleReplacing(inputs, outputs, blockSize);
+    if (b == stopAt)
+    {
+      printf("block %d took %.2f ms (%.2f ms of audio)\n", b, IRedrawScheduler::GetTimeMs() - t0, blockSize * 1000. / 44100.);
+    }
+    double t1 = IRedrawScheduler::GetTimeMs();
+    pRef->LockMutexAndProcessDoubleReplacing(inputs, refOutputs, blockSize);
+    refMs += IRedrawScheduler::GetTimeMs() - t1;
+
+    if (!shim.mSandbox.IsRunning())
+    {
+      // The block came out silent, what a host would hear. Start a new worker for the next one.
+      silenced++;
+      t0 = IRedrawScheduler::GetTimeMs();
+      if (!shim.StartSandbox())
+      {
+        fprintf(stderr, "worker didn't restart\n");
+        return 1;
+      }
+      printf("block %d silenced, worker %d restarted in %.1f ms\n", b, shim.mSandbox.GetWorkerPid(), IRedrawScheduler::GetTimeMs() - t0);
+    }
+    else if (memcmp(outputs[0], refOutputs[0], blockSize * sizeof(double) * 2))
+    {
+      mismatches++;
+    }
+  }
+
+  ISandboxStats stats;
+  shim.mSandbox.GetStats(&stats);
+  printf("%d blocks of %d frames, %d silenced, %d differed from in-process\n", nBlocks, blockSize, silenced, mismatches);
+  printf("round trip: avg %.1f us  jitter %.1f us  p99 %.1f us  max %.1f us  (plugin %.1f us, in-process %.1f us)\n",
+    stats.mAvgUs, stats.mJitterUs, stats.mP99Us, stats.mMaxUs, stats.mAvgProcessUs, refMs * 1000. / nBlocks);
+
+  shim.mSandbox.Stop();
+  delete pRef;
+  return mismatches ? 2 : 0;
+}
@@ -0,0 +1,210 @@
+// Times SerializeParams / UnserializeParams / CompareState on a plugin with 2000 params,
+// in the compact chunk format and the legacy one double per param layout.
+//
+// usage: state_bench [-n iterations] [-p params]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IPlugHeadless.h"
+#include "IRedrawScheduler.h"
+
+class StateBenchPlug : public IPlugHeadless
+{
+public:
+  // reversed is a later version of the plugin that declares the same params in the opposite order, with IDs.
+  StateBenchPlug(IPlugInstanceInfo instanceInfo, int nParams, bool reversed = false)
+    : IPlugHeadless(instanceInfo, nParams, "2-2", 1, "StateBench", "StateBench", "IPlug", 0x10000, 'SbPl', 'Ipl_')
+  {
+    char name[32];
+    for (int i = 0; i < nParams; ++i)
+    {
+      int id = (reversed ? nParams - 1 - i : i);
+      sprintf(name, "p%d", id);
+      switch (id % 4)
+      {
+        case 0: GetParam(i)->InitBool(name, false); break;
+        case 1: GetParam(i)->InitEnum(name, 0, 8); break;
+        case 2: GetParam(i)->InitInt(name, 64, 0, 127); break;
+        default: GetParam(i)->InitDouble(name, 0.5, 0., 1., 0.0001); break;
+      }
+      GetParam(i)->SetID(id);
+    }
+    MakeDefaultPreset();
+  }
+
+  // Changes every stride'th param, starting at first.
+  void Scramble(int first, int stride)
+  {
+    for (int i = first; i < NParams(); i += stride)
+    {
+      GetParam(i)->SetNormalized((double) rand() / RAND_MAX);
+    }
+  }
+
+  using IPlugBase::SetCompactParamsChunk;
+};
+
+struct BenchResult
+{
+  int mBytes;
+  double mSaveUs, mRestoreUs, mCompareEqualUs, mCompareDiffUs;
+};
+
+static bool SameParams(StateBenchPlug* pA, const double* pValues)
+{
+  for (int i = 0; i < pA->NParams(); ++i)
+  {
+    if (pA->GetParam(i)->Value() != pValues[i]) return false;
+  }
+  return true;
+}
+
+static bool Run(StateBenchPlug* pPlug, int iterations, BenchResult* pResult)
+{
+  int i, n = pPlug->NParams();
+  WDL_TypedBuf<double> values;
+  pPlug->SnapshotParams(values.Resize(n));
+
+  ByteChunk chunk;
+  double t0 = IRedrawScheduler::GetTimeMs();
+  for (i = 0; i < iterations; ++i)
+  {
+    chunk.Clear();
+    pPlug->SerializeState(&chunk);
+  }
+  double t1 = IRedrawScheduler::GetTimeMs();
+  for (i = 0; i < iterations; ++i)
+  {
+    if (pPlug->UnserializeState(&chunk, 0) != chunk.Size()) return false;
+  }
+  double t2 = IRedrawScheduler::GetTimeMs();
+  for (i = 0; i < iterations; ++i)
+  {
+    if (!pPlug->CompareStateSized(chunk.GetBytes(), 0, chunk.Size())) return false;
+  }
+  double t3 = IRedrawScheduler::GetTimeMs();
+
+  // One param off by a lot, so the fuzzy compare has to look at every value.
+  IParam* pLast = pPlug->GetParam(n - 1);
+  double last = pLast->Value();
+  pLast->Set(last > 0.5 ? 0. : 1.);
+  for (i = 0; i < iterations; ++i)
+  {
+    if (pPlug->CompareStateSized(chunk.GetBytes(), 0, chunk.Size())) return false;
+  }
+  double t4 = IRedrawScheduler::GetTimeMs();
+  pLast->Set(last);
+
+  pResult->mBytes = chunk.Size();
+  pResult->mSaveUs = (t1 - t0) * 1000. / iterations;
+  pResult->mRestoreUs = (t2 - t1) * 1000. / iterations;
+  pResult->mCompareEqualUs = (t3 - t2) * 1000. / iterations;
+  pResult->mCompareDiffUs = (t4 - t3) * 1000. / iterations;
+  return SameParams(pPlug, values.Get());
+}
+
+int main(int argc, char** argv)
+{
+  int iterations = 1000, nParams = 2000;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) iterations = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc) nParams = atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [-n iterations] [-p params]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (iterations < 1 || nParams < 4)
+  {
+    fprintf(stderr, "need at least 1 iteration and 4 params\n");
+    return 1;
+  }
+
+  IPlugInstanceInfo info;
+  StateBenchPlug plug(info, nParams);
+
+  struct { const char* mName; int mStride; } states[] =
+  {
+    { "default", 0 },
+    { "10% changed", 10 },
+    { "all changed", 1 },
+  };
+
+  int rc = 0;
+  printf("%d params, %d iterations, times in us\n", nParams, iterations);
+  printf("%-12s %-8s %8s %9s %9s %9s %9s\n", "state", "format", "bytes", "save", "restore", "cmp same", "cmp diff");
+  for (int s = 0; s < sizeof(states) / sizeof(states[0]); ++s)
+  {
+    srand(1);
+    plug.RestorePreset(0);
+    if (states[s].mStride) plug.Scramble(s, states[s].mStride);
+
+    for (int compact = 1; compact >= 0; --compact)
+    {
+      BenchResult r;
+      plug.SetCompactParamsChunk(!!compact);
+      if (!Run(&plug, iterations, &r))
+      {
+        printf("%-12s %-8s round trip FAILED\n", states[s].mName, compact ? "compact" : "legacy");
+        rc = 1;
+        continue;
+      }
+      printf("%-12s %-8s %8d %9.2f %9.2f %9.2f %9.2f\n", states[s].mName, compact ? "compact" : "legacy",
+             r.mBytes, r.mSaveUs, r.mRestoreUs, r.mCompareEqualUs, r.mCompareDiffUs);
+    }
+  }
+
+  // A legacy chunk (or a preset made before the compact format) has to load into the current one.
+  ByteChunk legacy;
+  WDL_TypedBuf<double> values;
+  plug.SnapshotParams(values.Resize(nParams));
+  plug.SetCompactParamsChunk(false);
+  plug.SerializeState(&legacy);
+  plug.SetCompactParamsChunk(true);
+  plug.RestorePreset(0);
+  if (plug.UnserializeState(&legacy, 0) != legacy.Size() || !SameParams(&plug, values.Get()))
+  {
+    printf("legacy chunk FAILED to load\n");
+    rc = 1;
+  }
+
+  // What the plugin APIs do with host memory: restore through a view, save into an arena.
+  ByteChunk owned;
+  plug.Scramble(1, 3);
+  plug.SnapshotParams(values.Get());
+  plug.SerializeState(&owned);
+  WDL_TypedBuf<BYTE> arena;
+  ByteChunk inArena;
+  inArena.SetArena(arena.Resize(owned.PeakSize()), owned.PeakSize()); // PeakSize() covers the params worst case
+  plug.SerializeState(&inArena);
+  plug.RestorePreset(0);
+  ByteChunkView view(owned.GetBytes(), owned.Size());
+  if (!inArena.IsExternal() || !inArena.IsEqual(&owned) ||
+      plug.UnserializeState(&view, 0) != owned.Size() || !SameParams(&plug, values.Get()))
+  {
+    printf("view/arena chunk FAILED\n");
+    rc = 1;
+  }
+
+  // A compact chunk reaches the right params in a version that moved them, through the IDs.
+  StateBenchPlug reversed(info, nParams, true);
+  reversed.SetCompactParamsChunk(true);
+  plug.SetCompactParamsChunk(true);
+  plug.Scramble(2, 7);
+  owned.Clear();
+  plug.SerializeState(&owned);
+  bool same = reversed.UnserializeState(&owned, 0) == owned.Size();
+  for (int i = 0; same && i < nParams; ++i)
+  {
+    same = reversed.GetParamIdx(i) == nParams - 1 - i && reversed.GetParam(nParams - 1 - i)->Value() == plug.GetParam(i)->Value();
+  }
+  if (!same)
+  {
+    printf("reordered params FAILED\n");
+    rc = 1;
+  }
+  return rc;
+}
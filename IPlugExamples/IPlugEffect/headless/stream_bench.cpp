@@ -0,0 +1,232 @@
+// Streams voices from WAV files with IDiskStreamer, the audio thread paced faster than real time,
+// and checks every frame against what was written. Reports underruns, the heap allocations the
+// audio thread made, and how long a stopped voice takes to go back to the pool.
+//
+// usage: stream_bench [-v voices] [-s seconds per file] [-b block size] [-x speed]
+//   -x 1 runs the audio thread in real time, the default 8 runs it eight times faster
+
+// Only this file is built with the trap, it counts every malloc()/free() on the audio thread.
+#define WDL_RT_MALLOC_TRAP
+#define WDL_RT_MALLOC_TRAP_IMPLEMENT
+#define WDL_RT_MALLOC_TRAP_HANDLER(what, size) g_nAllocs++;
+static volatile int g_nAllocs;
+#include "../rtalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include "IDiskStreamer.h"
+#include "IRedrawScheduler.h"
+
+#define SAMPLE_RATE 44100
+
+// Frame f, channel c of file i.
+static short TestValue(int i, int f, int c)
+{
+  return (short) ((f * 7 + i * 131 + c * 5003) % 65536 - 32768);
+}
+
+static bool WriteTestFile(const char* path, int i, int frames)
+{
+  FILE* fp = fopen(path, "wb");
+  if (!fp) return false;
+  unsigned char hdr[44];
+  int dataBytes = frames * 4;
+  memcpy(hdr, "RIFF", 4);
+  for (int k = 0; k < 4; ++k) hdr[4 + k] = (unsigned char) ((36 + dataBytes) >> (8 * k));
+  memcpy(hdr + 8, "WAVEfmt ", 8);
+  static const unsigned char fmt[20] = { 16, 0, 0, 0, 1, 0, 2, 0, 0x44, 0xAC, 0, 0, 0x10, 0xB1, 2, 0, 4, 0, 16, 0 };
+  memcpy(hdr + 16, fmt, 20);
+  memcpy(hdr + 36, "data", 4);
+  for (int k = 0; k < 4; ++k) hdr[40 + k] = (unsigned char) (dataBytes >> (8 * k));
+  bool ok = fwrite(hdr, 1, 44, fp) == 44;
+
+  WDL_TypedBuf<short> buf;
+  short* p = buf.Resize(SAMPLE_RATE * 2);
+  for (int f = 0; ok && f < frames; f += SAMPLE_RATE)
+  {
+    int n = frames - f < SAMPLE_RATE ? frames - f : SAMPLE_RATE;
+    for (int k = 0; k < n; ++k)
+    {
+      p[k * 2] = TestValue(i, f + k, 0);
+      p[k * 2 + 1] = TestValue(i, f + k, 1);
+    }
+    ok = (int) fwrite(p, 4, n, fp) == n;
+  }
+  fclose(fp);
+  return ok;
+}
+
+static void TestFilePath(char* path, int size, int i)
+{
+  snprintf(path, size, "/tmp/stream_bench_%d_%d.wav", (int) getpid(), i);
+}
+
+static void RemoveTestFiles(int n)
+{
+  char path[64];
+  for (int i = 0; i < n; ++i)
+  {
+    TestFilePath(path, sizeof(path), i);
+    unlink(path);
+  }
+}
+
+// Marks this thread the way the plugin APIs mark the audio thread.
+struct CountAllocs
+{
+  CountAllocs() { g_nAllocs = 0; ++WDL_RT_ThreadDepth(); }
+  ~CountAllocs() { --WDL_RT_ThreadDepth(); }
+};
+
+static void SleepUntil(double ms)
+{
+  double now = IRedrawScheduler::GetTimeMs();
+  if (ms > now) usleep((useconds_t) ((ms - now) * 1000.));
+}
+
+int main(int argc, char** argv)
+{
+  int nVoices = 32, seconds = 10, blockSize = 512;
+  double speed = 8.;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "-v") && i + 1 < argc) nVoices = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) seconds = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) blockSize = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-x") && i + 1 < argc) speed = atof(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [-v voices] [-s seconds per file] [-b block size] [-x speed]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (nVoices < 1 || seconds < 1 || blockSize < 1 || speed <= 0.)
+  {
+    fprintf(stderr, "need at least 1 voice, 1 second, a block size of 1 and a speed above 0\n");
+    return 1;
+  }
+
+  {
+    CountAllocs count;
+    free(malloc(16));
+    if (g_nAllocs != 2)
+    {
+      fprintf(stderr, "the allocation trap isn't active\n");
+      return 1;
+    }
+  }
+
+  int i, frames = seconds * SAMPLE_RATE, rc = 0;
+  char path[64];
+  IDiskStreamer streamer(nVoices + 4, 8192, 32768, 2);
+  // The I/O thread opens each file again for every voice, so they stay until the end.
+  for (i = 0; i < nVoices; ++i)
+  {
+    TestFilePath(path, sizeof(path), i);
+    if (!WriteTestFile(path, i, frames) || streamer.AddSample(path) != i)
+    {
+      fprintf(stderr, "can't write or add %s\n", path);
+      RemoveTestFiles(i + 1);
+      return 1;
+    }
+  }
+
+  WDL_TypedBuf<double> outBuf;
+  double* pOut = outBuf.Resize(blockSize * 2);
+  double* outputs[2] = { pOut, pOut + blockSize };
+  WDL_TypedBuf<int> voiceBuf, posBuf;
+  int* pVoice = voiceBuf.Resize(nVoices);
+  int* pPos = posBuf.Resize(nVoices);
+  int nMismatches = 0, nStartFailed = 0, nAllocs;
+  double framesPlayed = 0.;
+
+  // Voice i starts at block 4 * i, so the I/O thread gets them at different points.
+  const double blockMs = 1000. * blockSize / SAMPLE_RATE / speed;
+  double t0 = IRedrawScheduler::GetTimeMs();
+  {
+    CountAllocs count;
+    for (i = 0; i < nVoices; ++i) pVoice[i] = -2;
+    int nDone = 0;
+    for (int block = 0; nDone < nVoices; ++block)
+    {
+      SleepUntil(t0 + block * blockMs);
+      for (i = 0; i < nVoices; ++i)
+      {
+        if (pVoice[i] == -2 && block >= 4 * i)
+        {
+          pVoice[i] = streamer.StartVoice(i);
+          pPos[i] = 0;
+          if (pVoice[i] < 0)
+          {
+            ++nStartFailed;
+            ++nDone;
+          }
+        }
+        if (pVoice[i] < 0) continue;
+
+        int n = streamer.ReadVoice(pVoice[i], outputs, 2, blockSize);
+        for (int k = 0; k < n; ++k)
+        {
+          if (pOut[k] != TestValue(i, pPos[i] + k, 0) / 32768. || pOut[blockSize + k] != TestValue(i, pPos[i] + k, 1) / 32768.) ++nMismatches;
+        }
+        pPos[i] += n;
+        framesPlayed += n;
+        if (!streamer.IsVoicePlaying(pVoice[i]))
+        {
+          if (pPos[i] != frames) ++nMismatches;
+          pVoice[i] = -1;
+          ++nDone;
+        }
+      }
+    }
+    nAllocs = g_nAllocs;
+  }
+  double t1 = IRedrawScheduler::GetTimeMs();
+
+  IDiskStreamStats stats;
+  streamer.GetStats(&stats);
+  printf("%d voices of %d s, %d frame blocks at %gx real time: %.0f frames in %.0f ms\n", nVoices, seconds, blockSize, speed,
+    framesPlayed, t1 - t0);
+  printf("%-28s %d blocks, %d frames\n", "underruns", stats.mUnderruns, stats.mUnderrunFrames);
+  printf("%-28s %d\n", "mismatched frames", nMismatches);
+  printf("%-28s %d\n", "audio thread allocations", nAllocs);
+  rc |= nMismatches || nStartFailed || nAllocs || stats.mReadErrors;
+
+  // Stop voices partway through, and time how long the I/O thread takes to free them.
+  double worstMs = 0.;
+  for (int round = 0; round < 20; ++round)
+  {
+    int v;
+    {
+      CountAllocs count;
+      v = streamer.StartVoice(round % nVoices, frames / 2);
+      for (int block = 0; block < 8 && v >= 0; ++block) streamer.ReadVoice(v, outputs, 2, blockSize);
+      rc |= g_nAllocs;
+    }
+    if (v < 0)
+    {
+      rc = 1;
+      break;
+    }
+    usleep(50000); // Lets the I/O thread top up the ring and go back to sleep.
+    double t = IRedrawScheduler::GetTimeMs();
+    streamer.StopVoice(v);
+    do
+    {
+      sched_yield(); // The I/O thread may need this CPU.
+      streamer.GetStats(&stats);
+    }
+    while (stats.mActiveVoices && IRedrawScheduler::GetTimeMs() - t < 1000.);
+    t = IRedrawScheduler::GetTimeMs() - t;
+    if (t > worstMs) worstMs = t;
+    if (stats.mActiveVoices) rc = 1;
+  }
+  printf("%-28s %.3f ms worst of 20\n", "stopped voice freed in", worstMs);
+
+  RemoveTestFiles(nVoices);
+  if (rc) printf("FAILED\n");
+  return rc;
+}
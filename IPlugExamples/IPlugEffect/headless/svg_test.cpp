@@ -0,0 +1,72 @@
+// Checks that LICE's SVG loader accepts buffers however they end and resolves colours however
+// they are given, rendering each case to a small bitmap and checking its centre pixel.
+//
+// usage: svg_test
+
+#include <stdio.h>
+#include <string.h>
+#include "../../../WDL/lice/lice.h"
+
+struct SVGCase
+{
+  const char* name;
+  const char* svg;
+  LICE_pixel expect;   // Centre pixel, unused with fails set.
+  bool fails;          // The loader should reject it.
+};
+
+#define PIX(r, g, b, a) ((LICE_pixel) LICE_RGBA(r, g, b, a))
+#define RECT(attrs) "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"8\" height=\"8\"><rect width=\"8\" height=\"8\" " attrs "/></svg>"
+
+static const SVGCase s_cases[] =
+{
+  { "no trailing newline", RECT("fill=\"#ff0000\""), PIX(255, 0, 0, 255), false },
+  { "trailing newline", RECT("fill=\"#ff0000\"") "\n", PIX(255, 0, 0, 255), false },
+  { "named fill attribute", RECT("fill=\"blue\""), PIX(0, 0, 255, 255), false },
+  { "named fill last in style", RECT("style=\"stroke:none;fill:lime\""), PIX(0, 255, 0, 255), false },
+  { "named fill before another property", RECT("style=\"fill:red;stroke:none\""), PIX(255, 0, 0, 255), false },
+  { "named fill before opacity", RECT("style=\"fill:red;opacity:0.5\""), PIX(255, 0, 0, 128), false },
+  { "unterminated element", "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"8\" height=\"8\"><rect", 0, true },
+  { "empty", "", 0, true },
+};
+
+// Within one step, the fill rounds coverage and alpha.
+static bool Near(LICE_pixel a, LICE_pixel b)
+{
+  int d[4] = { LICE_GETR(a) - LICE_GETR(b), LICE_GETG(a) - LICE_GETG(b), LICE_GETB(a) - LICE_GETB(b), LICE_GETA(a) - LICE_GETA(b) };
+  for (int i = 0; i < 4; ++i) if (d[i] < -1 || d[i] > 1) return false;
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  int nFailed = 0;
+  for (int i = 0; i < (int) (sizeof(s_cases) / sizeof(s_cases[0])); ++i)
+  {
+    const SVGCase* pCase = s_cases + i;
+    LICE_IBitmap* pBitmap = LICE_LoadSVGFromBuffer(pCase->svg, (int) strlen(pCase->svg));
+    bool ok;
+    if (pCase->fails)
+    {
+      ok = !pBitmap;
+      printf("%-36s %s\n", pCase->name, pBitmap ? "loaded, expected an error" : "rejected");
+    }
+    else if (!pBitmap)
+    {
+      ok = false;
+      printf("%-36s not loaded\n", pCase->name);
+    }
+    else
+    {
+      LICE_pixel px = LICE_GetPixel(pBitmap, pBitmap->getWidth() / 2, pBitmap->getHeight() / 2);
+      ok = Near(px, pCase->expect);
+      printf("%-36s %02x%02x%02x%02x", pCase->name, LICE_GETR(px), LICE_GETG(px), LICE_GETB(px), LICE_GETA(px));
+      if (!ok) printf(", expected %02x%02x%02x%02x", LICE_GETR(pCase->expect), LICE_GETG(pCase->expect), LICE_GETB(pCase->expect), LICE_GETA(pCase->expect));
+      printf("\n");
+    }
+    delete pBitmap;
+    if (!ok) ++nFailed;
+  }
+  if (nFailed) printf("%d FAILED\n", nFailed);
+  return nFailed != 0;
+}
@@ -280,6 +280,7 @@ bool IPlugChunks::CompareState(const unsigned char* incomingState, int startPos)
   bool isEqual = true;
   const double* data = (const double*) incomingState;
   startPos = NUM_SLIDERS * sizeof(double);
+  if (GetCompareStateSize() >= 0 && GetCompareStateSize() < startPos) return false;
   isEqual = (memcmp(data, mSteps, startPos) == 0);
   isEqual &= IPlugBase::CompareState(incomingState, startPos); // fuzzy compare regular params
   
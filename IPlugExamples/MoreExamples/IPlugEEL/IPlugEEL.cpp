@@ -43,7 +43,7 @@ IPlugEEL::IPlugEEL(IPlugInstanceInfo instanceInfo)
   memset(codetext, 0, 65536);
   strcpy(codetext, "x=rand(2)-1.;");
   
-  codehandle = NSEEL_code_compile(vm, codetext, 0); // compile code
+  codehandle = NSEEL_code_compile_ex(vm, codetext, 0, NSEEL_CODE_COMPILE_FLAG_BLOCK); // compile code, run once per sample by NSEEL_code_execute_block()
 
   //arguments are: name, defaultVal, minVal, maxVal, step, label
   GetParam(kGain)->InitDouble("Gain", 50., 0., 100.0, 0.01, "%");
@@ -78,16 +78,17 @@ void IPlugEEL::ProcessDoubleReplacing(double** inputs, double** outputs, int nFr
 {
   // Mutex is already locked for us.
 
-  double* in1 = inputs[0];
-  double* in2 = inputs[1];
   double* out1 = outputs[0];
   double* out2 = outputs[1];
 
-  for (int s = 0; s < nFrames; ++s, ++in1, ++in2, ++out1, ++out2)
+  // runs the script nFrames times in one call, x is stored to out1 after each sample
+  NSEEL_BLOCK_BINDING binding = { mVmOutput, 0, out1 };
+  NSEEL_code_execute_block(codehandle, nFrames, &binding, 1);
+
+  for (int s = 0; s < nFrames; ++s)
   {
-    NSEEL_code_execute(codehandle);
-    *out1 = *mVmOutput * mGain;
-    *out2 = *out1;
+    out1[s] *= mGain;
+    out2[s] = out1[s];
   }
 }
 
@@ -37,6 +37,7 @@ DONT_COPY = ("*.exe", "*.dmg", "*.pkg", "*.mpkg", "*.svn", "*.ncb", "*.suo", "*s
 
 SUBFOLDERS_TO_SEARCH = [
 "app_wrapper",
+"headless",
 "resources",
 "installer",
 "scripts",
@@ -60,26 +60,106 @@ template <class T> inline void SWAP(T& a, T& b)
 }
 
 typedef unsigned char BYTE;
+
+// Bytes are normally owned by the chunk. SetView() reads from memory owned by someone else
+// (a host buffer) without copying it, SetArena() builds into a caller-provided buffer. Either
+// way the first write that doesn't fit moves the bytes into the chunk's own heap buffer, so a
+// view or an arena behaves like any other ByteChunk. Don't write through GetBytes() on a view.
 class ByteChunk
 {
 public:
-  ByteChunk() {}
+  ByteChunk() : mExt(0), mExtSize(0), mExtCapacity(0), mPeakSize(0) {}
   ~ByteChunk() {}
 
+  // A copy owns its bytes, even when it is copied from a view or an arena.
+  ByteChunk(const ByteChunk& src) : mExt(0), mExtSize(0), mExtCapacity(0), mPeakSize(0) { CopyFrom(&src); }
+  ByteChunk& operator=(const ByteChunk& src)
+  {
+    if (&src != this) CopyFrom(&src);
+    return *this;
+  }
+
+  // Reads pData[0..size) in place. The memory must outlive the view.
+  inline void SetView(const void* pData, int size)
+  {
+    mBytes.Resize(0, false);
+    mExt = (BYTE*) pData;
+    mExtSize = IPMAX(size, 0);
+    mExtCapacity = 0;
+    mPeakSize = mExtSize;
+  }
+
+  // Builds into pBuf (capacity bytes) until it overflows, check IsExternal() afterwards.
+  inline void SetArena(void* pBuf, int capacity)
+  {
+    mBytes.Resize(0, false);
+    mExt = (BYTE*) pBuf;
+    mExtSize = 0;
+    mExtCapacity = IPMAX(capacity, 0);
+    mPeakSize = 0;
+  }
+
+  // True while the bytes still live in a view or arena rather than the chunk's own buffer.
+  inline bool IsExternal()
+  {
+    return !!mExt;
+  }
+
+  // Makes room for size bytes in total without changing Size(), so large saves don't realloc per Put.
+  inline void Reserve(int size)
+  {
+    if (mExt)
+    {
+      if (size > mExtCapacity) Detach(size);
+    }
+    else
+    {
+      int n = mBytes.GetSize();
+      if (size > n)
+      {
+        mBytes.Resize(size, false);
+        mBytes.Resize(n, false);
+      }
+    }
+  }
+
+  // Appends size uninitialised bytes and returns them, for filling in place. 0 if out of memory.
+  inline BYTE* Extend(int size)
+  {
+    int n = Size();
+    if (mExt && n + size > mExtCapacity)
+    {
+      if (!Detach(n + size)) return 0;
+    }
+    BYTE* p;
+    if (mExt)
+    {
+      mExtSize += size;
+      p = mExt + n;
+    }
+    else
+    {
+      p = mBytes.ResizeOK(n + size, false);
+      if (!p) return 0;
+      p += n;
+    }
+    if (n + size > mPeakSize) mPeakSize = n + size;
+    return p;
+  }
+
   inline int PutBytes(const void* pBuf, int size)
   {
-    int n = mBytes.GetSize();
-    mBytes.Resize(n + size);
-    memcpy(mBytes.Get() + n, pBuf, size);
-    return mBytes.GetSize();
+    BYTE* p = Extend(size);
+    if (p) memcpy(p, pBuf, size);
+    return Size();
   }
 
   inline int GetBytes(void* pBuf, int size, int startPos)
   {
     int endPos = startPos + size;
-    if (startPos >= 0 && endPos <= mBytes.GetSize())
+    if (startPos >= 0 && endPos <= Size())
     {
-      memcpy(pBuf, mBytes.Get() + startPos, size);
+      memcpy(pBuf, GetBytes() + startPos, size);
       return endPos;
     }
     return -1;
@@ -191,6 +271,22 @@ public:
   }
 
   inline int GetStr(WDL_String* pStr, int startPos)
+  {
+    const char* str;
+    int len;
+    int strEndPos = GetStr(&str, &len, startPos);
+    if (strEndPos >= 0)
+    {
+      if (len > 0)
+        pStr->Set(str, len);
+      else
+        pStr->Set("");
+    }
+    return strEndPos;
+  }
+
+  // Points *pStr at the string's bytes inside the chunk, not null terminated.
+  inline int GetStr(const char** pStr, int* pLen, int startPos)
   {
     int len;
     int strStartPos = Get(&len, startPos);
@@ -198,13 +294,9 @@ public:
     {
       WDL_BSWAP32_IF_BE(len);
       int strEndPos = strStartPos + len;
-      if (strEndPos <= mBytes.GetSize())
-      {
-        if (len > 0)
-          pStr->Set((char*) (mBytes.Get() + strStartPos), len);
-        else
-          pStr->Set("");
-      }
+      if (len < 0 || strEndPos > Size()) return -1;
+      *pStr = (const char*) GetBytes() + strStartPos;
+      *pLen = len;
       return strEndPos;
     }
     return -1;
@@ -213,10 +305,7 @@ public:
   inline int PutDoubleArray(const double* data, const int numItems)
   {
     Put(&numItems);
-    int n = mBytes.GetSize();
-    mBytes.Resize(n + numItems * sizeof(double));
-    memcpy(mBytes.Get() + n, (BYTE*) data, numItems * sizeof(double));
-    return mBytes.GetSize();
+    return PutBytes(data, numItems * sizeof(double));
   }
 
   inline int GetDoubleArray(double* data, int startPos)
@@ -226,9 +315,9 @@ public:
     if (dStartPos >= 0)
     {
       int dEndPos = dStartPos + (len * sizeof(double));
-      if (dEndPos <= mBytes.GetSize() && len > 0)
+      if (dEndPos <= Size() && len > 0)
       {
-        memcpy(data, mBytes.Get() + dStartPos, len * sizeof(double));
+        memcpy(data, GetBytes() + dStartPos, len * sizeof(double));
       }
       return dEndPos;
     }
@@ -237,18 +326,17 @@ public:
 
   inline int PutBool(bool b)
   {
-    int n = mBytes.GetSize();
-    mBytes.Resize(n + 1);
-    *(mBytes.Get() + n) = (BYTE) (b ? 1 : 0);
-    return mBytes.GetSize();
+    BYTE* p = Extend(1);
+    if (p) *p = (BYTE) (b ? 1 : 0);
+    return Size();
   }
 
   inline int GetBool(bool* pB, int startPos)
   {
     int endPos = startPos + 1;
-    if (startPos >= 0 && endPos <= mBytes.GetSize())
+    if (startPos >= 0 && endPos <= Size())
     {
-      BYTE byt = *(mBytes.Get() + startPos);
+      BYTE byt = *(GetBytes() + startPos);
       *pB = (byt);
       return endPos;
     }
@@ -260,30 +348,49 @@ public:
     return PutBytes(pRHS->GetBytes(), pRHS->Size());
   }
 
+  // Keeps the allocation (or arena) for the next save, drops a view.
   inline void Clear()
   {
-    mBytes.Resize(0);
+    if (mExt && !mExtCapacity) mExt = 0;
+    mExtSize = 0;
+    mBytes.Resize(0, false);
+    mPeakSize = 0;
   }
 
   inline int Size()
   {
-    return mBytes.GetSize();
+    return (mExt ? mExtSize : mBytes.GetSize());
+  }
+
+  // Largest Size() since the last Clear/SetView/SetArena, to size the next Reserve or arena.
+  inline int PeakSize()
+  {
+    return mPeakSize;
   }
 
   inline int Resize(int newSize)
   {
-    int n = mBytes.GetSize();
-    mBytes.Resize(newSize);
+    int n = Size();
     if (newSize > n)
     {
-      memset(mBytes.Get() + n, 0, (newSize - n));
+      BYTE* p = Extend(newSize - n);
+      if (p) memset(p, 0, newSize - n);
+    }
+    else if (mExt && mExtCapacity)
+    {
+      mExtSize = IPMAX(newSize, 0);
+    }
+    else
+    {
+      if (mExt && !Detach(newSize)) return n;
+      mBytes.Resize(newSize, false);
     }
     return n;
   }
 
   inline BYTE* GetBytes()
   {
-    return mBytes.Get();
+    return (mExt ? mExt : mBytes.Get());
   }
 
   inline bool IsEqual(ByteChunk* pRHS)
@@ -292,7 +399,41 @@ public:
   }
 
 private:
+  void CopyFrom(const ByteChunk* pSrc)
+  {
+    const BYTE* pData = (pSrc->mExt ? pSrc->mExt : pSrc->mBytes.Get());
+    int n = (pSrc->mExt ? pSrc->mExtSize : pSrc->mBytes.GetSize());
+    mExt = 0;
+    mExtSize = mExtCapacity = 0;
+    BYTE* p = mBytes.ResizeOK(n, false);
+    if (p) memcpy(p, pData, n);
+    else mBytes.Resize(0, false);
+    mPeakSize = Size();
+  }
+
+  // Moves view/arena bytes into mBytes, with room for reserveSize.
+  bool Detach(int reserveSize)
+  {
+    int n = mExtSize, size = IPMAX(n, reserveSize);
+    BYTE* p = mBytes.ResizeOK(size, false);
+    if (!p && size) return false;
+    if (n) memcpy(p, mExt, n);
+    mBytes.Resize(n, false);
+    mExt = 0;
+    mExtSize = mExtCapacity = 0;
+    return true;
+  }
+
   WDL_TypedBuf<unsigned char> mBytes;
+  BYTE* mExt;
+  int mExtSize, mExtCapacity, mPeakSize;
+};
+
+// A read-only ByteChunk over someone else's memory, for UnserializeState() straight from a host buffer.
+class ByteChunkView : public ByteChunk
+{
+public:
+  ByteChunkView(const void* pData, int size) { SetView(pData, size); }
 };
 
 #endif
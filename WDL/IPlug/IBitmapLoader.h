@@ -0,0 +1,430 @@
+#ifndef _IBITMAPLOADER_
+#define _IBITMAPLOADER_
+
+// IBitmapLoader takes PNG and JPEG decoding off the GUI thread when an editor opens.
+//
+// - Load() reads only the image header. It returns an IDeferredBitmap that already has the
+//   right dimensions, so layout code can use IBitmap::W/H straight away. The decode is queued
+//   on a small pool of worker threads.
+// - The first getBits() or getRowSpan() call on a bitmap that isn't decoded yet blocks. If no
+//   worker has started on it, the calling thread decodes it. Controls that use IBitmap::mData
+//   directly through LICE need no changes.
+// - Workers exit when the queue is empty.
+// - Debug (_DEBUG) builds print each decode, and any time a caller had to wait for one.
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../lice/lice.h"
+#include "../mutex.h"
+#include "../ptrlist.h"
+#include "../wdlstring.h"
+#include "../heapbuf.h"
+#include "../wdlatomic.h"
+#include "IRedrawScheduler.h"
+#include "IWorkerSignal.h"
+#include "Log.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+#define BITMAPLOADER_MAX_THREADS 4
+// Enough for the PNG header, and for the JPEG frame header behind typical EXIF/ICC blocks.
+#define BITMAPLOADER_HEADER_BYTES 65536
+
+// Where the encoded image comes from, filled in by IGraphics::OSGetBitmapSource().
+struct IBitmapSource
+{
+  const void* mData;  // Encoded image that outlives the bitmap (a Windows resource), or 0 to read mPath.
+  int mSize;
+  WDL_String mPath;
+  bool mJPEG;
+
+  IBitmapSource() : mData(0), mSize(0), mJPEG(false) {}
+};
+
+class IBitmapLoader;
+
+class IDeferredBitmap : public LICE_IBitmap
+{
+public:
+  IDeferredBitmap(IBitmapLoader* pLoader, int ID, const char* name, IBitmapSource* pSource, int w, int h)
+    : mLoader(pLoader), mID(ID), mW(w), mH(h), mState(0), mReady(0), mQueuedMs(0.0)
+  {
+    mName.Set(name);
+    mSource.mData = pSource->mData;
+    mSource.mSize = pSource->mSize;
+    mSource.mPath.Set(pSource->mPath.Get());
+    mSource.mJPEG = pSource->mJPEG;
+  }
+  inline ~IDeferredBitmap();
+
+  LICE_pixel* getBits() { if (!IsDecoded()) Wait(); return mBitmap.getBits(); }
+  int getRowSpan() { if (!IsDecoded()) Wait(); return mBitmap.getRowSpan(); }
+  int getWidth() { return mW; }
+  int getHeight() { return mH; }
+  bool isFlipped() { return false; }
+  bool resize(int w, int h)
+  {
+    if (!IsDecoded()) Wait();
+    mW = w;
+    mH = h;
+    return mBitmap.resize(w, h);
+  }
+
+  bool IsDecoded() { return !!wdl_atomic_get(&mReady); }
+  inline void Wait();
+
+private:
+  friend class IBitmapLoader;
+
+  IBitmapLoader* mLoader;
+  LICE_MemBitmap mBitmap;   // The worker decodes into this.
+  IBitmapSource mSource;
+  WDL_String mName;
+  int mID, mW, mH;
+  int mState;               // IBitmapLoader::EState, guarded by the loader's mutex.
+  IWorkerSignal mDecoded;   // Signalled when mState becomes kDone after a decode started.
+  volatile int mReady;      // Set once a thread has waited for the decode to finish.
+  double mQueuedMs;
+};
+
+class IBitmapLoader
+{
+public:
+  IBitmapLoader() : mQuit(false)
+  {
+    memset(mThreads, 0, sizeof(mThreads));
+    int nCPUs = 1;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    nCPUs = (int) info.dwNumberOfProcessors;
+#else
+    nCPUs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    // Leave a core for the GUI thread, which decodes too when it has to wait.
+    mMaxThreads = nCPUs - 1;
+    if (mMaxThreads > BITMAPLOADER_MAX_THREADS) mMaxThreads = BITMAPLOADER_MAX_THREADS;
+    if (mMaxThreads < 1) mMaxThreads = 1;
+  }
+
+  ~IBitmapLoader()
+  {
+    Stop();
+  }
+
+  // Joins the workers. IGraphics calls this when the last editor closes, so no thread is left for the
+  // static destructor, which runs under the Windows loader lock where joining a thread can deadlock.
+  // Bitmaps still queued are decoded when they are used, or by the workers the next Load() starts.
+  void Stop()
+  {
+    mMutex.Enter();
+    mQuit = true;
+    mMutex.Leave();
+    for (int i = 0; i < BITMAPLOADER_MAX_THREADS; ++i)
+    {
+      JoinThread(&mThreads[i]);
+    }
+    mMutex.Enter();
+    mQuit = false;
+    mMutex.Leave();
+  }
+
+  // Returns 0 if the header can't be read, load the bitmap synchronously then.
+  LICE_IBitmap* Load(int ID, const char* name, IBitmapSource* pSource)
+  {
+    int w = 0, h = 0;
+    if (pSource->mData)
+    {
+      if (!GetImageSize((const unsigned char*) pSource->mData, pSource->mSize, pSource->mJPEG, &w, &h)) return 0;
+    }
+    else
+    {
+      WDL_HeapBuf header;
+      if (!ReadFile(pSource->mPath.Get(), &header, BITMAPLOADER_HEADER_BYTES)) return 0;
+      if (!GetImageSize((const unsigned char*) header.Get(), header.GetSize(), pSource->mJPEG, &w, &h))
+      {
+        // The JPEG frame header can be further in.
+        if (!pSource->mJPEG || header.GetSize() < BITMAPLOADER_HEADER_BYTES ||
+            !ReadFile(pSource->mPath.Get(), &header, 0) ||
+            !GetImageSize((const unsigned char*) header.Get(), header.GetSize(), true, &w, &h)) return 0;
+      }
+    }
+
+    IDeferredBitmap* pBitmap = new IDeferredBitmap(this, ID, name, pSource, w, h);
+    pBitmap->mQueuedMs = IRedrawScheduler::GetTimeMs();
+
+    WDL_MutexLock lock(&mMutex);
+    pBitmap->mState = kQueued;
+    mQueue.Add(pBitmap);
+    StartThread();
+    return pBitmap;
+  }
+
+  // Number of bitmaps waiting for a worker.
+  int NQueued()
+  {
+    WDL_MutexLock lock(&mMutex);
+    return mQueue.GetSize();
+  }
+
+  // Width and height from a PNG IHDR chunk or a JPEG SOFn marker.
+  static bool GetImageSize(const unsigned char* pData, int size, bool jpeg, int* pW, int* pH)
+  {
+    if (!jpeg)
+    {
+      static const unsigned char sig[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+      if (size < 24 || memcmp(pData, sig, 8) || memcmp(pData + 12, "IHDR", 4)) return false;
+      *pW = (pData[16] << 24) | (pData[17] << 16) | (pData[18] << 8) | pData[19];
+      *pH = (pData[20] << 24) | (pData[21] << 16) | (pData[22] << 8) | pData[23];
+      return (*pW > 0 && *pH > 0);
+    }
+
+    if (size < 4 || pData[0] != 0xFF || pData[1] != 0xD8) return false;
+    int pos = 2;
+    while (pos + 4 <= size)
+    {
+      if (pData[pos] != 0xFF) return false;
+      int marker = pData[pos + 1];
+      if (marker == 0xFF)   // Fill byte.
+      {
+        ++pos;
+        continue;
+      }
+      if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))   // No length.
+      {
+        pos += 2;
+        continue;
+      }
+      int len = (pData[pos + 2] << 8) | pData[pos + 3];
+      if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+      {
+        if (pos + 9 > size) return false;
+        *pH = (pData[pos + 5] << 8) | pData[pos + 6];
+        *pW = (pData[pos + 7] << 8) | pData[pos + 8];
+        return (*pW > 0 && *pH > 0);
+      }
+      if (len < 2) return false;
+      pos += 2 + len;
+    }
+    return false;
+  }
+
+  // maxBytes 0 reads the whole file.
+  static bool ReadFile(const char* filename, WDL_HeapBuf* pBuf, int maxBytes)
+  {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    int size = (int) ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (maxBytes > 0 && size > maxBytes) size = maxBytes;
+    bool ok = (size > 0 && pBuf->Resize(size, false) && (int) fread(pBuf->Get(), 1, size, fp) == size);
+    fclose(fp);
+    return ok;
+  }
+
+private:
+  friend class IDeferredBitmap;
+
+  enum EState { kDone, kQueued, kDecoding };
+
+  struct Thread
+  {
+    IBitmapLoader* mLoader;
+    bool mRunning, mHasHandle;
+#ifdef _WIN32
+    HANDLE mHandle;
+#else
+    pthread_t mHandle;
+#endif
+  };
+
+  static void Decode(IDeferredBitmap* pBitmap)
+  {
+#ifdef _DEBUG
+    double t0 = IRedrawScheduler::GetTimeMs();
+#endif
+    IBitmapSource* pSource = &pBitmap->mSource;
+    WDL_HeapBuf file;
+    const void* pData = pSource->mData;
+    int size = pSource->mSize;
+    if (!pData && ReadFile(pSource->mPath.Get(), &file, 0))
+    {
+      pData = file.Get();
+      size = file.GetSize();
+    }
+
+    bool ok = false;
+    if (pData)
+    {
+      if (!pSource->mJPEG) ok = !!LICE_LoadPNGFromMemory(pData, size, &pBitmap->mBitmap);
+#ifdef IPLUG_JPEG_SUPPORT
+      else ok = !!LICE_LoadJPGFromMemory(pData, size, &pBitmap->mBitmap);
+#endif
+    }
+    assert(ok && pBitmap->mBitmap.getWidth() == pBitmap->mW && pBitmap->mBitmap.getHeight() == pBitmap->mH);
+    if (!ok || pBitmap->mBitmap.getWidth() != pBitmap->mW || pBitmap->mBitmap.getHeight() != pBitmap->mH)
+    {
+      // Keep the size the header promised, whatever the decoder made of it.
+      pBitmap->mBitmap.resize(pBitmap->mW, pBitmap->mH);
+      if (!ok) LICE_Clear(&pBitmap->mBitmap, 0);
+    }
+
+#ifdef _DEBUG
+    double t1 = IRedrawScheduler::GetTimeMs();
+    DBGMSG("IBitmapLoader: %d %s %dx%d decoded in %.1f ms, %.1f ms after Load()\n", pBitmap->mID, pBitmap->mName.Get(),
+      pBitmap->mW, pBitmap->mH, t1 - t0, t1 - pBitmap->mQueuedMs);
+#endif
+  }
+
+  // Called by IDeferredBitmap::Wait() and its destructor.
+  void Wait(IDeferredBitmap* pBitmap, bool decode)
+  {
+#ifdef _DEBUG
+    double t0 = IRedrawScheduler::GetTimeMs();
+    bool waited = false;
+#endif
+    mMutex.Enter();
+    if (pBitmap->mState == kQueued)
+    {
+      mQueue.DeletePtr(pBitmap);
+      pBitmap->mState = kDecoding;
+      mMutex.Leave();
+      if (decode) Decode(pBitmap);
+      mMutex.Enter();
+      pBitmap->mState = kDone;
+#ifdef _DEBUG
+      waited = decode;
+#endif
+    }
+    if (pBitmap->mState == kDecoding)
+    {
+      // A worker has it. It signals under the mutex, so the bitmap can't be gone by the time it does.
+      do
+      {
+        mMutex.Leave();
+        pBitmap->mDecoded.Wait();
+        mMutex.Enter();
+      }
+      while (pBitmap->mState == kDecoding);
+      pBitmap->mDecoded.Signal(); // In case another thread is waiting for it too.
+#ifdef _DEBUG
+      waited = decode;
+#endif
+    }
+    mMutex.Leave();
+
+#ifdef _DEBUG
+    if (waited)
+    {
+      DBGMSG("IBitmapLoader: waited %.1f ms for %d %s\n", IRedrawScheduler::GetTimeMs() - t0, pBitmap->mID, pBitmap->mName.Get());
+    }
+#endif
+  }
+
+  void RunWorker(Thread* pThread)
+  {
+    for (;;)
+    {
+      mMutex.Enter();
+      IDeferredBitmap* pBitmap = (mQuit ? 0 : mQueue.Get(0));
+      if (!pBitmap)
+      {
+        pThread->mRunning = false;
+        mMutex.Leave();
+        return;
+      }
+      mQueue.Delete(0);
+      pBitmap->mState = kDecoding;
+      mMutex.Leave();
+
+      Decode(pBitmap);
+
+      mMutex.Enter();
+      pBitmap->mState = kDone;
+      pBitmap->mDecoded.Signal();
+      mMutex.Leave();
+    }
+  }
+
+  // Called with the mutex held. Starts another worker if the queue is longer than the number running.
+  void StartThread()
+  {
+    if (mQuit) return;
+    int i, nRunning = 0;
+    Thread* pIdle = 0;
+    for (i = 0; i < mMaxThreads; ++i)
+    {
+      if (mThreads[i].mRunning) ++nRunning;
+      else if (!pIdle) pIdle = &mThreads[i];
+    }
+    if (!pIdle || nRunning >= mQueue.GetSize()) return;
+
+    // It may still be on its way out.
+    JoinThread(pIdle);
+    pIdle->mLoader = this;
+#ifdef _WIN32
+    unsigned id;
+    pIdle->mHandle = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, pIdle, 0, &id);
+    pIdle->mHasHandle = !!pIdle->mHandle;
+#else
+    pIdle->mHasHandle = !pthread_create(&pIdle->mHandle, NULL, ThreadProc, pIdle);
+#endif
+    // If it didn't start, Wait() decodes on the GUI thread.
+    pIdle->mRunning = pIdle->mHasHandle;
+  }
+
+  static void JoinThread(Thread* pThread)
+  {
+    if (!pThread->mHasHandle) return;
+#ifdef _WIN32
+    WaitForSingleObject(pThread->mHandle, INFINITE);
+    CloseHandle(pThread->mHandle);
+#else
+    void* p;
+    pthread_join(pThread->mHandle, &p);
+#endif
+    pThread->mHasHandle = false;
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void* pThread)
+  {
+    ((Thread*) pThread)->mLoader->RunWorker((Thread*) pThread);
+    return 0;
+  }
+#else
+  static void* ThreadProc(void* pThread)
+  {
+    ((Thread*) pThread)->mLoader->RunWorker((Thread*) pThread);
+    return 0;
+  }
+#endif
+
+  WDL_Mutex mMutex;
+  WDL_PtrList<IDeferredBitmap> mQueue;
+  Thread mThreads[BITMAPLOADER_MAX_THREADS];
+  int mMaxThreads;
+  bool mQuit;
+};
+
+inline IDeferredBitmap::~IDeferredBitmap()
+{
+  // Take it off the queue, or let a worker that is decoding it finish.
+  if (!IsDecoded()) mLoader->Wait(this, false);
+}
+
+inline void IDeferredBitmap::Wait()
+{
+  mLoader->Wait(this, true);
+  wdl_atomic_set(&mReady, 1);
+}
+
+#endif // _IBITMAPLOADER_
@@ -33,6 +33,10 @@ void IControl::SetDirty(bool pushParamToPlug)
 {
   mValue = BOUNDED(mValue, mClampLo, mClampHi);
   mDirty = true;
+  if (mPlug && mPlug->GetGUI())
+  {
+    mPlug->GetGUI()->WakeRedraw();
+  }
   if (pushParamToPlug && mPlug && mParamIdx >= 0)
   {
     mPlug->SetParameterFromGUI(mParamIdx, mValue);
@@ -768,3 +772,31 @@ bool IFileSelectorControl::IsDirty()
   }
   return false;
 }
+
+bool IDSPLoadControl::IsDirty()
+{
+  WDL_UINT64 now = wdl_timing_now_ns();
+  if (now - mWindowStart >= (WDL_UINT64) mWindowMs * 1000000)
+  {
+    mPlug->GetDSPLoad(&mStats, true);
+    mWindowStart = now;
+    return true;
+  }
+  return mDirty;
+}
+
+bool IDSPLoadControl::Draw(IGraphics* pGraphics)
+{
+  IRECT bar = mRECT;
+  bar.R = bar.L + (int) ((double) mRECT.W() * IPMIN(mStats.mAvgLoad, 1.));
+  pGraphics->FillIRect(mStats.mOverruns ? &mOverrunColor : &mBarColor, &bar, &mBlend);
+  if (mStats.mBlocks)
+  {
+    pGraphics->DrawVerticalLine(&mText.mColor, &mRECT, (float) IPMIN(mStats.mP99Load, 1.));
+  }
+
+  char str[128];
+  sprintf(str, "DSP %.1f%%  p99 %.0f%%  max %.0f%% (%.2f ms)  overruns %d",
+          mStats.mAvgLoad * 100., mStats.mP99Load * 100., mStats.mMaxLoad * 100., mStats.mMaxMs, mStats.mOverruns);
+  return pGraphics->DrawIText(&mText, str, &mRECT);
+}
@@ -484,4 +484,29 @@ protected:
   EFileSelectorState mState;
 };
 
+// Overlay showing the plugin's own DSP load (see IDSPLoad.h): a bar for the average load,
+// a mark at the 99th percentile, and a line of text. The figures cover the last windowMs,
+// the control resets the plugin's meter each time it updates.
+class IDSPLoadControl : public IControl
+{
+public:
+  IDSPLoadControl(IPlugBase* pPlug, IRECT pR, IText* pText, int windowMs = 1000,
+                  const IColor* pBarColor = &COLOR_GREEN, const IColor* pOverrunColor = &COLOR_RED)
+    : IControl(pPlug, pR), mBarColor(*pBarColor), mOverrunColor(*pOverrunColor), mWindowMs(windowMs), mWindowStart(0)
+  {
+    mText = *pText;
+    memset(&mStats, 0, sizeof(mStats));
+  }
+  ~IDSPLoadControl() {}
+
+  bool Draw(IGraphics* pGraphics);
+  bool IsDirty();
+
+protected:
+  IColor mBarColor, mOverrunColor;
+  int mWindowMs;
+  WDL_UINT64 mWindowStart;
+  IDSPLoadStats mStats;
+};
+
 #endif
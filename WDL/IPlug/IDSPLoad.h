@@ -0,0 +1,117 @@
+#ifndef _IDSPLOAD_
+#define _IDSPLOAD_
+
+// Per-instance DSP load, measured by IPlugBase around every process call (ProcessBuffers(),
+// PassThroughBuffers() etc). Load is the time a block took as a fraction of its real-time
+// budget, nFrames / sample rate, so 1.0 means the block only just made its deadline and
+// anything over is an overrun.
+//
+// The audio thread keeps a histogram of load in 1% steps, plus the totals, without locks or
+// allocation. Any other thread can read it with IPlugBase::GetDSPLoad(), which is what
+// IDSPLoadControl does. The histogram only ever grows until it is reset, so a GUI that wants
+// recent figures should reset it every so often (the reset happens at the start of the next
+// block, on the audio thread).
+
+#include <string.h>
+#include "../wdltypes.h"
+#include "../wdlatomic.h"
+#include "../timing.h"
+
+#define IDSPLOAD_BUCKETS 201  // 0% - 199% in 1% steps, then everything from 200% up.
+
+struct IDSPLoadStats
+{
+  int mBlocks;          // Since the last reset.
+  int mOverruns;        // Blocks that took longer than their budget.
+  double mLastLoad;     // 1.0 = 100% of the budget.
+  double mAvgLoad;
+  double mP99Load;      // To the histogram's 1% resolution.
+  double mMaxLoad;
+  double mMaxMs;        // The longest block, in milliseconds.
+};
+
+class IDSPLoadMeter
+{
+public:
+  IDSPLoadMeter() : mResetRequest(0) { Clear(); }
+
+  // Audio thread.
+  void AddBlock(WDL_UINT64 startNs, WDL_UINT64 endNs, int nFrames, double sampleRate)
+  {
+    if (wdl_atomic_get(&mResetRequest))
+    {
+      Clear();
+      wdl_atomic_set(&mResetRequest, 0);
+    }
+    if (nFrames <= 0 || sampleRate <= 0.) return;
+
+    double ms = (double) (endNs - startNs) / 1000000.;
+    double load = ms * sampleRate / (1000. * (double) nFrames);
+    int bucket = (int) (load * 100.);
+    if (bucket >= IDSPLOAD_BUCKETS) bucket = IDSPLOAD_BUCKETS - 1;
+    mHist[bucket]++;
+    mSumLoad += load;
+    mLastLoad = load;
+    if (load > mMaxLoad) mMaxLoad = load;
+    if (ms > mMaxMs) mMaxMs = ms;
+    if (load > 1.) mOverruns++;
+    wdl_atomic_set(&mBlocks, mBlocks + 1);
+  }
+
+  // Any thread. The figures can be a block apart from each other, the audio thread isn't held up.
+  void GetStats(IDSPLoadStats* pStats)
+  {
+    int n = wdl_atomic_get(&mBlocks);
+    memset(pStats, 0, sizeof(IDSPLoadStats));
+    pStats->mBlocks = n;
+    if (!n) return;
+    pStats->mOverruns = mOverruns;
+    pStats->mLastLoad = mLastLoad;
+    pStats->mAvgLoad = mSumLoad / (double) n;
+    pStats->mMaxLoad = mMaxLoad;
+    pStats->mMaxMs = mMaxMs;
+
+    int i, above = 0, limit = n / 100;  // Blocks allowed above the 99th percentile.
+    for (i = IDSPLOAD_BUCKETS - 1; i > 0; --i)
+    {
+      above += mHist[i];
+      if (above > limit) break;
+    }
+    pStats->mP99Load = (double) (i + 1) / 100.;
+    if (pStats->mP99Load > pStats->mMaxLoad) pStats->mP99Load = pStats->mMaxLoad;
+  }
+
+  // Any thread.
+  void Reset() { wdl_atomic_set(&mResetRequest, 1); }
+
+private:
+  void Clear()
+  {
+    memset(mHist, 0, sizeof(mHist));
+    mBlocks = mOverruns = 0;
+    mSumLoad = mLastLoad = mMaxLoad = mMaxMs = 0.;
+  }
+
+  int mHist[IDSPLOAD_BUCKETS];
+  volatile int mBlocks;             // Published last, by the audio thread.
+  int mOverruns;
+  double mSumLoad, mLastLoad, mMaxLoad, mMaxMs;
+  volatile int mResetRequest;
+};
+
+// Times the enclosing scope as one block.
+class IDSPLoadScope
+{
+public:
+  IDSPLoadScope(IDSPLoadMeter* pMeter, int nFrames, double sampleRate)
+    : mMeter(pMeter), mNFrames(nFrames), mSampleRate(sampleRate), mStart(wdl_timing_now_ns()) {}
+  ~IDSPLoadScope() { mMeter->AddBlock(mStart, wdl_timing_now_ns(), mNFrames, mSampleRate); }
+
+private:
+  IDSPLoadMeter* mMeter;
+  int mNFrames;
+  double mSampleRate;
+  WDL_UINT64 mStart;
+};
+
+#endif // _IDSPLOAD_
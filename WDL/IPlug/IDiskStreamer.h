@@ -0,0 +1,541 @@
+#ifndef _IDISKSTREAMER_
+#define _IDISKSTREAMER_
+
+// IDiskStreamer plays sample voices straight from disk, so an instrument only keeps the start
+// of each sample in memory.
+//
+// - AddSample() reads a WAV file's header and its first headFrames frames (the attack head),
+//   which stay in RAM as raw PCM. The rest of the file is never loaded.
+// - Each voice has a float ring buffer. An I/O thread opens the voice's file and keeps the ring
+//   filled ahead of the playhead, topping up the emptiest voice first. It sleeps until the audio
+//   thread signals it: when a voice starts or stops, or a ring has room for another disk read.
+// - StartVoice(), StopVoice() and ReadVoice() are for the audio thread. They only touch
+//   preallocated memory and a few atomics, and never lock, allocate or do I/O. A started voice
+//   plays from its head at once, which gives the I/O thread headFrames worth of time to get its
+//   ring going. A voice started past the head has to wait for the disk.
+// - When the ring runs dry before the end of the sample, ReadVoice() outputs silence for the rest
+//   of the block and the voice resumes where it was on the next one. GetStats() counts these
+//   underruns, and the frames of silence.
+// - A stopped voice goes back to the pool once the I/O thread has closed its file, which it does
+//   as soon as it wakes. Give the streamer a few more voices than the instrument's polyphony.
+//
+// Voices play at the file's sample rate. Put a WDL_Resampler after ReadVoice() for pitch or rate
+// changes.
+//
+// Supported files are WAV with 16, 24 or 32 bit integer or 32 bit float samples.
+
+#include <stdio.h>
+#include <string.h>
+#include "../fileread.h"
+#include "../heapbuf.h"
+#include "../mutex.h"
+#include "../ptrlist.h"
+#include "../wdlstring.h"
+#include "../wdlatomic.h"
+#include "../pcmfmtcvt.h"
+#include "IWorkerSignal.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+#define DISKSTREAM_CHUNK_FRAMES 4096    // Frames per disk read.
+
+struct IDiskStreamStats
+{
+  int mActiveVoices;
+  int mUnderruns;           // Blocks where a voice ran out of streamed audio.
+  int mUnderrunFrames;      // Frames of silence output because of them.
+  int mReadErrors;          // Files that couldn't be opened or read, the voice ends early.
+  double mFramesStreamed;
+  double mPreloadBytes;
+};
+
+class IDiskStreamer
+{
+public:
+  // ringFrames is rounded up to a power of two of at least two disk chunks.
+  IDiskStreamer(int maxVoices = 64, int headFrames = 16384, int ringFrames = 32768, int maxChannels = 2)
+    : mNVoices(maxVoices > 0 ? maxVoices : 1), mHeadFrames(headFrames > 0 ? headFrames : 0)
+    , mMaxChannels(maxChannels > 0 ? maxChannels : 1), mNSamples(0), mSampleCapacity(0), mSampleTable(0)
+    , mUnderruns(0), mUnderrunFrames(0), mReadErrors(0), mFramesStreamed(0.), mPreloadBytes(0.), mQuit(false)
+  {
+    mRingFrames = DISKSTREAM_CHUNK_FRAMES * 2;
+    while (mRingFrames < ringFrames) mRingFrames <<= 1;
+
+    Voice* pVoices = mVoices.Resize(mNVoices);
+    memset(pVoices, 0, mNVoices * sizeof(Voice));
+    float* pRing = mRingSpace.Resize(mNVoices * mRingFrames * mMaxChannels);
+    for (int i = 0; i < mNVoices; ++i)
+    {
+      pVoices[i].mRing = pRing + i * mRingFrames * mMaxChannels;
+    }
+
+    // The I/O thread lives as long as the streamer, so nothing on the audio thread ever has to start it.
+#ifdef _WIN32
+    unsigned tid;
+    mThread = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, this, 0, &tid);
+    mHasThread = !!mThread;
+#else
+    mHasThread = !pthread_create(&mThread, NULL, ThreadProc, this);
+#endif
+  }
+
+  ~IDiskStreamer()
+  {
+    mQuit = true;
+    mSignal.Signal();
+    if (mHasThread)
+    {
+#ifdef _WIN32
+      WaitForSingleObject(mThread, INFINITE);
+      CloseHandle(mThread);
+#else
+      void* p;
+      pthread_join(mThread, &p);
+#endif
+    }
+    for (int i = 0; i < mNVoices; ++i)
+    {
+      delete mVoices.Get()[i].mFile;
+    }
+    for (int i = 0; i < mNSamples; ++i)
+    {
+      delete mSampleTable[i];
+    }
+    mOldTables.Empty(true, free);
+    free(mSampleTable);
+  }
+
+  // Not on the audio thread. Returns the sample's index, or -1 if the file can't be used.
+  // headFrames < 0 uses the streamer's default.
+  int AddSample(const char* path, int headFrames = -1)
+  {
+    Sample* pSample = new Sample;
+    if (!ReadHeader(path, pSample))
+    {
+      delete pSample;
+      return -1;
+    }
+    pSample->mPath.Set(path);
+
+    int nHead = headFrames >= 0 ? headFrames : mHeadFrames;
+    if (nHead > pSample->mFrames) nHead = pSample->mFrames;
+    if (nHead > 0)
+    {
+      WDL_FileRead file(path, 0, 0, 0);
+      int bytes = nHead * pSample->mBlockAlign;
+      void* pHead = pSample->mHead.ResizeOK(bytes, false);
+      if (!pHead || !file.IsOpen() || file.SetPosition(pSample->mDataOffset) || file.Read(pHead, bytes) != bytes)
+      {
+        delete pSample;
+        return -1;
+      }
+    }
+    pSample->mHeadFrames = nHead;
+
+    WDL_MutexLock lock(&mAddMutex);
+    if (mNSamples == mSampleCapacity)
+    {
+      // The audio thread may be reading the table, so grow into a new one and keep the old one around.
+      int capacity = mSampleCapacity ? mSampleCapacity * 2 : 256;
+      Sample** pTable = (Sample**) malloc(capacity * sizeof(Sample*));
+      if (!pTable)
+      {
+        delete pSample;
+        return -1;
+      }
+      if (mNSamples) memcpy(pTable, mSampleTable, mNSamples * sizeof(Sample*));
+      if (mSampleTable) mOldTables.Add(mSampleTable);
+      mSampleTable = pTable;
+      mSampleCapacity = capacity;
+    }
+    int idx = mNSamples;
+    mSampleTable[idx] = pSample;
+    mPreloadBytes += (double) pSample->mHead.GetSize();
+    wdl_atomic_incr(&mNSamples);
+    return idx;
+  }
+
+  int NSamples() { return mNSamples; }
+  int NVoices() { return mNVoices; }
+  int GetSampleFrames(int idx) { Sample* pSample = GetSample(idx); return pSample ? pSample->mFrames : 0; }
+  int GetSampleChannels(int idx) { Sample* pSample = GetSample(idx); return pSample ? pSample->mNChans : 0; }
+  double GetSampleRate(int idx) { Sample* pSample = GetSample(idx); return pSample ? pSample->mSampleRate : 0.; }
+
+  // Audio thread. Returns the voice to pass to ReadVoice()/StopVoice(), or -1 if all voices are busy.
+  int StartVoice(int sampleIdx, int startFrame = 0)
+  {
+    Sample* pSample = GetSample(sampleIdx);
+    if (!pSample || startFrame < 0 || startFrame >= pSample->mFrames) return -1;
+
+    for (int i = 0; i < mNVoices; ++i)
+    {
+      Voice* pVoice = mVoices.Get() + i;
+      if (wdl_atomic_get(&pVoice->mState) != kFree) continue;   // Also sees the I/O thread's last use of the voice.
+
+      pVoice->mSample = pSample;
+      pVoice->mPos = startFrame;
+      pVoice->mRingStart = startFrame < pSample->mHeadFrames ? pSample->mHeadFrames : startFrame;
+      pVoice->mWritten = 0;
+      pVoice->mRead = 0;
+      pVoice->mEnd = pSample->mFrames;
+      wdl_atomic_set(&pVoice->mState, kPlaying);   // Publishes the fields above to the I/O thread.
+      mSignal.Signal();
+      return i;
+    }
+    return -1;
+  }
+
+  // Audio thread.
+  void StopVoice(int voice)
+  {
+    if (voice < 0 || voice >= mNVoices) return;
+    Voice* pVoice = mVoices.Get() + voice;
+    if (pVoice->mState == kPlaying)
+    {
+      wdl_atomic_set(&pVoice->mState, kStopped);
+      mSignal.Signal();   // To close the file and free the voice.
+    }
+  }
+
+  bool IsVoicePlaying(int voice)
+  {
+    return voice >= 0 && voice < mNVoices && mVoices.Get()[voice].mState == kPlaying;
+  }
+
+  // Audio thread. Writes nFrames to each output, a mono sample goes to every output. Returns how many
+  // frames came from the sample, the rest are silence. The voice stops itself at the end of the sample.
+  int ReadVoice(int voice, double** outputs, int nOutputs, int nFrames)
+  {
+    Voice* pVoice = (voice >= 0 && voice < mNVoices) ? mVoices.Get() + voice : 0;
+    int done = 0;
+    bool starved = false;
+    if (pVoice && pVoice->mState == kPlaying)
+    {
+      Sample* pSample = pVoice->mSample;
+      while (done < nFrames)
+      {
+        int end = wdl_atomic_get(&pVoice->mEnd);
+        if (pVoice->mPos >= end) break;
+        int n = nFrames - done;
+        if (n > end - pVoice->mPos) n = end - pVoice->mPos;
+
+        if (pVoice->mPos < pVoice->mRingStart)
+        {
+          if (n > pVoice->mRingStart - pVoice->mPos) n = pVoice->mRingStart - pVoice->mPos;
+          ReadHead(pSample, pVoice->mPos, n, outputs, nOutputs, done);
+        }
+        else
+        {
+          int avail = wdl_atomic_get(&pVoice->mWritten) - pVoice->mRead;
+          if (avail <= 0)
+          {
+            starved = true;
+            break;
+          }
+          if (n > avail) n = avail;
+          ReadRing(pVoice, n, outputs, nOutputs, done);
+          wdl_atomic_set(&pVoice->mRead, pVoice->mRead + n);   // Hands the space back to the I/O thread.
+        }
+        pVoice->mPos += n;
+        done += n;
+      }
+      bool wake = starved;
+      if (starved)
+      {
+        ++mUnderruns;
+        mUnderrunFrames += nFrames - done;
+      }
+      else if (pVoice->mPos >= wdl_atomic_get(&pVoice->mEnd))
+      {
+        wdl_atomic_set(&pVoice->mState, kStopped);
+        wake = true;
+      }
+      // A refill request: there is more of the file to read, and room in the ring for a whole disk read.
+      int written = wdl_atomic_get(&pVoice->mWritten);
+      if (!wake && pVoice->mRingStart + written < wdl_atomic_get(&pVoice->mEnd))
+      {
+        wake = mRingFrames - (written - pVoice->mRead) >= DISKSTREAM_CHUNK_FRAMES;
+      }
+      if (wake) mSignal.Signal();
+    }
+
+    for (int c = 0; c < nOutputs; ++c)
+    {
+      if (done < nFrames) memset(outputs[c] + done, 0, (nFrames - done) * sizeof(double));
+    }
+    return done;
+  }
+
+  // Any thread. The counters only go up, and may be a block behind.
+  void GetStats(IDiskStreamStats* pStats)
+  {
+    pStats->mActiveVoices = 0;
+    for (int i = 0; i < mNVoices; ++i)
+    {
+      if (mVoices.Get()[i].mState != kFree) ++pStats->mActiveVoices;
+    }
+    pStats->mUnderruns = mUnderruns;
+    pStats->mUnderrunFrames = mUnderrunFrames;
+    pStats->mReadErrors = mReadErrors;
+    pStats->mFramesStreamed = mFramesStreamed;
+    pStats->mPreloadBytes = mPreloadBytes;
+  }
+
+private:
+  enum EVoiceState { kFree = 0, kPlaying, kStopped };
+
+  struct Sample
+  {
+    WDL_String mPath;
+    WDL_FILEREAD_POSTYPE mDataOffset;
+    int mFrames, mNChans, mBPS, mBlockAlign, mHeadFrames;
+    bool mFloat;
+    double mSampleRate;
+    WDL_HeapBuf mHead;    // Raw PCM, the first mHeadFrames frames.
+  };
+
+  // kFree -> kPlaying by the audio thread, kPlaying -> kStopped by the audio thread,
+  // kStopped -> kFree by the I/O thread once it is done with the voice.
+  struct Voice
+  {
+    volatile int mState;
+    Sample* mSample;
+    int mPos;               // Next frame to play, audio thread only.
+    int mRingStart;         // Sample frame that goes in the first ring slot.
+    volatile int mWritten;  // Frames the I/O thread has put in the ring.
+    volatile int mRead;     // Frames the audio thread has taken out of it.
+    volatile int mEnd;      // The sample's length, or less if the file couldn't be read.
+    float* mRing;           // mRingFrames frames of mSample->mNChans interleaved floats.
+    WDL_FileRead* mFile;    // I/O thread only.
+  };
+
+  Sample* GetSample(int idx)
+  {
+    if (idx < 0 || idx >= wdl_atomic_get(&mNSamples)) return 0;
+    return mSampleTable[idx];
+  }
+
+  // Header of a PCM or float WAV file, fills in everything but the path and the head.
+  bool ReadHeader(const char* path, Sample* pSample)
+  {
+    WDL_FileRead file(path, 0, 0, 0);
+    unsigned char hdr[40];
+    if (!file.IsOpen() || file.Read(hdr, 12) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) return false;
+
+    bool hasFmt = false;
+    int format = 0;
+    for (;;)
+    {
+      if (file.Read(hdr, 8) != 8) return false;
+      WDL_FILEREAD_POSTYPE size = Get32(hdr + 4), pos = file.GetPosition();
+      if (!memcmp(hdr, "fmt ", 4))
+      {
+        if (size < 16 || file.Read(hdr, size < 40 ? (int) size : 40) < 16) return false;
+        format = Get16(hdr);
+        if (format == 0xFFFE && size >= 26) format = Get16(hdr + 24);   // WAVE_FORMAT_EXTENSIBLE sub-format.
+        pSample->mNChans = Get16(hdr + 2);
+        pSample->mSampleRate = (double) Get32(hdr + 4);
+        pSample->mBlockAlign = Get16(hdr + 12);
+        pSample->mBPS = Get16(hdr + 14);
+        hasFmt = true;
+      }
+      else if (!memcmp(hdr, "data", 4))
+      {
+        if (!hasFmt) return false;
+        WDL_FILEREAD_POSTYPE avail = file.GetSize() - pos;
+        if (size > avail) size = avail;   // Files that were cut short, or never had their size filled in.
+        pSample->mDataOffset = pos;
+        break;
+      }
+      if (file.SetPosition(pos + size + (size & 1))) return false;
+    }
+
+    pSample->mFloat = format == 3;
+    if ((format != 1 && format != 3) || (pSample->mFloat && pSample->mBPS != 32)) return false;
+    if (pSample->mBPS != 16 && pSample->mBPS != 24 && pSample->mBPS != 32) return false;
+    if (pSample->mNChans < 1 || pSample->mNChans > mMaxChannels || pSample->mBlockAlign != pSample->mNChans * pSample->mBPS / 8) return false;
+
+    WDL_FILEREAD_POSTYPE frames = (file.GetSize() - pSample->mDataOffset) / pSample->mBlockAlign;
+    file.SetPosition(pSample->mDataOffset - 4);
+    if (file.Read(hdr, 4) == 4 && Get32(hdr) / pSample->mBlockAlign < frames) frames = Get32(hdr) / pSample->mBlockAlign;
+    pSample->mFrames = frames > 0x7fffffff ? 0x7fffffff : (int) frames;
+    return pSample->mFrames > 0;
+  }
+
+  void ReadHead(Sample* pSample, int pos, int n, double** outputs, int nOutputs, int outPos)
+  {
+    int nch = pSample->mNChans, bytes = pSample->mBPS / 8;
+    unsigned char* pSrc = (unsigned char*) pSample->mHead.Get() + pos * pSample->mBlockAlign;
+    for (int c = 0; c < nOutputs; ++c)
+    {
+      unsigned char* pChan = pSrc + (c % nch) * bytes;
+      double* pOut = outputs[c] + outPos;
+      if (pSample->mFloat)
+      {
+        for (int i = 0; i < n; ++i) pOut[i] = ((float*) pChan)[i * nch];
+      }
+      else
+      {
+        pcmToDoubles(pChan, n, pSample->mBPS, nch, pOut, 1);
+      }
+    }
+  }
+
+  void ReadRing(Voice* pVoice, int n, double** outputs, int nOutputs, int outPos)
+  {
+    int nch = pVoice->mSample->mNChans;
+    int idx = pVoice->mRead & (mRingFrames - 1);
+    int n1 = mRingFrames - idx;
+    if (n1 > n) n1 = n;
+    for (int c = 0; c < nOutputs; ++c)
+    {
+      const float* pSrc = pVoice->mRing + idx * nch + (c % nch);
+      double* pOut = outputs[c] + outPos;
+      int i;
+      for (i = 0; i < n1; ++i) pOut[i] = pSrc[i * nch];
+      pSrc = pVoice->mRing + (c % nch);
+      for (; i < n; ++i) pOut[i] = pSrc[(i - n1) * nch];
+    }
+  }
+
+  // One disk read for the voice whose ring is emptiest. Returns false if every ring was full.
+  bool FillOne()
+  {
+    Voice* pBest = 0;
+    int bestLevel = 0;
+    for (int i = 0; i < mNVoices; ++i)
+    {
+      Voice* pVoice = mVoices.Get() + i;
+      int state = wdl_atomic_get(&pVoice->mState);
+      if (state == kStopped)
+      {
+        delete pVoice->mFile;
+        pVoice->mFile = 0;
+        wdl_atomic_set(&pVoice->mState, kFree);
+        continue;
+      }
+      if (state != kPlaying) continue;
+
+      int level = pVoice->mWritten - wdl_atomic_get(&pVoice->mRead);
+      int remain = pVoice->mEnd - (pVoice->mRingStart + pVoice->mWritten);
+      // Wait until a whole chunk fits, unless this is the end of the sample.
+      if (remain <= 0 || (mRingFrames - level < DISKSTREAM_CHUNK_FRAMES && mRingFrames - level < remain)) continue;
+      if (!pBest || level < bestLevel)
+      {
+        pBest = pVoice;
+        bestLevel = level;
+      }
+    }
+    if (!pBest) return false;
+    Fill(pBest, bestLevel);
+    return true;
+  }
+
+  void Fill(Voice* pVoice, int level)
+  {
+    Sample* pSample = pVoice->mSample;
+    int written = pVoice->mWritten;
+    int frame = pVoice->mRingStart + written;
+    int n = pVoice->mEnd - frame;
+    if (n > DISKSTREAM_CHUNK_FRAMES) n = DISKSTREAM_CHUNK_FRAMES;
+    if (n > mRingFrames - level) n = mRingFrames - level;
+
+    if (!pVoice->mFile)
+    {
+      pVoice->mFile = new WDL_FileRead(pSample->mPath.Get(), 0, 0, 0);
+      if (!pVoice->mFile->IsOpen() ||
+          pVoice->mFile->SetPosition(pSample->mDataOffset + (WDL_FILEREAD_POSTYPE) frame * pSample->mBlockAlign))
+      {
+        Fail(pVoice, frame);
+        return;
+      }
+    }
+
+    int bytes = n * pSample->mBlockAlign;
+    void* pBuf = mIOBuf.Resize(bytes, false);
+    int got = pVoice->mFile->Read(pBuf, bytes) / pSample->mBlockAlign;
+
+    int nch = pSample->mNChans;
+    int idx = written & (mRingFrames - 1);
+    int n1 = mRingFrames - idx;
+    if (n1 > got) n1 = got;
+    Decode(pSample, pBuf, n1, pVoice->mRing + idx * nch);
+    Decode(pSample, (char*) pBuf + n1 * pSample->mBlockAlign, got - n1, pVoice->mRing);
+    wdl_atomic_set(&pVoice->mWritten, written + got);   // Publishes the frames to the audio thread.
+    mFramesStreamed += got;
+
+    if (got < n) Fail(pVoice, frame + got);
+  }
+
+  // The voice ends where the readable data does.
+  void Fail(Voice* pVoice, int end)
+  {
+    wdl_atomic_set(&pVoice->mEnd, end);
+    ++mReadErrors;
+  }
+
+  static void Decode(Sample* pSample, const void* pSrc, int frames, float* pDest)
+  {
+    if (frames <= 0) return;
+    if (pSample->mFloat) memcpy(pDest, pSrc, frames * pSample->mBlockAlign);
+    else pcmToFloats((void*) pSrc, frames * pSample->mNChans, pSample->mBPS, 1, pDest, 1);
+  }
+
+  static unsigned int Get32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24); }
+  static int Get16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+
+  void RunIO()
+  {
+    while (!mQuit)
+    {
+      if (!FillOne()) mSignal.Wait();
+    }
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void* p)
+  {
+    ((IDiskStreamer*) p)->RunIO();
+    return 0;
+  }
+#else
+  static void* ThreadProc(void* p)
+  {
+    ((IDiskStreamer*) p)->RunIO();
+    return 0;
+  }
+#endif
+
+  int mNVoices, mHeadFrames, mMaxChannels, mRingFrames;
+  WDL_TypedBuf<Voice> mVoices;
+  WDL_TypedBuf<float> mRingSpace;
+  WDL_HeapBuf mIOBuf;
+
+  WDL_Mutex mAddMutex;
+  volatile int mNSamples;
+  int mSampleCapacity;
+  Sample** mSampleTable;
+  WDL_PtrList<Sample*> mOldTables;    // Tables the audio thread may still be looking at.
+
+  int mUnderruns, mUnderrunFrames;    // Audio thread.
+  int mReadErrors;                    // I/O thread.
+  double mFramesStreamed;             // I/O thread.
+  double mPreloadBytes;
+
+  IWorkerSignal mSignal;              // Audio thread -> I/O thread.
+  volatile bool mQuit;
+  bool mHasThread;
+#ifdef _WIN32
+  HANDLE mThread;
+#else
+  pthread_t mThread;
+#endif
+};
+
+#endif
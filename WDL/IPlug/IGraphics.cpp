@@ -1,4 +1,9 @@
 #include "IGraphics.h"
+#include "ITextAtlas.h"
+#include "IBitmapLoader.h"
+#ifdef IPLUG_SVG_SUPPORT
+  #include "ISVGCache.h"
+#endif
 
 #define DEFAULT_FPS 25
 
@@ -69,6 +74,8 @@ public:
   }
 };
 
+// Declared first so it is destroyed after the bitmaps it may still be decoding.
+static IBitmapLoader s_bitmapLoader;
 static BitmapStorage s_bitmapCache;
 
 class FontStorage
@@ -121,6 +128,12 @@ public:
 };
 
 static FontStorage s_fontCache;
+static ITextAtlas s_textAtlas;
+#ifdef IPLUG_SVG_SUPPORT
+static ISVGCache s_svgCache;
+#endif
+// Number of IGraphics. The bitmap loader and SVG cache are shared by all of them, see ~IGraphics().
+static volatile int s_nGraphics;
 
 inline LICE_pixel LiceColor(const IColor* pColor)
 {
@@ -180,8 +193,14 @@ IGraphics::IGraphics(IPlugBase* pPlug, int w, int h, int refreshFPS)
   , mHiddenMousePointY(-1)
   , mEnableTooltips(false)
   , mShowControlBounds(false)
+  , mTextAtlas(false)
+  , mSVGBackground(true)
+  , mDeferBitmapDecode(true)
+  , mSVGNRendered(0)
 {
   mFPS = (refreshFPS > 0 ? refreshFPS : DEFAULT_FPS);
+  mRedrawScheduler.SetFPS(mFPS);
+  wdl_atomic_incr(&s_nGraphics);
 }
 
 IGraphics::~IGraphics()
@@ -192,6 +211,15 @@ IGraphics::~IGraphics()
   mControls.Empty(true);
   DELETE_NULL(mDrawBitmap);
   DELETE_NULL(mTmpBitmap);
+
+  // Not left to the static destructors, which run under the Windows loader lock.
+  if (!wdl_atomic_decr(&s_nGraphics))
+  {
+    s_bitmapLoader.Stop();
+#ifdef IPLUG_SVG_SUPPORT
+    s_svgCache.Stop();
+#endif
+  }
 }
 
 void IGraphics::Resize(int w, int h)
@@ -425,7 +453,12 @@ IBitmap IGraphics::LoadIBitmap(int ID, const char* name, int nStates, bool frame
   LICE_IBitmap* lb = s_bitmapCache.Find(ID);
   if (!lb)
   {
-    lb = OSLoadBitmap(ID, name);
+    IBitmapSource source;
+    if (mDeferBitmapDecode && OSGetBitmapSource(ID, name, &source))
+    {
+      lb = s_bitmapLoader.Load(ID, name, &source);
+    }
+    if (!lb) lb = OSLoadBitmap(ID, name);
     #ifndef NDEBUG
     bool imgResourceFound = lb;
     #endif
@@ -435,6 +468,26 @@ IBitmap IGraphics::LoadIBitmap(int ID, const char* name, int nStates, bool frame
   return IBitmap(lb, lb->getWidth(), lb->getHeight(), nStates, framesAreHoriztonal);
 }
 
+#ifdef IPLUG_SVG_SUPPORT
+IBitmap IGraphics::LoadISVG(int ID, const char* name, int w, int h, int nStates, bool framesAreHoriztonal)
+{
+  if (!s_svgCache.HasSource(ID))
+  {
+    WDL_String svg;
+    bool svgResourceFound = OSLoadSVG(ID, name, &svg);
+    assert(svgResourceFound); // Protect against typos in resource.h and .rc files.
+    if (svgResourceFound)
+    {
+      s_svgCache.AddSource(ID, svg.Get());
+    }
+  }
+  int bw = (framesAreHoriztonal ? w * nStates : w);
+  int bh = (framesAreHoriztonal ? h : h * nStates);
+  LICE_IBitmap* lb = s_svgCache.Get(ID, bw, bh, mSVGBackground);
+  return IBitmap(lb, (lb ? bw : 0), (lb ? bh : 0), nStates, framesAreHoriztonal);
+}
+#endif
+
 void IGraphics::RetainBitmap(IBitmap* pBitmap)
 {
   s_bitmapCache.Add((LICE_IBitmap*)pBitmap->mData);
@@ -447,7 +500,7 @@ void IGraphics::ReleaseBitmap(IBitmap* pBitmap)
 
 void IGraphics::PrepDraw()
 {
-  mDrawBitmap = new LICE_SysBitmap(Width(), Height());
+  mDrawBitmap = CreateDrawBitmap(Width(), Height());
   mTmpBitmap = new LICE_MemBitmap();
 }
 
@@ -722,6 +775,15 @@ bool IGraphics::IsDirty(IRECT* pR)
   }
 #endif
   
+#ifdef IPLUG_SVG_SUPPORT
+  // Some SVG bitmaps finished rasterising in the background since we last looked.
+  if (s_svgCache.GetNRendered() != mSVGNRendered)
+  {
+    mSVGNRendered = s_svgCache.Update();
+    SetAllControlsDirty();
+  }
+#endif
+
   bool dirty = false;
   int i, n = mControls.GetSize();
   IControl** ppControl = mControls.GetList();
@@ -750,10 +812,29 @@ bool IGraphics::IsDirty(IRECT* pR)
   return dirty;
 }
 
+bool IGraphics::IsDirtyScheduled(IRECT* pR)
+{
+  double now = IRedrawScheduler::GetTimeMs();
+#ifdef IPLUG_SVG_SUPPORT
+  if (s_svgCache.GetNRendered() != mSVGNRendered)
+  {
+    mRedrawScheduler.Wake();
+  }
+#endif
+  if (!mRedrawScheduler.OnTick(now))
+  {
+    return false;
+  }
+  bool dirty = IsDirty(pR);
+  mRedrawScheduler.OnPolled(now, dirty);
+  return dirty;
+}
+
 // The OS is announcing what needs to be redrawn,
 // which may be a larger area than what is strictly dirty.
 bool IGraphics::Draw(IRECT* pR)
 {
+  ITRACE_DRAW(mPlug);
 //  #pragma REMINDER("Mutex set while drawing")
 //  WDL_MutexLock lock(&mMutex);
 
@@ -763,6 +844,8 @@ bool IGraphics::Draw(IRECT* pR)
     return true;
   }
 
+  mRedrawScheduler.OnDrawBegin(IRedrawScheduler::GetTimeMs());
+
   if (mStrict)
   {
     mDrawRECT = *pR;
@@ -841,7 +924,9 @@ bool IGraphics::Draw(IRECT* pR)
   }
 #endif
 
-  return DrawScreen(pR);
+  bool rc = DrawScreen(pR);
+  mRedrawScheduler.OnDrawEnd(IRedrawScheduler::GetTimeMs());
+  return rc;
 }
 
 void IGraphics::SetStrictDrawing(bool strict)
@@ -1095,16 +1180,7 @@ bool IGraphics::DrawIText(IText* pTxt, const char* str, IRECT* pR, bool measure)
     return true;
   }
 
-  LICE_IFont* font = pTxt->mCached;
-  
-  if (!font)
-  {
-    font = CacheFont(pTxt);
-    if (!font) return false;
-  }
-
   LICE_pixel color = LiceColor(&pTxt->mColor);
-  font->SetTextColor(color);
 
   UINT fmt = DT_NOCLIP;
   if (LICE_GETA(color) < 255) fmt |= LICE_DT_USEFGALPHA;
@@ -1115,28 +1191,45 @@ bool IGraphics::DrawIText(IText* pTxt, const char* str, IRECT* pR, bool measure)
   else // if (pTxt->mAlign == IText::kAlignFar)
     fmt |= DT_RIGHT;
 
+  if (mTextAtlas)
+  {
+    WDL_MutexLock lock(&s_textAtlas.mMutex);
+    IAtlasFont* pFont = s_textAtlas.GetFont(pTxt, CreateHFont);
+    if (pFont)
+    {
+      if (measure)
+      {
+        IRECT r = *pR;
+        if (s_textAtlas.DrawText(pFont, mDrawBitmap, str, &r, fmt, true, color, 1.0f))
+        {
+          MeasuredToIRECT(pTxt, r.W(), r.H(), pR);
+          return true;
+        }
+      }
+      else if (s_textAtlas.DrawText(pFont, mDrawBitmap, str, pR, fmt, false, color, (float) LICE_GETA(color) / 255.0f))
+      {
+        return true;
+      }
+    }
+    // Otherwise the text doesn't fit in the atlas, LICE draws it.
+  }
+
+  LICE_IFont* font = pTxt->mCached;
+  
+  if (!font)
+  {
+    font = CacheFont(pTxt);
+    if (!font) return false;
+  }
+
+  font->SetTextColor(color);
+
   if (measure) 
   {
     fmt |= DT_CALCRECT;
     RECT R = {0,0,0,0};
     font->DrawText(mDrawBitmap, str, -1, &R, fmt);
-    
-    if( pTxt->mAlign == IText::kAlignNear)
-    {
-      pR->R = R.right;
-    }
-    else if (pTxt->mAlign == IText::kAlignCenter)
-    {
-      pR->L = (int) pR->MW() - (R.right/2);
-      pR->R = pR->L + R.right;
-    }
-    else // (pTxt->mAlign == IText::kAlignFar)
-    {
-      pR->L = pR->R - R.right;
-      pR->R = pR->L + R.right;
-    }
-    
-    pR->B = pR->T + R.bottom;
+    MeasuredToIRECT(pTxt, R.right, R.bottom, pR);
   }
   else 
   {
@@ -1147,53 +1240,91 @@ bool IGraphics::DrawIText(IText* pTxt, const char* str, IRECT* pR, bool measure)
   return true;
 }
 
+void IGraphics::MeasuredToIRECT(IText* pTxt, int w, int h, IRECT* pR)
+{
+  if( pTxt->mAlign == IText::kAlignNear)
+  {
+    pR->R = w;
+  }
+  else if (pTxt->mAlign == IText::kAlignCenter)
+  {
+    pR->L = (int) pR->MW() - (w/2);
+    pR->R = pR->L + w;
+  }
+  else // (pTxt->mAlign == IText::kAlignFar)
+  {
+    pR->L = pR->R - w;
+    pR->R = pR->L + w;
+  }
+  
+  pR->B = pR->T + h;
+}
+
+HFONT IGraphics::CreateHFont(IText* pTxt)
+{
+  int h = pTxt->mSize;
+  int esc = 10 * pTxt->mOrientation;
+  int wt = (pTxt->mStyle == IText::kStyleBold ? FW_BOLD : FW_NORMAL);
+  int it = (pTxt->mStyle == IText::kStyleItalic ? TRUE : FALSE);
+
+  int q;
+  if (pTxt->mQuality == IText::kQualityDefault)
+    q = DEFAULT_QUALITY;
+  #ifdef CLEARTYPE_QUALITY
+  else if (pTxt->mQuality == IText::kQualityClearType)
+    q = CLEARTYPE_QUALITY;
+  else if (pTxt->mQuality == IText::kQualityAntiAliased)
+  #else
+  else if (pTxt->mQuality != IText::kQualityNonAntiAliased)
+  #endif
+    q = ANTIALIASED_QUALITY;
+  else // if (pTxt->mQuality == IText::kQualityNonAntiAliased)
+    q = NONANTIALIASED_QUALITY;
+
+  #ifdef __APPLE__
+  bool resized = false;
+  Resize:
+  if (h < 2) h = 2;
+  #endif
+  HFONT hFont = CreateFont(h, 0, esc, esc, wt, it, FALSE, FALSE, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, q, DEFAULT_PITCH, pTxt->mFont);
+  #ifdef __APPLE__
+  if (hFont && !resized)
+  {
+    LICE_CachedFont tmp;
+    tmp.SetFromHFont(hFont);
+    if (tmp.GetLineHeight() != h)
+    {
+      h = int((double)(h * h) / (double)tmp.GetLineHeight() + 0.5);
+      resized = true;
+      DeleteObject(hFont);
+      goto Resize;
+    }
+  }
+  #endif
+  return hFont;
+}
+
 LICE_IFont* IGraphics::CacheFont(IText* pTxt)
 {
   LICE_CachedFont* font = (LICE_CachedFont*)s_fontCache.Find(pTxt);
   if (!font)
   {
-    font = new LICE_CachedFont;
-    int h = pTxt->mSize;
-    int esc = 10 * pTxt->mOrientation;
-    int wt = (pTxt->mStyle == IText::kStyleBold ? FW_BOLD : FW_NORMAL);
-    int it = (pTxt->mStyle == IText::kStyleItalic ? TRUE : FALSE);
-
-    int q;
-    if (pTxt->mQuality == IText::kQualityDefault)
-      q = DEFAULT_QUALITY;
-    #ifdef CLEARTYPE_QUALITY
-    else if (pTxt->mQuality == IText::kQualityClearType)
-      q = CLEARTYPE_QUALITY;
-    else if (pTxt->mQuality == IText::kQualityAntiAliased)
-    #else
-    else if (pTxt->mQuality != IText::kQualityNonAntiAliased)
-    #endif
-      q = ANTIALIASED_QUALITY;
-    else // if (pTxt->mQuality == IText::kQualityNonAntiAliased)
-      q = NONANTIALIASED_QUALITY;
-
-    #ifdef __APPLE__
-    bool resized = false;
-    Resize:
-    if (h < 2) h = 2;
-    #endif
-    HFONT hFont = CreateFont(h, 0, esc, esc, wt, it, FALSE, FALSE, ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, q, DEFAULT_PITCH, pTxt->mFont);
+    HFONT hFont = CreateHFont(pTxt);
     if (!hFont)
     {
-      delete(font);
       return 0;
     }
+    font = new LICE_CachedFont;
     font->SetFromHFont(hFont, LICE_FONT_FLAG_OWNS_HFONT | LICE_FONT_FLAG_FORCE_NATIVE);
-    #ifdef __APPLE__
-    if (!resized && font->GetLineHeight() != h)
-    {
-      h = int((double)(h * h) / (double)font->GetLineHeight() + 0.5);
-      resized = true;
-      goto Resize;
-    }
-    #endif
     s_fontCache.Add(font, pTxt);
   }
   pTxt->mCached = font;
   return font;
-}
\ No newline at end of file
+}
+
+#ifdef IPLUG_FREETYPE
+void IGraphics::SetFontFile(const char* face, const char* fontFile)
+{
+  s_textAtlas.SetFontFile(face, fontFile);
+}
+#endif
\ No newline at end of file
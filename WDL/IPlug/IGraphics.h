@@ -4,6 +4,7 @@
 #include "IPlugStructs.h"
 #include "IPopupMenu.h"
 #include "IControl.h"
+#include "IRedrawScheduler.h"
 #include "../lice/lice.h"
 
 // Specialty stuff for calling in to Reaper for Lice functionality.
@@ -41,6 +42,7 @@
 class IPlugBase;
 class IControl;
 class IParam;
+struct IBitmapSource;
 
 class IGraphics
 {
@@ -48,6 +50,7 @@ public:
   void PrepDraw();    // Called once, when the IGraphics class is attached to the IPlug class.
 
   bool IsDirty(IRECT* pR);        // Ask the plugin what needs to be redrawn.
+  bool IsDirtyScheduled(IRECT* pR); // Called from the OS redraw timer, IsDirty() gated by the redraw scheduler.
   bool Draw(IRECT* pR);           // The system announces what needs to be redrawn.  Ordering and drawing logic.
   virtual bool DrawScreen(IRECT* pR) = 0;  // Tells the OS class to put the final bitmap on the screen.
 
@@ -141,10 +144,26 @@ public:
   int Height() { return mHeight; }
   int FPS() { return mFPS; }
 
+  // The OS classes pace their redraw timers with this, see IRedrawScheduler.h.
+  IRedrawScheduler* GetRedrawScheduler() { return &mRedrawScheduler; }
+  // Called by IControl::SetDirty(), safe to call from any thread.
+  void WakeRedraw() { mRedrawScheduler.Wake(); }
+
   IPlugBase* GetPlug() { return mPlug; }
 
   IBitmap LoadIBitmap(int ID, const char* name, int nStates = 1, bool framesAreHoriztonal = false);
+  // By default LoadIBitmap() only reads the image header and PNG/JPEG decoding runs on worker threads
+  // (see IBitmapLoader.h). Disable to decode before LoadIBitmap() returns.
+  void EnableDeferredBitmapDecode(bool enable) { mDeferBitmapDecode = enable; }
   IBitmap ScaleBitmap(IBitmap* pSrcBitmap, int destW, int destH);
+#ifdef IPLUG_SVG_SUPPORT
+  // Rasterises an SVG resource to w x h pixels per frame (see ISVGCache.h), so fold any scale factor
+  // into w and h, and call it again with the new size when the editor is resized.
+  IBitmap LoadISVG(int ID, const char* name, int w, int h, int nStates = 1, bool framesAreHoriztonal = false);
+  // By default LoadISVG() returns a transparent bitmap straight away and the controls redraw once
+  // it has been rasterised in the background. Disable to rasterise before LoadISVG() returns.
+  void EnableSVGBackgroundRasterisation(bool enable) { mSVGBackground = enable; }
+#endif
   IBitmap CropBitmap(IBitmap* pSrcBitmap, IRECT* pR);
   void AttachBackground(int ID, const char* name);
   void AttachPanelBackground(const IColor *pColor);
@@ -216,6 +235,15 @@ public:
   
   void AssignParamNameToolTips();
   
+  // Draw text through the shared glyph atlas and layout cache (see ITextAtlas.h), rather than
+  // measuring and drawing every string with LICE_CachedFont each time.
+  void EnableTextAtlas(bool enable) { mTextAtlas = enable; }
+  bool TextAtlasEnabled() const { return mTextAtlas; }
+#ifdef IPLUG_FREETYPE
+  // Render face with FreeType from fontFile when the text atlas is enabled, see ITextAtlas::SetFontFile().
+  static void SetFontFile(const char* face, const char* fontFile);
+#endif
+
   // in debug builds you can enable this to draw a coloured box on the top of the GUI to show the bounds of the IControls
   inline void ShowControlBounds(bool enable)
   {
@@ -233,7 +261,7 @@ public:
   void ReleaseBitmap(IBitmap* pBitmap);
   LICE_pixel* GetBits();
   // For controls that need to interface directly with LICE.
-  inline LICE_SysBitmap* GetDrawBitmap() const { return mDrawBitmap; }
+  inline LICE_IBitmap* GetDrawBitmap() const { return mDrawBitmap; }
 
   WDL_Mutex mMutex;
 
@@ -258,9 +286,21 @@ protected:
   inline bool TooltipsEnabled() const { return mEnableTooltips; }
   
   virtual LICE_IBitmap* OSLoadBitmap(int ID, const char* name) = 0;
+  // Where LoadIBitmap() finds the encoded image for a deferred decode, false to use OSLoadBitmap().
+  virtual bool OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource) { return false; }
+#ifdef IPLUG_SVG_SUPPORT
+  virtual bool OSLoadSVG(int ID, const char* name, WDL_String* pSVG) = 0;
+#endif
+  // The bitmap everything is drawn into, the OS classes need a LICE_SysBitmap to blit to the screen.
+  virtual LICE_IBitmap* CreateDrawBitmap(int w, int h) { return new LICE_SysBitmap(w, h); }
   
-  LICE_SysBitmap* mDrawBitmap;
+  LICE_IBitmap* mDrawBitmap;
   LICE_IFont* CacheFont(IText* pTxt);
+  static HFONT CreateHFont(IText* pTxt);
+  // Turns a measured text extent into the IRECT that DrawIText(measure = true) returns.
+  static void MeasuredToIRECT(IText* pTxt, int w, int h, IRECT* pR);
+
+  IRedrawScheduler mRedrawScheduler;
   
 #ifdef AAX_API
   AAX_IViewContainer* mAAXViewContainer;  
@@ -271,7 +311,8 @@ private:
   int mWidth, mHeight, mFPS, mIdleTicks;
   int GetMouseControlIdx(int x, int y, bool mo = false);
   int mMouseCapture, mMouseOver, mMouseX, mMouseY, mLastClickedParam;
-  bool mHandleMouseOver, mStrict, mEnableTooltips, mShowControlBounds;
+  bool mHandleMouseOver, mStrict, mEnableTooltips, mShowControlBounds, mTextAtlas, mSVGBackground, mDeferBitmapDecode;
+  int mSVGNRendered;
   IControl* mKeyCatcher;
 };
 
@@ -0,0 +1,304 @@
+#ifndef _IGRAPHICSBENCH_
+#define _IGRAPHICSBENCH_
+
+// Replays a recorded stream of mouse and parameter events against a headless editor,
+// timing every frame that draws something and comparing snapshots against reference PNGs.
+//
+// The stream is plain text, one event per line, '#' starts a comment:
+//
+//   frame [n]              Render n frames (default 1), as the OS timer would.
+//   down x y [mods]        Mouse events, mods is any of LRSCA (default L for down/drag/dblclick).
+//   up x y [mods]
+//   drag x y [mods]
+//   dblclick x y [mods]
+//   over x y [mods]
+//   out
+//   wheel x y d [mods]
+//   param idx value        Host automation, value is normalized.
+//   snapshot name          Render, then write <output dir>/name.png and diff it against <reference dir>/name.png.
+//                          Only the first iteration of Run() takes snapshots.
+//
+// Mouse and param events don't render by themselves, follow them with "frame".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "IPlugHeadless.h"
+#include "IGraphicsHeadless.h"
+#include "../ptrlist.h"
+
+class IGraphicsBench
+{
+public:
+  struct Snapshot
+  {
+    WDL_String mName;
+    bool mHasReference;
+    bool mSizeMismatch;
+    int mDiffPixels;    // Pixels where any color channel differs by more than the tolerance.
+    int mMaxDiff;       // Largest channel difference.
+
+    bool Passed() const { return !mHasReference || (!mSizeMismatch && !mDiffPixels); }
+  };
+
+  IGraphicsBench(IPlugHeadless* pPlug)
+    : mPlug(pPlug), mGraphics((IGraphicsHeadless*) pPlug->GetGUI()), mTolerance(0), mIteration(0), mLine(0) {}
+  ~IGraphicsBench() { mSnapshots.Empty(true); }
+
+  void SetOutputDir(const char* dir) { mOutputDir.Set(dir); }
+  void SetReferenceDir(const char* dir) { mReferenceDir.Set(dir); }
+  // Per channel difference (0-255) that still counts as identical.
+  void SetTolerance(int tolerance) { mTolerance = tolerance; }
+
+  bool LoadStream(const char* filename)
+  {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    mStream.Set("");
+    char buf[4096];
+    int n;
+    while ((n = (int) fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+      mStream.Append(buf, n);
+    }
+    fclose(fp);
+    return true;
+  }
+  void SetStream(const char* text) { mStream.Set(text); }
+
+  // Replays the stream iterations times. Returns false (see GetError()) on a parse error.
+  bool Run(int iterations = 1)
+  {
+    if (!mGraphics) return Fail("plug has no GUI");
+    if (!mGraphics->WindowIsOpen())
+    {
+      mGraphics->OpenWindow(0);
+    }
+    for (mIteration = 0; mIteration < iterations; ++mIteration)
+    {
+      mLine = 0;
+      const char* p = mStream.Get();
+      while (*p)
+      {
+        const char* eol = p;
+        while (*eol && *eol != '\n') ++eol;
+        ++mLine;
+        WDL_String line;
+        line.Set(p, (int) (eol - p));
+        if (!RunLine(line.Get())) return false;
+        p = (*eol ? eol + 1 : eol);
+      }
+    }
+    return true;
+  }
+
+  int NFrames() const { return mFrameMs.GetSize(); }
+  // p in [0, 100].
+  double GetPercentile(double p)
+  {
+    int n = mFrameMs.GetSize();
+    if (!n) return 0.0;
+    double* pSorted = mSorted.Resize(n);
+    memcpy(pSorted, mFrameMs.Get(), n * sizeof(double));
+    qsort(pSorted, n, sizeof(double), CompareDouble);
+    int i = (int) (p / 100.0 * (double) (n - 1) + 0.5);
+    return pSorted[BOUNDED(i, 0, n - 1)];
+  }
+  double GetMean() const
+  {
+    int n = mFrameMs.GetSize();
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) sum += mFrameMs.Get()[i];
+    return (n ? sum / (double) n : 0.0);
+  }
+
+  int NSnapshots() const { return mSnapshots.GetSize(); }
+  const Snapshot* GetSnapshot(int i) const { return mSnapshots.Get(i); }
+  int NFailedSnapshots() const
+  {
+    int nFailed = 0;
+    for (int i = 0; i < mSnapshots.GetSize(); ++i)
+    {
+      if (!mSnapshots.Get(i)->Passed()) ++nFailed;
+    }
+    return nFailed;
+  }
+
+  const char* GetError() { return mError.Get(); }
+
+  void Report(FILE* fp)
+  {
+    fprintf(fp, "frames: %d\n", NFrames());
+    if (NFrames())
+    {
+      fprintf(fp, "frame ms: p50 %.3f p90 %.3f p99 %.3f max %.3f mean %.3f\n",
+        GetPercentile(50.0), GetPercentile(90.0), GetPercentile(99.0), GetPercentile(100.0), GetMean());
+    }
+    for (int i = 0; i < mSnapshots.GetSize(); ++i)
+    {
+      const Snapshot* pSnap = mSnapshots.Get(i);
+      if (!pSnap->mHasReference)
+        fprintf(fp, "snapshot %s: no reference\n", pSnap->mName.Get());
+      else if (pSnap->mSizeMismatch)
+        fprintf(fp, "snapshot %s: FAIL size mismatch\n", pSnap->mName.Get());
+      else
+        fprintf(fp, "snapshot %s: %s %d pixels differ, max diff %d\n", pSnap->mName.Get(),
+          (pSnap->Passed() ? "ok" : "FAIL"), pSnap->mDiffPixels, pSnap->mMaxDiff);
+    }
+  }
+
+private:
+  bool RunLine(char* line)
+  {
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    char cmd[64], arg[256];
+    double a = 0.0, b = 0.0, c = 0.0;
+    arg[0] = '\0';
+    if (sscanf(line, "%63s", cmd) != 1) return true;   // Blank line.
+
+    if (!strcmp(cmd, "frame"))
+    {
+      int n = 1;
+      sscanf(line, "%*s %d", &n);
+      for (int i = 0; i < n; ++i) RenderFrame();
+      return true;
+    }
+    if (!strcmp(cmd, "out"))
+    {
+      mGraphics->OnMouseOut();
+      return true;
+    }
+    if (!strcmp(cmd, "param"))
+    {
+      int idx = -1;
+      if (sscanf(line, "%*s %d %lf", &idx, &a) != 2 || idx < 0 || idx >= mPlug->NParams())
+      {
+        return Fail("bad param event");
+      }
+      mPlug->SetParameterFromHost(idx, BOUNDED(a, 0.0, 1.0));
+      return true;
+    }
+    if (!strcmp(cmd, "snapshot"))
+    {
+      if (sscanf(line, "%*s %255s", arg) != 1) return Fail("snapshot needs a name");
+      if (mIteration)
+      {
+        RenderFrame();
+        return true;
+      }
+      return TakeSnapshot(arg);
+    }
+    if (!strcmp(cmd, "wheel"))
+    {
+      if (sscanf(line, "%*s %lf %lf %lf %255s", &a, &b, &c, arg) < 3) return Fail("bad wheel event");
+      IMouseMod mod = ParseMods(arg, false);
+      mGraphics->OnMouseWheel((int) a, (int) b, &mod, (int) c);
+      return true;
+    }
+
+    bool defaultL = (!strcmp(cmd, "down") || !strcmp(cmd, "drag") || !strcmp(cmd, "dblclick"));
+    if (sscanf(line, "%*s %lf %lf %255s", &a, &b, arg) < 2) return Fail("bad mouse event");
+    IMouseMod mod = ParseMods(arg, defaultL);
+    int x = (int) a, y = (int) b;
+
+    if (!strcmp(cmd, "down")) mGraphics->OnMouseDown(x, y, &mod);
+    else if (!strcmp(cmd, "up")) mGraphics->OnMouseUp(x, y, &mod);
+    else if (!strcmp(cmd, "drag")) mGraphics->OnMouseDrag(x, y, &mod);
+    else if (!strcmp(cmd, "dblclick")) mGraphics->OnMouseDblClick(x, y, &mod);
+    else if (!strcmp(cmd, "over")) mGraphics->OnMouseOver(x, y, &mod);
+    else return Fail("unknown event");
+    return true;
+  }
+
+  void RenderFrame()
+  {
+    double t0 = IRedrawScheduler::GetTimeMs();
+    if (mGraphics->RenderFrame())
+    {
+      mFrameMs.Add(IRedrawScheduler::GetTimeMs() - t0);
+    }
+  }
+
+  bool TakeSnapshot(const char* name)
+  {
+    RenderFrame();
+
+    Snapshot* pSnap = new Snapshot;
+    pSnap->mName.Set(name);
+    pSnap->mHasReference = pSnap->mSizeMismatch = false;
+    pSnap->mDiffPixels = pSnap->mMaxDiff = 0;
+    mSnapshots.Add(pSnap);
+
+    LICE_IBitmap* pBitmap = mGraphics->GetDrawBitmap();
+    if (mOutputDir.GetLength())
+    {
+      WDL_String path;
+      path.SetFormatted(4096, "%s/%s.png", mOutputDir.Get(), name);
+      if (!mGraphics->SaveFrame(path.Get())) return Fail("can't write snapshot");
+    }
+    if (mReferenceDir.GetLength())
+    {
+      WDL_String path;
+      path.SetFormatted(4096, "%s/%s.png", mReferenceDir.Get(), name);
+      LICE_MemBitmap ref;
+      if (LICE_LoadPNG(path.Get(), &ref))
+      {
+        pSnap->mHasReference = true;
+        Diff(pSnap, pBitmap, &ref);
+      }
+    }
+    return true;
+  }
+
+  void Diff(Snapshot* pSnap, LICE_IBitmap* pA, LICE_IBitmap* pB)
+  {
+    int w = pA->getWidth(), h = pA->getHeight();
+    if (w != pB->getWidth() || h != pB->getHeight())
+    {
+      pSnap->mSizeMismatch = true;
+      return;
+    }
+    for (int y = 0; y < h; ++y)
+    {
+      const LICE_pixel* pa = pA->getBits() + (pA->isFlipped() ? h - 1 - y : y) * pA->getRowSpan();
+      const LICE_pixel* pb = pB->getBits() + (pB->isFlipped() ? h - 1 - y : y) * pB->getRowSpan();
+      for (int x = 0; x < w; ++x)
+      {
+        int d = IPMAX(IPMAX(abs((int) LICE_GETR(pa[x]) - (int) LICE_GETR(pb[x])),
+                            abs((int) LICE_GETG(pa[x]) - (int) LICE_GETG(pb[x]))),
+                            abs((int) LICE_GETB(pa[x]) - (int) LICE_GETB(pb[x])));
+        if (d > pSnap->mMaxDiff) pSnap->mMaxDiff = d;
+        if (d > mTolerance) ++pSnap->mDiffPixels;
+      }
+    }
+  }
+
+  static IMouseMod ParseMods(const char* str, bool defaultL)
+  {
+    if (!str[0]) return IMouseMod(defaultL);
+    return IMouseMod(strchr(str, 'L') != 0, strchr(str, 'R') != 0, strchr(str, 'S') != 0,
+                     strchr(str, 'C') != 0, strchr(str, 'A') != 0);
+  }
+
+  static int CompareDouble(const void* a, const void* b)
+  {
+    double da = *(const double*) a, db = *(const double*) b;
+    return (da < db ? -1 : (da > db ? 1 : 0));
+  }
+
+  bool Fail(const char* msg)
+  {
+    mError.SetFormatted(256, "line %d: %s", mLine, msg);
+    return false;
+  }
+
+  IPlugHeadless* mPlug;
+  IGraphicsHeadless* mGraphics;
+  WDL_String mStream, mOutputDir, mReferenceDir, mError;
+  WDL_TypedBuf<double> mFrameMs, mSorted;
+  WDL_PtrList<Snapshot> mSnapshots;
+  int mTolerance, mIteration, mLine;
+};
+
+#endif // _IGRAPHICSBENCH_
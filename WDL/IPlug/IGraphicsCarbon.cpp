@@ -581,7 +581,7 @@ pascal void IGraphicsCarbon::TimerHandler(EventLoopTimerRef pTimer, void* pGraph
 
   IRECT r;
 
-  if (_this->mGraphicsMac->IsDirty(&r))
+  if (_this->mGraphicsMac->IsDirtyScheduled(&r))
   {
     if (_this->mIsComposited)
     {
@@ -232,6 +232,14 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
   r.size.height = (float) pGraphics->Height();
   self = [super initWithFrame:r];
 
+  CGDisplayModeRef mode = CGDisplayCopyDisplayMode(CGMainDisplayID());
+  if (mode)
+  {
+    double hz = CGDisplayModeGetRefreshRate(mode);
+    if (hz > 0.0) pGraphics->GetRedrawScheduler()->SetDisplayTiming(1000.0 / hz);
+    CGDisplayModeRelease(mode);
+  }
+
   double sec = 1.0 / (double) pGraphics->FPS();
   mTimer = [NSTimer timerWithTimeInterval:sec target:self selector:@selector(onTimer:) userInfo:nil repeats:YES];
   [[NSRunLoop currentRunLoop] addTimer: mTimer forMode: (NSString*) kCFRunLoopCommonModes];
@@ -276,7 +284,13 @@ inline int GetMouseOver(IGraphicsMac* pGraphics)
 - (void) onTimer: (NSTimer*) pTimer
 {
   IRECT r;
-  if (pTimer == mTimer && mGraphics && mGraphics->IsDirty(&r))
+  if (pTimer == mTimer && mGraphics)
+  {
+    // The NSTimer keeps running at FPS(), the scheduler decides which ticks actually poll the controls.
+    NSWindow* pWindow = [self window];
+    mGraphics->GetRedrawScheduler()->SetOccluded(!pWindow || ![pWindow isVisible] || [pWindow isMiniaturized] || [self isHiddenOrHasHiddenAncestor]);
+  }
+  if (pTimer == mTimer && mGraphics && mGraphics->IsDirtyScheduled(&r))
   {
     [self setNeedsDisplayInRect:ToNSRect(mGraphics, &r)];
   }
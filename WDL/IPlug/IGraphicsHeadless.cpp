@@ -0,0 +1,113 @@
+#include "IGraphicsHeadless.h"
+#include "IBitmapLoader.h"
+#ifdef IPLUG_SVG_SUPPORT
+  #include "ISVGCache.h"
+#endif
+
+IGraphicsHeadless::IGraphicsHeadless(IPlugBase* pPlug, int w, int h, int refreshFPS)
+  : IGraphics(pPlug, w, h, refreshFPS), mWindowOpen(false), mNScreenDraws(0)
+{
+  EnableTextAtlas(true);
+#ifdef IPLUG_SVG_SUPPORT
+  // Snapshots have to be deterministic.
+  EnableSVGBackgroundRasterisation(false);
+#endif
+}
+
+IGraphicsHeadless::~IGraphicsHeadless()
+{
+  CloseWindow();
+}
+
+LICE_IBitmap* IGraphicsHeadless::OSLoadBitmap(int ID, const char* name)
+{
+  if (!name) return 0;
+
+  const char* ext = name+strlen(name)-1;
+  while (ext > name && *ext != '.') --ext;
+  ++ext;
+
+  WDL_String path;
+  GetResourceFile(name, &path);
+
+  if (!stricmp(ext, "png")) return LICE_LoadPNG(path.Get());
+  #ifdef IPLUG_JPEG_SUPPORT
+  if (!stricmp(ext, "jpg") || !stricmp(ext, "jpeg")) return LICE_LoadJPG(path.Get());
+  #endif
+
+  return 0;
+}
+
+bool IGraphicsHeadless::OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource)
+{
+  if (!name) return false;
+
+  const char* ext = name+strlen(name)-1;
+  while (ext > name && *ext != '.') --ext;
+  ++ext;
+
+  if (!stricmp(ext, "png")) pSource->mJPEG = false;
+  #ifdef IPLUG_JPEG_SUPPORT
+  else if (!stricmp(ext, "jpg") || !stricmp(ext, "jpeg")) pSource->mJPEG = true;
+  #endif
+  else return false;
+
+  GetResourceFile(name, &pSource->mPath);
+  return true;
+}
+
+#ifdef IPLUG_SVG_SUPPORT
+bool IGraphicsHeadless::OSLoadSVG(int ID, const char* name, WDL_String* pSVG)
+{
+  if (!name) return false;
+  WDL_String path;
+  GetResourceFile(name, &path);
+  return ISVGCache::ReadFile(path.Get(), pSVG);
+}
+#endif
+
+void IGraphicsHeadless::GetResourceFile(const char* name, WDL_String* pPath)
+{
+  pPath->Set(mResourcePath.Get());
+  int len = pPath->GetLength();
+  if (len && pPath->Get()[len-1] != '/' && pPath->Get()[len-1] != '\\')
+  {
+    pPath->Append("/");
+  }
+  pPath->Append(name);
+}
+
+void* IGraphicsHeadless::OpenWindow(void* pParentWnd)
+{
+  mWindowOpen = true;
+  SetAllControlsDirty();
+  return this;
+}
+
+void IGraphicsHeadless::CloseWindow()
+{
+  mWindowOpen = false;
+}
+
+bool IGraphicsHeadless::RenderFrame()
+{
+  IRECT r;
+  if (IsDirty(&r))
+  {
+    Draw(&r);
+    return true;
+  }
+  return false;
+}
+
+void IGraphicsHeadless::RenderAll()
+{
+  SetAllControlsDirty();
+  RenderFrame();
+}
+
+bool IGraphicsHeadless::SaveFrame(const char* filename)
+{
+  LICE_IBitmap* pBitmap = GetDrawBitmap();
+  return (pBitmap && LICE_WritePNG(filename, pBitmap, false));
+}
@@ -0,0 +1,77 @@
+#ifndef _IGRAPHICSHEADLESS_
+#define _IGRAPHICSHEADLESS_
+
+// IGraphics without a window, drawing into a LICE_MemBitmap.
+// Used for rendering editors offscreen, e.g. for the GUI benchmarks in IGraphicsBench.h.
+// Bitmaps are loaded from PNG (or JPEG with IPLUG_JPEG_SUPPORT) files in the resource path,
+// every other OS service is a no-op.
+
+#include "IGraphics.h"
+
+class IGraphicsHeadless : public IGraphics
+{
+public:
+  IGraphicsHeadless(IPlugBase* pPlug, int w, int h, int refreshFPS);
+  virtual ~IGraphicsHeadless();
+
+  // Directory that OSLoadBitmap() and OSLoadSVG() look for the image files in.
+  void SetResourcePath(const char* path) { mResourcePath.Set(path); }
+  const char* GetResourcePath() { return mResourcePath.Get(); }
+
+  void ForceEndUserEdit() {}
+
+  int ShowMessageBox(const char* pText, const char* pCaption, int type) { return IDCANCEL; }
+
+  bool DrawScreen(IRECT* pR) { ++mNScreenDraws; return true; }
+
+  void* OpenWindow(void* pParentWnd);
+  void CloseWindow();
+  void* GetWindow() { return (mWindowOpen ? this : 0); }
+  bool WindowIsOpen() { return mWindowOpen; }
+
+  void UpdateTooltips() {}
+
+  void HostPath(WDL_String* pPath) { pPath->Set(""); }
+  void PluginPath(WDL_String* pPath) { pPath->Set(mResourcePath.Get()); }
+  void DesktopPath(WDL_String* pPath) { pPath->Set(""); }
+  void AppSupportPath(WDL_String* pPath, bool isSystem = false) { pPath->Set(""); }
+  void SandboxSafeAppSupportPath(WDL_String* pPath) { pPath->Set(""); }
+
+  void PromptForFile(WDL_String* pFilename, EFileAction action = kFileOpen, WDL_String* pDir = 0, char* extensions = 0) { pFilename->Set(""); }
+  bool PromptForColor(IColor* pColor, char* prompt = 0) { return false; }
+
+  IPopupMenu* CreateIPopupMenu(IPopupMenu* pMenu, IRECT* pTextRect) { return 0; }
+  void CreateTextEntry(IControl* pControl, IText* pText, IRECT* pTextRect, const char* pString, IParam* pParam) {}
+
+  bool OpenURL(const char* url, const char* msgWindowTitle = 0, const char* confirmMsg = 0, const char* errMsgOnFailure = 0) { return false; }
+
+  bool GetTextFromClipboard(WDL_String* pStr) { pStr->Set(""); return false; }
+
+  const char* GetGUIAPI() { return "Headless"; }
+
+  // Does what the OS timer would do: redraws whatever is dirty. Returns true if anything was drawn.
+  bool RenderFrame();
+  // Redraws everything.
+  void RenderAll();
+  // Number of times DrawScreen() has been called.
+  int NScreenDraws() const { return mNScreenDraws; }
+  // Writes the current contents of the draw bitmap to a PNG file.
+  bool SaveFrame(const char* filename);
+
+protected:
+  LICE_IBitmap* OSLoadBitmap(int ID, const char* name);
+  bool OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource);
+#ifdef IPLUG_SVG_SUPPORT
+  bool OSLoadSVG(int ID, const char* name, WDL_String* pSVG);
+#endif
+  LICE_IBitmap* CreateDrawBitmap(int w, int h) { return new LICE_MemBitmap(w, h); }
+
+private:
+  void GetResourceFile(const char* name, WDL_String* pPath);
+
+  WDL_String mResourcePath;
+  bool mWindowOpen;
+  int mNScreenDraws;
+};
+
+#endif // _IGRAPHICSHEADLESS_
@@ -112,6 +112,10 @@ public:
 
 protected:
   virtual LICE_IBitmap* OSLoadBitmap(int ID, const char* name);
+  virtual bool OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource);
+#ifdef IPLUG_SVG_SUPPORT
+  virtual bool OSLoadSVG(int ID, const char* name, WDL_String* pSVG);
+#endif
   
 private:
 #ifndef IPLUG_NO_CARBON_SUPPORT
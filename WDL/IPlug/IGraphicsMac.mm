@@ -1,11 +1,15 @@
 #include <Foundation/NSArchiver.h>
 #include "IGraphicsMac.h"
 #include "IControl.h"
+#include "IBitmapLoader.h"
 #include "Log.h"
 #import "IGraphicsCocoa.h"
 #ifndef IPLUG_NO_CARBON_SUPPORT
   #include "IGraphicsCarbon.h"
 #endif
+#ifdef IPLUG_SVG_SUPPORT
+  #include "ISVGCache.h"
+#endif
 #include "../swell/swell-internal.h"
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -146,6 +150,66 @@ LICE_IBitmap* IGraphicsMac::OSLoadBitmap(int ID, const char* name)
   return LoadImgFromResourceOSX(GetBundleID(), name);
 }
 
+bool IGraphicsMac::OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource)
+{
+  if (!name) return false;
+  CocoaAutoReleasePool pool;
+
+  const char* ext = name+strlen(name)-1;
+  while (ext >= name && *ext != '.') --ext;
+  ++ext;
+
+  bool ispng = !stricmp(ext, "png");
+  #ifndef IPLUG_JPEG_SUPPORT
+  if (!ispng) return false;
+  #else
+  bool isjpg = !stricmp(ext, "jpg");
+  if (!isjpg && !ispng) return false;
+  #endif
+
+  NSBundle* pBundle = [NSBundle bundleWithIdentifier:ToNSString(GetBundleID())];
+  NSString* pFile = [[[NSString stringWithCString:name] lastPathComponent] stringByDeletingPathExtension];
+  if (pBundle && pFile)
+  {
+    NSString* pPath = [pBundle pathForResource:pFile ofType:(ispng ? @"png" : @"jpg")];
+    if (pPath)
+    {
+      const char* resourceFileName = [pPath cString];
+      if (CSTR_NOT_EMPTY(resourceFileName))
+      {
+        pSource->mPath.Set(resourceFileName);
+        pSource->mJPEG = !ispng;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+#ifdef IPLUG_SVG_SUPPORT
+bool IGraphicsMac::OSLoadSVG(int ID, const char* name, WDL_String* pSVG)
+{
+  if (!name) return false;
+  CocoaAutoReleasePool pool;
+
+  NSBundle* pBundle = [NSBundle bundleWithIdentifier:ToNSString(GetBundleID())];
+  NSString* pFile = [[[NSString stringWithCString:name] lastPathComponent] stringByDeletingPathExtension];
+  if (pBundle && pFile)
+  {
+    NSString* pPath = [pBundle pathForResource:pFile ofType:@"svg"];
+    if (pPath)
+    {
+      const char* resourceFileName = [pPath cString];
+      if (CSTR_NOT_EMPTY(resourceFileName))
+      {
+        return ISVGCache::ReadFile(resourceFileName, pSVG);
+      }
+    }
+  }
+  return false;
+}
+#endif
+
 bool IGraphicsMac::DrawScreen(IRECT* pR)
 {
   CGContextRef pCGC = 0;
@@ -197,7 +261,7 @@ bool IGraphicsMac::DrawScreen(IRECT* pR)
   CGImageRef img=NULL;
   
 #ifdef IGRAPHICS_MAC_OLD_IMAGE_DRAWING
-  HDC__ * srcCtx = (HDC__*) mDrawBitmap->getDC();
+  HDC__ * srcCtx = (HDC__*) ((LICE_SysBitmap*) mDrawBitmap)->getDC();
   img = CGBitmapContextCreateImage(srcCtx->ctx);
 #else
   const unsigned char *p = (const unsigned char *)mDrawBitmap->getBits();
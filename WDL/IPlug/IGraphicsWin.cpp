@@ -1,9 +1,11 @@
 #include "IGraphicsWin.h"
 #include "IControl.h"
+#include "IBitmapLoader.h"
 #include "Log.h"
 #include <wininet.h>
 #include <Shlobj.h>
 #include <commctrl.h>
+#include <dwmapi.h>
 
 #ifdef RTAS_API
   #include "PlugInUtils.h"
@@ -56,6 +58,7 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
     SetWindowLongPtr(hWnd, GWLP_USERDATA, (LPARAM) (lpcs->lpCreateParams));
     int mSec = int(1000.0 / sFPS);
     SetTimer(hWnd, IPLUG_TIMER_ID, mSec, NULL);
+    ((IGraphicsWin*) lpcs->lpCreateParams)->mTimerInterval = mSec;
     SetFocus(hWnd); // gets scroll wheel working straight away
     return 0;
   }
@@ -135,8 +138,13 @@ LRESULT CALLBACK IGraphicsWin::WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARA
           return 0; // TODO: check this!
         }
 
+        pGraphics->UpdateRedrawScheduler();
+
         IRECT dirtyR;
-        if (pGraphics->IsDirty(&dirtyR))
+        bool dirty = pGraphics->IsDirtyScheduled(&dirtyR);
+        pGraphics->RescheduleTimer();
+
+        if (dirty)
         {
           RECT r = { dirtyR.L, dirtyR.T, dirtyR.R, dirtyR.B };
 
@@ -488,11 +496,14 @@ IGraphicsWin::IGraphicsWin(IPlugBase* pPlug, int w, int h, int refreshFPS)
     mPID(0), mParentWnd(0), mMainWnd(0), mCustomColorStorage(0),
     mEdControl(0), mEdParam(0), mDefEditProc(0), mParamEditMsg(kNone),
     mTooltipWnd(0), mShowingTooltip(false), mTooltipIdx(-1),
-    mHInstance(0)
-{}
+    mHInstance(0), mTimerInterval(0)
+{
+  mRedrawScheduler.SetWakeCallback(WakeTimer, this);
+}
 
 IGraphicsWin::~IGraphicsWin()
 {
+  mRedrawScheduler.SetWakeCallback(0, 0);
   CloseWindow();
   FREE_NULL(mCustomColorStorage);
 }
@@ -511,6 +522,47 @@ LICE_IBitmap* IGraphicsWin::OSLoadBitmap(int ID, const char* name)
   return 0;
 }
 
+// Resources stay mapped for the life of the module, so the decoders read them in place.
+bool IGraphicsWin::OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource)
+{
+  const char* ext = name+strlen(name)-1;
+  while (ext > name && *ext != '.') --ext;
+  ++ext;
+
+  const char* type = 0;
+  if (!stricmp(ext, "png")) type = "PNG";
+  #ifdef IPLUG_JPEG_SUPPORT
+  if (!stricmp(ext, "jpg") || !stricmp(ext, "jpeg")) type = "JPG";
+  #endif
+  if (!type) return false;
+
+  HRSRC hResource = FindResource(mHInstance, MAKEINTRESOURCE(ID), type);
+  if (!hResource) return false;
+  DWORD size = SizeofResource(mHInstance, hResource);
+  HGLOBAL res = LoadResource(mHInstance, hResource);
+  const void* pData = LockResource(res);
+  if (!pData || !size) return false;
+  pSource->mData = pData;
+  pSource->mSize = (int) size;
+  pSource->mJPEG = (type[0] == 'J');
+  return true;
+}
+
+#ifdef IPLUG_SVG_SUPPORT
+// The .rc file declares them as: MY_SVG_ID SVG "file.svg"
+bool IGraphicsWin::OSLoadSVG(int ID, const char* name, WDL_String* pSVG)
+{
+  HRSRC hResource = FindResource(mHInstance, MAKEINTRESOURCE(ID), "SVG");
+  if (!hResource) return false;
+  DWORD size = SizeofResource(mHInstance, hResource);
+  HGLOBAL res = LoadResource(mHInstance, hResource);
+  const char* pData = (const char*) LockResource(res);
+  if (!pData || !size) return false;
+  pSVG->Set(pData, size);
+  return true;
+}
+#endif
+
 void GetWindowSize(HWND pWnd, int* pW, int* pH)
 {
   if (pWnd)
@@ -625,7 +677,7 @@ bool IGraphicsWin::DrawScreen(IRECT* pR)
   PAINTSTRUCT ps;
   HWND hWnd = (HWND) GetWindow();
   HDC dc = BeginPaint(hWnd, &ps);
-  BitBlt(dc, pR->L, pR->T, pR->W(), pR->H(), mDrawBitmap->getDC(), pR->L, pR->T, SRCCOPY);
+  BitBlt(dc, pR->L, pR->T, pR->W(), pR->H(), ((LICE_SysBitmap*) mDrawBitmap)->getDC(), pR->L, pR->T, SRCCOPY);
   EndPaint(hWnd, &ps);
   return true;
 }
@@ -763,6 +815,71 @@ void IGraphicsWin::SetWindowTitle(char* str)
   SetWindowText(mPlugWnd, str);
 }
 
+typedef HRESULT (WINAPI *DwmGetCompositionTimingInfoProc)(HWND, DWM_TIMING_INFO*);
+
+// Feeds the redraw scheduler with occlusion state and, if DWM is running, the display refresh timing.
+void IGraphicsWin::UpdateRedrawScheduler()
+{
+  HWND rootWnd = GetAncestor(mPlugWnd, GA_ROOT);
+  mRedrawScheduler.SetOccluded(!IsWindowVisible(mPlugWnd) || (rootWnd && IsIconic(rootWnd)));
+
+  if (mRedrawScheduler.IsOccluded() || !mRedrawScheduler.VBlankPacingEnabled()) return;
+
+  static DwmGetCompositionTimingInfoProc sGetTimingInfo = 0;
+  static bool sDwmChecked = false;
+  if (!sDwmChecked)
+  {
+    HMODULE hDwm = LoadLibrary("dwmapi.dll");
+    if (hDwm) sGetTimingInfo = (DwmGetCompositionTimingInfoProc) GetProcAddress(hDwm, "DwmGetCompositionTimingInfo");
+    sDwmChecked = true;
+  }
+
+  DWM_TIMING_INFO ti;
+  memset(&ti, 0, sizeof(ti));
+  ti.cbSize = sizeof(ti);
+  if (sGetTimingInfo && SUCCEEDED(sGetTimingInfo(0, &ti)) && ti.qpcRefreshPeriod)
+  {
+    // DWM times are in QueryPerformanceCounter units, same as IRedrawScheduler::GetTimeMs().
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    double msPerCount = 1000.0 / (double) freq.QuadPart;
+    mRedrawScheduler.SetDisplayTiming((double) ti.qpcRefreshPeriod * msPerCount, (double) ti.qpcVBlank * msPerCount);
+  }
+  else
+  {
+    mRedrawScheduler.SetDisplayTiming(0.0);
+  }
+}
+
+void IGraphicsWin::RescheduleTimer()
+{
+  int mSec;
+  if (mRedrawScheduler.VBlankPacing() && !mRedrawScheduler.IsThrottled())
+  {
+    mSec = mRedrawScheduler.GetIntervalFrom(IRedrawScheduler::GetTimeMs());
+  }
+  else
+  {
+    mSec = mRedrawScheduler.GetInterval();
+  }
+
+  if (mSec != mTimerInterval && mPlugWnd)
+  {
+    SetTimer(mPlugWnd, IPLUG_TIMER_ID, mSec, NULL);
+    mTimerInterval = mSec;
+  }
+}
+
+// static, may be called from any thread.
+void IGraphicsWin::WakeTimer(void* pGraphicsWin)
+{
+  HWND hWnd = ((IGraphicsWin*) pGraphicsWin)->mPlugWnd;
+  if (hWnd)
+  {
+    PostMessage(hWnd, WM_TIMER, IPLUG_TIMER_ID, 0);
+  }
+}
+
 void IGraphicsWin::CloseWindow()
 {
   if (mPlugWnd)
@@ -62,11 +62,18 @@ public:
   bool GetTextFromClipboard(WDL_String* pStr);
 protected:
   LICE_IBitmap* OSLoadBitmap(int ID, const char* name);
+  bool OSGetBitmapSource(int ID, const char* name, IBitmapSource* pSource);
+#ifdef IPLUG_SVG_SUPPORT
+  bool OSLoadSVG(int ID, const char* name, WDL_String* pSVG);
+#endif
 
   void SetTooltip(const char* tooltip);
   void ShowTooltip();
   void HideTooltip();
 
+  void UpdateRedrawScheduler();
+  void RescheduleTimer();
+
 private:
   HINSTANCE mHInstance;
   HWND mPlugWnd, mParamEditWnd, mTooltipWnd;
@@ -78,6 +85,7 @@ private:
   bool mShowingTooltip;
   int mTooltipIdx;
   COLORREF* mCustomColorStorage;
+  int mTimerInterval;
 
   DWORD mPID;
   HWND mParentWnd, mMainWnd;
@@ -87,6 +95,7 @@ public:
   static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
   static LRESULT CALLBACK ParamEditProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
   static BOOL CALLBACK FindMainWindow(HWND hWnd, LPARAM lParam);
+  static void WakeTimer(void* pGraphicsWin);
 };
 
 ////////////////////////////////////////
@@ -76,11 +76,32 @@ void MyPlug::ProcessDoubleReplacing(double** inputs, double** outputs, int nFram
 */
 
 
+#include "../rtalloc.h"
+
 class IMidiQueue
 {
 public:
-  IMidiQueue(int size = DEFAULT_BLOCK_SIZE): mBuf(NULL), mSize(0), mGrow(Granulize(size)), mFront(0), mBack(0) { Expand(); }
-  ~IMidiQueue() { free(mBuf); }
+  IMidiQueue(int size = DEFAULT_BLOCK_SIZE): mBuf(NULL), mAllocator(NULL), mSize(0), mGrow(Granulize(size)), mFront(0), mBack(0) { Expand(); }
+  ~IMidiQueue() { FreeBuf(mAllocator, mBuf); }
+
+  // Takes the queue's memory from pAllocator (NULL for malloc()), e.g. a WDL_RTPool so
+  // that Add() can grow the queue on the audio thread. Returns false if the queued
+  // messages didn't fit, the queue stays where it was.
+  bool SetAllocator(WDL_Allocator* pAllocator)
+  {
+    if (pAllocator == mAllocator) return true;
+    void* buf = NULL;
+    if (mSize)
+    {
+      buf = pAllocator ? pAllocator->Alloc(mSize * sizeof(IMidiMsg)) : malloc(mSize * sizeof(IMidiMsg));
+      if (!buf) return false;
+      memcpy(buf, mBuf, mSize * sizeof(IMidiMsg));
+    }
+    FreeBuf(mAllocator, mBuf);
+    mBuf = (IMidiMsg*)buf;
+    mAllocator = pAllocator;
+    return true;
+  }
 
   // Adds a MIDI message add the back of the queue. If the queue is full,
   // it will automatically expand itself.
@@ -151,7 +172,7 @@ public:
     if (size < mBack) size = Granulize(mBack);
     if (size == mSize) return mSize;
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
+    void* buf = ReallocBuf(size);
     if (!buf) return mSize;
 
     mBuf = (IMidiMsg*)buf;
@@ -166,7 +187,7 @@ protected:
     if (!mGrow) return false;
     int size = (mSize / mGrow + 1) * mGrow;
 
-    void* buf = realloc(mBuf, size * sizeof(IMidiMsg));
+    void* buf = ReallocBuf(size);
     if (!buf) return false;
 
     mBuf = (IMidiMsg*)buf;
@@ -191,7 +212,21 @@ protected:
     return size;
   }
 
+  void* ReallocBuf(int size)
+  {
+    if (mAllocator) return mAllocator->Realloc(mBuf, size * sizeof(IMidiMsg), mSize * sizeof(IMidiMsg));
+    WDL_RT_CHECK_ALLOC("IMidiQueue realloc", size * sizeof(IMidiMsg))
+    return realloc(mBuf, size * sizeof(IMidiMsg));
+  }
+
+  static void FreeBuf(WDL_Allocator* pAllocator, void* buf)
+  {
+    if (pAllocator) pAllocator->Free(buf);
+    else free(buf);
+  }
+
   IMidiMsg* mBuf;
+  WDL_Allocator* mAllocator;
 
   int mSize, mGrow;
   int mFront, mBack;
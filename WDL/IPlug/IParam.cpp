@@ -1,13 +1,18 @@
 #include "IParam.h"
+#include "../hashmap.h"
 #include <stdio.h>
 
 IParam::IParam()
   : mType(kTypeNone)
+  , mID(0)
   , mValue(0.0)
   , mMin(0.0)
   , mMax(1.0)
   , mStep(1.0)
   , mDisplayPrecision(0)
+  , mChangedFlag(0)
+  , mIDMap(0)
+  , mIdx(0)
   , mNegateDisplay(false)
   , mShape(1.0)
   , mCanAutomate(true)
@@ -21,6 +26,16 @@ IParam::IParam()
 
 IParam::~IParam() {}
 
+void IParam::SetID(int id)
+{
+  if (mIDMap)
+  {
+    if (mIDMap->Get(mID, -1) == mIdx) mIDMap->Delete(mID);
+    if (id != mIdx && !mIDMap->Exists(id)) mIDMap->Insert(id, mIdx);
+  }
+  mID = id;
+}
+
 void IParam::InitBool(const char* name, bool defaultVal, const char* label, const char* group)
 {
   if (mType == kTypeNone) mType = kTypeBool;
@@ -53,6 +68,7 @@ void IParam::InitDouble(const char* name, double defaultVal, double minVal, doub
   strcpy(mLabel, label);
   strcpy(mParamGroup, group);
   mValue = defaultVal;
+  Changed();
   mMin = minVal;
   mMax = IPMAX(maxVal, minVal + step);
   mStep = step;
@@ -98,6 +114,7 @@ void IParam::SetNormalized(double normalizedValue)
   }
   
   mValue = IPMIN(mValue, mMax);
+  Changed();
 }
 
 double IParam::GetNormalized()
@@ -4,6 +4,8 @@
 #include "Containers.h"
 #include <math.h>
 
+template <class VAL> class WDL_IntHashMap;
+
 #define MAX_PARAM_NAME_LEN 32 // e.g. "Gain"
 #define MAX_PARAM_LABEL_LEN 32 // e.g. "Percent"
 #define MAX_PARAM_DISPLAY_LEN 32 // e.g. "100" / "Mute"
@@ -34,13 +36,23 @@ public:
   void InitInt(const char* name, int defaultVal, int minVal, int maxVal, const char* label = "", const char* group = "");
   void InitDouble(const char* name, double defaultVal, double minVal, double maxVal, double step, const char* label = "", const char* group = "", double shape = 1.);
 
-  void Set(double value) { mValue = BOUNDED(value, mMin, mMax); }
+  void Set(double value) { mValue = BOUNDED(value, mMin, mMax); Changed(); }
   void SetDisplayText(int value, const char* text);
   void SetCanAutomate(bool canAutomate) { mCanAutomate = canAutomate; }
   // The higher the shape, the more resolution around host value zero.
   void SetShape(double shape);
   void SetIsMeta(bool meta) { mIsMeta = meta; }
-  void SetToDefault() { mValue = mDefault; }
+  // The ID stored with the param's value in state chunks, defaults to the param's index.
+  // If you reorder, insert or remove params between versions, set IDs (0 to 0x3fffffff, unique) in the plugin constructor
+  // so that saved states still reach the right params.
+  void SetID(int id);
+  int GetID() const { return mID; }
+  // Defaults are part of compact state chunks, see IPlugBase::SetCompactParamsChunk().
+  void SetToDefault() { mValue = mDefault; Changed(); }
+  // Set to 1 whenever the value changes, IPlugBase uses it to know when its hash of the values is stale.
+  void SetChangedFlag(volatile int* pFlag) { mChangedFlag = pFlag; }
+  // IPlugBase's ID -> index map, kept up to date by SetID() for IDs that aren't the param's index.
+  void SetIDMap(WDL_IntHashMap<int>* pMap, int idx) { mIDMap = pMap; mIdx = idx; }
 
   // Call this if your param is (x, y) but you want to always display (-x, -y).
   void NegateDisplay() { mNegateDisplay = true; }
@@ -85,11 +97,17 @@ public:
   bool GetIsMeta() { return mIsMeta; }
 
 private:
+  void Changed() { if (mChangedFlag) *mChangedFlag = 1; }
+
   // All we store is the readable values.
   // SetFromHost() and GetForHost() handle conversion from/to (0,1).
   EParamType mType;
+  int mID;
   double mValue, mMin, mMax, mStep, mShape, mDefault;
   int mDisplayPrecision;
+  volatile int* mChangedFlag;
+  WDL_IntHashMap<int>* mIDMap;
+  int mIdx;
   char mName[MAX_PARAM_NAME_LEN];
   char mLabel[MAX_PARAM_LABEL_LEN];
   char mParamGroup[MAX_PARAM_LABEL_LEN];
@@ -267,6 +267,7 @@ AAX_Result IPlugAAX::UpdateParameterNormalizedValue(AAX_CParamID iParameterID, d
       GetGUI()->SetParameterFromPlug(paramIdx, iValue, true);
     }
     
+    ITRACE_PARAM(this, paramIdx, GetParam(paramIdx)->GetNormalized());
     OnParamChange(paramIdx);      
   }
   
@@ -298,6 +299,7 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* ioRenderInfo)
     AAX_CMidiStream* midiBuffer = midiIn->GetNodeBuffer();
     AAX_CMidiPacket* midiBufferPtr = midiBuffer->mBuffer;
     uint32_t packets_count = midiBuffer->mBufferSize;
+    WDL_RTScope rt;
     
     // Setup MIDI Out node pointers 
 //		AAX_IMIDINode* midiNodeOut = instance->mMIDINodeOutP;
@@ -307,6 +309,7 @@ void IPlugAAX::RenderAudio(AAX_SIPlugRenderInfo* ioRenderInfo)
     for (int i = 0; i<packets_count; i++, midiBufferPtr++) 
     {
       IMidiMsg msg(midiBufferPtr->mTimestamp, midiBufferPtr->mData[0], midiBufferPtr->mData[1], midiBufferPtr->mData[2]);
+      ITRACE_MIDI(this, &msg);
       ProcessMidiMsg(&msg);
     }
   }
@@ -438,7 +441,7 @@ AAX_Result IPlugAAX::CompareActiveChunk(const AAX_SPlugInChunk * aChunkP, AAX_CB
 		return AAX_SUCCESS; 
 	}
   
-	*aIsEqualP = _this->CompareState((const unsigned char*) aChunkP->fData, 0);
+	*aIsEqualP = _this->CompareStateSized((const unsigned char*) aChunkP->fData, 0, aChunkP->fSize);
     
   return AAX_SUCCESS;
 }  
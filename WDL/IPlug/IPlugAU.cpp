@@ -1332,10 +1332,10 @@ inline void PutStrInDict(CFMutableDictionaryRef pDict, const char* key, const ch
   CFDictionarySetValue(pDict, cfKey.mCFStr, cfValue.mCFStr);
 }
 
-inline void PutDataInDict(CFMutableDictionaryRef pDict, const char* key, ByteChunk* pChunk)
+// Releases pData.
+inline void PutDataInDict(CFMutableDictionaryRef pDict, const char* key, CFDataRef pData)
 {
   CFStrLocal cfKey(key);
-  CFDataRef pData = CFDataCreate(0, pChunk->GetBytes(), pChunk->Size());
   CFDictionarySetValue(pDict, cfKey.mCFStr, pData);
   CFRelease(pData);
 }
@@ -1372,9 +1372,8 @@ inline bool GetDataFromDict(CFDictionaryRef pDict, const char* key, ByteChunk* p
   CFDataRef pData = (CFDataRef) CFDictionaryGetValue(pDict, cfKey.mCFStr);
   if (pData)
   {
-    CFIndex n = CFDataGetLength(pData);
-    pChunk->Resize((int) n);
-    memcpy(pChunk->GetBytes(), CFDataGetBytePtr(pData), n);
+    // pDict holds on to pData for as long as the caller needs pChunk.
+    pChunk->SetView(CFDataGetBytePtr(pData), (int) CFDataGetLength(pData));
     return true;
   }
   return false;
@@ -1407,12 +1406,31 @@ OSStatus IPlugAU::GetState(CFPropertyListRef* ppPropList)
   PutNumberInDict(pDict, kAUPresetManufacturerKey, &(cd.componentManufacturer), kCFNumberSInt32Type);
   PutStrInDict(pDict, kAUPresetNameKey, GetPresetName(GetCurrentPresetIdx()));
 
+  // Build the state in a malloc'd arena that the CFData can adopt as is. If the state outgrows
+  // the arena (sized from the last save) it's copied once instead.
+  int arenaSize = mStateSizeHint;
+  void* pArena = malloc(arenaSize);
   ByteChunk chunk;
+  if (pArena)
+  {
+    chunk.SetArena(pArena, arenaSize);
+  }
 
   if (SerializeState(&chunk))
   {
-    PutDataInDict(pDict, kAUPresetDataKey, &chunk);
+    CFDataRef pData = 0;
+    if (chunk.IsExternal() && (pData = CFDataCreateWithBytesNoCopy(0, (const UInt8*) pArena, chunk.Size(), kCFAllocatorMalloc)))
+    {
+      pArena = 0;
+    }
+    else
+    {
+      pData = CFDataCreate(0, chunk.GetBytes(), chunk.Size());
+    }
+    PutDataInDict(pDict, kAUPresetDataKey, pData);
   }
+  mStateSizeHint = IPMAX(chunk.PeakSize() + chunk.PeakSize() / 8, 4096);
+  free(pArena);
 
   *ppPropList = pDict;
   TRACE;
@@ -1539,6 +1557,7 @@ OSStatus IPlugAU::SetParamProc(void* pPlug, AudioUnitParameterID paramID, AudioU
   {
     _this->GetGUI()->SetParameterFromPlug(paramID, value, false);
   }
+  ITRACE_PARAM(_this, paramID, pParam->GetNormalized());
   _this->OnParamChange(paramID);
   return noErr;
 }
@@ -1560,7 +1579,7 @@ inline OSStatus RenderCallback(AURenderCallbackStruct* pCB, AudioUnitRenderActio
 OSStatus IPlugAU::RenderProc(void* pPlug, AudioUnitRenderActionFlags* pFlags, const AudioTimeStamp* pTimestamp,
                                     UInt32 outputBusIdx, UInt32 nFrames, AudioBufferList* pOutBufList)
 {
-  TRACE_PROCESS(TRACELOC, "%d:%d:%d", outputBusIdx, pOutBufList->mNumberBuffers, nFrames);
+  TRACE_PROCESS;
 
   IPlugAU* _this = (IPlugAU*) pPlug;
 
@@ -1797,6 +1816,7 @@ IPlugAU::IPlugAU(IPlugInstanceInfo instanceInfo,
   , mRenderTimestamp(-1.0)
   , mTempo(DEFAULT_TEMPO)
   , mActive(false)
+  , mStateSizeHint(4096)
 {
   Trace(TRACELOC, "%s", effectName);
 
@@ -2467,11 +2487,13 @@ OSStatus IPlugAU::DoMIDIEvent(IPlugAU *_this, UInt32 inStatus, UInt32 inData1, U
     IPlugBase::IMutexLock lock(_this);
 #endif
     
+    WDL_RTScope rt;
     IMidiMsg msg;
     msg.mStatus = inStatus;
     msg.mData1 = inData1;
     msg.mData2 = inData2;
     msg.mOffset = inOffsetSampleFrame;
+    ITRACE_MIDI(_this, &msg);
     _this->ProcessMidiMsg(&msg);
     return noErr;
   }
@@ -2488,6 +2510,7 @@ OSStatus IPlugAU::DoSysEx(IPlugAU *_this, const UInt8 *inData, UInt32 inLength)
     IPlugBase::IMutexLock lock(_this);
 #endif
     
+    WDL_RTScope rt;
     ISysEx sysex;
     sysex.mData = inData;
     sysex.mSize = inLength;
@@ -106,6 +106,7 @@ private:
   bool mActive, mIsOffline;
   double mRenderTimestamp, mTempo;
   HostCallbackInfo mHostCallbacks;
+  int mStateSizeHint; // Arena size for the next GetState(), from the last one.
 
 // InScratchBuf is only needed if the upstream connection is a callback.
 // OutScratchBuf is only needed if the downstream connection fails to give us a buffer.
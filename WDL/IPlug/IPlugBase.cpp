@@ -1,11 +1,13 @@
 #include "IPlugBase.h"
 #include "IGraphics.h"
 #include "IControl.h"
+#include "IPresetBank.h"
 #include <math.h>
 #include <stdio.h>
 #include <time.h>
 #include "../wdlendian.h"
 #include "../base64encdec.h"
+#include "../wdlatomic.h"
 
 #ifndef VstInt32
   #ifdef WIN32
@@ -82,19 +84,32 @@ IPlugBase::IPlugBase(int nParams,
   , mAPI(plugAPI)
   , mIsBypassed(false)
   , mDelay(0)
+  , mRTPool(0)
   , mTailSize(0)
+  , mParamsSeq(0)
+  , mParamsChanged(1)
+  , mParamsHash(0)
+  , mCompactParamsChunk(false)
+  , mCompareStateSize(-1)
+  , mPresetBank(0)
 {
   Trace(TRACELOC, "%s:%s", effectName, CurrentTime());
 
   for (int i = 0; i < nParams; ++i)
   {
-    mParams.Add(new IParam);
+    IParam* pParam = new IParam;
+    pParam->SetID(i);
+    pParam->SetIDMap(&mParamIdxByID, i);
+    pParam->SetChangedFlag(&mParamsChanged);
+    mParams.Add(pParam);
   }
+  mParamScratch.Resize(nParams);
 
   for (int i = 0; i < nPresets; ++i)
   {
     mPresets.Add(new IPreset(i));
   }
+  RebuildPresetIndex();
 
   strcpy(mEffectName, effectName);
   strcpy(mProductName, productName);
@@ -145,6 +160,13 @@ IPlugBase::IPlugBase(int nParams,
     pOutChannel->mFDest = 0;
     mOutChannels.Add(pOutChannel);
   }
+
+#ifdef IPLUG_TRACE
+  char traceName[MAX_EFFECT_NAME_LEN + 32];
+  sprintf(traceName, "%s %p", mEffectName, (void*) this);
+  ITracer::Get()->Start();
+  ITracer::Get()->SetInstanceName(this, traceName);
+#endif
 }
 
 IPlugBase::~IPlugBase()
@@ -153,6 +175,7 @@ IPlugBase::~IPlugBase()
   DELETE_NULL(mGraphics);
   mParams.Empty(true);
   mPresets.Empty(true);
+  DELETE_NULL(mPresetBank);
   mInChannels.Empty(true);
   mOutChannels.Empty(true);
   mChannelIO.Empty(true);
@@ -163,6 +186,17 @@ IPlugBase::~IPlugBase()
   {
     DELETE_NULL(mDelay);
   }
+  DELETE_NULL(mRTPool);
+
+#ifdef IPLUG_TRACE
+  ITracer::Get()->Stop();
+#endif
+}
+
+WDL_RTPool* IPlugBase::CreateRTPool(int bytes)
+{
+  if (!mRTPool) mRTPool = new WDL_RTPool(bytes);
+  return mRTPool;
 }
 
 int IPlugBase::GetHostVersion(bool decimal)
@@ -271,6 +305,7 @@ const char* IPlugBase::GetAPIString()
     case kAPIRTAS: return "RTAS";
     case kAPIAAX: return "AAX";
     case kAPISA: return "Standalone";
+    case kAPIHeadless: return "Headless";
     default: return "";
   }
 }
@@ -425,6 +460,9 @@ void IPlugBase::AttachOutputBuffers(int idx, int n, float** ppData)
 
 void IPlugBase::PassThroughBuffers(double sampleType, int nFrames)
 {
+  WDL_RTScope rt;
+  ITRACE_PROCESS(this, nFrames);
+  IDSPLoadScope dspLoad(&mDSPLoad, nFrames, mSampleRate);
   if (mLatency && mDelay) 
   {
     mDelay->ProcessBlock(mInData.Get(), mOutData.Get(), nFrames);
@@ -455,11 +493,17 @@ void IPlugBase::PassThroughBuffers(float sampleType, int nFrames)
 
 void IPlugBase::ProcessBuffers(double sampleType, int nFrames)
 {
+  WDL_RTScope rt;
+  ITRACE_PROCESS(this, nFrames);
+  IDSPLoadScope dspLoad(&mDSPLoad, nFrames, mSampleRate);
   ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
 }
 
 void IPlugBase::ProcessBuffers(float sampleType, int nFrames)
 {
+  WDL_RTScope rt;
+  ITRACE_PROCESS(this, nFrames);
+  IDSPLoadScope dspLoad(&mDSPLoad, nFrames, mSampleRate);
   ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
   int i, n = NOutChannels();
   OutChannel** ppOutChannel = mOutChannels.GetList();
@@ -477,6 +521,9 @@ void IPlugBase::ProcessBuffers(float sampleType, int nFrames)
 
 void IPlugBase::ProcessBuffersAccumulating(float sampleType, int nFrames)
 {
+  WDL_RTScope rt;
+  ITRACE_PROCESS(this, nFrames);
+  IDSPLoadScope dspLoad(&mDSPLoad, nFrames, mSampleRate);
   ProcessDoubleReplacing(mInData.Get(), mOutData.Get(), nFrames);
   int i, n = NOutChannels();
   OutChannel** ppOutChannel = mOutChannels.GetList();
@@ -532,6 +579,7 @@ void IPlugBase::SetParameterFromGUI(int idx, double normalizedValue)
   WDL_MutexLock lock(&mMutex);
   GetParam(idx)->SetNormalized(normalizedValue);
   InformHostOfParamChange(idx, normalizedValue);
+  ITRACE_PARAM(this, idx, normalizedValue);
   OnParamChange(idx);
 }
 
@@ -593,7 +641,7 @@ void IPlugBase::MakeDefaultPreset(char* name, int nPresets)
     if (pPreset)
     {
       pPreset->mInitialized = true;
-      strcpy(pPreset->mName, (name ? name : "Empty"));
+      SetPresetName(pPreset, (name ? name : "Empty"));
       SerializeState(&(pPreset->mChunk));
     }
   }
@@ -623,18 +671,20 @@ void IPlugBase::MakePreset(char* name, ...)
   if (pPreset)
   {
     pPreset->mInitialized = true;
-    strcpy(pPreset->mName, name);
+    SetPresetName(pPreset, name);
 
     int i, n = mParams.GetSize();
 
-    double v = 0.0;
+    WDL_TypedBuf<double> vals;
+    double* pV = vals.Resize(n);
     va_list vp;
     va_start(vp, name);
     for (i = 0; i < n; ++i)
     {
-      GET_PARAM_FROM_VARARG(GetParam(i)->Type(), vp, v);
-      pPreset->mChunk.Put(&v);
+      GET_PARAM_FROM_VARARG(GetParam(i)->Type(), vp, pV[i]);
     }
+    va_end(vp);
+    SerializeParamValues(&(pPreset->mChunk), pV);
   }
 }
 
@@ -647,7 +697,7 @@ void IPlugBase::MakePresetFromNamedParams(char* name, int nParamsNamed, ...)
   if (pPreset)
   {
     pPreset->mInitialized = true;
-    strcpy(pPreset->mName, name);
+    SetPresetName(pPreset, name);
 
     int i = 0, n = mParams.GetSize();
 
@@ -678,8 +728,8 @@ void IPlugBase::MakePresetFromNamedParams(char* name, int nParamsNamed, ...)
       {
         *pV = GetParam(i)->Value();
       }
-      pPreset->mChunk.Put(pV);
     }
+    SerializeParamValues(&(pPreset->mChunk), vals.Get());
   }
 }
 
@@ -689,7 +739,7 @@ void IPlugBase::MakePresetFromChunk(char* name, ByteChunk* pChunk)
   if (pPreset)
   {
     pPreset->mInitialized = true;
-    strcpy(pPreset->mName, name);
+    SetPresetName(pPreset, name);
 
     pPreset->mChunk.PutChunk(pChunk);
   }
@@ -743,6 +793,7 @@ void IPlugBase::PruneUninitializedPresets()
       mPresets.Delete(i, true);
     }
   }
+  RebuildPresetIndex();
 }
 
 bool IPlugBase::RestorePreset(int idx)
@@ -755,8 +806,10 @@ bool IPlugBase::RestorePreset(int idx)
 
     if (!(pPreset->mInitialized))
     {
+      char name[MAX_PRESET_NAME_LEN];
       pPreset->mInitialized = true;
-      MakeDefaultUserPresetName(&mPresets, pPreset->mName);
+      MakeDefaultUserPresetName(&mPresets, name);
+      SetPresetName(pPreset, name);
       restoredOK = SerializeState(&(pPreset->mChunk));
     }
     else
@@ -778,19 +831,141 @@ bool IPlugBase::RestorePreset(const char* name)
 {
   if (CSTR_NOT_EMPTY(name))
   {
-    int n = mPresets.GetSize();
-    for (int i = 0; i < n; ++i)
+    int idx = FindPreset(name);
+    if (idx >= 0)
+    {
+      return RestorePreset(idx);
+    }
+    // The bank's own name table covers the presets past NPresets(). A hit below that is a preset
+    // that has been renamed since the bank was loaded.
+    if (mPresetBank && (idx = mPresetBank->Find(name)) >= mPresets.GetSize())
     {
-      IPreset* pPreset = mPresets.Get(i);
-      if (!strcmp(pPreset->mName, name))
+      return RestorePresetFromBank(idx);
+    }
+  }
+  return false;
+}
+
+// Every change to a preset's name goes through here, so FindPreset() is a lookup.
+void IPlugBase::SetPresetName(IPreset* pPreset, const char* name)
+{
+  int i, n = mPresets.GetSize(), idx = mPresets.Find(pPreset);
+  if (mPresetIdxByName.Get(pPreset->mName, -1) == idx)
+  {
+    // The next preset with the old name, if any, becomes the first one.
+    mPresetIdxByName.Delete(pPreset->mName);
+    for (i = idx + 1; i < n; ++i)
+    {
+      if (!strcmp(mPresets.Get(i)->mName, pPreset->mName))
       {
-        return RestorePreset(i);
+        mPresetIdxByName.Insert(pPreset->mName, i);
+        break;
       }
     }
   }
+  strncpy(pPreset->mName, name, MAX_PRESET_NAME_LEN - 1);
+  pPreset->mName[MAX_PRESET_NAME_LEN - 1] = '\0';
+  int first = mPresetIdxByName.Get(pPreset->mName, -1);
+  if (first < 0 || first > idx) mPresetIdxByName.Insert(pPreset->mName, idx);
+}
+
+// For changes to many presets at once.
+void IPlugBase::RebuildPresetIndex()
+{
+  mPresetIdxByName.DeleteAll();
+  for (int i = mPresets.GetSize() - 1; i >= 0; --i)
+  {
+    mPresetIdxByName.Insert(mPresets.Get(i)->mName, i); // The first preset should win.
+  }
+}
+
+bool IPlugBase::RestorePresetFromBank(int bankIdx)
+{
+  TRACE;
+  ByteChunk chunk;
+  if (!mPresetBank || !mPresetBank->GetState(bankIdx, &chunk) || !chunk.Size()) return false;
+  mPresetBank->Prefetch(bankIdx);
+  if (UnserializeState(&chunk, 0) > 0)
+  {
+    RedrawParamControls();
+    return true;
+  }
   return false;
 }
 
+// Gives every preset that still reads from mPresetBank its own copy, before the bank goes away.
+void IPlugBase::MaterializePresets()
+{
+  int n = mPresets.GetSize();
+  for (int i = 0; i < n; ++i)
+  {
+    ByteChunk* pChunk = &(mPresets.Get(i)->mChunk);
+    if (pChunk->IsExternal())
+    {
+      pChunk->Reserve(pChunk->Size() + 1); // Reserving past a view's end copies it into the chunk.
+    }
+  }
+}
+
+bool IPlugBase::SavePresetBank(const char* path)
+{
+  TRACE;
+  IPresetBankWriter writer;
+  int i, n = mPresets.GetSize();
+  for (i = 0; i < n; ++i)
+  {
+    IPreset* pPreset = mPresets.Get(i);
+    // Keep the tags of presets that came from the bank.
+    const char* tags = (mPresetBank && !strcmp(mPresetBank->GetName(i), pPreset->mName) ? mPresetBank->GetTags(i) : 0);
+    writer.Add(pPreset->mName, tags, pPreset->mChunk.GetBytes(), pPreset->mInitialized ? pPreset->mChunk.Size() : 0);
+  }
+  if (mPresetBank)
+  {
+    for (i = n; i < mPresetBank->NPresets(); ++i)
+    {
+      ByteChunk chunk;
+      mPresetBank->GetState(i, &chunk);
+      writer.Add(mPresetBank->GetName(i), mPresetBank->GetTags(i), chunk.GetBytes(), chunk.Size());
+    }
+  }
+  return writer.Write(path, GetUniqueID());
+}
+
+bool IPlugBase::LoadPresetBank(const char* path)
+{
+  TRACE;
+  IPresetBank* pBank = new IPresetBank;
+  if (!pBank->Open(path, GetUniqueID()))
+  {
+    delete pBank;
+    return false;
+  }
+
+  WDL_MutexLock lock(&mMutex);
+  MaterializePresets();
+  DELETE_NULL(mPresetBank);
+  mPresetBank = pBank;
+
+  int n = IPMIN(mPresets.GetSize(), pBank->NPresets());
+  for (int i = 0; i < n; ++i)
+  {
+    IPreset* pPreset = mPresets.Get(i);
+    strncpy(pPreset->mName, pBank->GetName(i), MAX_PRESET_NAME_LEN - 1);
+    pPreset->mName[MAX_PRESET_NAME_LEN - 1] = '\0';
+    pBank->GetState(i, &(pPreset->mChunk));
+    pPreset->mInitialized = (pPreset->mChunk.Size() > 0);
+    if (!pPreset->mInitialized)
+    {
+      pPreset->mChunk.Clear();
+    }
+  }
+  RebuildPresetIndex();
+  Trace(TRACELOC, "%d of %d presets", n, pBank->NPresets());
+
+  RestorePreset(mCurrentPresetIdx);
+  return true;
+}
+
 const char* IPlugBase::GetPresetName(int idx)
 {
   if (idx >= 0 && idx < mPresets.GetSize())
@@ -813,7 +988,7 @@ void IPlugBase::ModifyCurrentPreset(const char* name)
 
     if (CSTR_NOT_EMPTY(name))
     {
-      strcpy(pPreset->mName, name);
+      SetPresetName(pPreset, name);
     }
   }
 }
@@ -822,8 +997,15 @@ bool IPlugBase::SerializePresets(ByteChunk* pChunk)
 {
   TRACE;
   bool savedOK = true;
-  int n = mPresets.GetSize();
-  for (int i = 0; i < n && savedOK; ++i)
+  int i, n = mPresets.GetSize(), size = pChunk->Size();
+  for (i = 0; i < n; ++i)
+  {
+    IPreset* pPreset = mPresets.Get(i);
+    size += sizeof(int) + strlen(pPreset->mName) + 1 + pPreset->mChunk.Size();
+  }
+  pChunk->Reserve(size);
+
+  for (i = 0; i < n && savedOK; ++i)
   {
     IPreset* pPreset = mPresets.Get(i);
     pChunk->PutStr(pPreset->mName);
@@ -842,82 +1024,444 @@ bool IPlugBase::SerializePresets(ByteChunk* pChunk)
 int IPlugBase::UnserializePresets(ByteChunk* pChunk, int startPos)
 {
   TRACE;
-  WDL_String name;
+  const char* name;
+  int nameLen;
   int n = mPresets.GetSize(), pos = startPos;
   for (int i = 0; i < n && pos >= 0; ++i)
   {
     IPreset* pPreset = mPresets.Get(i);
-    pos = pChunk->GetStr(&name, pos);
-    strcpy(pPreset->mName, name.Get());
+    pos = pChunk->GetStr(&name, &nameLen, pos);
+    if (pos < 0) break;
+    nameLen = IPMIN(nameLen, MAX_PRESET_NAME_LEN - 1);
+    memcpy(pPreset->mName, name, nameLen);
+    pPreset->mName[nameLen] = '\0';
 
     Trace(TRACELOC, "%d %s", i, pPreset->mName);
 
     pos = pChunk->GetBool(&(pPreset->mInitialized), pos);
     if (pPreset->mInitialized)
     {
+      // UnserializeState() is the only way to find where the preset ends, keep its bytes as they are
+      // rather than serializing it all over again.
+      int statePos = pos;
       pos = UnserializeState(pChunk, pos);
       if (pos > 0)
       {
         pPreset->mChunk.Clear();
-        SerializeState(&(pPreset->mChunk));
+        pPreset->mChunk.PutBytes(pChunk->GetBytes() + statePos, pos - statePos);
       }
     }
   }
+  RebuildPresetIndex();
   RestorePreset(mCurrentPresetIdx);
   return pos;
 }
 
+// Compact params chunk, all little endian:
+//
+//   8  magic, a NaN when read as a double so it can't be the first value of a legacy chunk
+//   4  format version
+//   4  number of entries
+//   4  size of the entries in bytes
+//   8  hash of every param's ID and value as a float, in index order, see HashParamValues() and CompareState()
+//
+// followed by an entry for each param that isn't at its default value: a varint of (ID << 2 | kind), then
+// a zigzag varint for whole numbers (bools, enums, ints), a float if that is exact, otherwise a double.
+// Params that have no entry are set to their default, entries for unknown IDs are skipped. That makes the defaults
+// part of the format: they must not change between plugin versions, see SetCompactParamsChunk().
+
+#define PARAMS_CHUNK_MAGIC WDL_UINT64_CONST(0x7FF8324D52415049)
+#define PARAMS_CHUNK_VERSION 1
+#define PARAMS_CHUNK_HEADER_SIZE 28
+#define PARAMS_CHUNK_MAX_ENTRY_SIZE 13
+
+enum EParamEntryKind { kEntryInt = 0, kEntryFloat = 1, kEntryDouble = 2 };
+
+static inline void PutLE(unsigned char* p, WDL_UINT64 v, int size)
+{
+#ifdef WDL_LITTLE_ENDIAN
+  memcpy(p, &v, size);
+#else
+  for (int i = 0; i < size; ++i, v >>= 8) p[i] = (unsigned char) v;
+#endif
+}
+
+static WDL_UINT64 GetLE(const unsigned char* p, int size)
+{
+  WDL_UINT64 v = 0;
+  while (size--) v = (v << 8) | p[size];
+  return v;
+}
+
+static inline int PutVarInt(unsigned char* p, unsigned int v)
+{
+  if (v < 0x80)
+  {
+    *p = (unsigned char) v;
+    return 1;
+  }
+  int n = 0;
+  for (; v >= 0x80; v >>= 7) p[n++] = (unsigned char) (v | 0x80);
+  p[n++] = (unsigned char) v;
+  return n;
+}
+
+// Returns the number of bytes read, 0 if the varint is cut off.
+static int GetVarInt(const unsigned char* p, const unsigned char* pEnd, unsigned int* pV)
+{
+  unsigned int v = 0;
+  for (int n = 0; n < 5 && p + n < pEnd; ++n)
+  {
+    v |= (unsigned int) (p[n] & 0x7f) << (7 * n);
+    if (!(p[n] & 0x80))
+    {
+      *pV = v;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+// Returns 1 for a compact params chunk, 0 for a legacy one, -1 if it is damaged or from a newer IPlug.
+static int GetParamsChunkHeader(const unsigned char* pData, int size, int* pNEntries, int* pEntriesSize, WDL_UINT64* pHash)
+{
+  if (size < 8 || GetLE(pData, 8) != PARAMS_CHUNK_MAGIC) return 0;
+  if (size < PARAMS_CHUNK_HEADER_SIZE || GetLE(pData + 8, 4) != PARAMS_CHUNK_VERSION) return -1;
+  *pNEntries = (int) GetLE(pData + 12, 4);
+  *pEntriesSize = (int) GetLE(pData + 16, 4);
+  *pHash = GetLE(pData + 20, 8);
+  return (*pNEntries >= 0 && *pEntriesSize >= 0 && *pEntriesSize <= size - PARAMS_CHUNK_HEADER_SIZE ? 1 : -1);
+}
+
+int IPlugBase::GetParamIdx(int id)
+{
+  int n = mParams.GetSize();
+  if (id >= 0 && id < n && mParams.Get(id)->GetID() == id) return id;
+  return mParamIdxByID.Get(id, -1);
+}
+
+void IPlugBase::SnapshotParams(double* pValues)
+{
+  int i, n = mParams.GetSize();
+  IParam** ppParams = mParams.GetList();
+  for (int tries = 0; tries < 4; ++tries)
+  {
+    int seq = wdl_atomic_get(&mParamsSeq);
+    if (seq & 1) continue;
+    for (i = 0; i < n; ++i)
+    {
+      pValues[i] = ppParams[i]->Value();
+    }
+    if (wdl_atomic_get(&mParamsSeq) == seq) return;
+  }
+
+  // UnserializeParams() keeps the mutex until it is done.
+  WDL_MutexLock lock(&mMutex);
+  for (i = 0; i < n; ++i)
+  {
+    pValues[i] = ppParams[i]->Value();
+  }
+}
+
+// A 64 bit word per param (ID in the low half, float bits in the high half), each one mixed on its own and summed, so
+// params don't wait on each other and it is much faster than a byte-wise hash.
+static inline WDL_UINT64 MixParamHash(int id, double v)
+{
+  float f = (float) v;
+  unsigned int bits = 0;
+  if (f != 0.0f) memcpy(&bits, &f, 4); // -0 hashes as 0.
+  WDL_UINT64 h = (WDL_UINT64) (unsigned int) id | ((WDL_UINT64) bits << 32);
+  h ^= h >> 33;
+  h *= WDL_UINT64_CONST(0xFF51AFD7ED558CCD);
+  h ^= h >> 33;
+  h *= WDL_UINT64_CONST(0xC4CEB9FE1A85EC53);
+  return h ^ (h >> 33);
+}
+
+WDL_UINT64 IPlugBase::HashParamValues(const double* pValues)
+{
+  WDL_UINT64 h = 0;
+  int i, n = mParams.GetSize();
+  IParam** ppParams = mParams.GetList();
+  for (i = 0; i < n; ++i)
+  {
+    h += MixParamHash(ppParams[i]->GetID(), pValues[i]);
+  }
+  return h;
+}
+
+// Under mMutex. Only recomputed after a param has changed, so comparing against an unchanged state doesn't
+// have to look at every value.
+WDL_UINT64 IPlugBase::CurrentParamsHash()
+{
+  if (wdl_atomic_get(&mParamsChanged))
+  {
+    wdl_atomic_set(&mParamsChanged, 0); // Before reading the values, a change from here on sets it again.
+    SnapshotParams(mParamScratch.Get());
+    mParamsHash = HashParamValues(mParamScratch.Get());
+  }
+  return mParamsHash;
+}
+
+// pValues must hold the defaults.
+bool IPlugBase::DecodeParamValues(const unsigned char* pData, int size, int nEntries, double* pValues)
+{
+  const unsigned char* pEnd = pData + size;
+  for (int i = 0; i < nEntries; ++i)
+  {
+    unsigned int key, u;
+    int n = GetVarInt(pData, pEnd, &key);
+    if (!n) return false;
+    pData += n;
+
+    double v;
+    switch (key & 3)
+    {
+      case kEntryInt:
+        if (!(n = GetVarInt(pData, pEnd, &u))) return false;
+        pData += n;
+        v = (double) (int) ((u >> 1) ^ (0 - (u & 1)));
+        break;
+      case kEntryFloat:
+      {
+        if (pEnd - pData < 4) return false;
+        unsigned int bits = (unsigned int) GetLE(pData, 4);
+        float f;
+        memcpy(&f, &bits, 4);
+        v = f;
+        pData += 4;
+        break;
+      }
+      case kEntryDouble:
+      {
+        if (pEnd - pData < 8) return false;
+        WDL_UINT64 bits = GetLE(pData, 8);
+        memcpy(&v, &bits, 8);
+        pData += 8;
+        break;
+      }
+      default:
+        return false;
+    }
+
+    int idx = GetParamIdx((int) (key >> 2));
+    if (idx >= 0) pValues[idx] = v;
+  }
+  return true;
+}
+
 bool IPlugBase::SerializeParams(ByteChunk* pChunk)
 {
   TRACE;
 
   WDL_MutexLock lock(&mMutex);
-  bool savedOK = true;
+  // Compact chunks carry the params hash. The cached one (see CurrentParamsHash()) is used if no param changed
+  // before or during the snapshot, otherwise it is worked out again while writing.
+  bool hashKnown = !mCompactParamsChunk || !wdl_atomic_get(&mParamsChanged);
+  if (!hashKnown) wdl_atomic_set(&mParamsChanged, 0); // Before the snapshot, a change from here on sets it again.
+  SnapshotParams(mParamScratch.Get());
+  hashKnown = hashKnown && !wdl_atomic_get(&mParamsChanged);
+  return WriteParamValues(pChunk, mParamScratch.Get(), &mParamsHash, hashKnown);
+}
+
+bool IPlugBase::SerializeParamValues(ByteChunk* pChunk, const double* pValues)
+{
+  return WriteParamValues(pChunk, pValues, 0, false);
+}
+
+// If hashKnown, *pHash is the hash of pValues, otherwise it is worked out and stored there (if pHash isn't 0).
+bool IPlugBase::WriteParamValues(ByteChunk* pChunk, const double* pValues, WDL_UINT64* pHash, bool hashKnown)
+{
   int i, n = mParams.GetSize();
-  for (i = 0; i < n && savedOK; ++i)
+  if (!mCompactParamsChunk)
   {
-    IParam* pParam = mParams.Get(i);
-    Trace(TRACELOC, "%d %s %f", i, pParam->GetNameForHost(), pParam->Value());
-    double v = pParam->Value();
-    savedOK &= (pChunk->Put(&v) > 0);
+    bool savedOK = true;
+    for (i = 0; i < n && savedOK; ++i)
+    {
+      savedOK &= (pChunk->Put(pValues + i) > 0);
+    }
+    return savedOK;
   }
-  return savedOK;
+
+  int startPos = pChunk->Size();
+  unsigned char* pStart = pChunk->Extend(PARAMS_CHUNK_HEADER_SIZE + n * PARAMS_CHUNK_MAX_ENTRY_SIZE);
+  if (!pStart) return false;
+
+  // The hash is worked out in the same pass.
+  unsigned char* p = pStart + PARAMS_CHUNK_HEADER_SIZE;
+  int nEntries = 0;
+  WDL_UINT64 h = 0;
+  IParam** ppParams = mParams.GetList();
+  for (i = 0; i < n; ++i)
+  {
+    IParam* pParam = ppParams[i];
+    double v = pValues[i];
+    int id = pParam->GetID();
+    if (!hashKnown) h += MixParamHash(id, v);
+    if (v == pParam->GetDefault()) continue;
+
+    unsigned int key = (unsigned int) id << 2;
+    float f = (float) v;
+    if (fabs(v) < 1073741824.0 && (double) (int) v == v)
+    {
+      int iv = (int) v;
+      p += PutVarInt(p, key | kEntryInt);
+      p += PutVarInt(p, ((unsigned int) iv << 1) ^ (unsigned int) (iv >> 31));
+    }
+    else if ((double) f == v)
+    {
+      unsigned int bits;
+      memcpy(&bits, &f, 4);
+      p += PutVarInt(p, key | kEntryFloat);
+      PutLE(p, bits, 4);
+      p += 4;
+    }
+    else
+    {
+      WDL_UINT64 bits;
+      memcpy(&bits, &v, 8);
+      p += PutVarInt(p, key | kEntryDouble);
+      PutLE(p, bits, 8);
+      p += 8;
+    }
+    ++nEntries;
+  }
+
+  PutLE(pStart, PARAMS_CHUNK_MAGIC, 8);
+  PutLE(pStart + 8, PARAMS_CHUNK_VERSION, 4);
+  PutLE(pStart + 12, nEntries, 4);
+  PutLE(pStart + 16, (int) (p - pStart) - PARAMS_CHUNK_HEADER_SIZE, 4);
+  if (hashKnown) h = *pHash;
+  else if (pHash) *pHash = h;
+  PutLE(pStart + 20, h, 8);
+  pChunk->Resize(startPos + (int) (p - pStart));
+  return true;
 }
 
 int IPlugBase::UnserializeParams(ByteChunk* pChunk, int startPos)
 {
   TRACE;
 
+  int i, n = mParams.GetSize(), pos = startPos;
+  int nEntries = 0, entriesSize = 0;
+  WDL_UINT64 hash;
+  int compact = (startPos >= 0 && startPos < pChunk->Size() ?
+    GetParamsChunkHeader(pChunk->GetBytes() + startPos, pChunk->Size() - startPos, &nEntries, &entriesSize, &hash) : 0);
+  if (compact < 0) return -1;
+
   WDL_MutexLock lock(&mMutex);
+  if (compact)
+  {
+    // Decode into mParamScratch first, so a damaged chunk changes nothing.
+    pos = ReadParamValues(pChunk, startPos, mParamScratch.Get());
+    if (pos < 0) return -1;
+  }
+
+  wdl_atomic_incr(&mParamsSeq);
+  if (compact)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      mParams.Get(i)->Set(mParamScratch.Get()[i]);
+    }
+    Trace(TRACELOC, "%d of %d params", nEntries, n);
+  }
+  else
+  {
+    for (i = 0; i < n && pos >= 0; ++i)
+    {
+      IParam* pParam = mParams.Get(i);
+      double v = 0.0;
+      pos = pChunk->Get(&v, pos);
+      pParam->Set(v);
+      Trace(TRACELOC, "%d %s %f", i, pParam->GetNameForHost(), pParam->Value());
+    }
+  }
+  wdl_atomic_incr(&mParamsSeq);
+  OnParamReset();
+  return pos;
+}
+
+// Reads NParams() values from a params chunk in either format, returns the new chunk position or -1.
+// Values a legacy chunk is too short for are left alone.
+int IPlugBase::ReadParamValues(ByteChunk* pChunk, int startPos, double* pValues)
+{
   int i, n = mParams.GetSize(), pos = startPos;
+  int nEntries = 0, entriesSize = 0;
+  WDL_UINT64 hash;
+  int compact = (startPos >= 0 && startPos < pChunk->Size() ?
+    GetParamsChunkHeader(pChunk->GetBytes() + startPos, pChunk->Size() - startPos, &nEntries, &entriesSize, &hash) : 0);
+  if (compact < 0) return -1;
+
+  if (compact)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      pValues[i] = mParams.Get(i)->GetDefault();
+    }
+    pos += PARAMS_CHUNK_HEADER_SIZE;
+    if (!DecodeParamValues(pChunk->GetBytes() + pos, entriesSize, nEntries, pValues)) return -1;
+    return pos + entriesSize;
+  }
+
   for (i = 0; i < n && pos >= 0; ++i)
   {
-    IParam* pParam = mParams.Get(i);
-    double v = 0.0;
-    pos = pChunk->Get(&v, pos);
-    pParam->Set(v);
-    Trace(TRACELOC, "%d %s %f", i, pParam->GetNameForHost(), pParam->Value());
+    pos = pChunk->Get(pValues + i, pos);
   }
-  OnParamReset();
   return pos;
 }
 
+bool IPlugBase::CompareStateSized(const unsigned char* incomingState, int startPos, int size)
+{
+  WDL_MutexLock lock(&mMutex);
+  mCompareStateSize = size;
+  bool isEqual = CompareState(incomingState, startPos);
+  mCompareStateSize = -1;
+  return isEqual;
+}
+
+// startPos is in bytes. Chunks in the compact format are equal if the hashes match, otherwise (and for legacy chunks)
+// each param is compared as a float, because Pro Tools treats param values as 32 bit and they may come back with tiny
+// differences.
 bool IPlugBase::CompareState(const unsigned char* incomingState, int startPos)
 {
+  const unsigned char* pData = incomingState + startPos;
+  int i, n = NParams();
+
+  WDL_MutexLock lock(&mMutex);
+  // Without a size (a plugin calling this directly), trust the chunk the way IPlug always has.
+  int size = (mCompareStateSize >= 0 ? mCompareStateSize : 0x7fffffff) - startPos;
+  int nEntries = 0, entriesSize = 0;
+  WDL_UINT64 hash;
+  int compact = GetParamsChunkHeader(pData, size, &nEntries, &entriesSize, &hash);
+  if (compact < 0) return false;
+  if (compact && hash == CurrentParamsHash()) return true;
+  if (!compact && size < n * (int) sizeof(double)) return false;
+
+  WDL_TypedBuf<double> incoming;
+  double* pIncoming = incoming.Resize(n);
+  if (compact)
+  {
+    for (i = 0; i < n; ++i)
+    {
+      pIncoming[i] = mParams.Get(i)->GetDefault();
+    }
+    if (!DecodeParamValues(pData + PARAMS_CHUNK_HEADER_SIZE, entriesSize, nEntries, pIncoming)) return false;
+  }
+  else
+  {
+    memcpy(pIncoming, pData, n * sizeof(double));
+  }
+
+  double* pCurrent = mParamScratch.Get();
+  SnapshotParams(pCurrent);
   bool isEqual = true;
-  
-  const double* data = (const double*) incomingState + startPos;
-  
-  // dirty hack here because protools treats param values as 32 bit int and in IPlug they are 64bit float
-  // if we memcmp() the incoming state with the current they may have tiny differences due to the quantization
-  for (int i = 0; i < NParams(); i++)
+  for (i = 0; i < n; ++i)
   {
-    float v = (float) GetParam(i)->Value();
-    float vi = (float) *(data++);
-    
+    float v = (float) pCurrent[i];
+    float vi = (float) pIncoming[i];
     isEqual &= (fabsf(v - vi) < 0.00001);
   }
-  
   return isEqual;
 }
 
@@ -1229,15 +1773,16 @@ bool IPlugBase::SaveBankAsFXB(WDL_String* fileName)
         bnk.Put(&numParams);
         bnk.PutBytes(prgName, 28);
 
-        int pos = 0;
+        // Presets can be in the compact params format, or the legacy one.
+        WDL_TypedBuf<double> vals;
+        double* pV = vals.Resize(NParams());
+        memset(pV, 0, NParams() * sizeof(double));
+        ReadParamValues(&(pPreset->mChunk), 0, pV);
 
         for (int i = 0; i< NParams(); i++)
         {
-          double v = 0.0;
-          pos = pPreset->mChunk.Get(&v, pos);
-
           WDL_EndianFloat v32;
-          v32.f = (float) mParams.Get(i)->GetNormalized(v);
+          v32.f = (float) mParams.Get(i)->GetNormalized(pV[i]);
           unsigned int swapped = WDL_bswap32(v32.int32);
           bnk.Put(&swapped);
         }
@@ -1346,21 +1891,24 @@ bool IPlugBase::LoadBankFromFXB(WDL_String* fileName)
 {
   if (fileName->GetLength())
   {
-    FILE* fp = fopen(fileName->Get(), "rb");
+    // Banks can be big, read this one from a mapping instead of copying it.
+    WDL_FileRead file(fileName->Get(), 0, 0, 0, 0, 0x7fffffff);
 
-    if (fp)
+    if (file.IsOpen() && file.GetSize() < 0x7fffffff)
     {
       ByteChunk bnk;
-      long fileSize;
-
-      fseek(fp , 0 , SEEK_END);
-      fileSize = ftell(fp);
-      rewind(fp);
-
-      bnk.Resize(fileSize);
-      fread(bnk.GetBytes(), fileSize, 1, fp);
+      int fileSize = (int) file.GetSize();
+      const void* pMapped = file.GetMappedView(0, &fileSize);
 
-      fclose(fp);
+      if (pMapped)
+      {
+        bnk.SetView(pMapped, fileSize);
+      }
+      else
+      {
+        bnk.Resize(fileSize);
+        file.Read(bnk.GetBytes(), fileSize);
+      }
 
       int pos = 0;
 
@@ -5,11 +5,15 @@
 #define IPLUG_VERSION_MAGIC 'pfft'
 
 #include "Containers.h"
+#include "../assocarray.h"
+#include "../hashmap.h"
 #include "IPlugStructs.h"
 #include "IParam.h"
 #include "Hosts.h"
 #include "Log.h"
 #include "NChanDelay.h"
+#include "../rtpool.h"
+#include "IDSPLoad.h"
 
 // Uncomment to enable IPlug::OnIdle() and IGraphics::OnGUIIdle().
 // #define USE_IDLE_CALLS
@@ -21,6 +25,7 @@
 // All version ints are stored as 0xVVVVRRMM: V = version, R = revision, M = minor revision.
 
 class IGraphics;
+class IPresetBank;
 
 class IPlugBase
 {
@@ -80,7 +85,8 @@ public:
   // Return the new chunk position (endPos). Implementations should set a mutex lock and call UnserializeParams() after custom data is unserialized
   virtual int UnserializeState(ByteChunk* pChunk, int startPos) { TRACE; return UnserializeParams(pChunk, startPos); }
   
-  // Only used by RTAS & AAX, override in plugins that do chunks
+  // Only used by RTAS & AAX, override in plugins that do chunks. The wrappers call it through CompareStateSized(), so
+  // GetCompareStateSize() is the size of the whole of incomingState while it runs.
   virtual bool CompareState(const unsigned char* incomingState, int startPos);
   
   virtual void OnWindowResize() {}
@@ -98,6 +104,14 @@ public:
 
   int NParams() { return mParams.GetSize(); }
   IParam* GetParam(int idx) { return mParams.Get(idx); }
+  int GetParamIdx(int id); // Index of the param with IParam::GetID() == id, or -1.
+  // Calls CompareState() with GetCompareStateSize() set to size, for the RTAS/AAX wrappers.
+  bool CompareStateSized(const unsigned char* incomingState, int startPos, int size);
+  // In bytes, -1 outside of CompareStateSized().
+  int GetCompareStateSize() { return mCompareStateSize; }
+  // Copies all NParams() param values to pValues without locking mMutex. A snapshot never mixes values from
+  // before and after an UnserializeParams()/RestorePreset(), single param changes may land either side of it.
+  void SnapshotParams(double* pValues);
   IGraphics* GetGUI() { return mGraphics; }
 
   const char* GetEffectName() { return mEffectName; }
@@ -128,6 +142,16 @@ public:
 
   bool GetIsBypassed() { return mIsBypassed; }
 
+  // A preallocated pool for buffers that grow on the audio thread, e.g. mMidiQueue.SetAllocator(CreateRTPool(1 << 20)).
+  // Call from the plugin's constructor; the pool lives as long as the plugin, a second call returns the first pool.
+  // Build with WDL_RT_MALLOC_TRAP to trap any other allocation inside ProcessDoubleReplacing(), see rtalloc.h.
+  WDL_RTPool* CreateRTPool(int bytes);
+  WDL_RTPool* GetRTPool() { return mRTPool; }
+
+  // How long process calls take against their real-time budget, see IDSPLoad.h. Safe to call from the GUI.
+  void GetDSPLoad(IDSPLoadStats* pStats, bool reset = false) { mDSPLoad.GetStats(pStats); if (reset) mDSPLoad.Reset(); }
+  void ResetDSPLoad() { mDSPLoad.Reset(); }
+
   // In ProcessDoubleReplacing you are always guaranteed to get valid pointers
   // to all the channels the plugin requested.  If the host hasn't connected all the pins,
   // the unconnected channels will be full of zeros.
@@ -222,6 +246,15 @@ protected:
   // Will append if the chunk is already started
   bool SerializeParams(ByteChunk* pChunk);
   int UnserializeParams(ByteChunk* pChunk, int startPos); // Returns the new chunk position (endPos)
+  // Like SerializeParams(), for NParams() values that aren't necessarily the current ones.
+  bool SerializeParamValues(ByteChunk* pChunk, const double* pValues);
+  // Params are written as one double per param unless this is set to true (call it in the plugin constructor). Then they
+  // are written in the compact format (see IPlugBase.cpp), which is smaller and compares in O(1), but which IPlug builds
+  // from before it can't read. UnserializeParams() reads both.
+  // The compact format leaves out params that are at their default, and they are restored to whatever their default is
+  // when the chunk is loaded. So a param's default must not change between versions of a plugin, or presets and
+  // sessions saved with the old one change too. Start it at a new value with IParam::Set() in the constructor instead.
+  void SetCompactParamsChunk(bool compact) { mCompactParamsChunk = compact; }
 
   virtual void RedrawParamControls();  // Called after restoring state.
 
@@ -260,6 +293,15 @@ public:
   bool RestorePreset(int idx);
   bool RestorePreset(const char* name);
   const char* GetPresetName(int idx);
+
+  // Preset banks (see IPresetBank.h) are memory-mapped, and a preset is only decoded when it is restored.
+  // LoadPresetBank() points the first NPresets() presets at the bank's states without copying them, a preset
+  // gets its own copy when it is modified. Bank presets past NPresets() can be restored (and browsed) by
+  // bank index, RestorePreset(name) finds them too. Uninitialized presets are saved empty, to keep indexes.
+  bool SavePresetBank(const char* path);
+  bool LoadPresetBank(const char* path);
+  IPresetBank* GetPresetBank() { return mPresetBank; }
+  bool RestorePresetFromBank(int bankIdx); // For preset browsers, prefetches the neighbouring presets.
   
   virtual void DirtyPTCompareState() {}; // needed in chunks based plugins to tell PT a non-indexed param changed and to turn on the compare light
 
@@ -321,12 +363,33 @@ protected:
   int mBlockSize, mLatency;
   unsigned int mTailSize;
   NChanDelayLine* mDelay; // for delaying dry signal when mLatency > 0 and plugin is bypassed
+  WDL_RTPool* mRTPool;
+  IDSPLoadMeter mDSPLoad;
   WDL_PtrList<const char> mParamGroups;
 
 private:
+  int FindPreset(const char* name) { return mPresetIdxByName.Get(name, -1); }
+  void SetPresetName(IPreset* pPreset, const char* name);
+  void RebuildPresetIndex();
+  void MaterializePresets();
+  int ReadParamValues(ByteChunk* pChunk, int startPos, double* pValues);
+  WDL_UINT64 HashParamValues(const double* pValues);
+  WDL_UINT64 CurrentParamsHash();
+  bool WriteParamValues(ByteChunk* pChunk, const double* pValues, WDL_UINT64* pHash, bool hashKnown);
+  bool DecodeParamValues(const unsigned char* pData, int size, int nEntries, double* pValues);
+
   IGraphics* mGraphics;
   WDL_PtrList<IParam> mParams;
+  WDL_IntHashMap<int> mParamIdxByID; // IDs that aren't their param's index, filled in by IParam::SetID().
+  volatile int mParamsSeq; // Odd while UnserializeParams() is changing values, see SnapshotParams().
+  volatile int mParamsChanged; // Set by the params when a value changes, see CurrentParamsHash().
+  WDL_UINT64 mParamsHash; // Under mMutex.
+  bool mCompactParamsChunk;
+  int mCompareStateSize; // Under mMutex.
   WDL_PtrList<IPreset> mPresets;
+  WDL_StringHashMap<int> mPresetIdxByName; // Name -> first preset with it, kept up to date wherever names change.
+  IPresetBank* mPresetBank;
+  WDL_TypedBuf<double> mParamScratch; // NParams() long and under mMutex, so (Un)SerializeParams() don't allocate.
   WDL_TypedBuf<double*> mInData, mOutData;
   WDL_PtrList<InChannel> mInChannels;
   WDL_PtrList<OutChannel> mOutChannels;
@@ -0,0 +1,75 @@
+#include "IPlugHeadless.h"
+#include "IGraphics.h"
+
+IPlugHeadless::IPlugHeadless(IPlugInstanceInfo instanceInfo,
+                             int nParams,
+                             const char* channelIOStr,
+                             int nPresets,
+                             const char* effectName,
+                             const char* productName,
+                             const char* mfrName,
+                             int vendorVersion,
+                             int uniqueID,
+                             int mfrID,
+                             int latency,
+                             bool plugDoesMidi,
+                             bool plugDoesChunks,
+                             bool plugIsInst,
+                             int plugScChans)
+  : IPlugBase(nParams,
+              channelIOStr,
+              nPresets,
+              effectName,
+              productName,
+              mfrName,
+              vendorVersion,
+              uniqueID,
+              mfrID,
+              latency,
+              plugDoesMidi,
+              plugDoesChunks,
+              plugIsInst,
+              kAPIHeadless)
+  , mSamplePos(0)
+{
+  Trace(TRACELOC, "%s%s", effectName, channelIOStr);
+
+  mResourcePath.Set(instanceInfo.mResourcePath.Get());
+
+  SetInputChannelConnections(0, NInChannels(), true);
+  SetOutputChannelConnections(0, NOutChannels(), true);
+
+  SetBlockSize(DEFAULT_BLOCK_SIZE);
+  SetHost("headless", vendorVersion);
+}
+
+void IPlugHeadless::ResizeGraphics(int w, int h)
+{
+  if (GetGUI())
+  {
+    OnWindowResize();
+  }
+}
+
+void IPlugHeadless::SetParameterFromHost(int idx, double normalizedValue)
+{
+  IMutexLock lock(this);
+  if (idx >= 0 && idx < NParams())
+  {
+    if (GetGUI())
+    {
+      GetGUI()->SetParameterFromPlug(idx, normalizedValue, true);
+    }
+    GetParam(idx)->SetNormalized(normalizedValue);
+    ITRACE_PARAM(this, idx, normalizedValue);
+    OnParamChange(idx);
+  }
+}
+
+void IPlugHeadless::LockMutexAndProcessDoubleReplacing(double** inputs, double** outputs, int nFrames)
+{
+  IMutexLock lock(this);
+  WDL_RTScope rt;
+  ProcessDoubleReplacing(inputs, outputs, nFrames);
+  mSamplePos += nFrames;
+}
@@ -0,0 +1,65 @@
+#ifndef _IPLUGHEADLESS_
+#define _IPLUGHEADLESS_
+
+// Plug API with no host at all, for driving a plugin (and an IGraphicsHeadless editor)
+// from a test or benchmark program. Define HEADLESS_API instead of VST_API etc.
+
+#include "IPlugOSDetect.h"
+#include "IPlugBase.h"
+
+struct IPlugInstanceInfo
+{
+  WDL_String mResourcePath;   // Where IGraphicsHeadless loads bitmaps from.
+};
+
+class IPlugHeadless : public IPlugBase
+{
+public:
+  IPlugHeadless(IPlugInstanceInfo instanceInfo,
+                int nParams,
+                const char* channelIOStr,
+                int nPresets,
+                const char* effectName,
+                const char* productName,
+                const char* mfrName,
+                int vendorVersion,
+                int uniqueID,
+                int mfrID,
+                int latency = 0,
+                bool plugDoesMidi = false,
+                bool plugDoesChunks = false,
+                bool plugIsInst = false,
+                int plugScChans = 0);
+
+  // There is no host to inform.
+  void BeginInformHostOfParamChange(int idx) {};
+  void InformHostOfParamChange(int idx, double normalizedValue) {};
+  void EndInformHostOfParamChange(int idx) {};
+  void InformHostOfProgramChange() {};
+
+  int GetSamplePos() { return mSamplePos; }
+  double GetTempo() { return DEFAULT_TEMPO; }
+  void GetTimeSig(int* pNum, int* pDenom) { *pNum = 4; *pDenom = 4; }
+  void GetTime(ITimeInfo* pTimeInfo) { return; }
+
+  void ResizeGraphics(int w, int h);
+
+  const char* GetResourcePath() { return mResourcePath.Get(); }
+
+  // What a host automating a parameter would do, including updating the GUI.
+  void SetParameterFromHost(int idx, double normalizedValue);
+
+  void LockMutexAndProcessDoubleReplacing(double** inputs, double** outputs, int nFrames);
+
+protected:
+  bool SendMidiMsg(IMidiMsg* pMsg) { return false; }
+  bool SendSysEx(ISysEx* pSysEx) { return false; }
+
+private:
+  WDL_String mResourcePath;
+  int mSamplePos;
+};
+
+IPlugHeadless* MakePlug(const char* resourcePath);
+
+#endif // _IPLUGHEADLESS_
@@ -238,6 +238,7 @@ void IPlugRTAS::SetParameter(int idx)
       GetGUI()->SetParameterFromPlug(idx - kPTParamIdxOffset, value, false);
 
     pParam->Set(value);
+    ITRACE_PARAM(this, idx - kPTParamIdxOffset, pParam->GetNormalized());
     OnParamChange(idx - kPTParamIdxOffset);
   }
 }
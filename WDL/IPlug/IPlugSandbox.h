@@ -0,0 +1,604 @@
+#ifndef _IPLUGSANDBOX_
+#define _IPLUGSANDBOX_
+
+// Runs a plugin's processing in a separate worker process, so a crash in the DSP takes down the
+// worker rather than the host.
+//
+// - IPlugSandboxHost lives in the host-side plugin (the shim). Its OnParamChange() passes values
+//   on with SetParameter(), ProcessMidiMsg() with SendMidi(), and ProcessDoubleReplacing() calls
+//   ProcessBlock() instead of doing any DSP.
+// - The worker is an executable built with HEADLESS_API around the real plugin. Its main() hands
+//   the plugin to IPlugSandboxWorker when GetSandboxArg() says it was started by a host.
+// - Audio goes through a shared memory region holding every input and output channel. The worker
+//   processes in place there, the host copies the block in and out (or renders straight into
+//   GetInput() and reads GetOutput(), which makes no copies at all).
+// - Each block is a single SHM_MsgReplyConnection message carrying the parameter changes and MIDI
+//   queued since the last one. The reply says the outputs are ready. That's one wakeup per block
+//   each way.
+// - Each block has a deadline of its own length plus a margin. If the worker dies or misses it,
+//   ProcessBlock() outputs silence and returns false until Start() is called again, so a hung
+//   worker costs one block rather than stalling the audio thread. GetStats() reports the round trip
+//   time and its jitter.
+// - Nothing on the audio thread allocates: the message and MIDI buffers are sized up front, and
+//   parameter changes come over a lock-free queue. SendRequest() and GetReply() do take the
+//   connection's mutex, but nothing else on the host side uses the connection while a block is out
+//   (Start() and Stop() must not run alongside ProcessBlock()), so that lock is never contended.
+// - Start() sends the worker every value SetParameter() has been given, so a restarted worker
+//   picks up where the last one left off.
+//
+// POSIX only, the worker is started with fork() and exec().
+
+#ifndef _WIN32
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../shm_msgreply.h"
+#include "../wdlstring.h"
+#include "../wdlatomic.h"
+#include "../timing.h"
+#include "Containers.h"
+#include "IPlugStructs.h"
+
+#define ISANDBOX_WORKER_ARG "-iplug-sandbox"
+#define ISANDBOX_HIST_US 5          // Round trip histogram resolution.
+#define ISANDBOX_HIST_BUCKETS 2000  // Up to 10 ms, then everything longer.
+#define ISANDBOX_MARGIN_US 1000     // Default for how far past a block's own length its reply can be.
+#define ISANDBOX_MAX_MIDI 1024      // Per ProcessBlock(), SendMidi() drops any more.
+#define ISANDBOX_START_TIMEOUT_MS 10000
+#define ISANDBOX_STOP_TIMEOUT_MS 1000
+
+enum ESandboxMsg
+{
+  kSandboxSetup = 'SbSu',
+  kSandboxProcess = 'SbPr',
+  kSandboxQuit = 'SbQu'
+};
+
+// The start of the shared audio region, channel buffers follow: inputs, then outputs, maxFrames each.
+struct ISandboxRegionHeader
+{
+  int mMagic;
+  int mNInputs, mNOutputs, mMaxFrames;
+  double mSampleRate;
+  char mPad[40];
+};
+
+struct ISandboxBlockHeader
+{
+  int mNFrames, mNParams, mNMidi, mPad;
+};
+
+struct ISandboxParamChange
+{
+  int mIdx, mPad;
+  double mValue;
+};
+
+struct ISandboxReply
+{
+  int mOK, mPad;
+  double mProcessUs;    // Time spent in the plugin.
+};
+
+struct ISandboxStats
+{
+  int mBlocks;          // Since the last reset.
+  int mFailures;        // Blocks that were silenced because the worker wasn't there.
+  double mAvgUs;        // Round trip, host send to reply.
+  double mJitterUs;     // Standard deviation of the round trip.
+  double mP99Us;        // To the histogram's 5 us resolution.
+  double mMaxUs;
+  double mAvgProcessUs; // The part of the round trip spent in the plugin.
+};
+
+static void ISandboxRegionName(const char* uniq, WDL_String* pName)
+{
+  pName->SetFormatted(256, "/IPlugSbx.%s", uniq);
+}
+
+class IPlugSandboxHost
+{
+public:
+  // workerPath is the executable to start, it gets ISANDBOX_WORKER_ARG and the connection name as
+  // arguments. nParams is the plugin's NParams(). A block's reply is due nFrames / sample rate
+  // plus marginUs after it's sent.
+  IPlugSandboxHost(const char* workerPath, int nInputs, int nOutputs, int nParams, int maxFrames = 1024, int marginUs = ISANDBOX_MARGIN_US)
+    : mNInputs(nInputs), mNOutputs(nOutputs), mNParams(IPMAX(nParams, 0)), mMaxFrames(maxFrames > 0 ? maxFrames : 1024)
+    , mMarginUs(marginUs), mCon(0), mPid(0), mKilledPid(0), mRegion(0), mRegionSize(0), mSampleRate(44100.), mDeadline(0)
+    , mParamHead(0), mParamTail(0), mNPendingMidi(0)
+  {
+    mWorkerPath.Set(workerPath);
+    // Each index is in the queue at most once, so one more slot than there are parameters is enough.
+    mParamQueue.Resize(mNParams + 1);
+    mParamValues.Resize(IPMAX(mNParams, 1));
+    mParamQueued.Resize(IPMAX(mNParams, 1));
+    memset(mParamQueued.Get(), 0, mParamQueued.GetSize() * sizeof(int));
+    mParamSet.Resize(IPMAX(mNParams, 1));
+    memset(mParamSet.Get(), 0, mParamSet.GetSize() * sizeof(int));
+    mPendingMidi.Resize(ISANDBOX_MAX_MIDI);
+    mMsg.Resize(sizeof(ISandboxBlockHeader) + mNParams * sizeof(ISandboxParamChange) + ISANDBOX_MAX_MIDI * sizeof(IMidiMsg));
+    ResetStats();
+  }
+
+  ~IPlugSandboxHost() { Stop(); }
+
+  // Starts (or restarts) the worker. Blocks until it's ready, which includes constructing the
+  // plugin and applying the parameter values, so give it a thread that can wait.
+  bool Start(double sampleRate)
+  {
+    Stop();
+    mSampleRate = sampleRate;
+
+    mCon = new SHM_MsgReplyConnection(262144, 16 << 20, false);
+    mCon->userData = this;
+    mCon->IdleProc = IdleProc;
+
+    WDL_String name;
+    ISandboxRegionName(mCon->GetUniqueString(), &name);
+    mRegionSize = (int) sizeof(ISandboxRegionHeader) + (mNInputs + mNOutputs) * mMaxFrames * (int) sizeof(double);
+    int fd = shm_open(name.Get(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+      void* p = MAP_FAILED;
+      if (!ftruncate(fd, mRegionSize)) p = mmap(NULL, mRegionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (p != MAP_FAILED) mRegion = (unsigned char*) p;
+    }
+    if (!mRegion)
+    {
+      shm_unlink(name.Get());
+      Stop();
+      return false;
+    }
+    ISandboxRegionHeader* pHdr = (ISandboxRegionHeader*) mRegion;
+    pHdr->mMagic = kSandboxSetup;
+    pHdr->mNInputs = mNInputs;
+    pHdr->mNOutputs = mNOutputs;
+    pHdr->mMaxFrames = mMaxFrames;
+    pHdr->mSampleRate = mSampleRate;
+
+    mPid = fork();
+    if (!mPid)
+    {
+      execl(mWorkerPath.Get(), mWorkerPath.Get(), ISANDBOX_WORKER_ARG, mCon->GetUniqueString(), (char*) NULL);
+      _exit(127);
+    }
+
+    // Every value set so far, a new worker starts from the plugin's defaults. A change that races
+    // with this is queued as well, and goes again with the first block.
+    WDL_TypedBuf<ISandboxParamChange> values;
+    ISandboxParamChange* pValues = values.Resize(IPMAX(mNParams, 1));
+    int nValues = 0;
+    for (int i = 0; i < mNParams; ++i)
+    {
+      if (!wdl_atomic_get(&mParamSet.Get()[i])) continue;
+      ISandboxParamChange change = { i, 0, mParamValues.Get()[i] };
+      pValues[nValues++] = change;
+    }
+
+    // The worker maps the region before it replies, after that nothing else needs the name.
+    ISandboxReply reply;
+    SetDeadline(ISANDBOX_START_TIMEOUT_MS);
+    bool ok = mPid > 0 && mCon->Send(kSandboxSetup, pValues, nValues * (int) sizeof(ISandboxParamChange), &reply, sizeof(reply)) == sizeof(reply) && reply.mOK;
+    shm_unlink(name.Get());
+    if (!ok) Stop();
+    return ok;
+  }
+
+  void Stop()
+  {
+    if (mCon && mPid > 0) mCon->Send(kSandboxQuit, NULL, 0, NULL, 0);
+    if (mPid > 0)
+    {
+      int i;
+      for (i = 0; i < ISANDBOX_STOP_TIMEOUT_MS && waitpid(mPid, NULL, WNOHANG) == 0; ++i) usleep(1000);
+      if (i == ISANDBOX_STOP_TIMEOUT_MS)
+      {
+        kill(mPid, SIGKILL);
+        waitpid(mPid, NULL, 0);
+      }
+    }
+    if (mKilledPid > 0) waitpid(mKilledPid, NULL, 0);
+    mPid = mKilledPid = 0;
+    DELETE_NULL(mCon);
+    if (mRegion) munmap(mRegion, mRegionSize);
+    mRegion = 0;
+  }
+
+  bool IsRunning() { return mCon && mPid > 0; }
+  int GetWorkerPid() { return mPid; }
+
+  // Sent with the next block. This is the parameter's value, IParam::Value(), rather than a
+  // normalized one that would come out a rounding error different on the other side. Changes
+  // between blocks are coalesced, the worker gets the latest value once.
+  // Any thread, but one at a time (IPlug calls OnParamChange() with its mutex held), since this is
+  // the single producer of the queue ProcessBlock() reads without locking.
+  void SetParameter(int idx, double value)
+  {
+    if (idx < 0 || idx >= mNParams) return;
+    mParamValues.Get()[idx] = value;
+    wdl_atomic_set(&mParamSet.Get()[idx], 1); // For Start().
+    // A full barrier, so the value is out before the flag is looked at. If the audio thread has
+    // already taken the index but not cleared the flag yet, it reads the value after clearing it.
+    if (wdl_atomic_get(&mParamQueued.Get()[idx])) return;
+    wdl_atomic_set(&mParamQueued.Get()[idx], 1);
+    int tail = mParamTail;
+    mParamQueue.Get()[tail] = idx;
+    wdl_atomic_set(&mParamTail, tail + 1 < mParamQueue.GetSize() ? tail + 1 : 0);
+  }
+
+  // Audio thread, before the ProcessBlock() the message's offset refers to. Returns false if
+  // ISANDBOX_MAX_MIDI messages are already waiting for it.
+  bool SendMidi(const IMidiMsg* pMsg)
+  {
+    if (mNPendingMidi >= ISANDBOX_MAX_MIDI) return false;
+    mPendingMidi.Get()[mNPendingMidi++] = *pMsg;
+    return true;
+  }
+
+  // The worker's buffers for the next block.
+  double* GetInput(int ch) { return mRegion ? Channel(ch) : 0; }
+  double* GetOutput(int ch) { return mRegion ? Channel(mNInputs + ch) : 0; }
+
+  // Audio thread. Blocks longer than maxFrames go over in pieces.
+  bool ProcessBlock(double** inputs, double** outputs, int nFrames)
+  {
+    bool ok = true;
+    for (int done = 0; done < nFrames; done += mMaxFrames)
+    {
+      int n = nFrames - done;
+      if (n > mMaxFrames) n = mMaxFrames;
+      if (!ProcessChunk(inputs, outputs, done, n, done + n == nFrames)) ok = false;
+    }
+    mNPendingMidi = 0;
+    return ok;
+  }
+
+  // Any thread, the figures can be a block apart from each other.
+  void GetStats(ISandboxStats* pStats)
+  {
+    memset(pStats, 0, sizeof(ISandboxStats));
+    int n = mBlocks;
+    pStats->mBlocks = n;
+    pStats->mFailures = mFailures;
+    if (!n) return;
+    double avg = mSumUs / n;
+    pStats->mAvgUs = avg;
+    pStats->mJitterUs = sqrt(IPMAX(mSumSqUs / n - avg * avg, 0.));
+    pStats->mMaxUs = mMaxUs;
+    pStats->mAvgProcessUs = mSumProcessUs / n;
+
+    int i, above = 0, limit = n / 100;
+    for (i = ISANDBOX_HIST_BUCKETS - 1; i > 0; --i)
+    {
+      above += mHist[i];
+      if (above > limit) break;
+    }
+    pStats->mP99Us = IPMIN((double) (i + 1) * ISANDBOX_HIST_US, mMaxUs);
+  }
+
+  // Audio thread, or while it isn't running.
+  void ResetStats()
+  {
+    memset(mHist, 0, sizeof(mHist));
+    mBlocks = mFailures = 0;
+    mSumUs = mSumSqUs = mMaxUs = mSumProcessUs = 0.;
+  }
+
+private:
+  double* Channel(int ch) { return (double*) (mRegion + sizeof(ISandboxRegionHeader)) + ch * mMaxFrames; }
+
+  bool ProcessChunk(double** inputs, double** outputs, int offset, int nFrames, bool last)
+  {
+    ISandboxBlockHeader hdr = { nFrames, 0, 0, 0 };
+    char* pMsg = mMsg.Get() + sizeof(hdr);
+
+    // Parameter changes, there's room in mMsg for every parameter.
+    int head = mParamHead, tail = wdl_atomic_get(&mParamTail);
+    while (head != tail)
+    {
+      int idx = mParamQueue.Get()[head];
+      if (++head == mParamQueue.GetSize()) head = 0;
+      wdl_atomic_set(&mParamQueued.Get()[idx], 0);
+      ISandboxParamChange change = { idx, 0, mParamValues.Get()[idx] };
+      memcpy(pMsg, &change, sizeof(change));
+      pMsg += sizeof(change);
+      hdr.mNParams++;
+    }
+    wdl_atomic_set(&mParamHead, head);
+
+    // MIDI for this chunk, with offsets relative to it. Out of range offsets go to the first or last chunk.
+    int i;
+    IMidiMsg* pMidi = mPendingMidi.Get();
+    for (i = 0; i < mNPendingMidi; ++i)
+    {
+      IMidiMsg msg = pMidi[i];
+      msg.mOffset -= offset;
+      if ((msg.mOffset >= 0 || !offset) && (msg.mOffset < nFrames || last))
+      {
+        msg.mOffset = BOUNDED(msg.mOffset, 0, nFrames - 1);
+        memcpy(pMsg, &msg, sizeof(msg));
+        pMsg += sizeof(msg);
+        hdr.mNMidi++;
+      }
+    }
+    memcpy(mMsg.Get(), &hdr, sizeof(hdr));
+
+    ISandboxReply reply;
+    WDL_UINT64 t0 = wdl_timing_now_ns();
+    bool ok = IsRunning();
+    if (ok)
+    {
+      for (i = 0; i < mNInputs; ++i)
+      {
+        if (inputs[i] + offset != Channel(i)) memcpy(Channel(i), inputs[i] + offset, nFrames * sizeof(double));
+      }
+      WDL_UINT64 deadline = t0 + (WDL_UINT64) ((double) nFrames / mSampleRate * 1e9) + (WDL_UINT64) mMarginUs * 1000;
+      ok = WaitReply(mCon->SendRequest(kSandboxProcess, mMsg.Get(), (int) (pMsg - mMsg.Get())), &reply, deadline);
+    }
+    if (ok)
+    {
+      for (i = 0; i < mNOutputs; ++i)
+      {
+        if (outputs[i] + offset != Channel(mNInputs + i)) memcpy(outputs[i] + offset, Channel(mNInputs + i), nFrames * sizeof(double));
+      }
+      double us = (double) (wdl_timing_now_ns() - t0) / 1000.;
+      int bucket = IPMIN((int) (us / ISANDBOX_HIST_US), ISANDBOX_HIST_BUCKETS - 1);
+      mHist[bucket]++;
+      mSumUs += us;
+      mSumSqUs += us * us;
+      mSumProcessUs += reply.mProcessUs;
+      if (us > mMaxUs) mMaxUs = us;
+      mBlocks++;
+    }
+    else
+    {
+      if (IsRunning()) Kill();
+      for (i = 0; i < mNOutputs; ++i) memset(outputs[i] + offset, 0, nFrames * sizeof(double));
+      mFailures++;
+    }
+    return ok;
+  }
+
+  void SetDeadline(int ms) { mDeadline = wdl_timing_now_ns() + (WDL_UINT64) ms * 1000000; }
+
+  // Not Send(), which doesn't look at the clock until it has waited ~30ms. The event wakes this as
+  // soon as the reply is in, the 1ms wait only bounds how far past the deadline a hung worker gets.
+  bool WaitReply(int msgID, ISandboxReply* pReply, WDL_UINT64 deadline)
+  {
+    if (!msgID) return false;
+    for (;;)
+    {
+      int rv = mCon->GetReply(msgID, pReply, sizeof(ISandboxReply));
+      if (rv >= 0) return rv == sizeof(ISandboxReply) && pReply->mOK;
+      if (rv < -1 || wdl_timing_now_ns() >= deadline) return false;
+      HANDLE evt = mCon->GetWaitEvent();
+      if (evt) WaitForSingleObject(evt, 1);
+      else Sleep(1);
+    }
+  }
+
+  // The worker is gone or stuck, from the audio thread so it can't wait around for it.
+  void Kill()
+  {
+    kill(mPid, SIGKILL);
+    mKilledPid = mPid; // Reaped by Stop().
+    mPid = 0;
+  }
+
+  // Called while Start()'s Send() waits for a reply, true gives up on it.
+  static bool IdleProc(SHM_MsgReplyConnection* pCon)
+  {
+    IPlugSandboxHost* _this = (IPlugSandboxHost*) pCon->userData;
+    if (_this->mPid <= 0 || waitpid(_this->mPid, NULL, WNOHANG) == _this->mPid)
+    {
+      _this->mPid = 0;
+      return true;
+    }
+    return wdl_timing_now_ns() > _this->mDeadline;
+  }
+
+  int mNInputs, mNOutputs, mNParams, mMaxFrames, mMarginUs;
+  WDL_String mWorkerPath;
+  SHM_MsgReplyConnection* mCon;
+  pid_t mPid, mKilledPid;
+  unsigned char* mRegion;
+  int mRegionSize;
+  double mSampleRate;
+  WDL_UINT64 mDeadline;
+
+  // SetParameter() writes the tail, ProcessChunk() the head. mParamSet marks the values Start() replays.
+  WDL_TypedBuf<int> mParamQueue, mParamQueued, mParamSet;
+  WDL_TypedBuf<double> mParamValues;
+  volatile int mParamHead, mParamTail;
+
+  WDL_TypedBuf<IMidiMsg> mPendingMidi;
+  int mNPendingMidi;
+  WDL_TypedBuf<char> mMsg;
+
+  int mHist[ISANDBOX_HIST_BUCKETS];
+  volatile int mBlocks, mFailures;
+  double mSumUs, mSumSqUs, mMaxUs, mSumProcessUs;
+};
+
+#ifdef HEADLESS_API
+#include "IPlugHeadless.h"
+
+class IPlugSandboxWorker
+{
+public:
+  IPlugSandboxWorker(IPlugHeadless* pPlug) : mPlug(pPlug), mCon(0), mRegion(0), mRegionSize(0), mQuit(false) {}
+
+  ~IPlugSandboxWorker()
+  {
+    DELETE_NULL(mCon);
+    if (mRegion) munmap(mRegion, mRegionSize);
+  }
+
+  // The connection name if this process was started by IPlugSandboxHost, otherwise NULL.
+  static const char* GetSandboxArg(int argc, char** argv)
+  {
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+      if (!strcmp(argv[i], ISANDBOX_WORKER_ARG)) return argv[i + 1];
+    }
+    return NULL;
+  }
+
+  // Serves the host until it quits or goes away, returns the exit code for the process.
+  int Run(const char* uniq)
+  {
+    mUniq.Set(uniq);
+    mCon = new SHM_MsgReplyConnection(262144, 16 << 20, true, uniq);
+    mCon->userData = this;
+    mCon->OnRecv = OnRecv;
+    while (!mQuit && !mCon->Run())
+    {
+      mCon->Wait();
+    }
+    return mQuit ? 0 : 1;
+  }
+
+private:
+  // pData holds the parameter values to start from.
+  bool Setup(const char* pData, int size)
+  {
+    if (size % (int) sizeof(ISandboxParamChange)) return false;
+    WDL_String name;
+    ISandboxRegionName(mUniq.Get(), &name);
+    int fd = shm_open(name.Get(), O_RDWR, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size >= (off_t) sizeof(ISandboxRegionHeader))
+    {
+      p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    mRegion = (unsigned char*) p;
+    mRegionSize = (int) st.st_size;
+
+    ISandboxRegionHeader* pHdr = (ISandboxRegionHeader*) mRegion;
+    int nChannels = pHdr->mNInputs + pHdr->mNOutputs;
+    if (pHdr->mMagic != kSandboxSetup || pHdr->mNInputs < 0 || pHdr->mNOutputs < 0 || pHdr->mMaxFrames <= 0 ||
+        sizeof(ISandboxRegionHeader) + (double) nChannels * pHdr->mMaxFrames * sizeof(double) > (double) mRegionSize)
+    {
+      return false;
+    }
+    // The plugin's own channel count wins, missing inputs read silence and extra outputs go nowhere.
+    mMaxFrames = pHdr->mMaxFrames;
+    mSilence.Resize(mMaxFrames);
+    mScratch.Resize(mMaxFrames);
+    memset(mSilence.Get(), 0, mMaxFrames * sizeof(double));
+    int i, nIn = mPlug->NInChannels(), nOut = mPlug->NOutChannels();
+    double* pChannels = (double*) (mRegion + sizeof(ISandboxRegionHeader));
+    mInputs.Resize(IPMAX(nIn, 1));
+    mOutputs.Resize(IPMAX(nOut, 1));
+    for (i = 0; i < nIn; ++i)
+    {
+      mInputs.Get()[i] = i < pHdr->mNInputs ? pChannels + i * mMaxFrames : mSilence.Get();
+    }
+    for (i = 0; i < nOut; ++i)
+    {
+      mOutputs.Get()[i] = i < pHdr->mNOutputs ? pChannels + (pHdr->mNInputs + i) * mMaxFrames : mScratch.Get();
+    }
+    mNOutputs = pHdr->mNOutputs;
+    mOutputsUsed = nOut;
+    mOutputBase = pChannels + pHdr->mNInputs * mMaxFrames;
+
+    mPlug->SetSampleRate(pHdr->mSampleRate);
+    mPlug->SetBlockSize(mMaxFrames);
+    SetParams(pData, size / (int) sizeof(ISandboxParamChange));
+    mPlug->Reset();
+    return true;
+  }
+
+  void SetParams(const char* pData, int n)
+  {
+    for (int i = 0; i < n; ++i, pData += sizeof(ISandboxParamChange))
+    {
+      ISandboxParamChange change;
+      memcpy(&change, pData, sizeof(change));
+      if (change.mIdx >= 0 && change.mIdx < mPlug->NParams())
+      {
+        IPlugBase::IMutexLock lock(mPlug);
+        mPlug->GetParam(change.mIdx)->Set(change.mValue);
+        mPlug->OnParamChange(change.mIdx);
+      }
+    }
+  }
+
+  bool Process(const char* pData, int size)
+  {
+    if (!mRegion || size < (int) sizeof(ISandboxBlockHeader)) return false;
+    ISandboxBlockHeader hdr;
+    memcpy(&hdr, pData, sizeof(hdr));
+    if (hdr.mNFrames <= 0 || hdr.mNFrames > mMaxFrames || hdr.mNParams < 0 || hdr.mNMidi < 0 ||
+        size != (int) (sizeof(hdr) + hdr.mNParams * sizeof(ISandboxParamChange) + hdr.mNMidi * sizeof(IMidiMsg)))
+    {
+      return false;
+    }
+    pData += sizeof(hdr);
+    SetParams(pData, hdr.mNParams);
+    pData += hdr.mNParams * sizeof(ISandboxParamChange);
+    int i;
+    for (i = 0; i < hdr.mNMidi; ++i, pData += sizeof(IMidiMsg))
+    {
+      IMidiMsg msg;
+      memcpy(&msg, pData, sizeof(msg));
+      mPlug->ProcessMidiMsg(&msg);
+    }
+    mPlug->LockMutexAndProcessDoubleReplacing(mInputs.Get(), mOutputs.Get(), hdr.mNFrames);
+    // Outputs the plugin doesn't have are silent.
+    for (i = mOutputsUsed; i < mNOutputs; ++i)
+    {
+      memset(mOutputBase + i * mMaxFrames, 0, hdr.mNFrames * sizeof(double));
+    }
+    return true;
+  }
+
+  static SHM_MsgReplyConnection::WaitingMessage* OnRecv(SHM_MsgReplyConnection* pCon, SHM_MsgReplyConnection::WaitingMessage* pMsg)
+  {
+    IPlugSandboxWorker* _this = (IPlugSandboxWorker*) pCon->userData;
+    ISandboxReply reply = { 0, 0, 0. };
+    WDL_UINT64 t0 = wdl_timing_now_ns();
+    switch (pMsg->m_msgtype)
+    {
+      case kSandboxSetup:
+        reply.mOK = !_this->mRegion && _this->Setup((const char*) pMsg->m_msgdata.Get(), pMsg->m_msgdata.GetSize());
+        break;
+      case kSandboxProcess:
+        reply.mOK = _this->Process((const char*) pMsg->m_msgdata.Get(), pMsg->m_msgdata.GetSize());
+        break;
+      case kSandboxQuit:
+        _this->mQuit = true;
+        break;
+    }
+    reply.mProcessUs = (double) (wdl_timing_now_ns() - t0) / 1000.;
+    pCon->Reply(pMsg->m_msgid, &reply, sizeof(reply));
+    return pMsg;
+  }
+
+  IPlugHeadless* mPlug;
+  SHM_MsgReplyConnection* mCon;
+  WDL_String mUniq;
+  unsigned char* mRegion;
+  int mRegionSize, mMaxFrames, mNOutputs, mOutputsUsed;
+  double* mOutputBase;
+  WDL_TypedBuf<double*> mInputs, mOutputs;
+  WDL_TypedBuf<double> mSilence, mScratch;
+  bool mQuit;
+};
+
+#endif // HEADLESS_API
+
+#endif // !_WIN32
+#endif // _IPLUGSANDBOX_
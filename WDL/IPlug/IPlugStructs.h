@@ -72,6 +72,9 @@ const IColor DEFAULT_TEXT_ENTRY_FGCOLOR = COLOR_BLACK;
 #elif defined OS_OSX
   const char* const DEFAULT_FONT = "Monaco";
   const int DEFAULT_TEXT_SIZE = 10;
+#elif defined OS_LINUX
+  const char* const DEFAULT_FONT = "DejaVu Sans";
+  const int DEFAULT_TEXT_SIZE = 12;
 #endif
 
 const int FONT_LEN = 32;
@@ -419,6 +419,7 @@ VstIntPtr VSTCALLBACK IPlugVST::VSTDispatcher(AEffect *pEffect, VstInt32 opCode,
           }
           if (_this->GetGUI()) _this->GetGUI()->SetParameterFromPlug(idx, v, false);
           pParam->Set(v);
+          ITRACE_PARAM(_this, idx, pParam->GetNormalized());
           _this->OnParamChange(idx);
         }
         return 1;
@@ -532,20 +533,18 @@ VstIntPtr VSTCALLBACK IPlugVST::VSTDispatcher(AEffect *pEffect, VstInt32 opCode,
       if (ptr)
       {
         bool isBank = (!idx);
-        ByteChunk* pChunk = (isBank ? &(_this->mBankState) : &(_this->mState));
-        pChunk->Resize(value);
-        memcpy(pChunk->GetBytes(), ptr, value);
+        ByteChunkView chunk(ptr, (int) value); // the host owns ptr until we return
         int pos = 0;
-        int iplugVer = _this->GetIPlugVerFromChunk(pChunk, &pos);
+        int iplugVer = _this->GetIPlugVerFromChunk(&chunk, &pos);
         isBank &= (iplugVer >= 0x010000);
         
         if (isBank)
         {
-          pos = _this->UnserializePresets(pChunk, pos);
+          pos = _this->UnserializePresets(&chunk, pos);
         }
         else
         {
-          pos = _this->UnserializeState(pChunk, pos);
+          pos = _this->UnserializeState(&chunk, pos);
           _this->ModifyCurrentPreset();
         }
         
@@ -562,6 +561,7 @@ VstIntPtr VSTCALLBACK IPlugVST::VSTDispatcher(AEffect *pEffect, VstInt32 opCode,
       VstEvents* pEvents = (VstEvents*) ptr;
       if (pEvents && pEvents->events)
       {
+        WDL_RTScope rt; // Called on the audio thread, right before processReplacing().
         for (int i = 0; i < pEvents->numEvents; ++i)
         {
           VstEvent* pEvent = pEvents->events[i];
@@ -571,6 +571,7 @@ VstIntPtr VSTCALLBACK IPlugVST::VSTDispatcher(AEffect *pEffect, VstInt32 opCode,
             {
               VstMidiEvent* pME = (VstMidiEvent*) pEvent;
               IMidiMsg msg(pME->deltaFrames, pME->midiData[0], pME->midiData[1], pME->midiData[2]);
+              ITRACE_MIDI(_this, &msg);
               _this->ProcessMidiMsg(&msg);
               //#ifdef TRACER_BUILD
               //  msg.LogMsg();
@@ -906,6 +907,7 @@ void VSTCALLBACK IPlugVST::VSTSetParameter(AEffect *pEffect, VstInt32 idx, float
       _this->GetGUI()->SetParameterFromPlug(idx, value, true);
     }
     _this->GetParam(idx)->SetNormalized(value);
+    ITRACE_PARAM(_this, idx, value);
     _this->OnParamChange(idx);
   }
 }
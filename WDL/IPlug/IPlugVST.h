@@ -75,7 +75,7 @@ private:
   enum { VSTEXT_NONE=0, VSTEXT_COCKOS, VSTEXT_COCOA }; // list of VST extensions supported by host
   int mHasVSTExtensions;
 
-  ByteChunk mState;     // Persistent storage if the host asks for plugin state.
+  ByteChunk mState;     // Persistent storage if the host asks for plugin state, keeps its allocation between saves.
   ByteChunk mBankState; // Persistent storage if the host asks for bank state.
 
 public:
@@ -409,6 +409,7 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
               {
                 GetParam(idx)->SetNormalized((double)value);
                 if (GetGUI()) GetGUI()->SetParameterFromPlug(idx, (double)value, true);
+                ITRACE_PARAM(this, idx, (double)value);
                 OnParamChange(idx);
               }
               break;
@@ -425,6 +426,7 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
     IEventList* eventList = data.inputEvents;
     if (eventList)
     {
+      WDL_RTScope rt;
       int32 numEvent = eventList->getEventCount();
       for (int32 i=0; i<numEvent; i++)
       {
@@ -437,6 +439,7 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
             case Event::kNoteOnEvent:
             {
               msg.MakeNoteOnMsg(event.noteOn.pitch, event.noteOn.velocity * 127, event.sampleOffset, event.noteOn.channel);
+              ITRACE_MIDI(this, &msg);
               ProcessMidiMsg(&msg);
               break;
             }
@@ -444,6 +447,7 @@ tresult PLUGIN_API IPlugVST3::process(ProcessData& data)
             case Event::kNoteOffEvent:
             {
               msg.MakeNoteOffMsg(event.noteOff.pitch, event.sampleOffset, event.noteOff.channel);
+              ITRACE_MIDI(this, &msg);
               ProcessMidiMsg(&msg);
               break;
             }
@@ -670,17 +674,30 @@ tresult PLUGIN_API IPlugVST3::setEditorState(IBStream* state)
   TRACE;
   WDL_MutexLock lock(&mMutex);
 
-  ByteChunk chunk;
-  SerializeState(&chunk); // to get the size
+  // The stream holds SerializeState() followed by the bypass flag. Read it into mStateChunk in
+  // one go when the stream can tell us its size, otherwise in blocks until it runs dry.
+  int64 start = 0, end = 0;
+  bool sized = (state->tell(&start) == kResultOk && state->seek(0, IBStream::kIBSeekEnd, &end) == kResultOk &&
+                state->seek(start, IBStream::kIBSeekSet, 0) == kResultOk && end > start && end - start < 0x7fffffff);
+  int32 readSize = (sized ? (int32) (end - start) : 65536), nRead;
 
-  if (chunk.Size() > 0)
+  mStateChunk.Clear();
+  do
   {
-    state->read(chunk.GetBytes(), chunk.Size());
-    UnserializeState(&chunk, 0);
+    BYTE* pBuf = mStateChunk.Extend(readSize);
+    if (!pBuf) return kResultFalse;
+    nRead = 0;
+    state->read(pBuf, readSize, &nRead);
+    mStateChunk.Resize(mStateChunk.Size() - readSize + IPMAX(nRead, 0));
+  } while (!sized && nRead == readSize);
+
+  if (mStateChunk.Size() > 0)
+  {
+    int pos = UnserializeState(&mStateChunk, 0);
     
     int32 savedBypass = 0;
     
-    if (state->read (&savedBypass, sizeof (int32)) != kResultOk)
+    if (pos < 0 || mStateChunk.Get(&savedBypass, pos) < 0)
     {
       return kResultFalse;
     }
@@ -699,19 +716,16 @@ tresult PLUGIN_API IPlugVST3::getEditorState(IBStream* state)
   TRACE;
   WDL_MutexLock lock(&mMutex);
 
-  ByteChunk chunk;
+  mStateChunk.Clear();
 
-  if (SerializeState(&chunk))
-  {
-    state->write(chunk.GetBytes(), chunk.Size());
-  }
-  else
+  if (!SerializeState(&mStateChunk))
   {
     return kResultFalse;
   }  
   
   int32 toSaveBypass = mIsBypassed ? 1 : 0;
-  state->write(&toSaveBypass, sizeof (int32));  
+  mStateChunk.Put(&toSaveBypass);
+  state->write(mStateChunk.GetBytes(), mStateChunk.Size());
 
   return kResultOk;
 }
@@ -133,6 +133,7 @@ private:
   bool mSidechainActive;
 //  IMidiQueue mMidiOutputQueue;
   Steinberg::Vst::ProcessContext mProcessContext;
+  ByteChunk mStateChunk; // Reused by get/setEditorState, so big states aren't reallocated on every save.
   std::vector <IPlugVST3View*> viewsArray;
   friend class IPlugVST3View;
 };
@@ -33,6 +33,11 @@
   #include "IPlugStandalone.h"
   typedef IPlugStandalone IPlug;
   #define API_EXT "standalone"
+#elif defined HEADLESS_API
+  #include "IPlugHeadless.h"
+  #include "IGraphicsHeadless.h"
+  typedef IPlugHeadless IPlug;
+  #define API_EXT "headless"
 #else
   #error "No API defined!"
 #endif
@@ -49,7 +54,8 @@
   #define EXPORT __attribute__ ((visibility("default")))
   #define BUNDLE_ID "com." BUNDLE_MFR "." API_EXT "." BUNDLE_NAME
 #elif defined OS_LINUX
-  //TODO
+  // Only HEADLESS_API for now.
+  #define EXPORT __attribute__ ((visibility("default")))
 #endif
 
 #endif // _IPLUG_INCLUDE_HDR_
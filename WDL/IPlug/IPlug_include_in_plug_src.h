@@ -16,7 +16,16 @@
     return TRUE;
   }
   #endif
+#endif
 
+#if defined HEADLESS_API
+  IGraphics* MakeGraphics(IPlug* pPlug, int w, int h, int FPS = 0)
+  {
+    IGraphicsHeadless* pGraphics = new IGraphicsHeadless(pPlug, w, h, FPS);
+    pGraphics->SetResourcePath(pPlug->GetResourcePath());
+    return pGraphics;
+  }
+#elif defined OS_WIN
   IGraphics* MakeGraphics(IPlug* pPlug, int w, int h, int FPS = 0)
   {
     IGraphicsWin* pGraphics = new IGraphicsWin(pPlug, w, h, FPS);
@@ -275,6 +284,16 @@ class IPlugAUFactory
       instanceInfo.mOSXBundleID.Set(BUNDLE_ID);
     #endif
 
+    return new PLUG_CLASS_NAME(instanceInfo);
+  }
+#elif defined HEADLESS_API
+  IPlug* MakePlug(const char* resourcePath)
+  {
+    static WDL_Mutex sMutex;
+    WDL_MutexLock lock(&sMutex);
+    IPlugInstanceInfo instanceInfo;
+    instanceInfo.mResourcePath.Set(resourcePath ? resourcePath : "");
+
     return new PLUG_CLASS_NAME(instanceInfo);
   }
 
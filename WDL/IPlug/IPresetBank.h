@@ -0,0 +1,487 @@
+#ifndef _IPRESETBANK_
+#define _IPRESETBANK_
+
+// IPresetBank keeps a preset library in a memory-mapped bank file instead of in ByteChunks.
+//
+// - Open() maps the file and checks its tables. Nothing else is read or decoded.
+// - Find() looks a name up in the file's hash table. NextTagged() walks a sorted tag table.
+//   Neither one allocates.
+// - GetState() points a ByteChunk at the preset's bytes inside the mapping, see
+//   ByteChunk::SetView(). Restoring a preset never copies or allocates, so it's fine on the
+//   audio thread once its pages are in memory.
+// - Prefetch() is for preset browsers. A worker thread touches the pages of the presets around
+//   the one shown, so stepping through them doesn't block on disk. The worker is started by
+//   Open() and sleeps until Prefetch() signals it. Prefetch() only stores the request, it
+//   doesn't lock or allocate, so it can be called from the audio thread.
+//
+// IPresetBankWriter builds the file. It writes to a temporary file and renames it over the old
+// one, so a bank can be saved while another instance still has it mapped (except on Windows).
+//
+// File layout, all little endian 32 bit:
+//
+//   header      'IPBK', version, plugin unique ID, number of presets, number of name hash slots,
+//               number of tag references, file size, 0
+//   presets     per preset: name offset, tags offset, state offset, state size, name hash
+//   name slots  preset index + 1 or 0, open addressing with linear probing, a power of two
+//   tag hashes  one per (tag, preset) pair, sorted
+//   tag presets the preset index for each of those
+//   strings     null terminated names and tags (comma separated)
+//   states      whatever SerializeState() wrote for each preset
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Containers.h"
+#include "../fileread.h"
+#include "../heapbuf.h"
+#include "../wdlatomic.h"
+#include "IWorkerSignal.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+#define PRESETBANK_MAGIC 0x4B425049 // "IPBK"
+#define PRESETBANK_VERSION 1
+#define PRESETBANK_HEADER_SIZE 32
+#define PRESETBANK_ENTRY_SIZE 20
+#define PRESETBANK_PAGE_SIZE 4096
+#define PRESETBANK_PREFETCH_RADIUS 8
+#define PRESETBANK_PREFETCH_MAX_RADIUS 127 // A request is packed into an int as idx << 7 | radius.
+
+class IPresetBank
+{
+public:
+  IPresetBank()
+    : mFile(0), mData(0), mSize(0), mNPresets(0), mNSlots(0), mNTagRefs(0)
+    , mPrefetchRequest(0), mPrefetchSeq(0), mHasThread(false), mQuit(false) {}
+
+  ~IPresetBank()
+  {
+    Close();
+  }
+
+  // Fails if the file isn't a bank, is damaged, or is for another plugin (uniqueID 0 skips that check).
+  bool Open(const char* path, int uniqueID)
+  {
+    Close();
+    // Map anything up to 2 GB, WDL_FileRead falls back to reading it into memory if it can't.
+    mFile = new WDL_FileRead(path, 0, 0, 0, 0, 0x7fffffff);
+    int size = (mFile->IsOpen() && mFile->GetSize() < 0x7fffffff ? (int) mFile->GetSize() : 0);
+    mData = (size ? (const unsigned char*) mFile->GetMappedView(0, &size) : 0);
+    if (!mData || !Check(size, uniqueID))
+    {
+      Close();
+      return false;
+    }
+    mSize = size;
+    StartPrefetch();
+    return true;
+  }
+
+  void Close()
+  {
+    StopPrefetch();
+    DELETE_NULL(mFile);
+    mData = 0;
+    mSize = mNPresets = mNSlots = mNTagRefs = 0;
+  }
+
+  bool IsOpen() { return !!mData; }
+  int NPresets() { return mNPresets; }
+
+  const char* GetName(int idx)
+  {
+    return (idx >= 0 && idx < mNPresets ? (const char*) mData + Get32(Entry(idx)) : "");
+  }
+
+  const char* GetTags(int idx)
+  {
+    return (idx >= 0 && idx < mNPresets ? (const char*) mData + Get32(Entry(idx) + 4) : "");
+  }
+
+  // Index of the first preset called name, or -1.
+  int Find(const char* name)
+  {
+    if (!mNSlots || !name) return -1;
+    const unsigned char* pSlots = Slots();
+    unsigned int h = Hash(name, -1), mask = mNSlots - 1, i = h & mask;
+    for (int n = 0; n < mNSlots; ++n, i = (i + 1) & mask)
+    {
+      unsigned int slot = Get32(pSlots + i * 4);
+      if (!slot) break;
+      if (Get32(Entry(slot - 1) + 16) == h && !strcmp(GetName(slot - 1), name)) return slot - 1;
+    }
+    return -1;
+  }
+
+  // Presets tagged with tag, in bank order. Start with *pPos = 0, returns -1 when there are no more.
+  int NextTagged(const char* tag, int* pPos)
+  {
+    unsigned int h = Hash(tag, -1);
+    const unsigned char* pHashes = TagHashes();
+    const unsigned char* pPresets = pHashes + mNTagRefs * 4;
+    int lo = 0, hi = mNTagRefs;
+    while (lo < hi) // First reference with this hash.
+    {
+      int mid = (lo + hi) / 2;
+      if (Get32(pHashes + mid * 4) < h) lo = mid + 1;
+      else hi = mid;
+    }
+    int tagLen = (int) strlen(tag);
+    for (int i = lo + *pPos; i < mNTagRefs && Get32(pHashes + i * 4) == h; ++i)
+    {
+      int idx = (int) Get32(pPresets + i * 4);
+      if (HasTag(GetTags(idx), tag, tagLen))
+      {
+        *pPos = i - lo + 1;
+        return idx;
+      }
+    }
+    *pPos = mNTagRefs;
+    return -1;
+  }
+
+  // Points pChunk at the preset's state inside the mapping, valid until Close().
+  bool GetState(int idx, ByteChunk* pChunk)
+  {
+    if (idx < 0 || idx >= mNPresets) return false;
+    const unsigned char* pEntry = Entry(idx);
+    pChunk->SetView(mData + Get32(pEntry + 8), (int) Get32(pEntry + 12));
+    return true;
+  }
+
+  // Brings the states of the presets within radius of idx into memory on the worker thread.
+  // Any thread may call it, a newer request replaces one the worker hasn't finished.
+  void Prefetch(int idx, int radius = PRESETBANK_PREFETCH_RADIUS)
+  {
+    if (!mHasThread || mNPresets < 1) return;
+    idx = IPMIN(IPMAX(idx, 0), mNPresets - 1);
+    radius = IPMIN(IPMAX(radius, 0), PRESETBANK_PREFETCH_MAX_RADIUS);
+    wdl_atomic_set(&mPrefetchRequest, idx << 7 | radius);
+    wdl_atomic_incr(&mPrefetchSeq);
+    mSignal.Signal();
+  }
+
+  static unsigned int Hash(const char* str, int len)
+  {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; len < 0 ? !!str[i] : i < len; ++i)
+    {
+      h ^= (unsigned char) str[i];
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  static unsigned int Get32(const unsigned char* p)
+  {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+  }
+
+private:
+  const unsigned char* Entry(int idx) { return mData + PRESETBANK_HEADER_SIZE + idx * PRESETBANK_ENTRY_SIZE; }
+  const unsigned char* Slots() { return Entry(mNPresets); }
+  const unsigned char* TagHashes() { return Slots() + mNSlots * 4; }
+
+  static bool HasTag(const char* tags, const char* tag, int tagLen)
+  {
+    while (*tags)
+    {
+      while (*tags == ' ' || *tags == ',') ++tags;
+      const char* pEnd = tags;
+      while (*pEnd && *pEnd != ',') ++pEnd;
+      const char* pLast = pEnd;
+      while (pLast > tags && pLast[-1] == ' ') --pLast;
+      if (pLast - tags == tagLen && !strncmp(tags, tag, tagLen)) return true;
+      tags = pEnd;
+    }
+    return false;
+  }
+
+  // Validates every table once, so the accessors can trust offsets.
+  bool Check(int size, int uniqueID)
+  {
+    const unsigned char* p = mData;
+    if (size < PRESETBANK_HEADER_SIZE || Get32(p) != PRESETBANK_MAGIC || Get32(p + 4) != PRESETBANK_VERSION ||
+        (uniqueID && (int) Get32(p + 8) != uniqueID) || (int) Get32(p + 24) != size) return false;
+
+    unsigned int nPresets = Get32(p + 12), nSlots = Get32(p + 16), nTagRefs = Get32(p + 20);
+    if (nPresets > 0x1000000 || nSlots > 0x4000000 || (nSlots & (nSlots - 1)) || nSlots < nPresets ||
+        nTagRefs > 0x4000000) return false;
+    int stringsPos = PRESETBANK_HEADER_SIZE + nPresets * PRESETBANK_ENTRY_SIZE + nSlots * 4 + nTagRefs * 8;
+    if (stringsPos > size) return false;
+
+    mNPresets = nPresets;
+    mNSlots = nSlots;
+    mNTagRefs = nTagRefs;
+    int i;
+    for (i = 0; i < mNPresets; ++i)
+    {
+      const unsigned char* pEntry = Entry(i);
+      unsigned int name = Get32(pEntry), tags = Get32(pEntry + 4), state = Get32(pEntry + 8), stateSize = Get32(pEntry + 12);
+      if (name < (unsigned int) stringsPos || tags < (unsigned int) stringsPos || name >= (unsigned int) size ||
+          tags >= (unsigned int) size || state > (unsigned int) size || stateSize > (unsigned int) size - state) return false;
+      // Both strings have to be null terminated inside the file.
+      if ((int) strnlen((const char*) p + name, size - name) >= (int) (size - name) ||
+          (int) strnlen((const char*) p + tags, size - tags) >= (int) (size - tags)) return false;
+    }
+    const unsigned char* pSlots = Slots();
+    for (i = 0; i < mNSlots; ++i)
+    {
+      if (Get32(pSlots + i * 4) > (unsigned int) mNPresets) return false;
+    }
+    const unsigned char* pTagPresets = TagHashes() + mNTagRefs * 4;
+    for (i = 0; i < mNTagRefs; ++i)
+    {
+      if (Get32(pTagPresets + i * 4) >= (unsigned int) mNPresets) return false;
+    }
+    return true;
+  }
+
+  void RunPrefetch()
+  {
+    int done = wdl_atomic_get(&mPrefetchSeq);
+    while (!mQuit)
+    {
+      int seq = wdl_atomic_get(&mPrefetchSeq);
+      if (seq == done)
+      {
+        mSignal.Wait();
+        continue;
+      }
+      done = seq;
+      int request = wdl_atomic_get(&mPrefetchRequest);
+      int center = request >> 7, radius = request & PRESETBANK_PREFETCH_MAX_RADIUS;
+      int first = IPMAX(center - radius, 0), last = IPMIN(center + radius, mNPresets - 1);
+      if (center < first || center > last) continue;
+
+      // Nearest first, a newer request takes over as soon as it comes in.
+      for (int d = 0; center - d >= first || center + d <= last; ++d)
+      {
+        if (center + d <= last) Touch(center + d);
+        if (d && center - d >= first) Touch(center - d);
+        if (wdl_atomic_get(&mPrefetchSeq) != done || mQuit) break;
+      }
+    }
+  }
+
+  void Touch(int idx)
+  {
+    const unsigned char* pEntry = Entry(idx);
+    const unsigned char* p = mData + Get32(pEntry + 8);
+    int size = (int) Get32(pEntry + 12);
+    volatile unsigned char sum = 0;
+    for (int i = 0; i < size; i += PRESETBANK_PAGE_SIZE) sum += p[i];
+    if (size) sum += p[size - 1];
+  }
+
+  void StartPrefetch()
+  {
+#ifdef _WIN32
+    unsigned id;
+    mThread = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, this, 0, &id);
+    mHasThread = !!mThread;
+#else
+    mHasThread = !pthread_create(&mThread, NULL, ThreadProc, this);
+#endif
+  }
+
+  void StopPrefetch()
+  {
+    if (!mHasThread) return;
+    mQuit = true;
+    mSignal.Signal();
+#ifdef _WIN32
+    WaitForSingleObject(mThread, INFINITE);
+    CloseHandle(mThread);
+#else
+    void* p;
+    pthread_join(mThread, &p);
+#endif
+    mHasThread = mQuit = false;
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void* p)
+  {
+    ((IPresetBank*) p)->RunPrefetch();
+    return 0;
+  }
+#else
+  static void* ThreadProc(void* p)
+  {
+    ((IPresetBank*) p)->RunPrefetch();
+    return 0;
+  }
+#endif
+
+  WDL_FileRead* mFile;
+  const unsigned char* mData;
+  int mSize, mNPresets, mNSlots, mNTagRefs;
+
+  IWorkerSignal mSignal;
+  volatile int mPrefetchRequest, mPrefetchSeq; // The worker compares mPrefetchSeq between presets.
+  bool mHasThread;
+  volatile bool mQuit;
+#ifdef _WIN32
+  HANDLE mThread;
+#else
+  pthread_t mThread;
+#endif
+};
+
+class IPresetBankWriter
+{
+public:
+  // state may be 0 if size is 0. tags is a comma separated list, or 0.
+  void Add(const char* name, const char* tags, const void* pState, int size)
+  {
+    Preset preset;
+    preset.mName = AddString(name);
+    preset.mTags = AddString(tags ? tags : "");
+    preset.mState = mStates.GetSize();
+    preset.mStateSize = size;
+    mPresets.Add(preset);
+    if (size > 0)
+    {
+      int n = mStates.GetSize();
+      memcpy((char*) mStates.Resize(n + size, false) + n, pState, size);
+    }
+  }
+
+  int NPresets() { return mPresets.GetSize(); }
+
+  bool Write(const char* path, int uniqueID)
+  {
+    int i, nPresets = mPresets.GetSize();
+    const char* pStrings = (const char*) mStrings.Get();
+    unsigned int nSlots = 16;
+    while (nSlots < (unsigned int) nPresets * 2) nSlots <<= 1;
+
+    // (hash, preset) for every tag of every preset, sorted by hash.
+    WDL_TypedBuf<TagRef> tagRefs;
+    for (i = 0; i < nPresets; ++i)
+    {
+      const char* tags = pStrings + mPresets.Get()[i].mTags;
+      while (*tags)
+      {
+        while (*tags == ' ' || *tags == ',') ++tags;
+        const char* pEnd = tags;
+        while (*pEnd && *pEnd != ',') ++pEnd;
+        const char* pLast = pEnd;
+        while (pLast > tags && pLast[-1] == ' ') --pLast;
+        if (pLast > tags)
+        {
+          TagRef ref = { IPresetBank::Hash(tags, (int) (pLast - tags)), (unsigned int) i };
+          tagRefs.Add(ref);
+        }
+        tags = pEnd;
+      }
+    }
+    qsort(tagRefs.Get(), tagRefs.GetSize(), sizeof(TagRef), CompareTagRefs);
+    int nTagRefs = tagRefs.GetSize();
+
+    int stringsPos = PRESETBANK_HEADER_SIZE + nPresets * PRESETBANK_ENTRY_SIZE + nSlots * 4 + nTagRefs * 8;
+    int statesPos = stringsPos + mStrings.GetSize();
+    int fileSize = statesPos + mStates.GetSize();
+
+    WDL_HeapBuf tables;
+    unsigned char* p = (unsigned char*) tables.ResizeOK(stringsPos, false);
+    if (!p) return false;
+    memset(p, 0, stringsPos);
+    Put32(p, PRESETBANK_MAGIC);
+    Put32(p + 4, PRESETBANK_VERSION);
+    Put32(p + 8, uniqueID);
+    Put32(p + 12, nPresets);
+    Put32(p + 16, nSlots);
+    Put32(p + 20, nTagRefs);
+    Put32(p + 24, fileSize);
+
+    unsigned char* pEntry = p + PRESETBANK_HEADER_SIZE;
+    unsigned char* pSlots = pEntry + nPresets * PRESETBANK_ENTRY_SIZE;
+    for (i = 0; i < nPresets; ++i, pEntry += PRESETBANK_ENTRY_SIZE)
+    {
+      Preset* pPreset = mPresets.Get() + i;
+      unsigned int h = IPresetBank::Hash(pStrings + pPreset->mName, -1);
+      Put32(pEntry, stringsPos + pPreset->mName);
+      Put32(pEntry + 4, stringsPos + pPreset->mTags);
+      Put32(pEntry + 8, statesPos + pPreset->mState);
+      Put32(pEntry + 12, pPreset->mStateSize);
+      Put32(pEntry + 16, h);
+
+      // The first preset with a name keeps its slot, as RestorePreset(name) finds the first one.
+      unsigned int slot;
+      for (slot = h & (nSlots - 1); IPresetBank::Get32(pSlots + slot * 4); slot = (slot + 1) & (nSlots - 1))
+      {
+        if (!strcmp(pStrings + mPresets.Get()[IPresetBank::Get32(pSlots + slot * 4) - 1].mName, pStrings + pPreset->mName)) break;
+      }
+      if (!IPresetBank::Get32(pSlots + slot * 4)) Put32(pSlots + slot * 4, i + 1);
+    }
+    unsigned char* pTagHashes = pSlots + nSlots * 4;
+    for (i = 0; i < nTagRefs; ++i)
+    {
+      Put32(pTagHashes + i * 4, tagRefs.Get()[i].mHash);
+      Put32(pTagHashes + (nTagRefs + i) * 4, tagRefs.Get()[i].mPreset);
+    }
+
+    WDL_String tmpPath;
+    tmpPath.SetFormatted(4096, "%s.tmp", path);
+    FILE* fp = fopen(tmpPath.Get(), "wb");
+    if (!fp) return false;
+    bool ok = (fwrite(p, 1, stringsPos, fp) == (size_t) stringsPos &&
+               fwrite(mStrings.Get(), 1, mStrings.GetSize(), fp) == (size_t) mStrings.GetSize() &&
+               fwrite(mStates.Get(), 1, mStates.GetSize(), fp) == (size_t) mStates.GetSize());
+    ok &= !fclose(fp);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmpPath.Get(), path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && !rename(tmpPath.Get(), path);
+#endif
+    if (!ok) remove(tmpPath.Get());
+    return ok;
+  }
+
+private:
+  struct Preset
+  {
+    int mName, mTags, mState, mStateSize;
+  };
+
+  struct TagRef
+  {
+    unsigned int mHash, mPreset;
+  };
+
+  int AddString(const char* str)
+  {
+    int pos = mStrings.GetSize(), len = (int) strlen(str) + 1;
+    memcpy((char*) mStrings.Resize(pos + len, false) + pos, str, len);
+    return pos;
+  }
+
+  static void Put32(unsigned char* p, unsigned int v)
+  {
+    p[0] = (unsigned char) v;
+    p[1] = (unsigned char) (v >> 8);
+    p[2] = (unsigned char) (v >> 16);
+    p[3] = (unsigned char) (v >> 24);
+  }
+
+  static int CompareTagRefs(const void* a, const void* b)
+  {
+    const TagRef* pA = (const TagRef*) a;
+    const TagRef* pB = (const TagRef*) b;
+    if (pA->mHash != pB->mHash) return (pA->mHash < pB->mHash ? -1 : 1);
+    return (pA->mPreset < pB->mPreset ? -1 : pA->mPreset > pB->mPreset);
+  }
+
+  WDL_TypedBuf<Preset> mPresets;
+  WDL_HeapBuf mStrings, mStates;
+};
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef _IREDRAWSCHEDULER_
+#define _IREDRAWSCHEDULER_
+
+// IRedrawScheduler decides when the OS specific IGraphics class should poll
+// the controls for dirtiness, and how long its timer should sleep in between.
+//
+// It has no OS dependencies of its own: the OS class feeds it timestamps (in
+// milliseconds, see GetTimeMs()) and display information, calls OnTick() from
+// its timer, and reprograms the timer from GetInterval() when that changes.
+//
+// - IControl::SetDirty() calls Wake(), which brings a throttled editor back to
+//   full rate straight away (via the wake callback, if the OS class set one).
+// - If SetEventDriven(true) is called, ticks where nothing has called Wake()
+//   and nothing was dirty last time skip the IsDirty() scan altogether.
+//   Only enable this if all your controls go through IControl::SetDirty().
+// - When nothing has been dirty for a while, or the window is occluded, the
+//   polling rate drops to the idle/occluded rate.
+// - With vblank pacing enabled, frames are snapped to whole display refresh
+//   periods, and GetIntervalFrom() returns the time to the next aligned vblank.
+
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <mach/mach_time.h>
+#else
+  #include <time.h>
+#endif
+
+#include "../wdlatomic.h"
+
+#define REDRAW_IDLE_FPS 4
+#define REDRAW_OCCLUDED_FPS 1
+// Seconds without anything being dirty before we throttle down to REDRAW_IDLE_FPS.
+#define REDRAW_IDLE_SECONDS 2.0
+
+class IRedrawScheduler
+{
+public:
+  struct Stats
+  {
+    int mTicks;           // Timer ticks seen.
+    int mPolls;           // Ticks that scanned the controls.
+    int mFrames;          // Polls that found something dirty.
+    volatile int mWakes;  // Calls to Wake(), from any thread.
+    double mLastDrawMs, mAvgDrawMs, mMaxDrawMs;   // Time spent in IGraphics::Draw().
+    double mLastFrameIntervalMs, mAvgFrameIntervalMs;  // Time between dirty polls.
+  };
+
+  IRedrawScheduler(int fps = 25)
+    : mFPS(fps > 0 ? fps : 25), mIdleFPS(REDRAW_IDLE_FPS), mIdleTicks(0), mIdleTicksLimit(0),
+      mEventDriven(false), mVBlankPacing(false), mOccluded(false), mThrottled(false), mLastPollDirty(true),
+      mWake(0), mWakeCallbackPending(0), mWakeFunc(0), mWakeCtx(0),
+      mRefreshPeriodMs(0.0), mLastVBlankMs(0.0), mNextDueMs(0.0), mLastFrameMs(-1.0), mDrawStartMs(0.0)
+  {
+    SetIdleThrottle(REDRAW_IDLE_SECONDS, REDRAW_IDLE_FPS);
+    ResetStats();
+  }
+
+  void SetFPS(int fps)
+  {
+    if (fps > 0) mFPS = fps;
+    SetIdleThrottle(REDRAW_IDLE_SECONDS, mIdleFPS);
+  }
+  int FPS() const { return mFPS; }
+
+  // Throttle polling to idleFPS after idleSeconds without anything dirty.
+  // Pass idleFPS <= 0 (or >= FPS()) to never throttle.
+  void SetIdleThrottle(double idleSeconds, int idleFPS)
+  {
+    mIdleFPS = idleFPS;
+    mIdleTicksLimit = (int) (idleSeconds * (double) mFPS + 0.5);
+  }
+
+  // If true, clean ticks without a Wake() skip the IsDirty() scan.
+  void SetEventDriven(bool enable) { mEventDriven = enable; }
+  bool IsEventDriven() const { return mEventDriven; }
+
+  // refreshPeriodMs <= 0 means "unknown", lastVBlankMs is the time of any past vblank (0 if unknown).
+  void SetDisplayTiming(double refreshPeriodMs, double lastVBlankMs = 0.0)
+  {
+    mRefreshPeriodMs = refreshPeriodMs;
+    mLastVBlankMs = lastVBlankMs;
+  }
+  void EnableVBlankPacing(bool enable) { mVBlankPacing = enable; }
+  bool VBlankPacingEnabled() const { return mVBlankPacing; }
+  // True if pacing is enabled and the display timing is known.
+  bool VBlankPacing() const { return mVBlankPacing && mRefreshPeriodMs > 0.0; }
+
+  void SetOccluded(bool occluded)
+  {
+    if (occluded != mOccluded)
+    {
+      mOccluded = occluded;
+      mIdleTicks = 0;
+      mLastPollDirty = true; // Catch up on anything missed as soon as we are visible.
+    }
+  }
+  bool IsOccluded() const { return mOccluded; }
+  bool IsThrottled() const { return mThrottled || mOccluded; }
+
+  // Called whenever the wake flag goes up while throttled, from whatever thread called Wake().
+  // The OS class should use it to kick its timer (e.g. PostMessage) - it must be thread safe.
+  void SetWakeCallback(void (*func)(void* ctx), void* ctx)
+  {
+    mWakeFunc = func;
+    mWakeCtx = ctx;
+  }
+
+  // Thread safe.
+  void Wake()
+  {
+    wdl_atomic_set(&mWake, 1);
+    wdl_atomic_incr(&mStats.mWakes);
+    if (mThrottled && !mOccluded && mWakeFunc && wdl_atomic_incr(&mWakeCallbackPending) == 1)
+    {
+      mWakeFunc(mWakeCtx);
+    }
+  }
+
+  // Called from the OS timer. Returns true if the controls should be polled now.
+  bool OnTick(double nowMs)
+  {
+    ++mStats.mTicks;
+    bool woken = (wdl_atomic_get(&mWake) != 0);
+    if (woken)
+    {
+      wdl_atomic_set(&mWake, 0);
+      wdl_atomic_set(&mWakeCallbackPending, 0);
+      if (!mOccluded)
+      {
+        mThrottled = false;
+        mIdleTicks = 0;
+      }
+    }
+
+    // OS timers fire early now and then, allow half a frame of slack.
+    if (!woken && nowMs < mNextDueMs - 500.0 / (double) mFPS) return false;
+    if (mEventDriven && !woken && !mLastPollDirty && !IsThrottled())
+    {
+      mNextDueMs = nowMs + GetInterval();
+      return false;
+    }
+    ++mStats.mPolls;
+    return true;
+  }
+
+  // Called after polling, dirty is the return value of IGraphics::IsDirty().
+  void OnPolled(double nowMs, bool dirty)
+  {
+    mLastPollDirty = dirty;
+    if (dirty)
+    {
+      mIdleTicks = 0;
+      mThrottled = false;
+      ++mStats.mFrames;
+      if (mLastFrameMs >= 0.0)
+      {
+        double dt = nowMs - mLastFrameMs;
+        mStats.mLastFrameIntervalMs = dt;
+        mStats.mAvgFrameIntervalMs = Average(mStats.mAvgFrameIntervalMs, dt, mStats.mFrames);
+      }
+      mLastFrameMs = nowMs;
+    }
+    else if (!mThrottled && mIdleFPS > 0 && mIdleFPS < mFPS && ++mIdleTicks > mIdleTicksLimit)
+    {
+      mThrottled = true;
+    }
+    mNextDueMs = (IsThrottled() ? nowMs + GetInterval() : NextFrameTime(nowMs));
+  }
+
+  void OnDrawBegin(double nowMs) { mDrawStartMs = nowMs; }
+  void OnDrawEnd(double nowMs)
+  {
+    double dt = nowMs - mDrawStartMs;
+    mStats.mLastDrawMs = dt;
+    mStats.mAvgDrawMs = Average(mStats.mAvgDrawMs, dt, mStats.mFrames);
+    if (dt > mStats.mMaxDrawMs) mStats.mMaxDrawMs = dt;
+  }
+
+  // The timer period the OS class should currently be using, in ms.
+  int GetInterval() const
+  {
+    int fps = mFPS;
+    if (mOccluded) fps = REDRAW_OCCLUDED_FPS;
+    else if (mThrottled) fps = mIdleFPS;
+    double ms = 1000.0 / (double) fps;
+    if (!IsThrottled() && VBlankPacing())
+    {
+      ms = mRefreshPeriodMs * floor(ms / mRefreshPeriodMs + 0.5);
+      if (ms < mRefreshPeriodMs) ms = mRefreshPeriodMs;
+    }
+    return (int) (ms + 0.5);
+  }
+
+  // Time from nowMs until the next tick is due, for OS timers that can be reprogrammed every tick.
+  int GetIntervalFrom(double nowMs) const
+  {
+    double ms = mNextDueMs - nowMs;
+    if (ms < 1.0) ms = 1.0;
+    return (int) (ms + 0.5);
+  }
+
+  const Stats* GetStats() const { return &mStats; }
+  void ResetStats() { memset(&mStats, 0, sizeof(Stats)); }
+
+  // Monotonic time in milliseconds, arbitrary origin.
+  static double GetTimeMs()
+  {
+#ifdef _WIN32
+    static double sMsPerCount = 0.0;
+    LARGE_INTEGER now;
+    if (sMsPerCount == 0.0)
+    {
+      LARGE_INTEGER freq;
+      QueryPerformanceFrequency(&freq);
+      sMsPerCount = 1000.0 / (double) freq.QuadPart;
+    }
+    QueryPerformanceCounter(&now);
+    return (double) now.QuadPart * sMsPerCount;
+#elif defined(__APPLE__)
+    static double sMsPerTick = 0.0;
+    if (sMsPerTick == 0.0)
+    {
+      mach_timebase_info_data_t tb;
+      mach_timebase_info(&tb);
+      sMsPerTick = (double) tb.numer / (double) tb.denom / 1000000.0;
+    }
+    return (double) mach_absolute_time() * sMsPerTick;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1000.0 + (double) ts.tv_nsec / 1000000.0;
+#endif
+  }
+
+private:
+  // Next frame deadline after a frame at nowMs, snapped to the vblank grid if pacing.
+  double NextFrameTime(double nowMs) const
+  {
+    double due = nowMs + (double) GetInterval();
+    if (VBlankPacing() && mLastVBlankMs > 0.0)
+    {
+      double n = floor((due - mLastVBlankMs) / mRefreshPeriodMs + 0.5);
+      due = mLastVBlankMs + n * mRefreshPeriodMs;
+      if (due <= nowMs) due += mRefreshPeriodMs;
+    }
+    return due;
+  }
+
+  static double Average(double avg, double x, int n)
+  {
+    return (n > 1 ? avg + (x - avg) / (double) n : x);
+  }
+
+  int mFPS, mIdleFPS, mIdleTicks, mIdleTicksLimit;
+  bool mEventDriven, mVBlankPacing, mOccluded, mThrottled, mLastPollDirty;
+  volatile int mWake;
+  volatile int mWakeCallbackPending;
+  void (*mWakeFunc)(void* ctx);
+  void* mWakeCtx;
+  double mRefreshPeriodMs, mLastVBlankMs, mNextDueMs, mLastFrameMs, mDrawStartMs;
+  Stats mStats;
+};
+
+#endif // _IREDRAWSCHEDULER_
@@ -0,0 +1,285 @@
+#ifndef _ISVGCACHE_
+#define _ISVGCACHE_
+
+// ISVGCache rasterises SVG resources at whatever size the editor asks for, so a skin can
+// ship one vector file per image instead of PNG strips at 1x, 2x and 3x.
+//
+// - Sources are kept as text, keyed by resource ID.
+// - Each (ID, width, height) gets its own bitmap. It is handed out straight away and stays
+//   valid for the life of the cache, like the bitmaps LoadIBitmap() returns.
+// - In background mode that bitmap starts out transparent and a worker thread renders a
+//   copy. Update(), called by IGraphics::IsDirty() on the GUI thread, copies finished
+//   renders in. Every IGraphics compares GetNRendered() against what it last saw and
+//   redraws when it changes.
+// - The worker only runs while there is something queued.
+//
+// Define IPLUG_SVG_SUPPORT and build lice_svg.cpp and tinyxml to use it through IGraphics::LoadISVG().
+
+#include <stdio.h>
+#include "../lice/lice.h"
+#include "../mutex.h"
+#include "../ptrlist.h"
+#include "../wdlstring.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <process.h>
+#else
+  #include <pthread.h>
+#endif
+
+class ISVGCache
+{
+public:
+  struct Source
+  {
+    int mID;
+    WDL_String mSVG;  // Never changes once added, so the worker reads it without the lock.
+  };
+
+  ISVGCache() : mNRendered(0), mThreadRunning(false), mHasThread(false), mQuit(false) {}
+
+  ~ISVGCache()
+  {
+    Stop();
+    mRasters.Empty(true);
+    mSources.Empty(true);
+  }
+
+  // Joins the worker. IGraphics calls this when the last editor closes, so the thread isn't left for the
+  // static destructor, which runs under the Windows loader lock where joining a thread can deadlock.
+  // Rasters still queued are rendered once Get() asks for them again.
+  void Stop()
+  {
+    mMutex.Enter();
+    mQuit = true;
+    mMutex.Leave();
+    JoinThread();
+    mMutex.Enter();
+    mQuit = false;
+    mMutex.Leave();
+  }
+
+  bool HasSource(int ID)
+  {
+    WDL_MutexLock lock(&mMutex);
+    return !!FindSource(ID);
+  }
+
+  void AddSource(int ID, const char* svg)
+  {
+    WDL_MutexLock lock(&mMutex);
+    if (!FindSource(ID))
+    {
+      Source* pSource = mSources.Add(new Source);
+      pSource->mID = ID;
+      pSource->mSVG.Set(svg);
+    }
+  }
+
+  // Returns the bitmap for ID at w x h pixels, or 0 if there is no source for ID.
+  // Without background (or if the worker can't be started) it is rasterised before returning.
+  LICE_IBitmap* Get(int ID, int w, int h, bool background)
+  {
+    WDL_MutexLock lock(&mMutex);
+    Source* pSource = FindSource(ID);
+    if (!pSource || w <= 0 || h <= 0) return 0;
+
+    Raster* pRaster = FindRaster(ID, w, h);
+    if (!pRaster)
+    {
+      pRaster = mRasters.Add(new Raster(pSource, w, h));
+      if (background && StartThread())
+      {
+        pRaster->mState = kQueued;
+        return &pRaster->mBitmap;
+      }
+    }
+    else if (pRaster->mState != kQueued || (background && StartThread()))
+    {
+      // StartThread() picks up rasters that Stop() left queued.
+      return &pRaster->mBitmap;
+    }
+
+    // The worker only takes queued rasters while holding the lock, so render it in place.
+    Render(pSource, &pRaster->mBitmap, w, h);
+    pRaster->mState = kDone;
+    return &pRaster->mBitmap;
+  }
+
+  // GUI thread. Copies finished background renders into the bitmaps handed out by Get(),
+  // and returns GetNRendered() as of those copies.
+  int Update()
+  {
+    WDL_MutexLock lock(&mMutex);
+    int i, n = mRasters.GetSize();
+    for (i = 0; i < n; ++i)
+    {
+      Raster* pRaster = mRasters.Get(i);
+      if (pRaster->mState == kRendered)
+      {
+        if (pRaster->mRendered)
+        {
+          LICE_Copy(&pRaster->mBitmap, pRaster->mRendered);
+          delete(pRaster->mRendered);
+          pRaster->mRendered = 0;
+        }
+        pRaster->mState = kDone;
+      }
+    }
+    return mNRendered;
+  }
+
+  // Number of background renders finished so far, safe to read from any thread.
+  int GetNRendered() const { return mNRendered; }
+
+  static bool Render(Source* pSource, LICE_IBitmap* pBitmap, int w, int h)
+  {
+    return !!LICE_LoadSVGFromBufferScaled(pSource->mSVG.Get(), pSource->mSVG.GetLength(), w, h, pBitmap);
+  }
+
+  static bool ReadFile(const char* filename, WDL_String* pSVG)
+  {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    pSVG->Set("");
+    char buf[4096];
+    int n;
+    while ((n = (int) fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+      pSVG->Append(buf, n);
+    }
+    fclose(fp);
+    return pSVG->GetLength() > 0;
+  }
+
+private:
+  enum ERasterState { kDone, kQueued, kRendering, kRendered };
+
+  struct Raster
+  {
+    Source* mSource;
+    int mW, mH;
+    ERasterState mState;
+    LICE_MemBitmap mBitmap;       // Handed out by Get().
+    LICE_MemBitmap* mRendered;    // Worker output waiting for Update().
+
+    Raster(Source* pSource, int w, int h)
+      : mSource(pSource), mW(w), mH(h), mState(kDone), mBitmap(w, h), mRendered(0)
+    {
+      LICE_Clear(&mBitmap, 0);
+    }
+    ~Raster() { delete(mRendered); }
+  };
+
+  Source* FindSource(int ID)
+  {
+    int i, n = mSources.GetSize();
+    for (i = 0; i < n; ++i)
+    {
+      if (mSources.Get(i)->mID == ID) return mSources.Get(i);
+    }
+    return 0;
+  }
+
+  Raster* FindRaster(int ID, int w, int h)
+  {
+    int i, n = mRasters.GetSize();
+    for (i = 0; i < n; ++i)
+    {
+      Raster* pRaster = mRasters.Get(i);
+      if (pRaster->mSource->mID == ID && pRaster->mW == w && pRaster->mH == h) return pRaster;
+    }
+    return 0;
+  }
+
+  void RunWorker()
+  {
+    for (;;)
+    {
+      Raster* pRaster = 0;
+      mMutex.Enter();
+      int i, n = (mQuit ? 0 : mRasters.GetSize());
+      for (i = 0; i < n && !pRaster; ++i)
+      {
+        if (mRasters.Get(i)->mState == kQueued) pRaster = mRasters.Get(i);
+      }
+      if (!pRaster)
+      {
+        mThreadRunning = false;
+        mMutex.Leave();
+        return;
+      }
+      pRaster->mState = kRendering;
+      mMutex.Leave();
+
+      LICE_MemBitmap* pRendered = new LICE_MemBitmap;
+      if (!Render(pRaster->mSource, pRendered, pRaster->mW, pRaster->mH))
+      {
+        delete(pRendered);
+        pRendered = 0;
+      }
+
+      mMutex.Enter();
+      pRaster->mRendered = pRendered;
+      pRaster->mState = kRendered;
+      ++mNRendered;
+      mMutex.Leave();
+    }
+  }
+
+  // Called with the mutex held.
+  bool StartThread()
+  {
+    if (mThreadRunning) return true;
+    if (mQuit) return false;
+    // A worker that found nothing left to do may still be on its way out.
+    JoinThread();
+#ifdef _WIN32
+    unsigned id;
+    mThread = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, this, 0, &id);
+    mHasThread = !!mThread;
+#else
+    mHasThread = !pthread_create(&mThread, NULL, ThreadProc, this);
+#endif
+    mThreadRunning = mHasThread;
+    return mHasThread;
+  }
+
+  void JoinThread()
+  {
+    if (!mHasThread) return;
+#ifdef _WIN32
+    WaitForSingleObject(mThread, INFINITE);
+    CloseHandle(mThread);
+#else
+    void* p;
+    pthread_join(mThread, &p);
+#endif
+    mHasThread = false;
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void* pCache)
+  {
+    ((ISVGCache*) pCache)->RunWorker();
+    return 0;
+  }
+  HANDLE mThread;
+#else
+  static void* ThreadProc(void* pCache)
+  {
+    ((ISVGCache*) pCache)->RunWorker();
+    return 0;
+  }
+  pthread_t mThread;
+#endif
+
+  WDL_Mutex mMutex;
+  WDL_PtrList<Source> mSources;
+  WDL_PtrList<Raster> mRasters;
+  volatile int mNRendered;
+  bool mThreadRunning, mHasThread, mQuit;
+};
+
+#endif // _ISVGCACHE_
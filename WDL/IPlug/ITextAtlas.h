@@ -0,0 +1,580 @@
+#ifndef _ITEXTATLAS_
+#define _ITEXTATLAS_
+
+// Text renderer for IGraphics::DrawIText() that keeps every glyph it has rendered in one
+// packed 8 bit coverage atlas, and caches the laid out glyph run for each
+// (font, string, width, alignment), so redrawing a string that has been drawn before is just
+// one pass of LICE_DrawGlyphEx() calls out of the atlas, without measuring or laying out again.
+//
+// Glyphs are rasterised by LICE_CachedFont (native fonts, or FreeType via SWELL), or with
+// IPLUG_FREETYPE defined, by FreeType directly from font files registered with SetFontFile().
+//
+// Enable it with IGraphics::EnableTextAtlas(). Text with an orientation, or ClearType quality,
+// is still drawn by LICE_CachedFont.
+
+#include "IPlugStructs.h"
+#include "../lice/lice.h"
+#include "../lice/lice_text.h"
+#include "../assocarray.h"
+#include "../hashmap.h"
+#include "../ptrlist.h"
+#include "../mutex.h"
+#include "../wdlutf8.h"
+
+#ifdef IPLUG_FREETYPE
+  #include <ft2build.h>
+  #include FT_FREETYPE_H
+  #include FT_SYNTHESIS_H
+#endif
+
+#define TEXT_ATLAS_WIDTH 512
+#define TEXT_ATLAS_MAX_HEIGHT 4096
+// Laid out runs kept before the layout cache is flushed.
+#define TEXT_LAYOUT_CACHE_SIZE 2048
+
+// One rendered glyph, coverage is w * h bytes.
+struct IGlyphBitmap
+{
+  WDL_TypedBuf<unsigned char> mCoverage;
+  int mW, mH;
+  int mXOffset, mYOffset;   // From the pen position (top of the line) to the top left of the bitmap.
+  int mAdvance;
+  int mCellH;               // Height the glyph takes up when measuring.
+};
+
+class IGlyphSource
+{
+public:
+  virtual ~IGlyphSource() {}
+  // Returns false if the font has no glyph for c.
+  virtual bool RenderGlyph(unsigned short c, IGlyphBitmap* pGlyph) = 0;
+  virtual int GetLineHeight() = 0;
+};
+
+// Glyphs from LICE_CachedFont, so they match what LICE would draw.
+class ILICEGlyphSource : public IGlyphSource, protected LICE_CachedFont
+{
+public:
+  // Takes ownership of hFont.
+  ILICEGlyphSource(HFONT hFont) { SetFromHFont(hFont, LICE_FONT_FLAG_OWNS_HFONT); }
+
+  LICE_CachedFont* GetLICEFont() { return this; }
+
+  bool RenderGlyph(unsigned short c, IGlyphBitmap* pGlyph)
+  {
+    charEnt* ent = findChar(c);
+    if (!ent || !ent->base_offset)
+    {
+      LICE_CachedFont::RenderGlyph(c);
+      ent = findChar(c);
+    }
+    if (!ent || ent->base_offset <= 0 || ent->base_offset > m_cachestore.GetSize()) return false;
+
+    int n = ent->width * ent->height;
+    unsigned char* pCoverage = pGlyph->mCoverage.Resize(n, false);
+    if (n && pCoverage) memcpy(pCoverage, m_cachestore.Get() + ent->base_offset - 1, n);
+    pGlyph->mW = ent->width;
+    pGlyph->mH = ent->height;
+    pGlyph->mXOffset = -ent->left_extra;
+    pGlyph->mYOffset = 0;
+    pGlyph->mAdvance = ent->advance;
+    pGlyph->mCellH = ent->height;
+    return true;
+  }
+
+  int GetLineHeight() { return LICE_CachedFont::GetLineHeight(); }
+};
+
+#ifdef IPLUG_FREETYPE
+class IFreeTypeGlyphSource : public IGlyphSource
+{
+public:
+  // size is the line height in pixels, like the height passed to CreateFont().
+  IFreeTypeGlyphSource(const char* fontFile, int size, bool bold, bool italic, bool antiAlias)
+    : mFace(0), mBold(bold), mItalic(italic), mAntiAlias(antiAlias), mLineHeight(size), mAscent(size)
+  {
+    if (!sLibrary && FT_Init_FreeType(&sLibrary)) return;
+    ++sNFaces;
+    if (FT_New_Face(sLibrary, fontFile, 0, &mFace))
+    {
+      mFace = 0;
+      return;
+    }
+    FT_Set_Pixel_Sizes(mFace, 0, size);
+    int h = (int) (mFace->size->metrics.height >> 6);
+    if (h > 0 && h != size)
+    {
+      FT_Set_Pixel_Sizes(mFace, 0, IPMAX(1, (int) ((double) (size * size) / (double) h + 0.5)));
+    }
+    mLineHeight = (int) (mFace->size->metrics.height >> 6);
+    mAscent = (int) (mFace->size->metrics.ascender >> 6);
+  }
+
+  ~IFreeTypeGlyphSource()
+  {
+    if (mFace) FT_Done_Face(mFace);
+    if (sLibrary && !--sNFaces)
+    {
+      FT_Done_FreeType(sLibrary);
+      sLibrary = 0;
+    }
+  }
+
+  bool IsValid() const { return (mFace != 0); }
+
+  bool RenderGlyph(unsigned short c, IGlyphBitmap* pGlyph)
+  {
+    if (!mFace) return false;
+    FT_UInt idx = FT_Get_Char_Index(mFace, c);
+    if (!idx && c != ' ') return false;
+    if (FT_Load_Glyph(mFace, idx, (mAntiAlias ? FT_LOAD_TARGET_NORMAL : FT_LOAD_TARGET_MONO))) return false;
+
+    FT_GlyphSlot slot = mFace->glyph;
+    if (mBold) FT_GlyphSlot_Embolden(slot);
+    if (mItalic) FT_GlyphSlot_Oblique(slot);
+    if (FT_Render_Glyph(slot, (mAntiAlias ? FT_RENDER_MODE_NORMAL : FT_RENDER_MODE_MONO))) return false;
+
+    FT_Bitmap* pBM = &slot->bitmap;
+    int w = pBM->width, h = pBM->rows;
+    unsigned char* pCoverage = pGlyph->mCoverage.Resize(w * h, false);
+    if (w * h && !pCoverage) return false;
+    for (int y = 0; y < h; ++y)
+    {
+      const unsigned char* pSrc = pBM->buffer + y * pBM->pitch;
+      if (pBM->pixel_mode == FT_PIXEL_MODE_MONO)
+      {
+        for (int x = 0; x < w; ++x) *pCoverage++ = ((pSrc[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0);
+      }
+      else
+      {
+        memcpy(pCoverage, pSrc, w);
+        pCoverage += w;
+      }
+    }
+    pGlyph->mW = w;
+    pGlyph->mH = h;
+    pGlyph->mXOffset = slot->bitmap_left;
+    pGlyph->mYOffset = mAscent - slot->bitmap_top;
+    pGlyph->mAdvance = (int) ((slot->advance.x + 32) >> 6);
+    pGlyph->mCellH = IPMAX(mLineHeight, pGlyph->mYOffset + h);
+    return true;
+  }
+
+  int GetLineHeight() { return mLineHeight; }
+
+private:
+  FT_Face mFace;
+  bool mBold, mItalic, mAntiAlias;
+  int mLineHeight, mAscent;
+
+  static FT_Library sLibrary;
+  static int sNFaces;
+};
+
+// Only ever included by IGraphics.cpp.
+FT_Library IFreeTypeGlyphSource::sLibrary = 0;
+int IFreeTypeGlyphSource::sNFaces = 0;
+#endif // IPLUG_FREETYPE
+
+// 8 bit coverage atlas with a fixed width, packed in shelves.
+// It grows downwards (which doesn't move anything already in it) up to TEXT_ATLAS_MAX_HEIGHT.
+class IGlyphAtlas
+{
+public:
+  IGlyphAtlas() : mHeight(0), mGeneration(0) {}
+
+  int Width() const { return TEXT_ATLAS_WIDTH; }
+  int Height() const { return mHeight; }
+  const LICE_pixel_chan* GetBits() const { return mBits.Get(); }
+  // Bumped every time the atlas is cleared, any stored positions are invalid after that.
+  int Generation() const { return mGeneration; }
+
+  // Returns the offset of a w * h area in GetBits(), or -1 if the atlas is full.
+  int Add(const unsigned char* pCoverage, int w, int h)
+  {
+    if (w > TEXT_ATLAS_WIDTH || h > TEXT_ATLAS_MAX_HEIGHT) return -1;
+
+    Shelf* pShelf = 0;
+    for (int i = 0; i < mShelves.GetSize(); ++i)
+    {
+      Shelf* s = mShelves.Get() + i;
+      // Don't waste tall shelves on short glyphs.
+      if (s->mX + w <= TEXT_ATLAS_WIDTH && h <= s->mH && h >= s->mH / 2)
+      {
+        pShelf = s;
+        break;
+      }
+    }
+    if (!pShelf)
+    {
+      int y = (mShelves.GetSize() ? mShelves.Get()[mShelves.GetSize()-1].mY + mShelves.Get()[mShelves.GetSize()-1].mH : 0);
+      if (y + h > mHeight && !Grow(y + h)) return -1;
+      Shelf s = { y, h, 0 };
+      mShelves.Add(s);
+      pShelf = mShelves.Get() + mShelves.GetSize() - 1;
+    }
+
+    int offset = pShelf->mY * TEXT_ATLAS_WIDTH + pShelf->mX;
+    pShelf->mX += w + 1;  // One pixel gap so bilinear lookups never bleed, should anyone scale from it.
+    LICE_pixel_chan* pDest = mBits.Get() + offset;
+    for (int y = 0; y < h; ++y, pDest += TEXT_ATLAS_WIDTH, pCoverage += w)
+    {
+      memcpy(pDest, pCoverage, w);
+    }
+    return offset;
+  }
+
+  void Clear()
+  {
+    mShelves.Resize(0, false);
+    ++mGeneration;
+  }
+
+private:
+  struct Shelf
+  {
+    int mY, mH, mX;
+  };
+
+  bool Grow(int minHeight)
+  {
+    int h = IPMAX(mHeight, 64);
+    while (h < minHeight) h *= 2;
+    if (h > TEXT_ATLAS_MAX_HEIGHT) return false;
+    int oldSize = mBits.GetSize();
+    if (!mBits.Resize(h * TEXT_ATLAS_WIDTH, false) || mBits.GetSize() != h * TEXT_ATLAS_WIDTH) return false;
+    memset(mBits.Get() + oldSize, 0, mBits.GetSize() - oldSize);
+    mHeight = h;
+    return true;
+  }
+
+  WDL_TypedBuf<LICE_pixel_chan> mBits;
+  WDL_TypedBuf<Shelf> mShelves;
+  int mHeight, mGeneration;
+};
+
+// A font whose glyphs live in an IGlyphAtlas.
+class IAtlasFont
+{
+public:
+  struct Glyph
+  {
+    int mOffset;      // In the atlas, -1 if the glyph has no pixels (or couldn't be rendered).
+    int mW, mH, mXOffset, mYOffset, mAdvance, mCellH;
+  };
+
+  // Takes ownership of pSource.
+  IAtlasFont(IGlyphSource* pSource, IGlyphAtlas* pAtlas)
+    : mSource(pSource), mAtlas(pAtlas), mGeneration(pAtlas->Generation())
+  {
+    ClearGlyphs();
+  }
+  ~IAtlasFont()
+  {
+    mExtraGlyphs.DeleteAll();
+    delete mSource;
+  }
+
+  int GetLineHeight() { return mSource->GetLineHeight(); }
+
+  // Returns 0 if the font has no such glyph.
+  const Glyph* GetGlyph(unsigned short c)
+  {
+    if (mGeneration != mAtlas->Generation())
+    {
+      ClearGlyphs();
+      mGeneration = mAtlas->Generation();
+    }
+
+    Glyph* pGlyph;
+    if (c < 128)
+    {
+      pGlyph = mLowGlyphs + c;
+    }
+    else
+    {
+      pGlyph = mExtraGlyphs.GetPtr(c);
+      if (!pGlyph)
+      {
+        Glyph g = { -2, 0, 0, 0, 0, 0, 0 };
+        mExtraGlyphs.Insert(c, g);
+        pGlyph = mExtraGlyphs.GetPtr(c);
+      }
+    }
+
+    if (pGlyph->mOffset == -2)
+    {
+      pGlyph->mOffset = -3;
+      if (mSource->RenderGlyph(c, &mTmp))
+      {
+        pGlyph->mW = mTmp.mW;
+        pGlyph->mH = mTmp.mH;
+        pGlyph->mXOffset = mTmp.mXOffset;
+        pGlyph->mYOffset = mTmp.mYOffset;
+        pGlyph->mAdvance = mTmp.mAdvance;
+        pGlyph->mCellH = mTmp.mCellH;
+        pGlyph->mOffset = (mTmp.mW > 0 && mTmp.mH > 0 ? mAtlas->Add(mTmp.mCoverage.Get(), mTmp.mW, mTmp.mH) : -1);
+        if (pGlyph->mOffset < 0 && mTmp.mW > 0 && mTmp.mH > 0)
+        {
+          // Atlas is full, start over. The caller checks the generation and lays out again.
+          mAtlas->Clear();
+          return 0;
+        }
+      }
+    }
+    return (pGlyph->mOffset == -3 ? 0 : pGlyph);
+  }
+
+private:
+  void ClearGlyphs()
+  {
+    for (int i = 0; i < 128; ++i)
+    {
+      mLowGlyphs[i].mOffset = -2;   // -2 = not rendered yet, -3 = no glyph.
+    }
+    mExtraGlyphs.DeleteAll();
+  }
+
+  IGlyphSource* mSource;
+  IGlyphAtlas* mAtlas;
+  int mGeneration;
+  Glyph mLowGlyphs[128];
+  WDL_IntKeyedArray<Glyph> mExtraGlyphs;
+  IGlyphBitmap mTmp;
+};
+
+// Glyphs of a string, positioned relative to the top left of the text rect.
+struct ITextRun
+{
+  struct Quad
+  {
+    int mOffset, mW, mH, mX, mY;
+  };
+  WDL_TypedBuf<Quad> mQuads;
+  int mW, mH;           // Extent, as DT_CALCRECT would report it.
+  int mGeneration;      // Of the atlas the offsets point into, -1 if the run doesn't fit in the atlas.
+};
+
+class ITextAtlas
+{
+public:
+  struct Stats
+  {
+    int mLayoutHits, mLayoutMisses, mAtlasClears, mFallbacks;
+  };
+
+  ITextAtlas()
+    : mFonts(false, DeleteFont), mRuns(true, DeleteRun)
+#ifdef IPLUG_FREETYPE
+    , mFontFiles(false, WDL_StringKeyedArray<char*>::freecharptr)
+#endif
+  {
+    memset(&mStats, 0, sizeof(Stats));
+  }
+
+  WDL_Mutex mMutex;
+
+#ifdef IPLUG_FREETYPE
+  // Render face (IText::mFont) with FreeType from fontFile, instead of through the OS font.
+  // Register any bold/italic variants as "face bold" or "face italic".
+  void SetFontFile(const char* face, const char* fontFile)
+  {
+    WDL_MutexLock lock(&mMutex);
+    mFontFiles.Insert(face, strdup(fontFile));
+  }
+#endif
+
+  // Returns the atlas font for pTxt, creating it if needed, or 0 if this text can't go through the atlas.
+  // pHFontFactory(pTxt) is called to create the OS font if FreeType isn't used for this face.
+  IAtlasFont* GetFont(IText* pTxt, HFONT (*pHFontFactory)(IText* pTxt))
+  {
+    if (pTxt->mOrientation || pTxt->mQuality == IText::kQualityClearType) return 0;
+
+    char key[FONT_LEN + 64];
+    sprintf(key, "%s|%d|%d|%d", pTxt->mFont, pTxt->mSize, (int) pTxt->mStyle, (int) (pTxt->mQuality == IText::kQualityNonAntiAliased));
+    IAtlasFont* pFont = mFonts.Get(key);
+    if (pFont) return pFont;
+
+    IGlyphSource* pSource = 0;
+#ifdef IPLUG_FREETYPE
+    WDL_String face(pTxt->mFont);
+    if (pTxt->mStyle == IText::kStyleBold) face.Append(" bold");
+    else if (pTxt->mStyle == IText::kStyleItalic) face.Append(" italic");
+    bool synthesize = false;
+    const char* fontFile = mFontFiles.Get(face.Get());
+    if (!fontFile)
+    {
+      fontFile = mFontFiles.Get(pTxt->mFont);
+      synthesize = true;
+    }
+    if (fontFile)
+    {
+      IFreeTypeGlyphSource* pFT = new IFreeTypeGlyphSource(fontFile, pTxt->mSize,
+        synthesize && pTxt->mStyle == IText::kStyleBold, synthesize && pTxt->mStyle == IText::kStyleItalic,
+        pTxt->mQuality != IText::kQualityNonAntiAliased);
+      if (pFT->IsValid()) pSource = pFT;
+      else delete pFT;
+    }
+#endif
+    if (!pSource)
+    {
+      HFONT hFont = pHFontFactory(pTxt);
+      if (!hFont) return 0;
+      pSource = new ILICEGlyphSource(hFont);
+    }
+    pFont = new IAtlasFont(pSource, &mAtlas);
+    mFonts.Insert(key, pFont);
+    return pFont;
+  }
+
+  // Draws (or if measure, measures into pR like DrawIText does) str in pFont.
+  // dtFlags are the alignment flags that IGraphics::DrawIText() would pass to LICE.
+  // Returns false if str doesn't fit in the atlas, draw it with LICE then.
+  bool DrawText(IAtlasFont* pFont, LICE_IBitmap* pDest, const char* str, IRECT* pR, UINT dtFlags, bool measure,
+                LICE_pixel color, float alpha)
+  {
+    int width = (measure ? 0 : pR->W());
+    if (!measure) dtFlags &= (DT_LEFT|DT_CENTER|DT_RIGHT);
+    else dtFlags = 0;
+
+    ITextRun* pRun = GetRun(pFont, str, width, dtFlags);
+    if (!pRun) return false;
+
+    if (measure)
+    {
+      pR->R = pR->L + pRun->mW;
+      pR->B = pR->T + pRun->mH;
+      return true;
+    }
+
+    const LICE_pixel_chan* pBits = mAtlas.GetBits();
+    const ITextRun::Quad* pQuad = pRun->mQuads.Get();
+    for (int i = 0, n = pRun->mQuads.GetSize(); i < n; ++i, ++pQuad)
+    {
+      LICE_DrawGlyphEx(pDest, pR->L + pQuad->mX, pR->T + pQuad->mY, color, pBits + pQuad->mOffset,
+        pQuad->mW, TEXT_ATLAS_WIDTH, pQuad->mH, alpha, LICE_BLIT_MODE_COPY);
+    }
+    return true;
+  }
+
+  const Stats* GetStats() const { return &mStats; }
+  const IGlyphAtlas* GetAtlas() const { return &mAtlas; }
+
+  ~ITextAtlas()
+  {
+    mRuns.DeleteAll();
+    mFonts.DeleteAll();
+#ifdef IPLUG_FREETYPE
+    mFontFiles.DeleteAll();
+#endif
+  }
+
+private:
+  ITextRun* GetRun(IAtlasFont* pFont, const char* str, int width, UINT dtFlags)
+  {
+    mKey.SetFormatted(64, "%p|%d|%x|", (void*) pFont, width, dtFlags);
+    mKey.Append(str);
+
+    ITextRun* pRun = mRuns.Get(mKey.Get());
+    if (pRun && pRun->mGeneration == mAtlas.Generation())
+    {
+      ++mStats.mLayoutHits;
+      return pRun;
+    }
+    if (pRun && pRun->mGeneration < 0)
+    {
+      // Known not to fit, don't clear the atlas over it again.
+      ++mStats.mFallbacks;
+      return 0;
+    }
+    ++mStats.mLayoutMisses;
+
+    if (!pRun)
+    {
+      if (mRuns.GetSize() >= TEXT_LAYOUT_CACHE_SIZE) mRuns.DeleteAll();
+      pRun = new ITextRun;
+      mRuns.Insert(mKey.Get(), pRun);
+    }
+
+    // A full atlas gets cleared while laying out, in which case start over (once).
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+      int generation = mAtlas.Generation();
+      Layout(pFont, str, width, dtFlags, pRun);
+      if (generation == mAtlas.Generation())
+      {
+        pRun->mGeneration = generation;
+        return pRun;
+      }
+      ++mStats.mAtlasClears;
+    }
+
+    // Cleared again, so the glyphs from before the clear are gone: str needs more than the whole atlas.
+    pRun->mGeneration = -1;
+    ++mStats.mFallbacks;
+    return 0;
+  }
+
+  // Same layout rules as LICE_CachedFont::DrawTextImpl(): lines start at the same x,
+  // the whole block is aligned by its widest extent.
+  void Layout(IAtlasFont* pFont, const char* str, int width, UINT dtFlags, ITextRun* pRun)
+  {
+    int lineHeight = pFont->GetLineHeight();
+    int x = 0, y = 0, maxX = 0, maxY = 0;
+    int n = 0;
+    pRun->mQuads.Resize(0, false);
+
+    while (*str)
+    {
+      int cc = ' ';
+      str += wdl_utf8_parsechar(str, &cc);
+      unsigned short c = (unsigned short) cc;
+      if (c == '\r') continue;
+      if (c == '\n')
+      {
+        y += lineHeight;
+        x = 0;
+        continue;
+      }
+
+      const IAtlasFont::Glyph* pGlyph = pFont->GetGlyph(c);
+      if (!pGlyph) continue;
+
+      if (pGlyph->mOffset >= 0)
+      {
+        ITextRun::Quad q = { pGlyph->mOffset, pGlyph->mW, pGlyph->mH, x + pGlyph->mXOffset, y + pGlyph->mYOffset };
+        pRun->mQuads.Add(q);
+        ++n;
+      }
+      maxX = IPMAX(maxX, IPMAX(x + pGlyph->mAdvance, x + pGlyph->mXOffset + pGlyph->mW));
+      maxY = IPMAX(maxY, y + pGlyph->mCellH);
+      x += pGlyph->mAdvance;
+    }
+
+    pRun->mW = maxX;
+    pRun->mH = maxY;
+
+    int dx = 0;
+    if (dtFlags & DT_CENTER) dx = (width - maxX) / 2;
+    else if (dtFlags & DT_RIGHT) dx = width - maxX;
+    if (dx)
+    {
+      ITextRun::Quad* pQuad = pRun->mQuads.Get();
+      for (int i = 0; i < n; ++i) pQuad[i].mX += dx;
+    }
+  }
+
+  static void DeleteFont(IAtlasFont* pFont) { delete pFont; }
+  static void DeleteRun(ITextRun* pRun) { delete pRun; }
+
+  IGlyphAtlas mAtlas;
+  WDL_StringHashMap<IAtlasFont*> mFonts;
+  WDL_StringHashMap<ITextRun*> mRuns;
+#ifdef IPLUG_FREETYPE
+  WDL_StringKeyedArray<char*> mFontFiles;
+#endif
+  WDL_String mKey;
+  Stats mStats;
+};
+
+#endif // _ITEXTATLAS_
@@ -0,0 +1,592 @@
+#ifndef _ITRACER_
+#define _ITRACER_
+
+// Binary event tracer, cheap enough for the audio thread. Define IPLUG_TRACE (TRACER_BUILD
+// implies it) and IPlugBase records every process block, parameter change, GUI draw and
+// incoming MIDI message of every instance, and writes them to a Chrome trace / Perfetto
+// JSON file (chrome://tracing or ui.perfetto.dev), one process track per plug-in instance.
+//
+// Recording an event only copies a fixed size record into the calling thread's ring buffer,
+// there is no formatting, locking or allocation. A background thread empties the rings
+// every ITRACE_FLUSH_MS and does the writing. If a ring is full the event is dropped and
+// counted rather than blocking (see ITracer::GetDropped()).
+//
+// Event names must be string literals (or otherwise outlive the tracer), they are stored
+// as pointers and double as the event id.
+//
+// The file is $IPLUG_TRACE_FILE, or IPlugTrace.json on the desktop (in %TEMP% on Windows).
+// It is written from when the first instance is created until the last one is destroyed.
+//
+// Other code can add its own events:
+//
+//   ITRACE_SCOPE("MyPlug::Reverb", this);            // a duration, until the end of the scope
+//   ITRACE_INSTANT("MyPlug::PresetLoaded", this, idx);
+//   ITRACE_COUNTER("MyPlug::Voices", this, nVoices);  // drawn as a graph
+//
+// The rings are allocated by the first Start(), ITRACE_MAX_THREADS of them (about 12 MB with
+// the defaults). A thread claims a free one with an atomic increment the first time it records,
+// and gives it back when it exits: the flusher writes what is left in it and hands it out again
+// under a new track. Threads beyond ITRACE_MAX_THREADS at once lose their events (counted).
+// ITracer::SetThreadName() names the calling thread's track, once the tracer has started.
+
+#if defined TRACER_BUILD && !defined IPLUG_TRACE
+  #define IPLUG_TRACE
+#endif
+
+#ifdef IPLUG_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mutex.h"
+#include "../ptrlist.h"
+#include "../wdlstring.h"
+#include "../wdlatomic.h"
+#include "../timing.h"
+#include "../hashmap.h"
+#include "../heapbuf.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <process.h>
+  #define ITRACE_THREADLOCAL __declspec(thread)
+#else
+  #include <pthread.h>
+  #include <unistd.h>
+  #define ITRACE_THREADLOCAL __thread
+#endif
+
+#ifndef ITRACE_RING_SIZE
+  #define ITRACE_RING_SIZE 4096     // Events per thread, a power of two.
+#endif
+#ifndef ITRACE_MAX_THREADS
+  #define ITRACE_MAX_THREADS 64     // Rings, so threads recording at the same time.
+#endif
+#define ITRACE_FLUSH_MS 50
+
+struct ITraceEvent
+{
+  WDL_UINT64 mTime;                 // wdl_timing_now_ns()
+  WDL_UINT64 mDuration;             // For ITracer::kComplete.
+  const char* mName;
+  const void* mInstance;            // The IPlugBase*, or 0.
+  double mValue;
+  int mType;                        // ITracer::EEventType
+  int mIndex;                       // -1 for none.
+};
+
+// One per thread: written only by the thread that has claimed it, read only by the flusher.
+class ITraceRing
+{
+public:
+  ITraceRing()
+    : mTID(0), mClaim(0), mReleased(0), mWrite(0), mRead(0), mWritePos(0), mReadCache(0), mReadPos(0), mDropped(0)
+    , mNameWritten(false)
+#ifdef _WIN32
+    , mThread(0)
+#endif
+  {}
+
+  bool Push(const ITraceEvent* pEvent)
+  {
+    if (mWritePos - mReadCache >= ITRACE_RING_SIZE)
+    {
+      mReadCache = wdl_atomic_get(&mRead);
+      if (mWritePos - mReadCache >= ITRACE_RING_SIZE)
+      {
+        wdl_atomic_incr(&mDropped);
+        return false;
+      }
+    }
+    mEvents[mWritePos & (ITRACE_RING_SIZE - 1)] = *pEvent;
+    wdl_atomic_set(&mWrite, ++mWritePos);
+    return true;
+  }
+
+  int mTID;                         // The flusher's, a recycled ring gets a new one.
+  volatile int mClaim;              // 0 when free, a thread owns it if its increment returned 1.
+  volatile int mReleased;           // Set when the owner exits, the flusher drains it and frees it.
+  volatile int mWrite, mRead;       // Free running, the difference is the fill. Each side only publishes its own.
+  int mWritePos, mReadCache;        // Writer's copies.
+  int mReadPos;                     // Flusher's copy.
+  volatile int mDropped;
+  WDL_String mName;                 // Under ITracer::mMutex.
+  bool mNameWritten;
+#ifdef _WIN32
+  HANDLE volatile mThread;          // The owner, the flusher releases the ring once it has exited.
+#endif
+  ITraceEvent mEvents[ITRACE_RING_SIZE];
+};
+
+class ITracer
+{
+public:
+  enum EEventType { kComplete = 0, kInstant, kCounter };
+
+  static ITracer* Get()
+  {
+    static ITracer sTracer;
+    return &sTracer;
+  }
+
+  // Reference counted, so every instance can call it. The first call opens the file and
+  // starts the flusher, the last Stop() writes everything left and closes it.
+  bool Start(const char* filename = 0)
+  {
+    WDL_MutexLock lock(&mMutex);
+    if (mStartCount++) return !!mFile;
+
+    WDL_String path(filename ? filename : getenv("IPLUG_TRACE_FILE"));
+    if (!path.GetLength())
+    {
+#ifdef _WIN32
+      path.Set(getenv("TEMP"));
+      path.Append("\\IPlugTrace.json");
+#else
+      path.Set(getenv("HOME"));
+      path.Append("/Desktop/IPlugTrace.json");
+#endif
+    }
+    mFile = fopen(path.Get(), "w");
+    if (!mFile) return false;
+    fputs("[\n", mFile);
+    mFirstRecord = true;
+    mStartTime = wdl_timing_now_ns();
+    for (int i = 0; i < mInstances.GetSize(); ++i)
+    {
+      mInstances.Get(i)->mNameWritten = false;
+    }
+    if (!mRings)
+    {
+      ITraceRing* pRings = new ITraceRing[ITRACE_MAX_THREADS];
+      for (int i = 0; i < ITRACE_MAX_THREADS; ++i)
+      {
+        pRings[i].mTID = i + 1;
+      }
+      mNextTID = ITRACE_MAX_THREADS + 1;
+      mRings = pRings;
+    }
+    for (int i = 0; i < ITRACE_MAX_THREADS; ++i)
+    {
+      mRings[i].mNameWritten = false;
+    }
+
+    wdl_atomic_set(&mQuit, 0);
+#ifdef _WIN32
+    unsigned tid;
+    mThread = (HANDLE) _beginthreadex(NULL, 0, ThreadProc, this, 0, &tid);
+    mHasThread = !!mThread;
+#else
+    mHasThread = !pthread_create(&mThread, NULL, ThreadProc, this);
+#endif
+    wdl_atomic_set(&mRunning, 1);
+    return true;
+  }
+
+  void Stop()
+  {
+    WDL_MutexLock lock(&mMutex);
+    if (!mStartCount || --mStartCount) return;
+    wdl_atomic_set(&mRunning, 0);
+    if (mHasThread)
+    {
+      wdl_atomic_set(&mQuit, 1);
+      mMutex.Leave();   // The flusher takes it too.
+#ifdef _WIN32
+      WaitForSingleObject(mThread, INFINITE);
+      CloseHandle(mThread);
+#else
+      void* p;
+      pthread_join(mThread, &p);
+#endif
+      mMutex.Enter();
+      mHasThread = false;
+    }
+    if (mFile)
+    {
+      Drain();
+      Write();
+      fputs("\n]\n", mFile);
+      fclose(mFile);
+      mFile = 0;
+    }
+  }
+
+  bool IsRunning() { return !!mRunning; }
+
+  // Names the calling thread's track, and claims its ring now rather than on its first event.
+  void SetThreadName(const char* name)
+  {
+    ITraceRing* pRing = ThreadRing();
+    if (!pRing) pRing = GetRing();
+    if (pRing)
+    {
+      WDL_MutexLock lock(&mMutex);
+      pRing->mName.Set(name);
+      pRing->mNameWritten = false;
+    }
+  }
+
+  void SetInstanceName(const void* pInstance, const char* name)
+  {
+    WDL_MutexLock lock(&mMutex);
+    Instance* pInst = GetInstance(pInstance);
+    pInst->mName.Set(name);
+    pInst->mNameWritten = false;
+  }
+
+  // Scopes are recorded once, at their end, so a dropped event can't unbalance the trace.
+  inline void Record(int type, const char* name, const void* pInstance = 0, double value = 0., int index = -1,
+    WDL_UINT64 startTime = 0)
+  {
+    if (!mRunning) return;
+    ITraceRing* pRing = ThreadRing();
+    if (!pRing && !(pRing = GetRing())) return;
+    WDL_UINT64 now = wdl_timing_now_ns();
+    ITraceEvent e = { startTime ? startTime : now, startTime ? now - startTime : 0, name, pInstance, value, type, index };
+    pRing->Push(&e);
+  }
+
+  // Events lost to full rings (or to threads beyond ITRACE_MAX_THREADS).
+  int GetDropped()
+  {
+    int n = wdl_atomic_get(&mLostThreadEvents);
+    for (int i = 0; mRings && i < ITRACE_MAX_THREADS; ++i)
+    {
+      n += wdl_atomic_get(&mRings[i].mDropped);
+    }
+    return n;
+  }
+
+private:
+  struct Instance
+  {
+    int mPID;
+    WDL_String mName;
+    bool mNameWritten;
+  };
+
+  ITracer()
+    : mFile(0), mStartCount(0), mRunning(0), mRings(0), mNextTID(0), mLostThreadEvents(0), mQuit(0), mHasThread(false)
+    , mFirstRecord(true), mStartTime(0)
+  {
+#ifndef _WIN32
+    mHasThreadKey = !pthread_key_create(&mThreadKey, ReleaseRing);
+#endif
+  }
+
+  ~ITracer()
+  {
+    if (mStartCount)
+    {
+      mStartCount = 1;
+      Stop();
+    }
+#ifdef _WIN32
+    for (int i = 0; mRings && i < ITRACE_MAX_THREADS; ++i)
+    {
+      if (mRings[i].mThread) CloseHandle(mRings[i].mThread);
+    }
+#else
+    if (mHasThreadKey) pthread_key_delete(mThreadKey); // No more ReleaseRing() calls.
+#endif
+    delete[] mRings;
+    mInstances.Empty(true);
+  }
+
+  static ITraceRing*& ThreadRing()
+  {
+    static ITRACE_THREADLOCAL ITraceRing* sRing;
+    return sRing;
+  }
+
+  // Claims a free ring for this thread, without locking or allocating.
+  ITraceRing* GetRing()
+  {
+    ITraceRing*& pRing = ThreadRing();
+    if (pRing || !mRings) return pRing;
+    for (int i = 0; i < ITRACE_MAX_THREADS; ++i)
+    {
+      ITraceRing* pCandidate = mRings + i;
+      if (wdl_atomic_get(&pCandidate->mClaim)) continue;
+      if (wdl_atomic_incr(&pCandidate->mClaim) == 1)
+      {
+#ifdef _WIN32
+        pCandidate->mThread = OpenThread(SYNCHRONIZE, FALSE, GetCurrentThreadId());
+#else
+        if (mHasThreadKey) pthread_setspecific(mThreadKey, pCandidate);
+#endif
+        pRing = pCandidate;
+        return pRing;
+      }
+      wdl_atomic_decr(&pCandidate->mClaim); // Someone else got it.
+    }
+    wdl_atomic_incr(&mLostThreadEvents);
+    return 0;
+  }
+
+#ifndef _WIN32
+  // At thread exit.
+  static void ReleaseRing(void* p)
+  {
+    wdl_atomic_set(&((ITraceRing*) p)->mReleased, 1);
+  }
+#endif
+
+  // Under mMutex.
+  Instance* GetInstance(const void* pInstance)
+  {
+    Instance* pInst = mInstanceMap.Get((INT_PTR) pInstance);
+    if (!pInst)
+    {
+      pInst = new Instance;
+      pInst->mPID = mInstances.GetSize() + 1;
+      pInst->mNameWritten = false;
+      if (!pInstance) pInst->mName.Set("IPlug");
+      mInstances.Add(pInst);
+      mInstanceMap.Insert((INT_PTR) pInstance, pInst);
+    }
+    return pInst;
+  }
+
+  // What Drain() took from the rings, for Write(). Metadata records have mEvent.mType kThreadName or
+  // kProcessName and mEvent.mIndex is the offset of the name in mDrainedNames.
+  enum { kThreadName = 4, kProcessName };
+  struct DrainedEvent
+  {
+    ITraceEvent mEvent;
+    int mPID, mTID;
+  };
+
+  void AddDrained(const ITraceEvent* pEvent, int pid, int tid)
+  {
+    DrainedEvent* pDrained = mDrained.ResizeOK(mDrained.GetSize() + 1, false);
+    if (!pDrained) return;
+    pDrained += mDrained.GetSize() - 1;
+    pDrained->mEvent = *pEvent;
+    pDrained->mPID = pid;
+    pDrained->mTID = tid;
+  }
+
+  void AddMetadata(int type, int pid, int tid, const char* name)
+  {
+    int pos = mDrainedNames.GetSize(), len = (int) strlen(name) + 1;
+    char* pNames = mDrainedNames.ResizeOK(pos + len, false);
+    if (!pNames) return;
+    memcpy(pNames + pos, name, len);
+    ITraceEvent e = { 0, 0, 0, 0, 0., type, pos };
+    AddDrained(&e, pid, tid);
+  }
+
+  // Under mMutex, on the flusher thread (or in Stop() once it has gone). Copies the rings' events out,
+  // so the writing can happen without the lock, and recycles the rings of threads that have exited.
+  void Drain()
+  {
+    for (int i = 0; mRings && i < ITRACE_MAX_THREADS; ++i)
+    {
+      ITraceRing* pRing = mRings + i;
+      if (!wdl_atomic_get(&pRing->mClaim)) continue;
+#ifdef _WIN32
+      HANDLE thread = pRing->mThread;
+      bool released = (thread && WaitForSingleObject(thread, 0) == WAIT_OBJECT_0);
+#else
+      bool released = !!wdl_atomic_get(&pRing->mReleased); // Before mWrite, which is then final.
+#endif
+      if (!pRing->mNameWritten && pRing->mName.GetLength())
+      {
+        for (int j = 0; j < mInstances.GetSize(); ++j)
+        {
+          AddMetadata(kThreadName, mInstances.Get(j)->mPID, pRing->mTID, pRing->mName.Get());
+        }
+        pRing->mNameWritten = true;
+      }
+
+      int w = wdl_atomic_get(&pRing->mWrite), r = pRing->mReadPos;
+      for (; r != w; ++r)
+      {
+        const ITraceEvent* e = pRing->mEvents + (r & (ITRACE_RING_SIZE - 1));
+        if (e->mTime < mStartTime) continue;  // Recorded before a restart.
+        Instance* pInst = GetInstance(e->mInstance);
+        if (!pInst->mNameWritten && pInst->mName.GetLength())
+        {
+          AddMetadata(kProcessName, pInst->mPID, 0, pInst->mName.Get());
+          if (pRing->mName.GetLength()) AddMetadata(kThreadName, pInst->mPID, pRing->mTID, pRing->mName.Get());
+          pInst->mNameWritten = true;
+        }
+        AddDrained(e, pInst->mPID, pRing->mTID);
+      }
+      pRing->mReadPos = r;
+      wdl_atomic_set(&pRing->mRead, r);
+
+      if (released)
+      {
+        // The next thread to claim it gets a track of its own.
+        pRing->mTID = mNextTID++;
+        pRing->mName.Set("");
+        pRing->mNameWritten = false;
+#ifdef _WIN32
+        CloseHandle(thread);
+        pRing->mThread = 0;
+#endif
+        wdl_atomic_set(&pRing->mReleased, 0);
+        wdl_atomic_decr(&pRing->mClaim);
+      }
+    }
+  }
+
+  void WriteString(const char* str)
+  {
+    fputc('"', mFile);
+    for (; *str; ++str)
+    {
+      if (*str == '"' || *str == '\\') fputc('\\', mFile);
+      if ((unsigned char) *str >= ' ') fputc(*str, mFile);
+    }
+    fputc('"', mFile);
+  }
+
+  void BeginRecord()
+  {
+    if (!mFirstRecord) fputs(",\n", mFile);
+    mFirstRecord = false;
+  }
+
+  void WriteMetadata(const char* what, int pid, int tid, const char* name)
+  {
+    BeginRecord();
+    fprintf(mFile, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", what, pid, tid);
+    WriteString(name);
+    fputs("}}", mFile);
+  }
+
+  // Writes what Drain() took. Only the flusher thread (or Stop() once it has gone) touches mFile.
+  void Write()
+  {
+    static const char* sPhase[] = { "X", "i", "C", "?" };
+    int n = mDrained.GetSize();
+    for (int i = 0; i < n; ++i)
+    {
+      const DrainedEvent* pDrained = mDrained.Get() + i;
+      const ITraceEvent* e = &pDrained->mEvent;
+      if (e->mType == kThreadName || e->mType == kProcessName)
+      {
+        WriteMetadata(e->mType == kThreadName ? "thread_name" : "process_name", pDrained->mPID, pDrained->mTID,
+          mDrainedNames.Get() + e->mIndex);
+        continue;
+      }
+
+      BeginRecord();
+      fputs("{\"name\":", mFile);
+      WriteString(e->mName);
+      fprintf(mFile, ",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d", sPhase[e->mType & 3],
+        (double) (e->mTime - mStartTime) / 1000., pDrained->mPID, pDrained->mTID);
+      if (e->mType == kComplete) fprintf(mFile, ",\"dur\":%.3f", (double) e->mDuration / 1000.);
+      if (e->mType == kInstant) fputs(",\"s\":\"t\"", mFile);
+      fprintf(mFile, ",\"args\":{\"value\":%.17g", e->mValue);
+      if (e->mIndex >= 0) fprintf(mFile, ",\"index\":%d", e->mIndex);
+      fputc('}', mFile);
+      fputc('}', mFile);
+    }
+    mDrained.Resize(0, false);
+    mDrainedNames.Resize(0, false);
+    fflush(mFile);
+  }
+
+  void RunFlusher()
+  {
+    while (!wdl_atomic_get(&mQuit))
+    {
+#ifdef _WIN32
+      Sleep(ITRACE_FLUSH_MS);
+#else
+      usleep(ITRACE_FLUSH_MS * 1000);
+#endif
+      mMutex.Enter();
+      bool hasFile = !!mFile;
+      if (hasFile) Drain();
+      mMutex.Leave();
+      if (hasFile) Write();
+    }
+  }
+
+#ifdef _WIN32
+  static unsigned WINAPI ThreadProc(void* p)
+  {
+    ((ITracer*) p)->RunFlusher();
+    return 0;
+  }
+#else
+  static void* ThreadProc(void* p)
+  {
+    ((ITracer*) p)->RunFlusher();
+    return 0;
+  }
+#endif
+
+  WDL_Mutex mMutex;
+  FILE* mFile;
+  int mStartCount;
+  volatile int mRunning;
+  ITraceRing* volatile mRings;     // ITRACE_MAX_THREADS of them, from the first Start() on.
+  int mNextTID;                     // Under mMutex.
+  volatile int mLostThreadEvents;
+  WDL_TypedBuf<DrainedEvent> mDrained; // The flusher's.
+  WDL_TypedBuf<char> mDrainedNames;
+#ifndef _WIN32
+  pthread_key_t mThreadKey;         // Its destructor releases the thread's ring.
+  bool mHasThreadKey;
+#endif
+  WDL_PtrList<Instance> mInstances;
+  WDL_PtrHashMap<Instance*> mInstanceMap;
+  volatile int mQuit;
+  bool mHasThread;
+  bool mFirstRecord;
+  WDL_UINT64 mStartTime;
+#ifdef _WIN32
+  HANDLE mThread;
+#else
+  pthread_t mThread;
+#endif
+};
+
+class ITraceScope
+{
+public:
+  ITraceScope(const char* name, const void* pInstance, double value = 0.)
+    : mName(name), mInstance(pInstance), mValue(value), mStart(ITracer::Get()->IsRunning() ? wdl_timing_now_ns() : 0) {}
+  ~ITraceScope() { if (mStart) ITracer::Get()->Record(ITracer::kComplete, mName, mInstance, mValue, -1, mStart); }
+
+private:
+  const char* mName;
+  const void* mInstance;
+  double mValue;
+  WDL_UINT64 mStart;
+};
+
+#define ITRACE_CAT2(a, b) a##b
+#define ITRACE_CAT(a, b) ITRACE_CAT2(a, b)
+#define ITRACE_SCOPE(name, pInstance) ITraceScope ITRACE_CAT(iTraceScope_, __LINE__)(name, pInstance)
+#define ITRACE_SCOPE_VALUE(name, pInstance, value) ITraceScope ITRACE_CAT(iTraceScope_, __LINE__)(name, pInstance, value)
+#define ITRACE_INSTANT(name, pInstance, value) ITracer::Get()->Record(ITracer::kInstant, name, pInstance, value)
+#define ITRACE_INSTANT_INDEX(name, pInstance, index, value) ITracer::Get()->Record(ITracer::kInstant, name, pInstance, value, index)
+#define ITRACE_COUNTER(name, pInstance, value) ITracer::Get()->Record(ITracer::kCounter, name, pInstance, value)
+
+#else
+
+#define ITRACE_SCOPE(name, pInstance)
+#define ITRACE_SCOPE_VALUE(name, pInstance, value)
+#define ITRACE_INSTANT(name, pInstance, value)
+#define ITRACE_INSTANT_INDEX(name, pInstance, index, value)
+#define ITRACE_COUNTER(name, pInstance, value)
+
+#endif // IPLUG_TRACE
+
+// What IPlug itself records.
+#define ITRACE_PROCESS(pPlug, nFrames) ITRACE_SCOPE_VALUE("Process", pPlug, nFrames)
+#define ITRACE_PARAM(pPlug, idx, normalizedValue) ITRACE_INSTANT_INDEX("ParamChange", pPlug, idx, normalizedValue)
+#define ITRACE_DRAW(pPlug) ITRACE_SCOPE("Draw", pPlug)
+// The message bytes as the index, its sample offset in the block as the value.
+#define ITRACE_MIDI(pPlug, pMsg) ITRACE_INSTANT_INDEX("MIDI", pPlug, ((pMsg)->mStatus << 16) | ((pMsg)->mData1 << 8) | (pMsg)->mData2, (pMsg)->mOffset)
+
+#endif // _ITRACER_
@@ -0,0 +1,110 @@
+#ifndef _IWORKERSIGNAL_
+#define _IWORKERSIGNAL_
+
+// Wakes a worker thread from any thread, including the audio thread: Signal() never takes a
+// lock, allocates or blocks. Signals sent while the worker is busy are coalesced into one.
+//
+// The worker's loop reads whatever state the signal is about after Wait() returns, so nothing
+// sent before a signal is missed:
+//
+//   while (!mQuit)
+//   {
+//     if (!HaveWork()) mSignal.Wait();
+//     else DoWork();
+//   }
+
+#include "../wdlatomic.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <dispatch/dispatch.h>
+#else
+  #include <errno.h>
+  #include <semaphore.h>
+  #include <time.h>
+#endif
+
+class IWorkerSignal
+{
+public:
+  IWorkerSignal() : mPending(0)
+  {
+#ifdef _WIN32
+    mEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#elif defined(__APPLE__)
+    mSem = dispatch_semaphore_create(0);
+#else
+    sem_init(&mSem, 0, 0);
+#endif
+  }
+
+  ~IWorkerSignal()
+  {
+#ifdef _WIN32
+    CloseHandle(mEvent);
+#elif defined(__APPLE__)
+    dispatch_release(mSem);
+#else
+    sem_destroy(&mSem);
+#endif
+  }
+
+  void Signal()
+  {
+    if (wdl_atomic_incr(&mPending) != 1) return; // Already on its way.
+#ifdef _WIN32
+    SetEvent(mEvent);
+#elif defined(__APPLE__)
+    dispatch_semaphore_signal(mSem);
+#else
+    sem_post(&mSem);
+#endif
+  }
+
+  // The worker thread. Returns false if timeoutMs (if >= 0) passed without a signal.
+  bool Wait(int timeoutMs = -1)
+  {
+    bool signalled;
+#ifdef _WIN32
+    signalled = WaitForSingleObject(mEvent, timeoutMs < 0 ? INFINITE : timeoutMs) == WAIT_OBJECT_0;
+#elif defined(__APPLE__)
+    signalled = !dispatch_semaphore_wait(mSem, timeoutMs < 0 ? DISPATCH_TIME_FOREVER : dispatch_time(DISPATCH_TIME_NOW, (int64_t) timeoutMs * 1000000));
+#else
+    int rv;
+    if (timeoutMs < 0)
+    {
+      while ((rv = sem_wait(&mSem)) && errno == EINTR);
+    }
+    else
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += timeoutMs / 1000;
+      ts.tv_nsec += (timeoutMs % 1000) * 1000000;
+      if (ts.tv_nsec >= 1000000000)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+      }
+      while ((rv = sem_timedwait(&mSem, &ts)) && errno == EINTR);
+    }
+    signalled = !rv;
+#endif
+    // Before the caller looks at its state, so a Signal() from here on posts again.
+    if (signalled) wdl_atomic_set(&mPending, 0);
+    return signalled;
+  }
+
+private:
+  volatile int mPending;
+#ifdef _WIN32
+  HANDLE mEvent;
+#elif defined(__APPLE__)
+  dispatch_semaphore_t mSem;
+#else
+  sem_t mSem;
+#endif
+};
+
+#endif
@@ -11,6 +11,7 @@
 
 #include "Containers.h"
 #include "IPlugOSDetect.h"
+#include "ITracer.h"
 #include <time.h>
 
 #if defined OS_WIN
@@ -19,17 +20,18 @@
   void DBGMSG(const char *format, ...);
   #define SYS_THREAD_ID (intptr_t) GetCurrentThreadId()
 
-#elif defined __APPLE__
+#elif defined __APPLE__ || defined OS_LINUX
   #define SYS_THREAD_ID (intptr_t) pthread_self()
   #define DBGMSG(...) printf(__VA_ARGS__)
 #else
   #error "No OS defined!"
 #endif
 
+// TRACE and TRACE_PROCESS go to the binary tracer (ITracer.h), so they cost next to nothing
+// and TRACE_PROCESS can be used on the audio thread. TRACE_PROCESS times the rest of the scope.
 #if defined TRACER_BUILD
-  #define TRACE Trace(TRACELOC, "");
-//  #define TRACE_PROCESS Trace(TRACELOC, "");
-  #define TRACE_PROCESS
+  #define TRACE ITRACE_INSTANT(__FUNCTION__, 0, __LINE__);
+  #define TRACE_PROCESS ITRACE_SCOPE(__FUNCTION__, 0)
 #else
   #define TRACE
   #define TRACE_PROCESS
@@ -38,8 +40,8 @@
 #define TRACELOC __FUNCTION__,__LINE__
 void Trace(const char* funcName, int line, const char* fmtStr, ...);
 
-// To trace some arbitrary data:                 Trace(TRACELOC, "%s:%d", myStr, myInt);
-// To simply create a trace entry in the log:    TRACE;
+// To trace some arbitrary data:                 Trace(TRACELOC, "%s:%d", myStr, myInt); (formatted, to the log file)
+// To simply create a trace entry:               TRACE; (an instant event in the trace file)
 // No need to wrap tracer calls in #ifdef TRACER_BUILD because Trace is a no-op unless TRACER_BUILD is defined.
 
 const char* VSTOpcodeStr(int opCode);
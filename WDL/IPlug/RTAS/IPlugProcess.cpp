@@ -421,7 +421,7 @@ ComponentResult IPlugProcess::CompareActiveChunk(SFicPlugInChunk *chunk, Boolean
     return kChunkRangeErr;
 	}
   
-	*isEqual = mPlug->CompareState((const unsigned char*) chunk->fData, 0);
+	*isEqual = mPlug->CompareStateSized((const unsigned char*) chunk->fData, 0, chunk->fSize - sizeof(SFicPlugInChunkHeader));
   
   return noErr;
 }
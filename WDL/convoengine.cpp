@@ -134,6 +134,21 @@ WDL_ConvolutionEngine::~WDL_ConvolutionEngine()
 {
 }
 
+void WDL_ConvolutionEngine::SetAllocator(WDL_Allocator *a)
+{
+  int x;
+  for (x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++)
+  {
+    m_samplesout[x].SetAllocator(a);
+    m_samplesin2[x].SetAllocator(a);
+    m_samplesin[x].SetAllocator(a);
+    m_samplehist[x].SetAllocator(a);
+    m_overlaphist[x].SetAllocator(a);
+  }
+  for (x = 0; x < WDL_CONVO_MAX_IMPULSE_NCH; x ++) m_samplehist_zflag[x].SetAllocator(a);
+  m_combinebuf.SetAllocator(a);
+}
+
 int WDL_ConvolutionEngine::SetImpulse(WDL_ImpulseBuffer *impulse, int fft_size, int impulse_sample_offset, int max_imp_size, bool forceBrute)
 {
   int impulse_len=0;
@@ -710,6 +725,14 @@ WDL_ConvolutionEngine_Div::WDL_ConvolutionEngine_Div()
   timingInit();
   m_proc_nch=2;
   m_need_feedsilence=true;
+  m_allocator=NULL;
+}
+
+void WDL_ConvolutionEngine_Div::SetAllocator(WDL_Allocator *a)
+{
+  m_allocator=a;
+  for (int x = 0; x < WDL_CONVO_MAX_PROC_NCH; x ++) m_samplesout[x].SetAllocator(a);
+  for (int x = 0; x < m_engines.GetSize(); x ++) m_engines.Get(x)->SetAllocator(a);
 }
 
 int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft_size, int known_blocksize, int max_imp_size, int impulse_offset, int latency_allowed)
@@ -747,6 +770,7 @@ int WDL_ConvolutionEngine_Div::SetImpulse(WDL_ImpulseBuffer *impulse, int maxfft
   do
   {
     WDL_ConvolutionEngine *eng=new WDL_ConvolutionEngine;
+    if (m_allocator) eng->SetAllocator(m_allocator);
 
     bool wantBrute = !latency_allowed && !offs;
     if (impulsechunksize*(wantBrute ? 2 : 3) >= samplesleft) impulsechunksize=samplesleft; // early-out, no point going to a larger FFT (since if we did this, we wouldnt have enough samples for a complete next pass)
@@ -91,6 +91,8 @@ public:
   
   void Reset(); // clears out any latent samples
 
+  void SetAllocator(WDL_Allocator *a); // for the sample buffers that grow in Add()/Avail() (the impulse stays on the heap)
+
   void Add(WDL_FFT_REAL **bufs, int len, int nch);
 
   int Avail(int wantSamples);
@@ -145,6 +147,8 @@ public:
   int GetLatency();
   void Reset();
 
+  void SetAllocator(WDL_Allocator *a); // see WDL_ConvolutionEngine::SetAllocator()
+
   void Add(WDL_FFT_REAL **bufs, int len, int nch);
 
   int Avail(int wantSamples);
@@ -159,6 +163,7 @@ private:
 
   int m_proc_nch;
   bool m_need_feedsilence;
+  WDL_Allocator *m_allocator;
 
 } WDL_FIXALIGN;
 
@@ -0,0 +1,1173 @@
+/* x86-64 SSE2 stubs, used by glue_x86_64_sse.h (gcc/clang, SysV ABI)
+
+   the compiler's fp stack is xmm0 (st0) and xmm1 (st1), see glue_x86_64_sse.h.
+   registers: P1 rax, P2 rdi, P3 rcx, WTP rsi, r12 is ram blocks (closenessfactor at -8(%r12)).
+   rsi is saved in r15 around C calls. stubs with BIF_FPSTACKUSE(0) must leave xmm1 alone,
+   the rest may be entered with only their own parameters on the fp stack.
+
+   conversions use cvttsd2si, which truncates like the x87 code does in eel_callcode64's
+   rounding mode.
+*/
+
+// denormal/inf/nan -> 0, same test as the x87 stubs. value in %rcx, stored to (%rdi), trashes rdx
+#define EEL_SSE_STORE_RCX_FILTERED \
+    "movq %rcx, %rdx\n" \
+    "shrq $32, %rdx\n" \
+    "addl $0x00100000, %edx\n" \
+    "andl $0x7FF00000, %edx\n" \
+    "cmpl $0x00100000, %edx\n" \
+    "jg 0f\n" \
+      "xorl %ecx, %ecx\n" \
+    "0:\n" \
+    "movq %rcx, (%rdi)\n"
+
+// xmm2 = 0x7FFFFFFFFFFFFFFF
+#define EEL_SSE_ABSMASK_XMM2 \
+    "pcmpeqd %xmm2, %xmm2\n" \
+    "psrlq $1, %xmm2\n"
+
+void nseel_asm_1pdd(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq %rsi, %r15\n"
+    "call *%rdi\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_1pdd_end(void){}
+
+void nseel_asm_2pdd(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movapd %xmm0, %xmm2\n" // first parameter is st1
+    "movapd %xmm1, %xmm0\n"
+    "movapd %xmm2, %xmm1\n"
+    "movq %rsi, %r15\n"
+    "call *%rdi\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_2pdd_end(void){}
+
+void nseel_asm_2pdds(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rax\n"
+    "movapd %xmm0, %xmm1\n"
+    "movsd (%rdi), %xmm0\n"
+    "movq %rsi, %r15\n"
+    "movq %rdi, %r14\n"
+    "call *%rax\n"
+    "movq %r14, %rdi\n"
+    "movq %r15, %rsi\n"
+    "movq %rdi, %rax\n" /* set return value */
+
+    // denormal-fix result (this is only currently used for pow_op, so we want this!)
+    "movq %xmm0, %rcx\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_2pdds_end(void){}
+
+
+
+//---------------------------------------------------------------------------------------------------------------
+
+
+// do nothing, eh
+void nseel_asm_exec2(void)
+{
+   __asm__(
+      FUNCTION_MARKER
+      ""
+      FUNCTION_MARKER
+    );
+}
+void nseel_asm_exec2_end(void) { }
+
+
+
+void nseel_asm_invsqrt(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movl $0x5f3759df, %edx\n"
+    "cvtsd2ss %xmm0, %xmm1\n"
+    "movd %xmm1, %ecx\n"
+    "movabsq $0xfefefefefefefefe, %rax\n"
+    "mulsd (%rax), %xmm0\n" // -0.5
+    "sarl $1, %ecx\n"
+    "subl %ecx, %edx\n"
+    "movd %edx, %xmm1\n"
+    "cvtss2sd %xmm1, %xmm1\n"
+    "mulsd %xmm1, %xmm0\n"
+    "mulsd %xmm1, %xmm0\n"
+    "movabsq $0xfefefefefefefefe, %rax\n"
+    "addsd (%rax), %xmm0\n" // 1.5
+    "mulsd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_invsqrt_end(void) {}
+
+
+void nseel_asm_dbg_getstackptr(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movl %esp, %edx\n"
+    "cvtsi2sdl %edx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_dbg_getstackptr_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_sqr(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "mulsd %xmm0, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sqr_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_sqrt(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm0\n"
+    "sqrtsd %xmm0, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sqrt_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_abs(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_abs_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_assign(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq (%rax), %rcx\n"
+    "movq %rdi, %rax\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_assign_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_assign_fromfp(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %xmm0, %rcx\n"
+    "movq %rdi, %rax\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_assign_fromfp_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_assign_fast_fromfp(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_assign_fast_fromfp_end(void) {}
+
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_assign_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq (%rax), %rdx\n"
+    "movq %rdx, (%rdi)\n"
+    "movq %rdi, %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_assign_fast_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_add(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "addsd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_add_end(void) {}
+
+void nseel_asm_add_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "addsd (%rdi), %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movq %xmm0, %rcx\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_add_op_end(void) {}
+
+void nseel_asm_add_op_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "addsd (%rdi), %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_add_op_fast_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_sub(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "subsd %xmm0, %xmm1\n"
+    "movapd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sub_end(void) {}
+
+void nseel_asm_sub_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "subsd %xmm0, %xmm2\n"
+    "movq %rdi, %rax\n"
+    "movq %xmm2, %rcx\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sub_op_end(void) {}
+
+void nseel_asm_sub_op_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "subsd %xmm0, %xmm2\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm2, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sub_op_fast_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_mul(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "mulsd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_mul_end(void) {}
+
+void nseel_asm_mul_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "mulsd (%rdi), %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movq %xmm0, %rcx\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_mul_op_end(void) {}
+
+void nseel_asm_mul_op_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "mulsd (%rdi), %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_mul_op_fast_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_div(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "divsd %xmm0, %xmm1\n"
+    "movapd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_div_end(void) {}
+
+void nseel_asm_div_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "divsd %xmm0, %xmm2\n"
+    "movq %rdi, %rax\n"
+    "movq %xmm2, %rcx\n"
+    EEL_SSE_STORE_RCX_FILTERED
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_div_op_end(void) {}
+
+void nseel_asm_div_op_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "divsd %xmm0, %xmm2\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm2, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_div_op_fast_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_mod(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm0\n"
+    "andpd %xmm2, %xmm1\n"
+    "cvttsd2si %xmm0, %ecx\n"
+    "cvttsd2si %xmm1, %eax\n"
+    "xorl %edx, %edx\n"
+    "testl %ecx, %ecx\n"
+    "jz 0f\n" // skip devide, set return to 0
+    "divl %ecx\n"
+    "0:\n"
+    "cvtsi2sdl %edx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_mod_end(void) {}
+
+void nseel_asm_shl(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %ecx\n"
+    "cvttsd2si %xmm1, %eax\n"
+    "shll %cl, %eax\n"
+    "cvtsi2sdl %eax, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_shl_end(void) {}
+
+void nseel_asm_shr(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %ecx\n"
+    "cvttsd2si %xmm1, %eax\n"
+    "sarl %cl, %eax\n"
+    "cvtsi2sdl %eax, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_shr_end(void) {}
+
+
+void nseel_asm_mod_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm1\n"
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm0\n"
+    "andpd %xmm2, %xmm1\n"
+    "cvttsd2si %xmm0, %ecx\n"
+    "cvttsd2si %xmm1, %eax\n"
+    "xorl %edx, %edx\n"
+    "testl %ecx, %ecx\n"
+    "jz 0f\n" // skip devide, set return to 0
+    "divl %ecx\n"
+    "0:\n"
+    "cvtsi2sdl %edx, %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_mod_op_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_or(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si %xmm1, %rcx\n"
+    "orq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_or_end(void) {}
+
+void nseel_asm_or0(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_or0_end(void) {}
+
+void nseel_asm_or_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si (%rdi), %rcx\n"
+    "orq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_or_op_end(void) {}
+
+
+void nseel_asm_xor(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si %xmm1, %rcx\n"
+    "xorq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_xor_end(void) {}
+
+void nseel_asm_xor_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si (%rdi), %rcx\n"
+    "xorq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_xor_op_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_and(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si %xmm1, %rcx\n"
+    "andq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_and_end(void) {}
+
+void nseel_asm_and_op(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "cvttsd2si %xmm0, %rdx\n"
+    "cvttsd2si (%rdi), %rcx\n"
+    "andq %rcx, %rdx\n"
+    "cvtsi2sdq %rdx, %xmm0\n"
+    "movq %rdi, %rax\n"
+    "movsd %xmm0, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_and_op_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_uplus(void) // this is the same as doing nothing, it seems
+{
+   __asm__(
+      FUNCTION_MARKER
+      ""
+      FUNCTION_MARKER
+    );
+}
+void nseel_asm_uplus_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_uminus(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "pcmpeqd %xmm2, %xmm2\n"
+    "psllq $63, %xmm2\n"
+    "xorpd %xmm2, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_uminus_end(void) {}
+
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_sign(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %xmm0, %rdx\n"
+    "movabsq $0x7FFFFFFFFFFFFFFF, %rcx\n"
+    "testq %rcx, %rdx\n"
+    "jz 0f\n" // zero zero, return the value passed directly
+      // calculate sign
+      "incq %rcx\n" // rcx becomes 0x80000...
+      "andq %rcx, %rdx\n"
+      "movabsq $0x3FF0000000000000, %rcx\n" // 1.0
+      "orq %rdx, %rcx\n"
+      "movq %rcx, %xmm0\n"
+    "0:\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_sign_end(void) {}
+
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_bnot(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "testl %eax, %eax\n"
+    "setz %al\n"
+    "andl $0xff, %eax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_bnot_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_fcall(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "subq $8, %rsp\n"
+    "call *%rdx\n"
+    "addq $8, %rsp\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_fcall_end(void) {}
+
+void nseel_asm_band(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "testl %eax, %eax\n"
+    "jz 0f\n"
+      "movabsq $0xfefefefefefefefe, %rcx\n"
+      "subq $8, %rsp\n"
+      "call *%rcx\n"
+      "addq $8, %rsp\n"
+    "0:\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_band_end(void) {}
+
+void nseel_asm_bor(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "testl %eax, %eax\n"
+    "jnz 0f\n"
+      "movabsq $0xfefefefefefefefe, %rcx\n"
+      "subq $8, %rsp\n"
+      "call *%rcx\n"
+      "addq $8, %rsp\n"
+    "0:\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_bor_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+// comparisons return nonzero in eax for true, and treat NaN the same way the x87 stubs do
+void nseel_asm_equal(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "subsd %xmm0, %xmm1\n"
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm1\n"
+    "xorl %eax, %eax\n"
+    "ucomisd -8(%r12), %xmm1\n" //[g_closefact]
+    "setb %al\n" // NaN means true
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_equal_end(void) {}
+//
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_equal_exact(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "xorl %eax, %eax\n"
+    "ucomisd %xmm0, %xmm1\n"
+    "sete %al\n"
+    "setnp %cl\n"
+    "andb %cl, %al\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_equal_exact_end(void) {}
+
+void nseel_asm_notequal_exact(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "xorl %eax, %eax\n"
+    "ucomisd %xmm0, %xmm1\n"
+    "setne %al\n"
+    "setp %cl\n"
+    "orb %cl, %al\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_notequal_exact_end(void) {}
+//
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_notequal(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "subsd %xmm0, %xmm1\n"
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm2, %xmm1\n"
+    "xorl %eax, %eax\n"
+    "ucomisd -8(%r12), %xmm1\n" //[g_closefact]
+    "setae %al\n" // NaN means false
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_notequal_end(void) {}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_above(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "xorl %eax, %eax\n"
+    "ucomisd %xmm1, %xmm0\n"
+    "setb %al\n" // st1 > st0, NaN would mean 1, preserve that
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_above_end(void) {}
+
+//---------------------------------------------------------------------------------------------------------------
+void nseel_asm_beloweq(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "xorl %eax, %eax\n"
+    "ucomisd %xmm1, %xmm0\n"
+    "setae %al\n" // st1 <= st0, NaN would be 0 (ugh)
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_beloweq_end(void) {}
+
+
+void nseel_asm_booltofp(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movapd %xmm0, %xmm1\n"
+    "xorpd %xmm0, %xmm0\n"
+    "testl %eax, %eax\n"
+    "setnz %dl\n"
+    "movzbl %dl, %edx\n"
+    "cvtsi2sdl %edx, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_booltofp_end(void) {}
+
+void nseel_asm_fptobool(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm0, %xmm2\n"
+    "movapd %xmm1, %xmm0\n"
+    "xorl %eax, %eax\n"
+    "ucomisd -8(%r12), %xmm2\n" //[g_closefact]
+    "setae %al\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_fptobool_end(void) {}
+
+void nseel_asm_fptobool_rev(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    EEL_SSE_ABSMASK_XMM2
+    "andpd %xmm0, %xmm2\n"
+    "movapd %xmm1, %xmm0\n"
+    "xorl %eax, %eax\n"
+    "ucomisd -8(%r12), %xmm2\n" //[g_closefact]
+    "setb %al\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_fptobool_rev_end(void) {}
+
+void nseel_asm_min(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "ucomisd (%rax), %xmm2\n"
+    "cmovbq %rdi, %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_min_end(void) {}
+
+void nseel_asm_max(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movsd (%rdi), %xmm2\n"
+    "ucomisd (%rax), %xmm2\n"
+    "cmovaeq %rdi, %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_max_end(void) {}
+
+
+
+// minsd/maxsd return their source operand if either is NaN, which gives st0 for min and st1 for max like the x87 stubs
+void nseel_asm_min_fp(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "minsd %xmm0, %xmm1\n"
+    "movapd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_min_fp_end(void) {}
+
+void nseel_asm_max_fp(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "maxsd %xmm1, %xmm0\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_max_fp_end(void) {}
+
+
+
+// just generic functions left, yay
+
+
+
+
+void _asm_generic3parm(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rsi, %r15\n"
+    "movq %rdi, %rdx\n" // third parameter = parm
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter= context
+    "movq %rcx, %rsi\n" // second parameter = parm
+    "movq %rax, %rcx\n" // fourth parameter = parm
+    "movabsq $0xfefefefefefefefe, %rax\n" // call function
+    "call *%rax\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic3parm_end(void) {}
+
+
+void _asm_generic3parm_retd(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rsi, %r15\n"
+    "movq %rdi, %rdx\n" // third parameter = parm
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter= context
+    "movq %rcx, %rsi\n" // second parameter = parm
+    "movq %rax, %rcx\n" // fourth parameter = parm
+    "movabsq $0xfefefefefefefefe, %rax\n" // call function
+    "call *%rax\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic3parm_retd_end(void) {}
+
+
+void _asm_generic2parm(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rsi, %r15\n"
+    "movq %rdi, %rsi\n" // second parameter = parm
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter= context
+    "movq %rax, %rdx\n" // third parameter = parm
+    "movabsq $0xfefefefefefefefe, %rcx\n" // call function
+    "call *%rcx\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic2parm_end(void) {}
+
+
+void _asm_generic2parm_retd(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rsi, %r15\n"
+    "movq %rdi, %rsi\n" // second parameter = parm
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter= context
+    "movabsq $0xfefefefefefefefe, %rcx\n" // call function
+    "movq %rax, %rdx\n" // third parameter = parm
+    "call *%rcx\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic2parm_retd_end(void) {}
+
+
+void _asm_generic1parm(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter= context
+    "movq %rsi, %r15\n"
+    "movq %rax, %rsi\n" // second parameter = parm
+    "movabsq $0xfefefefefefefefe, %rcx\n" // call function
+    "call *%rcx\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic1parm_end(void) {}
+
+
+void _asm_generic1parm_retd(void) // 1 parameter returning double
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter = context pointer
+    "movabsq $0xfefefefefefefefe, %rcx\n" // function address
+    "movq %rsi, %r15\n" // save rsi
+    "movq %rax, %rsi\n" // second parameter = parameter
+    "call *%rcx\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+void _asm_generic1parm_retd_end(void) {}
+
+
+
+// this gets its own stub because it's pretty crucial for performance :/
+
+void _asm_megabuf(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "addsd -8(%%r12), %%xmm0\n"
+    "cvttsd2si %%xmm0, %%edx\n"
+
+    // check if edx is in range, and buffer available, otherwise call function
+    "cmpq %0, %%rdx\n"
+    "jae 0f\n"
+      "movq %%rdx, %%rax\n"
+      "shrq %1, %%rax\n"
+      "andq %2, %%rax\n"
+      "movq (%%r12, %%rax), %%rax\n"
+      "testq %%rax, %%rax\n"
+      "jnz 1f\n"
+    "0:\n"
+      "movabsq $0xfefefefefefefefe, %%rax\n"
+      "movq %%r12, %%rdi\n" // set first parm to ctx
+      "movq %%rsi, %%r15\n" // save rsi
+      "movl %%edx, %%esi\n" // esi becomes second parameter (edi is first, context pointer)
+      "call *%%rax\n"
+      "movq %%r15, %%rsi\n" // restore rsi
+      "jmp 2f\n"
+    "1:\n"
+      "andq %3, %%rdx\n"
+      "shlq $3, %%rdx\n" // 3 is log2(sizeof(EEL_F))
+      "addq %%rdx, %%rax\n"
+    "2:\n"
+    FUNCTION_MARKER
+    :: "i" (((NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK))),
+       "i" ((NSEEL_RAM_ITEMSPERBLOCK_LOG2 - 3/*log2(sizeof(void *))*/   )),
+       "i" (((NSEEL_RAM_BLOCKS-1)*8 /*sizeof(void*)*/                   )),
+       "i" ((NSEEL_RAM_ITEMSPERBLOCK-1                                  ))
+  );
+}
+
+void _asm_megabuf_end(void) {}
+
+
+void _asm_gmegabuf(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movq %rsi, %r15\n"
+    "addsd -8(%r12), %xmm0\n"
+    "movabsq $0xfefefefefefefefe, %rdi\n" // first parameter = context pointer
+    "cvttsd2si %xmm0, %esi\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "call *%rdx\n"
+    "movq %r15, %rsi\n"
+    FUNCTION_MARKER
+ );
+}
+
+void _asm_gmegabuf_end(void) {}
+
+void nseel_asm_stack_push(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rax), %rcx\n"
+    "movq (%rdi), %rax\n"
+    "addq $8, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "andq %rdx, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "orq %rdx, %rax\n"
+    "movq %rcx, (%rax)\n"
+    "movq %rax, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_push_end(void) {}
+
+
+
+void nseel_asm_stack_pop(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rdi), %rcx\n"
+    "movq (%rcx), %r8\n"
+    "subq $8, %rcx\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "andq %rdx, %rcx\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "orq %rdx, %rcx\n"
+    "movq %rcx, (%rdi)\n"
+    "movq %r8, (%rax)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_pop_end(void) {}
+
+
+void nseel_asm_stack_pop_fast(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rdi), %rcx\n"
+    "movq %rcx, %rax\n"
+    "subq $8, %rcx\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "andq %rdx, %rcx\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "orq %rdx, %rcx\n"
+    "movq %rcx, (%rdi)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_pop_fast_end(void) {}
+
+void nseel_asm_stack_peek_int(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rdi), %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "subq %rdx, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "andq %rdx, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "orq %rdx, %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_peek_int_end(void) {}
+
+
+
+void nseel_asm_stack_peek(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "cvttsd2si %xmm0, %edx\n"
+    "movapd %xmm1, %xmm0\n" // BIF_FPSTACKUSE(0), so pop properly
+    "movq (%rdi), %rax\n"
+    "shlq $3, %rdx\n" // log2(sizeof(EEL_F))
+    "subq %rdx, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "andq %rdx, %rax\n"
+    "movabsq $0xfefefefefefefefe, %rdx\n"
+    "orq %rdx, %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_peek_end(void) {}
+
+
+void nseel_asm_stack_peek_top(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rdi), %rax\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_peek_top_end(void) {}
+
+void nseel_asm_stack_exch(void)
+{
+  __asm__(
+    FUNCTION_MARKER
+    "movabsq $0xfefefefefefefefe, %rdi\n"
+    "movq (%rdi), %rcx\n"
+    "movq (%rcx), %rdx\n"
+    "movq (%rax), %r8\n"
+    "movq %rdx, (%rax)\n"
+    "movq %r8, (%rcx)\n"
+    FUNCTION_MARKER
+  );
+}
+void nseel_asm_stack_exch_end(void) {}
+
+
+// eel_callcode64(code, ram_tab) is plain asm so that the compiler adds no prologue
+#ifdef __APPLE__
+  #define EEL_SSE_ASM_SYM(x) "_" #x
+#else
+  #define EEL_SSE_ASM_SYM(x) #x
+#endif
+
+__asm__(
+  ".text\n"
+  ".globl " EEL_SSE_ASM_SYM(eel_callcode64) "\n"
+  EEL_SSE_ASM_SYM(eel_callcode64) ":\n"
+    "subq $16, %rsp\n"
+#ifndef EEL_X64_NO_CHANGE_FPFLAGS
+    "stmxcsr (%rsp)\n"
+    "movl (%rsp), %eax\n"
+    "orl $0x9FC0, %eax\n" // flush denormals to zero (FTZ|DAZ), mask all exceptions
+    "movl %eax, 4(%rsp)\n"
+    "ldmxcsr 4(%rsp)\n"
+#endif
+    "push %rbx\n"
+    "push %rbp\n"
+    "push %r12\n"
+    "push %r13\n"
+    "push %r14\n"
+    "push %r15\n"
+
+    "movq %rsi, %r12\n" // second parameter is ram-blocks pointer
+    "call *%rdi\n"
+
+    "pop %r15\n"
+    "pop %r14\n"
+    "pop %r13\n"
+    "pop %r12\n"
+    "pop %rbp\n"
+    "pop %rbx\n"
+
+#ifndef EEL_X64_NO_CHANGE_FPFLAGS
+    "ldmxcsr (%rsp)\n"
+#endif
+    "addq $16, %rsp\n"
+    "ret\n"
+);
@@ -286,14 +286,9 @@ static EEL_F * fft_func(int dir, EEL_F **blocks, EEL_F *start, EEL_F *length)
 	ilen=1<<bitl;
 
 
-	// check to make sure we don't cross a boundary
-	if (offs/NSEEL_RAM_ITEMSPERBLOCK != (offs + (ilen<<itemSizeShift) - 1)/NSEEL_RAM_ITEMSPERBLOCK) 
-	{ 
-		return start; 
-	}
-
-	ptr=__NSEEL_RAMAlloc(blocks,offs);
-	if (!ptr || ptr==&nseel_ramalloc_onfail)
+	// the buffer can only cross a block boundary if the blocks are contiguous (flat RAM)
+	ptr=offs < 0 ? NULL : __NSEEL_RAMAllocSpan(blocks,offs,ilen<<itemSizeShift);
+	if (!ptr)
 	{ 
 		return start; 
 	}
@@ -340,15 +335,13 @@ static EEL_F * NSEEL_CGEN_CALL eel_convolve_c(EEL_F **blocks,EEL_F *dest, EEL_F
   const int len = ((int)(*lenptr + 0.0001)) * 2;
   EEL_F *srcptr,*destptr;
 
-  if (len < 1 || len > NSEEL_RAM_ITEMSPERBLOCK || dest_offs < 0 || src_offs < 0 || 
-      dest_offs >= NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK || src_offs >= NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK) return dest;
-  if ((dest_offs&(NSEEL_RAM_ITEMSPERBLOCK-1)) + len > NSEEL_RAM_ITEMSPERBLOCK) return dest;
-  if ((src_offs&(NSEEL_RAM_ITEMSPERBLOCK-1)) + len > NSEEL_RAM_ITEMSPERBLOCK) return dest;
+  if (len < 1 || len > NSEEL_RAM_ITEMSPERBLOCK || dest_offs < 0 || src_offs < 0) return dest;
 
-  srcptr = __NSEEL_RAMAlloc(blocks,src_offs);
-  if (!srcptr || srcptr==&nseel_ramalloc_onfail) return dest;
-  destptr = __NSEEL_RAMAlloc(blocks,dest_offs);
-  if (!destptr || destptr==&nseel_ramalloc_onfail) return dest;
+  // either buffer can only cross a block boundary if the blocks are contiguous (flat RAM)
+  srcptr = __NSEEL_RAMAllocSpan(blocks,src_offs,len);
+  if (!srcptr) return dest;
+  destptr = __NSEEL_RAMAllocSpan(blocks,dest_offs,len);
+  if (!destptr) return dest;
 
 
   WDL_fft_complexmul((WDL_FFT_COMPLEX*)destptr,(WDL_FFT_COMPLEX*)srcptr,(len/2)&~1);
@@ -716,14 +716,9 @@ static EEL_F * NSEEL_CGEN_CALL mdct_func(int dir, EEL_F **blocks, EEL_F *start,
   bidx = bitl - EEL_DCT_MINBITLEN;
 
 
-  // check to make sure we don't cross a boundary
-  if (offs / NSEEL_RAM_ITEMSPERBLOCK != (offs + ilen * 2 - 1) / NSEEL_RAM_ITEMSPERBLOCK)
-  {
-    return start;
-  }
-
-  ptr = __NSEEL_RAMAlloc(blocks, offs);
-  if (!ptr || ptr == &nseel_ramalloc_onfail)
+  // the buffer can only cross a block boundary if the blocks are contiguous (flat RAM)
+  ptr = offs < 0 ? NULL : __NSEEL_RAMAllocSpan(blocks, offs, ilen * 2);
+  if (!ptr)
   {
     return start;
   }
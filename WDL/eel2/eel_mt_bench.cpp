@@ -0,0 +1,159 @@
+// Compiles, runs and frees scripts in many VMs at once on a pool of threads, the way a host with
+// independent VMs per track would, and checks every result. Each script uses its own RAM (half of
+// the VMs flat), rand(), user functions and loops, and is compiled twice with NSEEL_CODE_COMPILE_FLAG_CACHE
+// so that the second one is a code cache hit (block mode scripts are run with
+// NSEEL_code_execute_block()). Every tenth script also checks what must miss the cache: another
+// lineoffs, a compile without the flag, and a compile after NSEEL_VM_remove_all_nonreg_vars().
+//
+// Built with TSAN=1 this is the thread safety check for what ns-eel.h says VMs don't share:
+//
+// make NO_GFX=1 eel_mt_bench && ./eel_mt_bench
+// make NO_GFX=1 TSAN=1 eel_mt_bench && ./eel_mt_bench -s
+// usage: eel_mt_bench [-t threads] [-n scripts] [-s]
+//   -s leaves NSEEL_HOSTSTUB_EnterMutex()/LeaveMutex() empty, as a host may if no VMs share state
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "ns-eel.h"
+#include "../wdlatomic.h"
+
+static bool s_stubMutex;
+static pthread_mutex_t s_mutex;
+
+void NSEEL_HOSTSTUB_EnterMutex() { if (!s_stubMutex) pthread_mutex_lock(&s_mutex); }
+void NSEEL_HOSTSTUB_LeaveMutex() { if (!s_stubMutex) pthread_mutex_unlock(&s_mutex); }
+
+static double GetTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static int s_nscripts;
+static volatile int s_next, s_failed;
+
+// Script j fills buf[0..999] with f(x) = x*mul, and leaves r = buf[idx].
+static bool RunScript(int j)
+{
+  const int mul = j % 1000 + 1, idx = j % 997, buf = (j % 50) * 1000;
+  const bool block = (j % 3) == 0;
+  char src[512];
+  snprintf(src,sizeof(src),
+    "function f(x) ( x*%d + rand(1)*0; );\n"
+    "a=0; buf=%d; loop(1000, buf[a]=f(a); a+=1;);\n"
+    "memset(200000,1,70000);\n"
+    "r = buf[%d];\n",
+    mul,buf,idx);
+
+  NSEEL_VMCTX vm = NSEEL_VM_alloc();
+  if (!vm) return false;
+  if (j & 1) NSEEL_VM_setramflat(vm,1);
+  EEL_F *r = NSEEL_VM_regvar(vm,"r");
+
+  bool ok = false;
+  const int flags = NSEEL_CODE_COMPILE_FLAG_CACHE | (block ? NSEEL_CODE_COMPILE_FLAG_BLOCK : 0);
+  NSEEL_CODEHANDLE code = NSEEL_code_compile_ex(vm,src,0,flags);
+  if (!code)
+  {
+    fprintf(stderr,"script %d: %s\n",j,NSEEL_code_getcodeerror(vm));
+  }
+  else
+  {
+    NSEEL_CODEHANDLE again = NSEEL_code_compile_ex(vm,src,0,flags);
+    EEL_F out = 0.0;
+    if (block)
+    {
+      NSEEL_BLOCK_BINDING b = { r, NULL, &out };
+      NSEEL_code_execute_block(again,1,&b,1);
+    }
+    else
+    {
+      NSEEL_code_execute(again);
+      out = *r;
+    }
+    ok = again == code && out == (EEL_F) (idx * mul);
+    if (!ok) fprintf(stderr,"script %d: r=%g, expected %d%s\n",j,out,idx * mul,again == code ? "" : ", not a cache hit");
+
+    if (ok && j % 10 == 0)
+    {
+      NSEEL_CODEHANDLE misses[3];
+      misses[0] = NSEEL_code_compile_ex(vm,src,1,flags);
+      misses[1] = NSEEL_code_compile_ex(vm,src,0,flags & ~NSEEL_CODE_COMPILE_FLAG_CACHE);
+      NSEEL_VM_remove_all_nonreg_vars(vm);
+      misses[2] = NSEEL_code_compile_ex(vm,src,0,flags);
+      for (int x = 0; x < 3; x ++)
+      {
+        if (!misses[x] || misses[x] == code)
+        {
+          fprintf(stderr,"script %d: compile %d should have missed the cache\n",j,x);
+          ok = false;
+        }
+        NSEEL_code_free(misses[x]);
+      }
+    }
+    NSEEL_code_free(again);
+    NSEEL_code_free(code);
+  }
+  NSEEL_VM_free(vm);
+  return ok;
+}
+
+static void *WorkerProc(void *p)
+{
+  int j;
+  while ((j = wdl_atomic_incr(&s_next) - 1) < s_nscripts)
+  {
+    if (!RunScript(j)) wdl_atomic_incr(&s_failed);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  int nthreads = 8, i;
+  s_nscripts = 4000;
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i],"-t") && i+1 < argc) nthreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-n") && i+1 < argc) s_nscripts = atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-s")) s_stubMutex = true;
+    else
+    {
+      fprintf(stderr,"usage: %s [-t threads] [-n scripts] [-s]\n",argv[0]);
+      return 1;
+    }
+  }
+  if (nthreads < 1 || nthreads > 256 || s_nscripts < 1)
+  {
+    fprintf(stderr,"need 1 to 256 threads and at least 1 script\n");
+    return 1;
+  }
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&s_mutex,&attr);
+  pthread_mutexattr_destroy(&attr);
+
+  NSEEL_init();
+
+  pthread_t threads[256];
+  const double t0 = GetTimeMs();
+  for (i = 0; i < nthreads; i ++) pthread_create(&threads[i],NULL,WorkerProc,NULL);
+  for (i = 0; i < nthreads; i ++) pthread_join(threads[i],NULL);
+  const double t1 = GetTimeMs();
+
+  const int *stats = NSEEL_getstats();
+  printf("%d scripts on %d threads (%s host mutex): %.0f scripts/s\n",s_nscripts,nthreads,s_stubMutex ? "empty" : "real",
+    s_nscripts * 1000.0 / (t1 - t0));
+  printf("%d compiles, %d cache hits, %d ms compiling\n",stats[5],stats[6],stats[7]);
+  printf("%d failed, %u bytes of RAM still counted, %d handles still counted\n",s_failed,NSEEL_RAM_memused,stats[4]);
+
+  NSEEL_quit();
+  return s_failed || NSEEL_RAM_memused || stats[4];
+}
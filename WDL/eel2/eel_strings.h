@@ -4,6 +4,7 @@
 #include "ns-eel-int.h"
 #include "../wdlcstring.h"
 #include "../wdlstring.h"
+#include "../hashmap.h"
 
 // required for context
 // #define EEL_STRING_GET_CONTEXT_POINTER(opaque) (((sInst *)opaque)->m_eel_string_state)
@@ -231,7 +232,7 @@ class eel_string_context_state
     WDL_PtrList<EEL_STRING_STORAGECLASS> m_literal_strings; // "this kind", normally immutable
     WDL_PtrList<EEL_STRING_STORAGECLASS> m_unnamed_strings; // #
     WDL_PtrList<EEL_STRING_STORAGECLASS> m_named_strings;  // #xyz by index, but stringkeyed below for names
-    WDL_StringKeyedArray<int> m_named_strings_names; // #xyz->index
+    WDL_StringHashMap<int> m_named_strings_names; // #xyz->index
 
     EEL_STRING_STORAGECLASS *m_user_strings[EEL_STRING_MAX_USER_STRINGS]; // indices 0-1023 (etc)
     WDL_AssocArray<const char *, EEL_F_PTR> m_varname_cache; // cached pointers when using %{xyz}s, %{#xyz}s bypasses
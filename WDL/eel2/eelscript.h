@@ -73,6 +73,7 @@ class eelScriptInst {
     int loadfile(const char *fn, const char *callerfn, bool allowstdin);
 
     NSEEL_VMCTX m_vm;
+    int m_compile_flags; // ORed into the flags of everything compiled, i.e. NSEEL_CODE_COMPILE_FLAG_PROFILE
 
     WDL_PtrList<void> m_code_freelist;
 
@@ -275,7 +276,7 @@ static EEL_F NSEEL_CGEN_CALL _eel_atexit(void *opaque, EEL_F *s)
 
 #define opaque ((void *)this)
 
-eelScriptInst::eelScriptInst() : m_loaded_fnlist(false)
+eelScriptInst::eelScriptInst() : m_compile_flags(0), m_loaded_fnlist(false)
 {
 #ifndef EELSCRIPT_NO_FILE
   memset(m_handles,0,sizeof(m_handles));
@@ -349,7 +350,7 @@ NSEEL_CODEHANDLE eelScriptInst::compile_code(const char *code, const char **err)
     *err = "EEL VM not initialized";
     return NULL;
   }
-  NSEEL_CODEHANDLE ch = NSEEL_code_compile_ex(m_vm, code, 0, NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS);
+  NSEEL_CODEHANDLE ch = NSEEL_code_compile_ex(m_vm, code, 0, m_compile_flags|NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS);
   if (ch)
   {
     m_string_context->update_named_vars(m_vm);
@@ -364,7 +365,7 @@ int eelScriptInst::runcode(const char *codeptr, int showerr, const char *showerr
 {
   if (m_vm) 
   {
-    NSEEL_CODEHANDLE code = NSEEL_code_compile_ex(m_vm,codeptr,0,canfree ? 0 : NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS);
+    NSEEL_CODEHANDLE code = NSEEL_code_compile_ex(m_vm,codeptr,0,m_compile_flags|(canfree ? 0 : NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS));
     if (code) m_string_context->update_named_vars(m_vm);
 
     char *err;
@@ -27,10 +27,40 @@ static void writeToStandardError(const char *fmt, ...)
 void NSEEL_HOSTSTUB_EnterMutex() { }
 void NSEEL_HOSTSTUB_LeaveMutex() { }
 
+static int sortProfileSites(const void *a, const void *b)
+{
+  const double d = ((const NSEEL_PROFILE_SITE *)b)->seconds - ((const NSEEL_PROFILE_SITE *)a)->seconds;
+  return d < 0.0 ? -1 : d > 0.0 ? 1 : 0;
+}
+
+// --profile: hottest sites first, time includes anything called from the site, % is of all top level code
+static void showProfile(NSEEL_VMCTX vm)
+{
+  WDL_TypedBuf<NSEEL_PROFILE_SITE> sites;
+  int n = NSEEL_VM_getprofile(vm,NULL,0);
+  if (!sites.Resize(n,false)) return;
+  n = NSEEL_VM_getprofile(vm,sites.Get(),n);
+  qsort(sites.Get(),n,sizeof(NSEEL_PROFILE_SITE),sortProfileSites);
+
+  double total = 0.0;
+  int x;
+  for (x=0;x<n;x++) if (!sites.Get()[x].name[0]) total += sites.Get()[x].seconds;
+
+  fprintf(stderr,"%6s  %-24s %12s %14s %12s %7s\n","line","site","calls","iterations","ms","%");
+  for (x=0;x<n;x++)
+  {
+    const NSEEL_PROFILE_SITE *s = sites.Get()+x;
+    if (!s->count) continue;
+    fprintf(stderr,"%6d  %-24s %12lld %14lld %12.3f %6.1f%%\n",
+      s->line, s->name[0] ? s->name : "(top level)", (long long)s->count, (long long)s->iterations,
+      s->seconds*1000.0, total > 0.0 ? s->seconds*100.0/total : 0.0);
+  }
+}
+
 
 int main(int argc, char **argv)
 {
-  bool want_args = true;
+  bool want_args = true, want_flatram = false, want_profile = false;
   int argpos = 1;
   const char *scriptfn = argv[0];
   while (argpos < argc && argv[argpos][0] == '-' && argv[argpos][1])
@@ -38,9 +68,11 @@ int main(int argc, char **argv)
     if (!strcmp(argv[argpos],"-v")) g_verbose++;
     else if (!strcmp(argv[argpos],"-i")) g_interactive++;
     else if (!strcmp(argv[argpos],"--no-args")) want_args=false;
+    else if (!strcmp(argv[argpos],"--flat-ram")) want_flatram=true;
+    else if (!strcmp(argv[argpos],"--profile")) want_profile=true;
     else
     {
-      fprintf(stderr,"Usage: %s [-v] [--no-args] [-i | scriptfile | -]\n",argv[0]);
+      fprintf(stderr,"Usage: %s [-v] [--no-args] [--flat-ram] [--profile] [-i | scriptfile | -]\n",argv[0]);
       return -1;
     }
     argpos++;
@@ -75,6 +107,10 @@ int main(int argc, char **argv)
   WDL_FastString code,t;
 
   eelScriptInst inst;
+  if (want_flatram && !NSEEL_VM_setramflat(inst.m_vm,1))
+    fprintf(stderr,"NSEEL_VM_setramflat(): failed, using normal RAM\n");
+  if (want_profile) inst.m_compile_flags |= NSEEL_CODE_COMPILE_FLAG_PROFILE;
+
   if (want_args)
   {
     const int argv_offs = 1<<22;
@@ -145,6 +181,8 @@ int main(int argc, char **argv)
     while (inst.run_deferred());
   }
 
+  if (want_profile) showProfile(inst.m_vm);
+
   return 0;
 }
 
@@ -33,6 +33,13 @@
 #include "ns-eel.h"
 #include "ns-eel-addfuncs.h"
 
+// x86-64 gcc/clang builds generate scalar SSE2 code (glue_x86_64_sse.h, asm-nseel-x64-sse-gcc.c).
+// define EEL_X64_X87 to use the x87 code generator and link asm-nseel-x64.o instead.
+#if !defined(EEL_TARGET_PORTABLE) && !defined(EEL_X64_X87) && !defined(EEL_X64_SSE) && \
+    defined(__GNUC__) && defined(__x86_64__) && !defined(_WIN64)
+  #define EEL_X64_SSE
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -157,6 +164,15 @@ typedef struct {
   void *ramPtr;
 
   int workTable_size; // size (minus padding/extra space) of workTable -- only used if EEL_VALIDATE_WORKTABLE_USE set, but might be handy to have around too
+
+  // NSEEL_CODE_COMPILE_FLAG_BLOCK: the code loops block_count times, calling nseel_block_io() at the start of each iteration
+  EEL_F block_count;
+  int block_start, block_pos, block_nbindings;
+  const NSEEL_BLOCK_BINDING *block_bindings;
+
+  // set if the handle is in its VM's code cache, shared by cache_refcnt NSEEL_code_compile*() callers
+  void *cache_ctx;
+  int cache_refcnt;
 } codeHandleType;
 
 
@@ -177,6 +193,7 @@ typedef struct _compileContext
 
   void *scanner;
   const char *rdbuf_start, *rdbuf, *rdbuf_end;
+  int lex_tokpos; // offset of the token being lexed from rdbuf_start, stamped onto new opcodes (-1 if unknown)
 
   llBlock *tmpblocks_head, // used while compiling, and freed after compiling
 
@@ -225,7 +242,17 @@ typedef struct _compileContext
 
   void *gram_blocks;
 
+  EEL_F *ram_flat; // see NSEEL_VM_setramflat(), backs ram_state.blocks[0..ram_flat_blocks-1]
+  int ram_flat_blocks;
+
+  EEL_F *global_regs; // reg00-reg99 in NSEEL_EEL1_COMPAT_MODE, NULL for the shared ones
+
   void *caller_this;
+
+  struct nseelCodeCacheRec *code_cache; // compiled code by source, see NSEEL_code_compile_ex()
+
+  struct nseelProfileSite *prof_sites; // NSEEL_CODE_COMPILE_FLAG_PROFILE counters, see NSEEL_VM_getprofile()
+  int prof_nsites, prof_sites_alloc;
 }
 compileContext;
 
@@ -300,8 +327,20 @@ int nseel_filter_escaped_string(char *outbuf, int outbuf_sz, const char *rdptr,
 opcodeRec *nseel_translate(compileContext *ctx, const char *tmp, size_t tmplen); // tmplen=0 for nul-term
 int nseel_lookup(compileContext *ctx, opcodeRec **opOut, const char *sname);
 
+// for counters shared by all VMs (NSEEL_RAM_memused, NSEEL_getstats())
+#ifdef _WIN32
+  #define nseel_atomic_add(p,v) InterlockedExchangeAdd((volatile LONG *)(p),(LONG)(v))
+  #define nseel_atomic_add64(p,v) InterlockedExchangeAdd64((volatile LONGLONG *)(p),(LONGLONG)(v))
+  #define nseel_atomic_cas(p,oldv,newv) (InterlockedCompareExchange((volatile LONG *)(p),(LONG)(newv),(LONG)(oldv)) == (LONG)(oldv))
+#else
+  #define nseel_atomic_add(p,v) __sync_fetch_and_add((p),(v))
+  #define nseel_atomic_add64(p,v) __sync_fetch_and_add((p),(v))
+  #define nseel_atomic_cas(p,oldv,newv) __sync_bool_compare_and_swap((p),(oldv),(newv))
+#endif
+
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAlloc(EEL_F **blocks, unsigned int w);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, unsigned int w);
+EEL_F *__NSEEL_RAMAllocSpan(EEL_F **blocks, unsigned int w, unsigned int len); // NULL if w..w+len-1 isn't contiguous
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemSet(EEL_F **blocks,EEL_F *dest, EEL_F *v, EEL_F *lenptr);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemFree(void *blocks, EEL_F *which);
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemTop(void *blocks, EEL_F *which);
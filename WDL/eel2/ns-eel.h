@@ -63,6 +63,13 @@ extern "C" {
 
   // or if you're daring....
 
+  // VMs are otherwise independent: different VMs can be compiled, run and freed in different
+  // threads at once (RAM accounting and NSEEL_getstats() are atomic, rand() state is per-thread).
+  // state that is shared between VMs, and so needs the mutex: _global.* variables, the
+  // default (NULL) GRAM, a GRAM shared between VMs, and reg00-reg99 in NSEEL_EEL1_COMPAT_MODE
+  // unless each VM has its own (NSEEL_VM_SetGlobalRegs()). scripts that access shared state
+  // from different threads still need to coordinate like any other shared memory.
+
 void NSEEL_HOSTSTUB_EnterMutex();
 void NSEEL_HOSTSTUB_LeaveMutex();
 
@@ -115,7 +122,8 @@ void NSEEL_addfunctionex2(const char *name, int nparms, char *code_startaddr, in
 void NSEEL_addfunc_ret_type(const char *name, int np, int ret_type,  NSEEL_PPPROC pproc, void *fptr, eel_function_table *destination); // ret_type=-1 for bool, 1 for value, 0 for ptr
 void NSEEL_addfunc_varparm_ex(const char *name, int min_np, int want_exact, NSEEL_PPPROC pproc, EEL_F (NSEEL_CGEN_CALL *fptr)(void *, INT_PTR, EEL_F **), eel_function_table *destination);
 
-int *NSEEL_getstats(); // returns a pointer to 5 ints... source bytes, static code bytes, call code bytes, data bytes, number of code handles
+int *NSEEL_getstats(); // returns a pointer to 8 ints... source bytes, static code bytes, call code bytes, data bytes, number of code handles,
+                       // NSEEL_code_compile*() calls, of which were code cache hits, total compile time in milliseconds
 
 typedef void *NSEEL_VMCTX;
 typedef void *NSEEL_CODEHANDLE;
@@ -149,6 +157,19 @@ int NSEEL_VM_wantfreeRAM(NSEEL_VMCTX ctx); // want NSEEL_VM_freeRAMIfCodeRequest
 // NSEEL_VM_FreeGRAM(&p);
 void NSEEL_VM_SetGRAM(NSEEL_VMCTX ctx, void **gram); 
 void NSEEL_VM_FreeGRAM(void **ufd); // frees a gmem context.
+
+// flat RAM: reserves address space for the VM's whole RAM (see NSEEL_VM_setramsize) as one mapping
+// up front, using transparent huge pages where available. blocks are still handed out (committed,
+// on Windows) on first use and count against NSEEL_RAM_limitmem like normal blocks, but they come
+// from the reservation rather than malloc(), so they're adjacent and fft()/convolve_c() etc can work
+// across block boundaries. discards the current RAM contents, returns 1 if flat RAM is in use.
+// NSEEL_VM_freeRAM() clears it, NSEEL_VM_free() releases it.
+int NSEEL_VM_setramflat(NSEEL_VMCTX ctx, int flat);
+
+// allocates a gmem context as one flat reservation, if *gram is NULL. returns 1 if *gram is flat.
+// blocks are handed out and counted on first use, as with NSEEL_VM_setramflat().
+// pass the same &p to NSEEL_VM_SetGRAM() of as many VMs as needed, and free with NSEEL_VM_FreeGRAM().
+int NSEEL_VM_AllocFlatGRAM(void **gram);
 void NSEEL_VM_SetCustomFuncThis(NSEEL_VMCTX ctx, void *thisptr);
 
 EEL_F *NSEEL_VM_getramptr(NSEEL_VMCTX ctx, unsigned int offs, int *validCount);
@@ -176,13 +197,48 @@ NSEEL_CODEHANDLE NSEEL_code_compile(NSEEL_VMCTX ctx, const char *code, int lineo
 #define NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS 1 // allows that code's functions to be used in other code (note you shouldn't destroy that codehandle without destroying others first if used)
 #define NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS_RESET 2 // resets common code functions
 
+#define NSEEL_CODE_COMPILE_FLAG_BLOCK 4 // code is run once per sample by NSEEL_code_execute_block() (NSEEL_code_execute() does nothing with it)
+#define NSEEL_CODE_COMPILE_FLAG_PROFILE 8 // counts and times each code segment, function, loop() and while(), see NSEEL_VM_getprofile()
+#define NSEEL_CODE_COMPILE_FLAG_CACHE 16 // shares the handle of an identical earlier compile in the VM, see below
+
+// with NSEEL_CODE_COMPILE_FLAG_CACHE, compiling the same code again in a VM (with the same flags, lineoffs, function table,
+// validator, SetCustomFuncThis() and GRAM) returns the existing handle, which is shared until each NSEEL_code_free().
+// COMMONFUNCS code, code compiled while a VM has common functions, and string-using code in VMs with string support are
+// always compiled. NSEEL_VM_remove_unused_vars() and NSEEL_VM_remove_all_nonreg_vars() empty the cache.
+// the cache is per VM: compiled code has the addresses of its VM's variables and RAM built in, so it can't be shared
+// between VMs, and N instances of the same script in N VMs still compile it N times. it only helps hosts that
+// recompile code in the same VM (i.e. on reset, or when one of several sections changes).
 NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX ctx, const char *code, int lineoffs, int flags);
 
 char *NSEEL_code_getcodeerror(NSEEL_VMCTX ctx);
 int NSEEL_code_geterror_flag(NSEEL_VMCTX ctx);
 void NSEEL_code_execute(NSEEL_CODEHANDLE code);
+
+// block mode: for code compiled with NSEEL_CODE_COMPILE_FLAG_BLOCK, runs the code n times in one native loop.
+// before each sample, every binding's var (from NSEEL_VM_regvar(), i.e. "spl0") is loaded from in[i], after it, var is stored to out[i].
+// in and out may be the same buffer, or NULL.
+typedef struct
+{
+  EEL_F *var;
+  const EEL_F *in;
+  EEL_F *out;
+} NSEEL_BLOCK_BINDING;
+void NSEEL_code_execute_block(NSEEL_CODEHANDLE code, int n, const NSEEL_BLOCK_BINDING *bindings, int nbindings);
 void NSEEL_code_free(NSEEL_CODEHANDLE code);
 int *NSEEL_code_getstats(NSEEL_CODEHANDLE code); // 4 ints...source bytes, static code bytes, call code bytes, data bytes
+
+// profiling: code compiled with NSEEL_CODE_COMPILE_FLAG_PROFILE updates a per-VM counter for each site it runs.
+// sites are keyed by name and line, so the copies of a function share one, and they survive NSEEL_code_free().
+typedef struct
+{
+  const char *name; // function name, "loop", "while", or "" for top level code (valid until the VM compiles more code)
+  int line; // 1-based line in the code passed to NSEEL_code_compile*() plus lineoffs, 0 if unknown
+  WDL_INT64 count; // times entered
+  WDL_INT64 iterations; // loop()/while() iterations
+  double seconds; // wall clock time spent inside, including any sites called from it
+} NSEEL_PROFILE_SITE;
+int NSEEL_VM_getprofile(NSEEL_VMCTX ctx, NSEEL_PROFILE_SITE *list, int maxlist); // returns number of sites, copies up to maxlist of them
+void NSEEL_VM_resetprofile(NSEEL_VMCTX ctx); // zeroes all counters
   
 
 // global memory control/view
@@ -253,6 +309,7 @@ extern int NSEEL_RAM_memused_errors;
 
 #ifdef NSEEL_EEL1_COMPAT_MODE
 double *NSEEL_getglobalregs();
+void NSEEL_VM_SetGlobalRegs(NSEEL_VMCTX ctx, EEL_F *regs); // 100 values for reg00-reg99 in code compiled afterwards, NULL (default) for NSEEL_getglobalregs()
 #endif
 
 void eel_setfp_round(); // use to set fp to rounding mode (normal) -- only really use this when being called from EEL
@@ -39,15 +39,24 @@
 #define UPPER_MASK 0x80000000UL /* most significant w-r bits */
 #define LOWER_MASK 0x7fffffffUL /* least significant r bits */
 
+// the generator state is per-thread where supported, so VMs running in different threads don't race on it
+#if defined(_MSC_VER)
+  #define NSEEL_RAND_STATE static __declspec(thread)
+#elif defined(__clang__) || (defined(__GNUC__) && !defined(__APPLE__))
+  #define NSEEL_RAND_STATE static __thread
+#else
+  #define NSEEL_RAND_STATE static
+#endif
+
 static unsigned int genrand_int32(void)
 {
 
     unsigned int y;
-    static unsigned int mag01[2]={0x0UL, MATRIX_A};
+    static const unsigned int mag01[2]={0x0UL, MATRIX_A};
     /* mag01[x] = x * MATRIX_A  for x=0,1 */
 
-    static unsigned int mt[N]; /* the array for the state vector  */
-    static int mti; /* mti==N+1 means mt[N] is not initialized */
+    NSEEL_RAND_STATE unsigned int mt[N]; /* the array for the state vector  */
+    NSEEL_RAND_STATE int mti; /* mti==N+1 means mt[N] is not initialized */
 
 
     if (!mti)
@@ -180,13 +189,16 @@ EEL_F NSEEL_CGEN_CALL nseel_int_rand(EEL_F f)
 		"addl $16, %esp\n"
 	);
    }
+  #elif defined(EEL_X64_SSE)
+    #define FUNCTION_MARKER "\n.byte 0x89,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90\n"
+    #include "asm-nseel-x64-sse-gcc.c"
   #endif
 #endif
 
 #endif
 
-#if defined(__ppc__) || defined(__arm__) || defined(EEL_TARGET_PORTABLE)
-  // blank stubs for PPC, portable modes
+#if defined(__ppc__) || defined(__arm__) || defined(EEL_TARGET_PORTABLE) || defined(EEL_X64_SSE)
+  // blank stubs for PPC, portable, x64 SSE modes (SSE code always truncates)
   void eel_setfp_round() { }
   void eel_setfp_trunc() { }
 #endif
@@ -29,11 +29,16 @@
 
 #include "../denormal.h"
 #include "../wdlcstring.h"
+#include "../fnv64.h"
 
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
 #include <ctype.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#include <time.h>
+#endif
 
 #ifndef EEL_TARGET_PORTABLE
 
@@ -126,6 +131,10 @@ FILE *g_eel_dump_fp, *g_eel_dump_fp2;
 
 #include "glue_arm.h"
 
+#elif defined(EEL_X64_SSE)
+
+#include "glue_x86_64_sse.h"
+
 #elif defined(_WIN64) || defined(__LP64__)
 
 #include "glue_x86_64.h"
@@ -159,12 +168,41 @@ typedef struct
 
 
 
-static int nseel_evallib_stats[5]; // source bytes, static code bytes, call code bytes, data bytes, segments
+// updated atomically, as VMs can compile in different threads
+static int nseel_evallib_stats[8]; // source bytes, static code bytes, call code bytes, data bytes, segments, compiles, cache hits, compile milliseconds
+static WDL_INT64 nseel_compile_us; // an int of microseconds would wrap after 35 minutes of compiling
 int *NSEEL_getstats()
 {
+  const int ms = (int) (nseel_atomic_add64(&nseel_compile_us,0) / 1000);
+  int old;
+  do old = nseel_evallib_stats[7]; while (old != ms && !nseel_atomic_cas(&nseel_evallib_stats[7],old,ms));
   return nseel_evallib_stats;
 }
 
+static double nseel_time_precise()
+{
+#ifdef _WIN32
+  static double freq_inv;
+  LARGE_INTEGER now;
+  if (!freq_inv)
+  {
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    freq_inv = 1.0 / (double)freq.QuadPart;
+  }
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * freq_inv;
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + ts.tv_nsec*0.000000001;
+#else
+  struct timeval tm={0,};
+  gettimeofday(&tm,NULL);
+  return tm.tv_sec + tm.tv_usec*0.000001;
+#endif
+}
+
 static int findLineNumber(const char *exp, int byteoffs)
 {
   int lc=0;
@@ -211,6 +249,7 @@ struct opcodeRec
  } parms;
   
  int namespaceidx;
+ int srcpos; // offset of the token that created it from the start of the code, -1 if not from the lexer
  
  // OPCODETYPE_VALUE_FROM_NAMESPACENAME (relname is either empty or blah)
  // OPCODETYPE_VARPTR if it represents a global variable, will be nonempty
@@ -252,6 +291,7 @@ static opcodeRec *newOpCode(compileContext *ctx, const char *str, int opType)
   {
     memset(rec,0,sizeof(*rec));
     rec->opcodeType = opType;
+    rec->srcpos = ctx->lex_tokpos;
 
     if (str_sz > 0) 
     {
@@ -496,7 +536,7 @@ static double eel1sigmoid(double x, double constraint)
 #define BIF_TWOPARMSONFPSTACK_LAZY (BIF_LAZYPARMORDERING|BIF_SECONDLASTPARMST|BIF_LASTPARMONSTACK)
 
 
-#ifndef GLUE_HAS_NATIVE_TRIGSQRTLOG
+#if !defined(GLUE_HAS_NATIVE_TRIGSQRTLOG) && !defined(GLUE_HAS_NATIVE_SQRT)
 static double sqrt_fabs(double a) { return sqrt(fabs(a)); }
 #endif
 
@@ -515,7 +555,11 @@ static functionType fnTable1[] = {
    { "sin",   nseel_asm_1pdd,nseel_asm_1pdd_end,   1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK|BIF_WONTMAKEDENORMAL, {&sin} },
    { "cos",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK|BIF_CLEARDENORMAL, {&cos} },
    { "tan",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK, {&tan}  },
+#ifdef GLUE_HAS_NATIVE_SQRT
+   { "sqrt",   nseel_asm_sqrt,nseel_asm_sqrt_end,  1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK|BIF_FPSTACKUSE(1)|BIF_WONTMAKEDENORMAL },
+#else
    { "sqrt",   nseel_asm_1pdd,nseel_asm_1pdd_end,  1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK|BIF_WONTMAKEDENORMAL, {&sqrt_fabs}, },
+#endif
    { "log",    nseel_asm_1pdd,nseel_asm_1pdd_end,   1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK, {&log} },
    { "log10",  nseel_asm_1pdd,nseel_asm_1pdd_end, 1|NSEEL_NPARAMS_FLAG_CONST|BIF_RETURNSONSTACK|BIF_LASTPARMONSTACK, {&log10} },
 #else
@@ -4297,9 +4341,151 @@ typedef struct topLevelCodeSegmentRec {
 } topLevelCodeSegmentRec;
 
 
-NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression, int lineoffs, int compile_flags)
+// NSEEL_CODE_COMPILE_FLAG_BLOCK: called at the start of each iteration, stores the previous sample's outputs and loads the next inputs
+static EEL_F * NSEEL_CGEN_CALL nseel_block_io(void *_h, EEL_F *parm)
+{
+  codeHandleType *h = (codeHandleType *)_h;
+  const NSEEL_BLOCK_BINDING *b = h->block_bindings;
+  const int pos = h->block_pos++;
+  int x;
+  for (x = 0; x < h->block_nbindings; x ++, b ++)
+  {
+    if (pos > h->block_start && b->out) b->out[pos-1] = *b->var;
+    if (b->in) *b->var = b->in[pos];
+  }
+  return parm;
+}
+
+static void *nseel_block_io_pproc(void *data, int data_size, compileContext *ctx)
+{
+  if (data_size>0) data=EEL_GLUE_set_immediate(data, (INT_PTR)ctx->tmpCodeHandle);
+  return data;
+}
+
+static functionType nseel_block_io_func = { "__block_io", _asm_generic1parm,_asm_generic1parm_end, 1, {&nseel_block_io}, nseel_block_io_pproc };
+
+
+// NSEEL_CODE_COMPILE_FLAG_PROFILE: per-VM counters, code refers to them by index as prof_sites may be reallocated by later compiles
+typedef struct nseelProfileSite
+{
+  NSEEL_PROFILE_SITE s;
+  double t0;
+  char name[NSEEL_MAX_VARIABLE_NAMELEN+1];
+} nseelProfileSite;
+
+static EEL_F * NSEEL_CGEN_CALL nseel_prof_enter(void *_ctx, EEL_F *site)
+{
+  nseelProfileSite *p = ((compileContext *)_ctx)->prof_sites + (int)*site;
+  p->s.count++;
+  p->t0 = nseel_time_precise();
+  return site;
+}
+
+static EEL_F * NSEEL_CGEN_CALL nseel_prof_leave(void *_ctx, EEL_F *site, EEL_F *value)
+{
+  nseelProfileSite *p = ((compileContext *)_ctx)->prof_sites + (int)*site;
+  p->s.seconds += nseel_time_precise() - p->t0;
+  return value;
+}
+
+static EEL_F * NSEEL_CGEN_CALL nseel_prof_iter(void *_ctx, EEL_F *site)
+{
+  ((compileContext *)_ctx)->prof_sites[(int)*site].s.iterations++;
+  return site;
+}
+
+static void *nseel_prof_pproc(void *data, int data_size, compileContext *ctx)
+{
+  if (data_size>0) data=EEL_GLUE_set_immediate(data, (INT_PTR)ctx);
+  return data;
+}
+
+static functionType nseel_prof_enter_func = { "__prof_enter", _asm_generic1parm,_asm_generic1parm_end, 1, {&nseel_prof_enter}, nseel_prof_pproc };
+static functionType nseel_prof_leave_func = { "__prof_leave", _asm_generic2parm,_asm_generic2parm_end, 2, {&nseel_prof_leave}, nseel_prof_pproc };
+static functionType nseel_prof_iter_func = { "__prof_iter", _asm_generic1parm,_asm_generic1parm_end, 1, {&nseel_prof_iter}, nseel_prof_pproc };
+
+static int nseel_prof_site(compileContext *ctx, const char *name, const char *_expression, int srcpos, int lineoffs)
+{
+  const int line = srcpos >= 0 ? findLineNumber(_expression,srcpos) + 1 + lineoffs : 0;
+  nseelProfileSite *p = ctx->prof_sites;
+  int x;
+  for (x = 0; x < ctx->prof_nsites; x ++, p ++)
+  {
+    if (p->s.line == line && !strcmp(p->name,name)) return x;
+  }
+  if (ctx->prof_nsites >= ctx->prof_sites_alloc)
+  {
+    const int na = ctx->prof_sites_alloc ? ctx->prof_sites_alloc*2 : 64;
+    p = (nseelProfileSite *)realloc(ctx->prof_sites,na*sizeof(nseelProfileSite));
+    if (!p) return -1;
+    ctx->prof_sites = p;
+    ctx->prof_sites_alloc = na;
+  }
+  p = ctx->prof_sites + ctx->prof_nsites;
+  memset(p,0,sizeof(*p));
+  lstrcpyn_safe(p->name,name,sizeof(p->name));
+  p->s.line = line;
+  return ctx->prof_nsites++;
+}
+
+static opcodeRec *nseel_prof_call(compileContext *ctx, functionType *fn, int site, opcodeRec *parm)
+{
+  opcodeRec *op = newOpCode(ctx,NULL,parm ? OPCODETYPE_FUNC2 : OPCODETYPE_FUNC1);
+  if (op)
+  {
+    op->fntype = FUNCTYPE_FUNCTIONTYPEREC;
+    op->fn = fn;
+    op->parms.parms[0] = nseel_createCompiledValue(ctx,(EEL_F)site);
+    op->parms.parms[1] = parm;
+    if (!op->parms.parms[0]) op = NULL;
+  }
+  return op;
+}
+
+// op becomes (__prof_enter(site); __prof_leave(site, op))
+static opcodeRec *nseel_prof_wrap(compileContext *ctx, opcodeRec *op, int site)
+{
+  opcodeRec *enter, *leave, *r;
+  if (site < 0 || !op) return op;
+  enter = nseel_prof_call(ctx,&nseel_prof_enter_func,site,NULL);
+  leave = nseel_prof_call(ctx,&nseel_prof_leave_func,site,op);
+  r = enter && leave ? nseel_createSimpleCompiledFunction(ctx,FN_JOIN_STATEMENTS,2,enter,leave) : NULL;
+  return r ? r : op;
+}
+
+// wraps every loop() and while() in op, and counts their iterations, returns the new op
+static opcodeRec *nseel_prof_instrument(compileContext *ctx, opcodeRec *op, const char *_expression, int lineoffs)
+{
+  int x, np;
+  if (!op) return op;
+  switch (op->opcodeType)
+  {
+    case OPCODETYPE_FUNC1: np = 1; break;
+    case OPCODETYPE_FUNC2: case OPCODETYPE_MOREPARAMS: np = 2; break;
+    case OPCODETYPE_FUNC3: case OPCODETYPE_FUNCX: np = 3; break;
+    default: return op;
+  }
+  for (x = 0; x < np; x ++) op->parms.parms[x] = nseel_prof_instrument(ctx,op->parms.parms[x],_expression,lineoffs);
+
+  if ((op->opcodeType == OPCODETYPE_FUNC2 && op->fntype == FN_LOOP) ||
+      (op->opcodeType == OPCODETYPE_FUNC1 && op->fntype == FN_WHILE))
+  {
+    // loop(n, __prof_iter(site); body), while(__prof_iter(site); body)
+    opcodeRec **body = op->parms.parms + (op->fntype == FN_LOOP ? 1 : 0);
+    const int site = *body ? nseel_prof_site(ctx,op->fntype == FN_LOOP ? "loop" : "while",_expression,op->srcpos,lineoffs) : -1;
+    opcodeRec *iter = site >= 0 ? nseel_prof_call(ctx,&nseel_prof_iter_func,site,NULL) : NULL;
+    opcodeRec *j = iter ? nseel_createSimpleCompiledFunction(ctx,FN_JOIN_STATEMENTS,2,iter,*body) : NULL;
+    if (j)
+    {
+      *body = j;
+      op = nseel_prof_wrap(ctx,op,site);
+    }
+  }
+  return op;
+}
+
+static NSEEL_CODEHANDLE nseel_code_compile_int(compileContext *ctx, const char *_expression, int lineoffs, int compile_flags)
 {
-  compileContext *ctx = (compileContext *)_ctx;
   const char *endptr;
   const char *_expression_end;
   codeHandleType *handle;
@@ -4309,6 +4495,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
   int curtabptr_sz=0;
   void *curtabptr=NULL;
   int had_err=0;
+  opcodeRec *block_body=NULL;
 
   if (!ctx) return 0;
 
@@ -4385,6 +4572,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
     void *startptr=NULL;
     opcodeRec *start_opcode=NULL;
     const char *expr=endptr;
+    const char *segment_start;
     
     int function_numparms=0;
     char is_fname[NSEEL_MAX_VARIABLE_NAMELEN+1];
@@ -4438,6 +4626,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
       }
       if (!*expr || !had_something) break;
     }
+    segment_start = expr;
 
     // parse   
 
@@ -4587,6 +4776,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
      void nseelrestart (void *input_file ,void *yyscanner );
 
      ctx->rdbuf_start = _expression;
+     ctx->lex_tokpos = -1;
 
 #ifdef NSEEL_SUPER_MINIMAL_LEXER
 
@@ -4614,6 +4804,7 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
      }
 #endif
      ctx->rdbuf = NULL;
+     ctx->lex_tokpos = -1;
    }
            
     if (start_opcode)
@@ -4640,6 +4831,13 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
       }
 #endif
 
+      if (compile_flags & NSEEL_CODE_COMPILE_FLAG_PROFILE)
+      {
+        start_opcode = nseel_prof_instrument(ctx,start_opcode,_expression,lineoffs);
+        start_opcode = nseel_prof_wrap(ctx,start_opcode,
+          nseel_prof_site(ctx,is_fname,_expression,(int)(segment_start-_expression),lineoffs));
+      }
+
       if (!(ctx->optimizeDisableFlags&OPTFLAG_NO_OPTIMIZE)) optimizeOpcodes(ctx,start_opcode,is_fname[0] ? 1 : 0);
 #ifdef LOG_OPT
       sprintf(buf,"post opt sz=%d, stack depth=%d\n",compileOpcodes(ctx,start_opcode,NULL,1024*1024*256,NULL,NULL, RETURNVALUE_IGNORE,NULL,&sd,NULL),sd);
@@ -4659,6 +4857,13 @@ NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression
       }
 #endif
 
+      if ((compile_flags & NSEEL_CODE_COMPILE_FLAG_BLOCK) && !is_fname[0])
+      {
+        // top level code becomes the body of the block loop, which is generated after all functions are parsed
+        block_body = block_body ? nseel_createSimpleCompiledFunction(ctx,FN_JOIN_STATEMENTS,2,block_body,start_opcode) : start_opcode;
+        continue;
+      }
+
 #ifdef DUMP_OPS_DURING_COMPILE
       g_debugfp_indent=0;
       g_debugfp_histsz=0;
@@ -4833,6 +5038,46 @@ had_error:
   ctx->function_curName=NULL;
   ctx->function_globalFlag=0;
 
+  if (block_body && !had_err)
+  {
+    // loop(block_count, __block_io(); body)
+    opcodeRec *op = newOpCode(ctx,NULL,OPCODETYPE_FUNC1);
+    void *startptr=NULL;
+    int startptr_size=0, computTableTop=0;
+    if (op)
+    {
+      op->fntype = FUNCTYPE_FUNCTIONTYPEREC;
+      op->fn = &nseel_block_io_func;
+      op->parms.parms[0] = nseel_createCompiledValue(ctx,0.0);
+      op = nseel_createSimpleCompiledFunction(ctx,FN_JOIN_STATEMENTS,2,op,block_body);
+      op = nseel_createSimpleCompiledFunction(ctx,FN_LOOP,2,nseel_createCompiledValuePtr(ctx,&handle->block_count,NULL),op);
+    }
+    if (op) startptr_size = compileOpcodes(ctx,op,NULL,1024*1024*256,NULL, NULL, RETURNVALUE_IGNORE, NULL, NULL, NULL);
+    if (startptr_size>0) startptr = newTmpBlock(ctx,startptr_size);
+    if (startptr)
+    {
+      startptr_size=compileOpcodes(ctx,op,(unsigned char*)startptr,startptr_size,&computTableTop, NULL, RETURNVALUE_IGNORE, NULL,NULL, NULL);
+      if (startptr_size<=0) startptr = NULL;
+    }
+
+    if (startptr)
+    {
+      topLevelCodeSegmentRec *p = newTmpBlock(ctx,sizeof(topLevelCodeSegmentRec));
+      p->_next=0;
+      p->code = startptr;
+      p->codesz = startptr_size;
+      p->tmptable_use = computTableTop;
+      startpts = startpts_tail = p;
+      if (curtabptr_sz < computTableTop) curtabptr_sz=computTableTop;
+    }
+    else
+    {
+      if (!ctx->last_error_string[0]) lstrcpyn_safe(ctx->last_error_string,"error compiling block loop",sizeof(ctx->last_error_string));
+      startpts=startpts_tail=NULL;
+      had_err=1;
+    }
+  }
+
   ctx->tmpCodeHandle = NULL;
     
   if (handle->want_stack)
@@ -4934,11 +5179,11 @@ had_error:
   {
     handle->ramPtr = ctx->ram_state.blocks;
     memcpy(handle->code_stats,ctx->l_stats,sizeof(ctx->l_stats));
-    nseel_evallib_stats[0]+=ctx->l_stats[0];
-    nseel_evallib_stats[1]+=ctx->l_stats[1];
-    nseel_evallib_stats[2]+=ctx->l_stats[2];
-    nseel_evallib_stats[3]+=ctx->l_stats[3];
-    nseel_evallib_stats[4]++;
+    nseel_atomic_add(&nseel_evallib_stats[0],ctx->l_stats[0]);
+    nseel_atomic_add(&nseel_evallib_stats[1],ctx->l_stats[1]);
+    nseel_atomic_add(&nseel_evallib_stats[2],ctx->l_stats[2]);
+    nseel_atomic_add(&nseel_evallib_stats[3],ctx->l_stats[3]);
+    nseel_atomic_add(&nseel_evallib_stats[4],1);
   }
   else
   {
@@ -4956,6 +5201,106 @@ had_error:
   return (NSEEL_CODEHANDLE)handle;
 }
 
+// per-VM code cache: code handles by source and the VM state that compiling depends on. not shared between VMs,
+// since the generated code points at the VM's own variables and RAM (see NSEEL_code_compile_ex() in ns-eel.h)
+typedef struct nseelCodeCacheRec
+{
+  struct nseelCodeCacheRec *next;
+  codeHandleType *handle;
+  WDL_UINT64 hash;
+  int flags, lineoffs;
+  eel_function_table *func_tab;
+  const char *(*func_check)(const char *fn_name, void *user);
+  void *func_check_user, *caller_this, *gram_blocks;
+  EEL_F *global_regs;
+  int srclen;
+  char src[1]; // varlen
+} nseelCodeCacheRec;
+
+static int nseel_code_cacheable(compileContext *ctx, const char *src, int compile_flags)
+{
+  if (!(compile_flags & NSEEL_CODE_COMPILE_FLAG_CACHE)) return 0;
+  if (compile_flags & (NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS|NSEEL_CODE_COMPILE_FLAG_COMMONFUNCS_RESET)) return 0;
+  if (ctx->functions_common) return 0; // code can call (and have inlined) other handles' functions
+  if ((ctx->onString || ctx->onNamedString) && (strchr(src,'"') || strchr(src,'#'))) return 0; // string values are host state
+  return 1;
+}
+
+static int nseel_code_cache_match(const nseelCodeCacheRec *r, const compileContext *ctx, WDL_UINT64 hash, const char *src, int srclen, int lineoffs, int compile_flags)
+{
+  return r->hash == hash && r->srclen == srclen && r->flags == compile_flags && r->lineoffs == lineoffs &&
+         r->func_tab == ctx->registered_func_tab &&
+         r->func_check == ctx->func_check && r->func_check_user == ctx->func_check_user &&
+         r->caller_this == ctx->caller_this && r->gram_blocks == ctx->gram_blocks &&
+         r->global_regs == ctx->global_regs &&
+         !memcmp(r->src,src,srclen);
+}
+
+// forgets every cached handle, which stay valid for their holders (and are freed by the last NSEEL_code_free())
+static void nseel_code_cache_drop(compileContext *ctx)
+{
+  while (ctx->code_cache)
+  {
+    nseelCodeCacheRec *r = ctx->code_cache;
+    ctx->code_cache = r->next;
+    r->handle->cache_ctx = NULL;
+    free(r);
+  }
+}
+
+NSEEL_CODEHANDLE NSEEL_code_compile_ex(NSEEL_VMCTX _ctx, const char *_expression, int lineoffs, int compile_flags)
+{
+  compileContext *ctx = (compileContext *)_ctx;
+  codeHandleType *handle;
+  nseelCodeCacheRec *r = NULL;
+  WDL_UINT64 hash = 0;
+  int srclen = 0;
+  const double start_time = nseel_time_precise();
+
+  if (!ctx) return 0;
+
+  nseel_atomic_add(&nseel_evallib_stats[5],1);
+  if (_expression && *_expression && nseel_code_cacheable(ctx,_expression,compile_flags))
+  {
+    srclen = (int) strlen(_expression);
+    hash = WDL_FNV64(WDL_FNV64_IV,(const unsigned char *)_expression,srclen);
+    for (r = ctx->code_cache; r && !nseel_code_cache_match(r,ctx,hash,_expression,srclen,lineoffs,compile_flags); r = r->next);
+    if (r)
+    {
+      ctx->last_error_string[0]=0;
+      r->handle->cache_refcnt++;
+      nseel_atomic_add(&nseel_evallib_stats[6],1);
+      return (NSEEL_CODEHANDLE)r->handle;
+    }
+  }
+
+  handle = (codeHandleType *)nseel_code_compile_int(ctx,_expression,lineoffs,compile_flags);
+
+  if (handle && srclen > 0 && NULL != (r = (nseelCodeCacheRec *)malloc(sizeof(nseelCodeCacheRec) + srclen)))
+  {
+    r->handle = handle;
+    r->hash = hash;
+    r->flags = compile_flags;
+    r->lineoffs = lineoffs;
+    r->func_tab = ctx->registered_func_tab;
+    r->func_check = ctx->func_check;
+    r->func_check_user = ctx->func_check_user;
+    r->caller_this = ctx->caller_this;
+    r->gram_blocks = ctx->gram_blocks;
+    r->global_regs = ctx->global_regs;
+    r->srclen = srclen;
+    memcpy(r->src,_expression,srclen+1);
+    r->next = ctx->code_cache;
+    ctx->code_cache = r;
+
+    handle->cache_ctx = ctx;
+    handle->cache_refcnt = 1;
+  }
+
+  nseel_atomic_add64(&nseel_compile_us,(WDL_INT64) ((nseel_time_precise() - start_time) * 1000000.0));
+  return (NSEEL_CODEHANDLE)handle;
+}
+
 //------------------------------------------------------------------------------
 void NSEEL_code_execute(NSEEL_CODEHANDLE code)
 {
@@ -4986,6 +5331,37 @@ void NSEEL_code_execute(NSEEL_CODEHANDLE code)
 
 }
 
+void NSEEL_code_execute_block(NSEEL_CODEHANDLE code, int n, const NSEEL_BLOCK_BINDING *bindings, int nbindings)
+{
+  codeHandleType *h = (codeHandleType *)code;
+  int x, start = 0;
+  if (!h || !h->code) return;
+
+  h->block_bindings = bindings;
+  h->block_nbindings = bindings ? nbindings : 0;
+  while (start < n)
+  {
+    int cnt = n - start;
+#if NSEEL_LOOPFUNC_SUPPORT_MAXLEN > 0
+    if (cnt > NSEEL_LOOPFUNC_SUPPORT_MAXLEN) cnt = NSEEL_LOOPFUNC_SUPPORT_MAXLEN;
+#endif
+    h->block_start = h->block_pos = start;
+    h->block_count = cnt;
+
+    NSEEL_code_execute(code);
+
+    start += cnt;
+    for (x = 0; x < h->block_nbindings; x ++) // outputs of the last sample
+    {
+      if (bindings[x].out) bindings[x].out[start-1] = *bindings[x].var;
+    }
+  }
+
+  h->block_count = 0; // NSEEL_code_execute() does nothing for block code
+  h->block_bindings = NULL;
+  h->block_nbindings = 0;
+}
+
 int NSEEL_code_geterror_flag(NSEEL_VMCTX ctx)
 {
   compileContext *c=(compileContext *)ctx;
@@ -5006,6 +5382,24 @@ void NSEEL_code_free(NSEEL_CODEHANDLE code)
   codeHandleType *h = (codeHandleType *)code;
   if (h != NULL)
   {
+    if (h->cache_refcnt > 1)
+    {
+      h->cache_refcnt--;
+      return;
+    }
+    if (h->cache_ctx)
+    {
+      compileContext *ctx = (compileContext *)h->cache_ctx;
+      nseelCodeCacheRec **rp = &ctx->code_cache;
+      while (*rp && (*rp)->handle != h) rp = &(*rp)->next;
+      if (*rp)
+      {
+        nseelCodeCacheRec *r = *rp;
+        *rp = r->next;
+        free(r);
+      }
+    }
+
 #ifdef EEL_VALIDATE_WORKTABLE_USE
     if (h->workTable)
     {
@@ -5026,11 +5420,11 @@ void NSEEL_code_free(NSEEL_CODEHANDLE code)
     }
 #endif
 
-    nseel_evallib_stats[0]-=h->code_stats[0];
-    nseel_evallib_stats[1]-=h->code_stats[1];
-    nseel_evallib_stats[2]-=h->code_stats[2];
-    nseel_evallib_stats[3]-=h->code_stats[3];
-    nseel_evallib_stats[4]--;
+    nseel_atomic_add(&nseel_evallib_stats[0],-h->code_stats[0]);
+    nseel_atomic_add(&nseel_evallib_stats[1],-h->code_stats[1]);
+    nseel_atomic_add(&nseel_evallib_stats[2],-h->code_stats[2]);
+    nseel_atomic_add(&nseel_evallib_stats[3],-h->code_stats[3]);
+    nseel_atomic_add(&nseel_evallib_stats[4],-1);
 
 #if defined(__ppc__) && defined(__APPLE__)
     {
@@ -5141,7 +5535,12 @@ void NSEEL_VM_free(NSEEL_VMCTX _ctx) // free when done with a VM and ALL of its
   {
     compileContext *ctx=(compileContext *)_ctx;
     NSEEL_VM_freevars(_ctx);
-    NSEEL_VM_freeRAM(_ctx);
+    NSEEL_VM_setramflat(_ctx,0); // frees RAM, including any flat reservation
+    free(ctx->prof_sites);
+    ctx->prof_sites = NULL;
+    ctx->prof_nsites = ctx->prof_sites_alloc = 0;
+
+    nseel_code_cache_drop(ctx); // should be empty, as all code should be freed first
 
     freeBlocks(&ctx->pblocks);
 
@@ -5193,6 +5592,30 @@ int *NSEEL_code_getstats(NSEEL_CODEHANDLE code)
   return 0;
 }
 
+int NSEEL_VM_getprofile(NSEEL_VMCTX _ctx, NSEEL_PROFILE_SITE *list, int maxlist)
+{
+  compileContext *ctx = (compileContext *)_ctx;
+  int x;
+  if (!ctx) return 0;
+  for (x = 0; x < ctx->prof_nsites && x < maxlist; x ++)
+  {
+    list[x] = ctx->prof_sites[x].s;
+    list[x].name = ctx->prof_sites[x].name;
+  }
+  return ctx->prof_nsites;
+}
+
+void NSEEL_VM_resetprofile(NSEEL_VMCTX _ctx)
+{
+  compileContext *ctx = (compileContext *)_ctx;
+  int x;
+  if (ctx) for (x = 0; x < ctx->prof_nsites; x ++)
+  {
+    ctx->prof_sites[x].s.count = ctx->prof_sites[x].s.iterations = 0;
+    ctx->prof_sites[x].s.seconds = 0.0;
+  }
+}
+
 void NSEEL_VM_SetStringFunc(NSEEL_VMCTX ctx, 
     EEL_F (*onString)(void *caller_this, struct eelStringSegmentRec *list),
     EEL_F (*onNamedString)(void *caller_this, const char *name))
@@ -5234,6 +5657,7 @@ void NSEEL_VM_remove_unused_vars(NSEEL_VMCTX _ctx)
 {
   compileContext *ctx = (compileContext *)_ctx;
   int wb;
+  if (ctx) nseel_code_cache_drop(ctx); // cached code may refer to the slots freed here
   if (ctx) for (wb = 0; wb < ctx->varTable_numBlocks; wb ++)
   {
     int ti;
@@ -5258,6 +5682,7 @@ void NSEEL_VM_remove_all_nonreg_vars(NSEEL_VMCTX _ctx)
 {
   compileContext *ctx = (compileContext *)_ctx;
   int wb;
+  if (ctx) nseel_code_cache_drop(ctx); // cached code may refer to the slots freed here
   if (ctx) for (wb = 0; wb < ctx->varTable_numBlocks; wb ++)
   {
     int ti;
@@ -5303,6 +5728,11 @@ void NSEEL_VM_clear_var_refcnts(NSEEL_VMCTX _ctx)
 #ifdef NSEEL_EEL1_COMPAT_MODE
 static EEL_F __nseel_global_regs[100];
 double *NSEEL_getglobalregs() { return __nseel_global_regs; }
+
+void NSEEL_VM_SetGlobalRegs(NSEEL_VMCTX ctx, EEL_F *regs)
+{
+  if (ctx) ((compileContext *)ctx)->global_regs = regs;
+}
 #endif
 
 EEL_F *get_global_var(compileContext *ctx, const char *gv, int addIfNotPresent)
@@ -5311,7 +5741,7 @@ EEL_F *get_global_var(compileContext *ctx, const char *gv, int addIfNotPresent)
 #ifdef NSEEL_EEL1_COMPAT_MODE
   if (!strnicmp(gv,"reg",3) && gv[3]>='0' && gv[3] <= '9' && gv[4] >= '0' && gv[4] <= '9' && !gv[5])
   {
-    return __nseel_global_regs + atoi(gv+3);
+    return (ctx->global_regs ? ctx->global_regs : __nseel_global_regs) + atoi(gv+3);
   }
 #endif
 
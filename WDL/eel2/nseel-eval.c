@@ -253,6 +253,7 @@ in_string:
     const char *endptr = scctx->rdbuf_end;
     const char *tok = nseel_simple_tokenizer(&rdptr,endptr,&toklen,NULL);
     *output = 0;
+    scctx->lex_tokpos = tok ? (int)(tok - scctx->rdbuf_start) : -1;
     if (tok)
     {
       rv = tok[0];
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 
 #ifdef _WIN32
@@ -34,12 +35,141 @@
 #define inline __inline
 #endif
 
+#else
+#include <sys/mman.h>
+#ifndef MAP_ANON
+#define MAP_ANON MAP_ANONYMOUS
+#endif
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
 #endif
 
 unsigned int NSEEL_RAM_limitmem=0;
 unsigned int NSEEL_RAM_memused=0;
 int NSEEL_RAM_memused_errors=0;
 
+// NSEEL_RAM_memused is shared by all VMs, which may be allocating from different threads
+
+static int nseel_ram_account(size_t sz) // returns 0 if NSEEL_RAM_limitmem would be exceeded
+{
+  for (;;)
+  {
+    const unsigned int v = (unsigned int) nseel_atomic_add(&NSEEL_RAM_memused,0);
+    if (NSEEL_RAM_limitmem && v+sz >= NSEEL_RAM_limitmem) return 0;
+    if (nseel_atomic_cas(&NSEEL_RAM_memused,v,v+(unsigned int)sz)) return 1;
+  }
+}
+
+static void nseel_ram_unaccount(size_t sz)
+{
+  for (;;)
+  {
+    const unsigned int v = (unsigned int) nseel_atomic_add(&NSEEL_RAM_memused,0);
+    if (v < sz)
+    {
+      nseel_atomic_add(&NSEEL_RAM_memused_errors,1);
+      return;
+    }
+    if (nseel_atomic_cas(&NSEEL_RAM_memused,v,v-(unsigned int)sz)) return;
+  }
+}
+
+
+// flat RAM reservations are aligned to (and flat gmem data starts at) a huge page boundary
+#define NSEEL_RAM_FLAT_ALIGN (2<<20)
+
+// flat RAM is only address space until a block is first used: then nseel_flat_commit() makes it
+// usable (Windows charges commit from then on, elsewhere pages are committed as they're touched)
+// and it counts against NSEEL_RAM_limitmem, like a normal block would.
+static EEL_F *nseel_flat_reserve(size_t sz)
+{
+#ifdef _WIN32
+  return (EEL_F *)VirtualAlloc(NULL,sz,MEM_RESERVE,PAGE_READWRITE);
+#else
+  char *p = (char *)mmap(NULL,sz+NSEEL_RAM_FLAT_ALIGN,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON|MAP_NORESERVE,-1,0);
+  char *a;
+  if (p == (char *)MAP_FAILED) return NULL;
+
+  // trim to an aligned range so that it can be backed by huge pages
+  a = p + ((NSEEL_RAM_FLAT_ALIGN - ((INT_PTR)p & (NSEEL_RAM_FLAT_ALIGN-1))) & (NSEEL_RAM_FLAT_ALIGN-1));
+  if (a > p) munmap(p, a-p);
+  munmap(a+sz, p+NSEEL_RAM_FLAT_ALIGN - a);
+#ifdef MADV_HUGEPAGE
+  madvise(a,sz,MADV_HUGEPAGE);
+#endif
+  return (EEL_F *)a;
+#endif
+}
+
+static int nseel_flat_commit(void *p, size_t sz)
+{
+#ifdef _WIN32
+  return VirtualAlloc(p,sz,MEM_COMMIT,PAGE_READWRITE) != NULL;
+#else
+  return 1;
+#endif
+}
+
+static void nseel_flat_release(void *p, size_t sz)
+{
+#ifdef _WIN32
+  VirtualFree(p,0,MEM_RELEASE);
+#else
+  munmap(p,sz);
+#endif
+}
+
+// gives the pages of a flat range back to the system, they read as zero once committed again
+static void nseel_flat_zero(void *p, size_t sz)
+{
+#ifdef _WIN32
+  VirtualFree(p,sz,MEM_DECOMMIT);
+#else
+  if (mmap(p,sz,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON|MAP_NORESERVE|MAP_FIXED,-1,0) == MAP_FAILED) memset(p,0,sz);
+#ifdef MADV_HUGEPAGE
+  else madvise(p,sz,MADV_HUGEPAGE);
+#endif
+#endif
+}
+
+static void nseel_ram_free_blocks(compileContext *c, int startblock)
+{
+  EEL_F **blocks = c->ram_state.blocks;
+  int x;
+  for (x = startblock; x < NSEEL_RAM_BLOCKS; x ++)
+  {
+    if (blocks[x])
+    {
+      nseel_ram_unaccount(sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK);
+      if (x >= c->ram_flat_blocks) free(blocks[x]);
+      blocks[x]=0;
+    }
+  }
+  if (startblock < c->ram_flat_blocks)
+    nseel_flat_zero(c->ram_flat + startblock*NSEEL_RAM_ITEMSPERBLOCK,sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK * (c->ram_flat_blocks-startblock));
+}
+
+// a new block for VM RAM or a flat gmem context, from the flat reservation if flat isn't NULL.
+// call with the mutex held.
+static EEL_F *nseel_ram_newblock(EEL_F *flat)
+{
+  const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
+  EEL_F *p;
+  if (!nseel_ram_account(msize)) return NULL;
+  p = flat ? (nseel_flat_commit(flat,msize) ? flat : NULL) : (EEL_F *)calloc(sizeof(EEL_F),NSEEL_RAM_ITEMSPERBLOCK);
+  if (!p) nseel_ram_unaccount(msize);
+  return p;
+}
+
+// where block whichblock of a VM's RAM goes if the VM has flat RAM, otherwise NULL. blocks is
+// always the VM's ram_state.blocks.
+static EEL_F *nseel_ram_flatblock(EEL_F **blocks, unsigned int whichblock)
+{
+  const compileContext *c = (const compileContext *)((char *)blocks - offsetof(compileContext,ram_state.blocks));
+  return whichblock < (unsigned int)c->ram_flat_blocks ? c->ram_flat + whichblock*NSEEL_RAM_ITEMSPERBLOCK : NULL;
+}
+
 
 
 int NSEEL_VM_wantfreeRAM(NSEEL_VMCTX ctx)
@@ -63,24 +193,8 @@ void NSEEL_VM_freeRAMIfCodeRequested(NSEEL_VMCTX ctx) // check to see if our fre
       NSEEL_HOSTSTUB_EnterMutex();
       {
 			  INT_PTR startpos=((INT_PTR)c->ram_state.needfree)-1;
-	 		  EEL_F **blocks = c->ram_state.blocks;
-			  INT_PTR pos=0;
-			  int x;
-  		  for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
-  		  {
-				  if (pos >= startpos)
-				  {
-					  if (blocks[x])
-					  {
-						  if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-							  NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-						  else NSEEL_RAM_memused_errors++;
-       	 	    free(blocks[x]);
-       	 	    blocks[x]=0;
-					  }
-				  }
-				  pos+=NSEEL_RAM_ITEMSPERBLOCK;
- 			  }
+        // frees every block that starts at or after startpos
+        nseel_ram_free_blocks(c,(int)((startpos + NSEEL_RAM_ITEMSPERBLOCK - 1)/NSEEL_RAM_ITEMSPERBLOCK));
 			  c->ram_state.needfree=0;
       }
       NSEEL_HOSTSTUB_LeaveMutex();
@@ -92,6 +206,8 @@ void NSEEL_VM_freeRAMIfCodeRequested(NSEEL_VMCTX ctx) // check to see if our fre
 EEL_F nseel_ramalloc_onfail;
 EEL_F * volatile  nseel_gmembuf_default;
 
+static EEL_F *nseel_flat_gram_block(EEL_F **blocks, unsigned int whichblock);
+
 
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, unsigned int w)
 {
@@ -110,14 +226,7 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAMAllocGMEM(EEL_F ***blocks, unsigned int w)
         else p = pblocks[whichblock];
 
         if (!p && pblocks)
-        {
-          const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-          if (!NSEEL_RAM_limitmem || NSEEL_RAM_memused+msize < NSEEL_RAM_limitmem) 
-          {
-            p=pblocks[whichblock]=(EEL_F *)calloc(sizeof(EEL_F),NSEEL_RAM_ITEMSPERBLOCK);
-            if (p) NSEEL_RAM_memused+=msize;
-          }
-        }
+          p=pblocks[whichblock]=nseel_ram_newblock(nseel_flat_gram_block(pblocks,whichblock));
         NSEEL_HOSTSTUB_LeaveMutex();
       }
       if (p) return p + (w&(NSEEL_RAM_ITEMSPERBLOCK-1));
@@ -149,15 +258,7 @@ EEL_F * NSEEL_CGEN_CALL  __NSEEL_RAMAlloc(EEL_F **pblocks, unsigned int w)
       NSEEL_HOSTSTUB_EnterMutex();
 
       if (!(p=pblocks[whichblock]))
-      {
-
-      	const int msize=sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-      	if (!NSEEL_RAM_limitmem || NSEEL_RAM_memused+msize < NSEEL_RAM_limitmem) 
-      	{
-	      	p=pblocks[whichblock]=(EEL_F *)calloc(sizeof(EEL_F),NSEEL_RAM_ITEMSPERBLOCK);
-      		if (p) NSEEL_RAM_memused+=msize;
-      	}
-      }
+        p=pblocks[whichblock]=nseel_ram_newblock(nseel_ram_flatblock(pblocks,whichblock));
       NSEEL_HOSTSTUB_LeaveMutex();
     }	  
     if (p) return p + (w&(NSEEL_RAM_ITEMSPERBLOCK-1));
@@ -167,6 +268,28 @@ EEL_F * NSEEL_CGEN_CALL  __NSEEL_RAMAlloc(EEL_F **pblocks, unsigned int w)
 }
 
 
+// for functions that work on a range of RAM in place: a range that crosses a block boundary is
+// only usable if the blocks are adjacent in memory, which they always are with flat RAM.
+// allocates the first block if needed, and with flat RAM the others too.
+EEL_F *__NSEEL_RAMAllocSpan(EEL_F **blocks, unsigned int w, unsigned int len)
+{
+  EEL_F *p;
+  unsigned int x;
+  if (len < 1 || w >= NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK || len > NSEEL_RAM_BLOCKS*NSEEL_RAM_ITEMSPERBLOCK - w) return NULL;
+
+  p = __NSEEL_RAMAlloc(blocks,w);
+  if (p == &nseel_ramalloc_onfail) return NULL;
+
+  for (x = (w|(NSEEL_RAM_ITEMSPERBLOCK-1))+1; x < w+len; x += NSEEL_RAM_ITEMSPERBLOCK)
+  {
+    const unsigned int whichblock = x/NSEEL_RAM_ITEMSPERBLOCK;
+    if (!blocks[whichblock] && nseel_ram_flatblock(blocks,whichblock)) __NSEEL_RAMAlloc(blocks,x);
+    if (blocks[whichblock] != p + (x-w)) return NULL;
+  }
+  return p;
+}
+
+
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemFree(void *blocks, EEL_F *which)
 {
   // blocks points to ram_state.blocks, so back it up past closefact and maxblocks to needfree
@@ -216,6 +339,17 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemCpy(EEL_F **blocks,EEL_F *dest, EEL_F *sr
 
   if (src_offs == dest_offs || len < 1) return dest;
 
+  {
+    // ranges that are contiguous (always, with flat RAM) take a single memmove()
+    EEL_F *srcptr = __NSEEL_RAMAllocSpan(blocks,src_offs,len);
+    EEL_F *destptr = srcptr ? __NSEEL_RAMAllocSpan(blocks,dest_offs,len) : NULL;
+    if (destptr)
+    {
+      memmove(destptr,srcptr,sizeof(EEL_F)*len);
+      return dest;
+    }
+  }
+
   if (src_offs < dest_offs && src_offs+len > dest_offs)
   {
     // if src_offs < dest_offs and overlapping, must copy right to left
@@ -274,6 +408,13 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemCpy(EEL_F **blocks,EEL_F *dest, EEL_F *sr
   return dest;
 }
 
+static void nseel_ram_fill(EEL_F *ptr, EEL_F v, int len)
+{
+  static const EEL_F zero;
+  if (!memcmp(&v,&zero,sizeof(v))) memset(ptr,0,sizeof(EEL_F)*len); // not for -0.0
+  else while (len-- > 0) *ptr++ = v;
+}
+
 EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemSet(EEL_F **blocks,EEL_F *dest, EEL_F *v, EEL_F *lenptr)
 {  
   int offs = (int)(*dest + 0.0001);
@@ -293,6 +434,15 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemSet(EEL_F **blocks,EEL_F *dest, EEL_F *v,
 
   t=*v; // set value
 
+  {
+    EEL_F *ptr=__NSEEL_RAMAllocSpan(blocks,offs,len);
+    if (ptr)
+    {
+      nseel_ram_fill(ptr,t,len);
+      return dest;
+    }
+  }
+
 //  int lastBlock=-1;
   while (len > 0)
   {
@@ -306,10 +456,7 @@ EEL_F * NSEEL_CGEN_CALL __NSEEL_RAM_MemSet(EEL_F **blocks,EEL_F *dest, EEL_F *v,
     len -= lcnt;
     offs += lcnt;
 
-    while (lcnt--)
-    {
-      *ptr++=t;
-    }       
+    nseel_ram_fill(ptr,t,lcnt);
   }
   return dest;
 }
@@ -395,22 +542,74 @@ void NSEEL_VM_freeRAM(NSEEL_VMCTX ctx)
 {
   if (ctx)
   {
-    int x;
     compileContext *c=(compileContext*)ctx;
-    EEL_F **blocks = c->ram_state.blocks;
-    for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
+    nseel_ram_free_blocks(c,0);
+    c->ram_state.needfree=0; // no need to free anymore
+  }
+}
+
+int NSEEL_VM_setramflat(NSEEL_VMCTX ctx, int flat)
+{
+  compileContext *c=(compileContext*)ctx;
+  if (!c) return 0;
+
+  NSEEL_VM_freeRAM(ctx);
+  if (c->ram_flat && (!flat || c->ram_flat_blocks != c->ram_state.maxblocks))
+  {
+    nseel_flat_release(c->ram_flat,sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK * c->ram_flat_blocks);
+    c->ram_flat = NULL;
+    c->ram_flat_blocks = 0;
+  }
+
+  if (flat && !c->ram_flat && c->ram_state.maxblocks > 0)
+  {
+    // blocks are pointed into it as they're first used, see __NSEEL_RAMAlloc()
+    c->ram_flat = nseel_flat_reserve(sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK * c->ram_state.maxblocks);
+    if (c->ram_flat) c->ram_flat_blocks = c->ram_state.maxblocks;
+  }
+  return c->ram_flat != NULL;
+}
+
+// a flat gmem context is a single mapping: the block table, then a link to the next flat
+// context (so NSEEL_VM_FreeGRAM() can tell them apart), then the data at NSEEL_RAM_FLAT_ALIGN
+#define NSEEL_FLAT_GRAM_SIZE (NSEEL_RAM_FLAT_ALIGN + sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK * (size_t)NSEEL_RAM_BLOCKS)
+#define NSEEL_FLAT_GRAM_TABLE_SIZE (sizeof(EEL_F *) * (NSEEL_RAM_BLOCKS+1))
+static EEL_F **nseel_flat_grams;
+
+// where block whichblock of a gmem context goes if it's flat, otherwise NULL. call with the mutex held.
+static EEL_F *nseel_flat_gram_block(EEL_F **blocks, unsigned int whichblock)
+{
+  EEL_F **p = nseel_flat_grams;
+  while (p && p != blocks) p = (EEL_F **)p[NSEEL_RAM_BLOCKS];
+  return p ? (EEL_F *)((char *)blocks + NSEEL_RAM_FLAT_ALIGN) + whichblock*NSEEL_RAM_ITEMSPERBLOCK : NULL;
+}
+
+int NSEEL_VM_AllocFlatGRAM(void **gram)
+{
+  int rv;
+  NSEEL_HOSTSTUB_EnterMutex();
+  if (!gram[0])
+  {
+    // only the block table is committed now, blocks are pointed into the rest as they're first used
+    EEL_F **blocks = (EEL_F **)nseel_flat_reserve(NSEEL_FLAT_GRAM_SIZE);
+    if (blocks && nseel_flat_commit(blocks,NSEEL_FLAT_GRAM_TABLE_SIZE))
     {
-	    if (blocks[x])
-	    {
-		    if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-			    NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-		    else NSEEL_RAM_memused_errors++;
-        free(blocks[x]);
-        blocks[x]=0;
-	    }
+      memset(blocks,0,NSEEL_FLAT_GRAM_TABLE_SIZE);
+      blocks[NSEEL_RAM_BLOCKS] = (EEL_F *)nseel_flat_grams;
+      nseel_flat_grams = blocks;
+      gram[0] = blocks;
     }
-    c->ram_state.needfree=0; // no need to free anymore
+    else if (blocks) nseel_flat_release(blocks,NSEEL_FLAT_GRAM_SIZE);
   }
+  rv = 0;
+  if (gram[0])
+  {
+    EEL_F **p = nseel_flat_grams;
+    while (p && p != gram[0]) p = (EEL_F **)p[NSEEL_RAM_BLOCKS];
+    rv = p != NULL;
+  }
+  NSEEL_HOSTSTUB_LeaveMutex();
+  return rv;
 }
 
 void NSEEL_VM_FreeGRAM(void **ufd)
@@ -418,14 +617,30 @@ void NSEEL_VM_FreeGRAM(void **ufd)
   if (ufd[0])
   {
     EEL_F **blocks = (EEL_F **)ufd[0];
+    EEL_F ***link = &nseel_flat_grams;
     int x;
+
+    NSEEL_HOSTSTUB_EnterMutex();
+    while (*link && *link != blocks) link = (EEL_F ***)&(*link)[NSEEL_RAM_BLOCKS];
+    if (*link)
+    {
+      *link = (EEL_F **)blocks[NSEEL_RAM_BLOCKS];
+      NSEEL_HOSTSTUB_LeaveMutex();
+      for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
+      {
+        if (blocks[x]) nseel_ram_unaccount(sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK);
+      }
+      nseel_flat_release(blocks,NSEEL_FLAT_GRAM_SIZE);
+      ufd[0]=0;
+      return;
+    }
+    NSEEL_HOSTSTUB_LeaveMutex();
+
     for (x = 0; x < NSEEL_RAM_BLOCKS; x ++)
     {
 	    if (blocks[x])
 	    {
-		    if (NSEEL_RAM_memused >= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK) 
-			    NSEEL_RAM_memused -= sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK;
-		    else NSEEL_RAM_memused_errors++;
+		    nseel_ram_unaccount(sizeof(EEL_F) * NSEEL_RAM_ITEMSPERBLOCK);
 	    }
       free(blocks[x]);
       blocks[x]=0;
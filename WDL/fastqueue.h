@@ -52,11 +52,24 @@ public:
     m_bsize=bsize<32?32:bsize;
     m_offs=0;
     m_maxemptieskeep=maxemptieskeep;
+    m_allocator=NULL;
   }
   ~WDL_FastQueue()
   {
-    m_queue.Empty(true,free);
-    m_empties.Empty(true,free);
+    int x;
+    for (x = 0; x < m_queue.GetSize(); x ++) FreeBuf(m_queue.Get(x));
+    for (x = 0; x < m_empties.GetSize(); x ++) FreeBuf(m_empties.Get(x));
+  }
+
+  // blocks (and the lists of them) come from a, NULL for malloc(). only works when
+  // no data is queued (returns false otherwise), drops any spare blocks.
+  bool SetAllocator(WDL_Allocator *a)
+  {
+    if (m_queue.GetSize()) return false;
+    for (int x = 0; x < m_empties.GetSize(); x ++) FreeBuf(m_empties.Get(x));
+    m_empties.Empty();
+    m_allocator=a;
+    return m_queue.SetAllocator(a) && m_empties.SetAllocator(a);
   }
   
   void *Add(const void *buf, int len) // buf can be NULL to add zeroes
@@ -71,13 +84,19 @@ public:
       m_empties.Delete(esz);
       if (qb && qb->alloc_size < len) // spare buffer is not big enough, toss it
       {
-        free(qb);
+        FreeBuf(qb);
         qb=NULL;
       }
       if (!qb)
       {
         const int sz=len < m_bsize ? m_bsize : len;
-        qb=(fqBuf *)malloc(sz + sizeof(fqBuf) - sizeof(qb->data));
+        const int allocsz=sz + sizeof(fqBuf) - sizeof(qb->data);
+        if (m_allocator) qb=(fqBuf *)m_allocator->Alloc(allocsz);
+        else
+        {
+          WDL_RT_CHECK_ALLOC("WDL_FastQueue malloc",allocsz)
+          qb=(fqBuf *)malloc(allocsz);
+        }
         if (!qb) return NULL;
         qb->alloc_size = sz;
       }
@@ -115,7 +134,7 @@ public:
       }
       else
       {
-        free(m_queue.Get(--x));
+        FreeBuf(m_queue.Get(--x));
       }
       m_queue.Delete(x);      
     }
@@ -142,7 +161,7 @@ public:
       }
       else
       {
-        free(mq);
+        FreeBuf(mq);
       }
       m_queue.Delete(0);
     }
@@ -210,7 +229,19 @@ public:
 
 private:
 
+  void FreeBuf(fqBuf *qb)
+  {
+    if (!qb) return;
+    if (m_allocator) m_allocator->Free(qb);
+    else
+    {
+      WDL_RT_CHECK_ALLOC("WDL_FastQueue free",0)
+      free(qb);
+    }
+  }
+
   WDL_PtrList<fqBuf> m_queue, m_empties;
+  WDL_Allocator *m_allocator;
   int m_offs;
   int m_avail;
   int m_bsize;
@@ -0,0 +1,460 @@
+/*
+  WDL - fileaio.h
+  Copyright (C) 2005 and later Cockos Incorporated
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+
+
+  This file provides WDL_FileAIO, which runs pread()/pwrite() requests in the background on Linux.
+  It is used by WDL_FileRead and WDL_FileWrite for their async modes (the equivalent of overlapped I/O on windows).
+
+  Each WDL_FileAIO gets its own io_uring if the kernel allows it (5.1+, and not blocked by seccomp etc), otherwise
+  requests go to a small process-wide pool of threads doing pread()/pwrite(). The pool threads are started on demand
+  and exit after a couple of seconds of being idle. They are joined when the last WDL_FileAIO is destroyed, or at static
+  teardown, so none is left running code from a module that is being unloaded. #define WDL_FILEAIO_NO_URING to always
+  use the threads.
+
+  A WDL_FileAIO (and the requests it was given) should only be used by one thread at a time.
+
+*/
+
+#ifndef _WDL_FILEAIO_H_
+#define _WDL_FILEAIO_H_
+
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__NR_io_uring_setup) && !defined(WDL_FILEAIO_NO_URING)
+  #include <linux/io_uring.h>
+  #define WDL_FILEAIO_URING
+#endif
+
+#ifndef WDL_FILEAIO_MAXTHREADS
+#define WDL_FILEAIO_MAXTHREADS 8
+#endif
+
+class WDL_FileAIO_Req
+{
+public:
+  WDL_FileAIO_Req() { m_fd=-1; m_write=false; m_offs=0; m_iov.iov_base=0; m_iov.iov_len=0; m_state=0; m_result=0; m_next=0; }
+
+  enum { IDLE=0, QUEUED, RUNNING, DONE };
+
+  int m_fd;
+  bool m_write;
+  long long m_offs;
+  struct iovec m_iov;
+
+  volatile int m_state;
+  int m_result; // bytes transferred, or -errno
+
+  WDL_FileAIO_Req *m_next; // thread pool queue
+};
+
+class WDL_FileAIO
+{
+public:
+  // depth is the most requests that will be in flight at once. mode=0 for io_uring if available, 1 for the thread pool
+  WDL_FileAIO(int depth, int mode=-1)
+  {
+    m_ring_fd=-1;
+    m_inflight=0;
+    Pool *p=GetPool();
+    pthread_mutex_lock(&p->mutex);
+    p->nusers++;
+    pthread_mutex_unlock(&p->mutex);
+#ifdef WDL_FILEAIO_URING
+    if (mode<0) mode=DefaultMode();
+    if (mode==0) InitRing(depth<1 ? 1 : depth);
+#endif
+  }
+
+  ~WDL_FileAIO()
+  {
+#ifdef WDL_FILEAIO_URING
+    while (m_inflight>0 && Reap(true)>=0);
+
+    if (m_ring_fd>=0)
+    {
+      if (m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr,m_cq_size);
+      munmap(m_sq_ptr,m_sq_size);
+      munmap(m_sqes,m_sqes_size);
+      close(m_ring_fd);
+    }
+#endif
+    Pool *p=GetPool();
+    pthread_mutex_lock(&p->mutex);
+    const bool last = !--p->nusers;
+    pthread_mutex_unlock(&p->mutex);
+    if (last) JoinThreads(p);
+  }
+
+  // default mode for WDL_FileAIOs created with mode=-1 (which is what WDL_FileRead/WDL_FileWrite do)
+  static int &DefaultMode() { static int mode; return mode; }
+
+  bool UsingRing() const { return m_ring_fd>=0; }
+
+  // starts req, which needs to stay around (and its buffer) until Wait() returns true or Cancel() succeeds
+  void Submit(WDL_FileAIO_Req *req, int fd, void *buf, int len, long long offs, bool write)
+  {
+    req->m_fd=fd;
+    req->m_write=write;
+    req->m_offs=offs;
+    req->m_iov.iov_base=buf;
+    req->m_iov.iov_len=len;
+    req->m_result=0;
+    req->m_next=0;
+
+#ifdef WDL_FILEAIO_URING
+    if (m_ring_fd>=0)
+    {
+      if (SubmitRing(req)) return;
+      if (req->m_state == WDL_FileAIO_Req::DONE) return;
+    }
+#endif
+    Pool *p=GetPool();
+    pthread_mutex_lock(&p->mutex);
+    req->m_state=WDL_FileAIO_Req::QUEUED;
+    if (p->tail) p->tail->m_next=req;
+    else p->head=req;
+    p->tail=req;
+    p->nqueued++;
+    if (p->nqueued > p->nidle && p->nthreads < WDL_FILEAIO_MAXTHREADS && !p->quit)
+    {
+      int x=0;
+      while (p->thread_state[x] == Pool::RUNNING) x++;
+      if (p->thread_state[x] == Pool::EXITED) pthread_join(p->threads[x],NULL); // it has let go of the mutex for good
+      p->thread_state[x]=Pool::EMPTY;
+      if (!pthread_create(&p->threads[x],NULL,PoolThread,(void *)(size_t)x))
+      {
+        p->thread_state[x]=Pool::RUNNING;
+        p->nthreads++;
+      }
+    }
+    if (!p->nthreads) // couldn't start any threads, do it here
+    {
+      Unqueue(p,req);
+      pthread_mutex_unlock(&p->mutex);
+      req->m_result=DoIO(req);
+      req->m_state=WDL_FileAIO_Req::DONE;
+      return;
+    }
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->mutex);
+  }
+
+  // returns true if req has completed (or was never started), in which case req->m_result is valid
+  bool Wait(WDL_FileAIO_Req *req, bool block)
+  {
+    const int state=__atomic_load_n(&req->m_state,__ATOMIC_ACQUIRE); // pairs with PoolThread(), so m_result and the buffer are there
+    if (state == WDL_FileAIO_Req::DONE || state == WDL_FileAIO_Req::IDLE) return true;
+
+#ifdef WDL_FILEAIO_URING
+    if (m_ring_fd>=0)
+    {
+      Reap(false);
+      while (block && req->m_state != WDL_FileAIO_Req::DONE && Reap(true)>=0);
+      return req->m_state == WDL_FileAIO_Req::DONE;
+    }
+#endif
+    Pool *p=GetPool();
+    pthread_mutex_lock(&p->mutex);
+    while (block && req->m_state != WDL_FileAIO_Req::DONE) pthread_cond_wait(&p->done,&p->mutex);
+    const bool done = req->m_state == WDL_FileAIO_Req::DONE;
+    pthread_mutex_unlock(&p->mutex);
+    return done;
+  }
+
+  // removes req if no thread has picked it up yet, otherwise waits for it
+  void Cancel(WDL_FileAIO_Req *req)
+  {
+    if (m_ring_fd<0 && __atomic_load_n(&req->m_state,__ATOMIC_RELAXED) == WDL_FileAIO_Req::QUEUED)
+    {
+      Pool *p=GetPool();
+      pthread_mutex_lock(&p->mutex);
+      if (req->m_state == WDL_FileAIO_Req::QUEUED)
+      {
+        Unqueue(p,req);
+        req->m_state=WDL_FileAIO_Req::IDLE;
+      }
+      pthread_mutex_unlock(&p->mutex);
+    }
+    Wait(req,true);
+  }
+
+  // does req synchronously, retrying short writes
+  static int DoIO(WDL_FileAIO_Req *req)
+  {
+    char *buf=(char *)req->m_iov.iov_base;
+    int len=(int)req->m_iov.iov_len, done=0;
+    while (done < len)
+    {
+      ssize_t v = req->m_write ? pwrite(req->m_fd,buf+done,len-done,req->m_offs+done) :
+                                 pread(req->m_fd,buf+done,len-done,req->m_offs+done);
+      if (v<0 && errno==EINTR) continue;
+      if (v<0) return done ? done : -errno;
+      if (!v || !req->m_write) return done+(int)v; // reads stop at EOF, and may be short
+      done+=(int)v;
+    }
+    return done;
+  }
+
+private:
+
+  struct Pool
+  {
+    Pool()
+    {
+      pthread_mutex_init(&mutex,NULL);
+      pthread_cond_init(&work,NULL);
+      pthread_cond_init(&done,NULL);
+      head=tail=0;
+      nqueued=nidle=nthreads=nusers=0;
+      quit=false;
+      memset(thread_state,0,sizeof(thread_state));
+    }
+    ~Pool() { JoinThreads(this); } // static teardown, e.g. a plugin being unloaded. the mutex etc stay, for WDL_FileAIOs destroyed later
+
+    enum { EMPTY=0, RUNNING, EXITED }; // EXITED threads still need to be joined
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work, done;
+    WDL_FileAIO_Req *head, *tail;
+    int nqueued, nidle, nthreads, nusers;
+    bool quit; // threads exit once the queue is empty
+    pthread_t threads[WDL_FILEAIO_MAXTHREADS];
+    int thread_state[WDL_FILEAIO_MAXTHREADS];
+  };
+
+  static Pool *GetPool()
+  {
+    static Pool p;
+    return &p;
+  }
+
+  static void JoinThreads(Pool *p)
+  {
+    pthread_t th[WDL_FILEAIO_MAXTHREADS];
+    int x, n=0;
+    pthread_mutex_lock(&p->mutex);
+    p->quit=true;
+    pthread_cond_broadcast(&p->work);
+    for (x = 0; x < WDL_FILEAIO_MAXTHREADS; x ++)
+    {
+      if (p->thread_state[x] != Pool::EMPTY) th[n++]=p->threads[x];
+      p->thread_state[x]=Pool::EMPTY;
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    for (x = 0; x < n; x ++) pthread_join(th[x],NULL);
+
+    pthread_mutex_lock(&p->mutex);
+    p->quit=false;
+    pthread_mutex_unlock(&p->mutex);
+  }
+
+  static void Unqueue(Pool *p, WDL_FileAIO_Req *req) // p->mutex must be held
+  {
+    WDL_FileAIO_Req *prev=0, *r=p->head;
+    while (r && r != req) { prev=r; r=r->m_next; }
+    if (!r) return;
+    if (prev) prev->m_next=r->m_next;
+    else p->head=r->m_next;
+    if (p->tail == r) p->tail=prev;
+    r->m_next=0;
+    p->nqueued--;
+  }
+
+  static void *PoolThread(void *slot)
+  {
+    Pool *p=GetPool();
+    pthread_mutex_lock(&p->mutex);
+    for (;;)
+    {
+      WDL_FileAIO_Req *req=p->head;
+      if (!req)
+      {
+        if (p->quit) break;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME,&ts);
+        ts.tv_sec+=2;
+        p->nidle++;
+        const int rv=pthread_cond_timedwait(&p->work,&p->mutex,&ts);
+        p->nidle--;
+        if (rv == ETIMEDOUT && !p->head) break;
+        continue;
+      }
+      Unqueue(p,req);
+      __atomic_store_n(&req->m_state,(int)WDL_FileAIO_Req::RUNNING,__ATOMIC_RELAXED);
+      pthread_mutex_unlock(&p->mutex);
+
+      const int res=DoIO(req);
+
+      pthread_mutex_lock(&p->mutex);
+      req->m_result=res;
+      __atomic_store_n(&req->m_state,(int)WDL_FileAIO_Req::DONE,__ATOMIC_RELEASE);
+      pthread_cond_broadcast(&p->done);
+    }
+    p->nthreads--;
+    if (p->thread_state[(size_t)slot] == Pool::RUNNING) p->thread_state[(size_t)slot]=Pool::EXITED; // otherwise JoinThreads() has it
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+  }
+
+  int m_ring_fd;
+  int m_inflight;
+
+#ifdef WDL_FILEAIO_URING
+  void *m_sq_ptr, *m_cq_ptr;
+  struct io_uring_sqe *m_sqes;
+  size_t m_sq_size, m_cq_size, m_sqes_size;
+  unsigned *m_sq_head, *m_sq_tail, *m_sq_mask, *m_sq_array, m_sq_entries;
+  unsigned *m_cq_head, *m_cq_tail, *m_cq_mask;
+  struct io_uring_cqe *m_cqes;
+
+  void InitRing(int depth)
+  {
+    struct io_uring_params p;
+    memset(&p,0,sizeof(p));
+    const int fd=(int)syscall(__NR_io_uring_setup,depth,&p);
+    if (fd<0) return;
+
+    m_sq_size=p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    m_cq_size=p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    m_sqes_size=p.sq_entries*sizeof(struct io_uring_sqe);
+    const bool single = !!(p.features & IORING_FEAT_SINGLE_MMAP);
+    if (single && m_cq_size > m_sq_size) m_sq_size=m_cq_size;
+
+    m_sq_ptr=mmap(NULL,m_sq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+    m_cq_ptr=m_sq_ptr;
+    if (m_sq_ptr != MAP_FAILED && !single)
+      m_cq_ptr=mmap(NULL,m_cq_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+    m_sqes=(struct io_uring_sqe *)mmap(NULL,m_sqes_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES);
+
+    if (m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+      if (m_sqes != MAP_FAILED) munmap(m_sqes,m_sqes_size);
+      if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr,m_cq_size);
+      if (m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr,m_sq_size);
+      close(fd);
+      return;
+    }
+
+    char *sq=(char *)m_sq_ptr, *cq=(char *)m_cq_ptr;
+    m_sq_head=(unsigned *)(sq+p.sq_off.head);
+    m_sq_tail=(unsigned *)(sq+p.sq_off.tail);
+    m_sq_mask=(unsigned *)(sq+p.sq_off.ring_mask);
+    m_sq_array=(unsigned *)(sq+p.sq_off.array);
+    m_sq_entries=p.sq_entries;
+    m_cq_head=(unsigned *)(cq+p.cq_off.head);
+    m_cq_tail=(unsigned *)(cq+p.cq_off.tail);
+    m_cq_mask=(unsigned *)(cq+p.cq_off.ring_mask);
+    m_cqes=(struct io_uring_cqe *)(cq+p.cq_off.cqes);
+    m_ring_fd=fd;
+  }
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+  {
+    return (int)syscall(__NR_io_uring_enter,m_ring_fd,to_submit,min_complete,flags,NULL,0);
+  }
+
+  // returns false if the ring can't take req, in which case the caller should use the thread pool
+  // (or req was done synchronously, if m_state == DONE)
+  bool SubmitRing(WDL_FileAIO_Req *req)
+  {
+    while (m_inflight >= (int)m_sq_entries)
+    {
+      if (Reap(true)<0) return false;
+    }
+
+    const unsigned tail = *m_sq_tail;
+    const unsigned idx = tail & *m_sq_mask;
+    struct io_uring_sqe *sqe=m_sqes+idx;
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = req->m_write ? IORING_OP_WRITEV : IORING_OP_READV; // rather than READ/WRITE, which need 5.6
+    sqe->fd = req->m_fd;
+    sqe->off = (unsigned long long) req->m_offs;
+    sqe->addr = (unsigned long long) (size_t) &req->m_iov;
+    sqe->len = 1;
+    sqe->user_data = (unsigned long long) (size_t) req;
+    m_sq_array[idx]=idx;
+    __atomic_store_n(m_sq_tail,tail+1,__ATOMIC_RELEASE);
+
+    req->m_state=WDL_FileAIO_Req::QUEUED;
+    m_inflight++;
+    for (;;)
+    {
+      const int rv=Enter(1,0,0);
+      if (rv>=1 || __atomic_load_n(m_sq_head,__ATOMIC_ACQUIRE) == tail+1) return true;
+      if (rv<0 && errno == EINTR) continue;
+      if (rv<0 && (errno == EAGAIN || errno == EBUSY) && m_inflight>1 && Reap(true)>=0) continue;
+      break;
+    }
+
+    // the kernel didn't take it, so it is ours again
+    m_inflight--;
+    __atomic_store_n(m_sq_tail,tail,__ATOMIC_RELEASE);
+    req->m_result=DoIO(req);
+    req->m_state=WDL_FileAIO_Req::DONE;
+    return false;
+  }
+
+  // collects completions, optionally waiting for at least one. returns -1 if there was nothing to wait for or the wait failed
+  int Reap(bool block)
+  {
+    if (block && m_inflight<1) return -1;
+    for (;;)
+    {
+      unsigned head = *m_cq_head;
+      const unsigned tail = __atomic_load_n(m_cq_tail,__ATOMIC_ACQUIRE);
+      int cnt=0;
+      while (head != tail)
+      {
+        const struct io_uring_cqe *cqe = m_cqes + (head & *m_cq_mask);
+        WDL_FileAIO_Req *req = (WDL_FileAIO_Req *)(size_t)cqe->user_data;
+        req->m_result = cqe->res;
+        if (req->m_write && cqe->res>0 && cqe->res < (int)req->m_iov.iov_len) // finish short writes here
+        {
+          WDL_FileAIO_Req rest=*req;
+          rest.m_iov.iov_base = (char *)req->m_iov.iov_base + cqe->res;
+          rest.m_iov.iov_len -= cqe->res;
+          rest.m_offs += cqe->res;
+          const int v=DoIO(&rest);
+          if (v>0) req->m_result += v;
+        }
+        req->m_state = WDL_FileAIO_Req::DONE;
+        m_inflight--;
+        head++;
+        cnt++;
+      }
+      __atomic_store_n(m_cq_head,head,__ATOMIC_RELEASE);
+
+      if (cnt || !block) return cnt;
+      if (Enter(0,1,IORING_ENTER_GETEVENTS)<0 && errno != EINTR) return -1;
+    }
+  }
+#endif
+
+};
+
+#endif
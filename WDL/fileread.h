@@ -21,7 +21,8 @@
 
   This file provides the WDL_FileRead object, which can be used to read files.
   On windows systems it supports reading synchronous, asynchronous, memory mapped, and asynchronous unbuffered.
-  On non-windows systems it acts as a wrapper for fopen()/etc.
+  On linux it supports the same modes, using io_uring (or a pool of pread() threads) for async and O_DIRECT for unbuffered.
+  On other systems it acts as a wrapper for open()/pread()/mmap() or fopen()/etc.
 
 
 */
@@ -57,10 +58,19 @@
       #include <sys/param.h>
       #include <sys/mount.h>
    #endif
+   #if defined(__linux__) && !defined(WDL_NO_POSIX_ASYNC_FILEREAD)
+      #define WDL_POSIX_ASYNC_READ
+      #include "fileaio.h"
+   #endif
   #endif
   
 #endif
 
+#ifndef WDL_FILE_ASYNC_POSIX
+// add to allow_async to get that mode on linux too, where allow_async is otherwise ignored
+#define WDL_FILE_ASYNC_POSIX 0x100
+#endif
+
 
 
 #ifdef _MSC_VER
@@ -80,6 +90,7 @@ public:
   WDL_FileRead__ReadEnt(int sz, char *buf)
   {
     m_size=0;
+    m_offs=0;
     memset(&m_ol,0,sizeof(m_ol));
     m_ol.hEvent=CreateEvent(NULL,TRUE,TRUE,NULL);
     m_buf=buf;
@@ -90,10 +101,29 @@ public:
   }
 
   OVERLAPPED m_ol;
+  WDL_FILEREAD_POSTYPE m_offs;
   DWORD m_size;
   LPVOID m_buf;
 };
 
+#elif defined(WDL_POSIX_ASYNC_READ)
+
+class WDL_FileRead__ReadEnt
+{
+public:
+  WDL_FileRead__ReadEnt(int sz, char *buf)
+  {
+    m_size=0;
+    m_offs=0;
+    m_buf=buf;
+  }
+
+  WDL_FileAIO_Req m_req;
+  WDL_FILEREAD_POSTYPE m_offs;
+  int m_size;
+  void *m_buf;
+};
+
 #endif
 
 #if defined(_WIN32) && !defined(WDL_NO_SUPPORT_UTF8)
@@ -119,8 +149,15 @@ public:
 public:
   // allow_async=1 for unbuffered async, 2 for buffered async, =-1 for unbuffered sync
   // async aspect is unused on OS X, but the buffered mode affects F_NOCACHE
+  // linux ignores allow_async unless WDL_FILE_ASYNC_POSIX is added to it, e.g. WDL_FILE_ASYNC_POSIX+1: then async uses io_uring,
+  // and unbuffered uses O_DIRECT (or drops the pages from the cache after reading them, if the filesystem can't do O_DIRECT)
   WDL_FileRead(const char *filename, int allow_async=1, int bufsize=8192, int nbufs=4, unsigned int mmap_minsize=0, unsigned int mmap_maxsize=0) : m_bufspace(4096 WDL_HEAPBUF_TRACEPARM("WDL_FileRead"))
   {
+  #ifdef WDL_POSIX_ASYNC_READ
+    const bool posix_async = allow_async >= WDL_FILE_ASYNC_POSIX-1 && allow_async <= WDL_FILE_ASYNC_POSIX+2;
+  #endif
+    if (allow_async >= WDL_FILE_ASYNC_POSIX-1 && allow_async <= WDL_FILE_ASYNC_POSIX+2) allow_async -= WDL_FILE_ASYNC_POSIX;
+
     m_async_hashaderr=false;
     m_sync_bufmode_used=m_sync_bufmode_pos=0;
     m_async_readpos=m_file_position=0;
@@ -253,7 +290,27 @@ public:
 #elif defined(WDL_POSIX_NATIVE_READ)
     m_filedes_locked=false;
     m_filedes_rdpos=0;
+    m_filedes_direct=false;
+    m_filedes_dontneed=false;
+  #ifdef WDL_POSIX_ASYNC_READ
+    m_async = posix_async ? allow_async : 0;
+    m_aio = 0;
+    const bool unbuf = m_async==1 || (m_async==-1 && nbufs*bufsize>=WDL_UNBUF_ALIGN && !mmap_maxsize); // same as FILE_FLAG_NO_BUFFERING above
+   #ifdef O_DIRECT
+    if (unbuf)
+    {
+      m_filedes=open(filename,O_RDONLY|O_DIRECT);
+      m_filedes_direct = m_filedes>=0;
+    }
+    if (!m_filedes_direct)
+   #endif
+    {
+      m_filedes=open(filename,O_RDONLY);
+      m_filedes_dontneed = unbuf; // tmpfs etc, emulate it
+    }
+  #else
     m_filedes=open(filename,O_RDONLY);
+  #endif
     if (m_filedes>=0)
     {
       if (flock(m_filedes,LOCK_SH|LOCK_NB)>=0) // get shared lock
@@ -272,7 +329,11 @@ public:
       m_fsize=lseek(m_filedes,0,SEEK_END);
       lseek(m_filedes,0,SEEK_SET);
 
+  #ifdef WDL_POSIX_ASYNC_READ
+      if (m_fsize < mmap_maxsize && m_async<=0)
+  #else
       if (m_fsize < mmap_maxsize)
+  #endif
       {
         if (m_fsize >= mmap_minsize)
         {
@@ -288,6 +349,28 @@ public:
         }
       }
 
+  #ifdef POSIX_FADV_SEQUENTIAL
+      if (!m_mmap_view && !m_mmap_totalbufmode && !m_filedes_direct && (allow_async>0 || nbufs*bufsize>=WDL_UNBUF_ALIGN))
+        posix_fadvise(m_filedes,0,0,POSIX_FADV_SEQUENTIAL); // more kernel read-ahead for streaming
+  #endif
+
+  #ifdef WDL_POSIX_ASYNC_READ
+      if (m_async>0)
+      {
+        m_aio = new WDL_FileAIO(nbufs);
+        m_async_bufsize=bufsize;
+        int x;
+        char *bptr=(char *)m_bufspace.Resize(nbufs*bufsize + (WDL_UNBUF_ALIGN-1));
+        int a=((int)(INT_PTR)bptr)&(WDL_UNBUF_ALIGN-1);
+        if (a) bptr += WDL_UNBUF_ALIGN-a;
+        for (x = 0; x < nbufs; x ++)
+        {
+          WDL_FileRead__ReadEnt *t=new WDL_FileRead__ReadEnt(m_async_bufsize,bptr);
+          m_empties.Add(t);
+          bptr+=m_async_bufsize;
+        }
+      }
+  #endif
     }
     if (!m_mmap_view && !m_mmap_totalbufmode && m_filedes>=0 && nbufs*bufsize>=WDL_UNBUF_ALIGN)
       m_bufspace.Resize(nbufs*bufsize+(WDL_UNBUF_ALIGN-1));
@@ -332,6 +415,15 @@ public:
     if (m_fh != INVALID_HANDLE_VALUE) CloseHandle(m_fh);
     m_fh=INVALID_HANDLE_VALUE;
 #elif defined(WDL_POSIX_NATIVE_READ)
+  #ifdef WDL_POSIX_ASYNC_READ
+    int x;
+    for (x = 0; x < m_pending.GetSize();x ++) m_aio->Cancel(&m_pending.Get(x)->m_req);
+    m_pending.Empty(true);
+    m_empties.Empty(true);
+    m_full.Empty(true);
+    delete m_aio;
+    m_aio=0;
+  #endif
     if (m_mmap_view) munmap(m_mmap_view,m_fsize);
     m_mmap_view=0;
     if (m_filedes>=0) 
@@ -360,16 +452,81 @@ public:
 
 #ifdef WDL_WIN32_NATIVE_READ
 
+  bool AsyncStartRead(WDL_FileRead__ReadEnt *t) // returns false on error
+  {
+    ResetEvent(t->m_ol.hEvent);
+
+    *(WDL_FILEREAD_POSTYPE *)&t->m_ol.Offset = t->m_offs;
+
+    DWORD dw;
+    if (ReadFile(m_fh,t->m_buf,m_async_bufsize,&dw,&t->m_ol))
+    {
+      if (!dw) return false;
+    }
+    else
+    {
+      if (GetLastError() != ERROR_IO_PENDING) return false;
+      dw=0;
+    }
+    t->m_size=dw;
+    return true;
+  }
+
+  int AsyncGetResult(WDL_FileRead__ReadEnt *ent, bool wait) // returns -1 if still pending (or failed, if !wait)
+  {
+    DWORD s=0;
+    if (!GetOverlappedResult(m_fh,&ent->m_ol,&s,wait)) return wait ? 0 : -1;
+    return (int)s;
+  }
+
+#elif defined(WDL_POSIX_ASYNC_READ)
+
+  bool AsyncStartRead(WDL_FileRead__ReadEnt *t)
+  {
+    t->m_size=0;
+    m_aio->Submit(&t->m_req,m_filedes,t->m_buf,m_async_bufsize,t->m_offs,false);
+    return true;
+  }
+
+  int AsyncGetResult(WDL_FileRead__ReadEnt *ent, bool wait)
+  {
+    if (!m_aio->Wait(&ent->m_req,wait)) return -1;
+
+    int s=ent->m_req.m_result;
+    if (s == -EINVAL && m_async==1) // filesystem took O_DIRECT at open() but not for reads
+    {
+      if (m_filedes_direct)
+      {
+        m_filedes_direct=false;
+        m_filedes_dontneed=true;
+        fcntl(m_filedes,F_SETFL,fcntl(m_filedes,F_GETFL)&~O_DIRECT);
+      }
+      s=WDL_FileAIO::DoIO(&ent->m_req); // reads that were already queued with O_DIRECT end up here too
+    }
+    if (s<0) return wait ? 0 : -1;
+  #ifdef POSIX_FADV_DONTNEED
+    if (m_filedes_dontneed && s>0) posix_fadvise(m_filedes,ent->m_offs,s,POSIX_FADV_DONTNEED);
+  #endif
+    return s;
+  }
+
+#endif
+
+#if defined(WDL_WIN32_NATIVE_READ) || defined(WDL_POSIX_ASYNC_READ)
+
   int RunReads()
   {
     while (m_pending.GetSize())
     {
       WDL_FileRead__ReadEnt *ent=m_pending.Get(0);
-      DWORD s=0;
 
-      if (!ent->m_size && !GetOverlappedResult(m_fh,&ent->m_ol,&s,FALSE)) break;
+      if (!ent->m_size)
+      {
+        const int s=AsyncGetResult(ent,false);
+        if (s<0) break;
+        ent->m_size=s;
+      }
       m_pending.Delete(0);
-      if (!ent->m_size) ent->m_size=s;
       m_full.Add(ent);
     }
 
@@ -385,22 +542,10 @@ public:
       const int rdidx=m_empties.GetSize()-1;
       WDL_FileRead__ReadEnt *t=m_empties.Get(rdidx);
 
-      ResetEvent(t->m_ol.hEvent);
-
-      *(WDL_FILEREAD_POSTYPE *)&t->m_ol.Offset = m_async_readpos;
+      t->m_offs = m_async_readpos;
 
       m_async_readpos += m_async_bufsize;
-      DWORD dw;
-      if (ReadFile(m_fh,t->m_buf,m_async_bufsize,&dw,&t->m_ol))
-      {
-        if (!dw) return 1;
-      }
-      else
-      {
-        if (GetLastError() != ERROR_IO_PENDING) return 1;
-        dw=0;
-      }
-      t->m_size=dw;
+      if (!AsyncStartRead(t)) return 1;
       m_empties.Delete(rdidx);
       m_pending.Add(t);
     }
@@ -409,7 +554,6 @@ public:
 
   int AsyncRead(char *buf, int maxlen)
   {
-    char *obuf=buf;
     int lenout=0;
     if (m_file_position+maxlen > m_fsize)
     {
@@ -423,7 +567,7 @@ public:
       while (m_full.GetSize() > 0)
       {
         WDL_FileRead__ReadEnt *ti=m_full.Get(0);
-        WDL_FILEREAD_POSTYPE tiofs=*(WDL_FILEREAD_POSTYPE *)&ti->m_ol.Offset;
+        WDL_FILEREAD_POSTYPE tiofs=ti->m_offs;
         if (m_file_position >= tiofs && m_file_position < tiofs + ti->m_size)
         {
           if (maxlen < 1) break;
@@ -450,7 +594,7 @@ public:
         for (x = 0; x < m_pending.GetSize(); x ++)
         {
           WDL_FileRead__ReadEnt *ent=m_pending.Get(x);
-          WDL_FILEREAD_POSTYPE tiofs=*(WDL_FILEREAD_POSTYPE *)&ent->m_ol.Offset;
+          WDL_FILEREAD_POSTYPE tiofs=ent->m_offs;
           if (m_file_position >= tiofs && m_file_position < tiofs + m_async_bufsize) break;
         }
         if (x == m_pending.GetSize())
@@ -469,10 +613,8 @@ public:
         if (ent->m_size) m_full.Add(ent);
         else
         {
-//          WaitForSingleObject(ent->m_ol.hEvent,INFINITE);
-
-          DWORD s=0;
-          if (GetOverlappedResult(m_fh,&ent->m_ol,&s,TRUE) && s)
+          const int s=AsyncGetResult(ent,true);
+          if (s>0)
           {
             ent->m_size=s;
             m_full.Add(ent);
@@ -538,6 +680,12 @@ public:
 #elif defined(WDL_POSIX_NATIVE_READ)
     if (m_filedes<0 || len<1) return 0;
 
+  #ifdef WDL_POSIX_ASYNC_READ
+    if (m_async>0)
+    {
+      return AsyncRead((char *)buf,len);
+    }
+  #endif
 #else
     if (!m_fp || len<1) return 0;
 
@@ -596,7 +744,26 @@ public:
               break;
             }
           #elif defined(WDL_POSIX_NATIVE_READ)
+            if (m_filedes_direct) // O_DIRECT needs aligned offsets and sizes
+            {
+              const int offs = (int)(m_filedes_rdpos&(WDL_UNBUF_ALIGN-1));
+              m_filedes_rdpos -= offs;
+              m_sync_bufmode_pos = offs;
+              thissz &= ~(WDL_UNBUF_ALIGN-1);
+            }
             int o=(int)pread(m_filedes,srcbuf,thissz,m_filedes_rdpos);
+          #ifdef O_DIRECT
+            if (o<0 && errno == EINVAL && m_filedes_direct)
+            {
+              m_filedes_direct=false;
+              m_filedes_dontneed=true;
+              fcntl(m_filedes,F_SETFL,fcntl(m_filedes,F_GETFL)&~O_DIRECT);
+              o=(int)pread(m_filedes,srcbuf,thissz,m_filedes_rdpos);
+            }
+          #endif
+          #ifdef POSIX_FADV_DONTNEED
+            if (m_filedes_dontneed && o>0) posix_fadvise(m_filedes,m_filedes_rdpos,o,POSIX_FADV_DONTNEED);
+          #endif
             if (o>0) m_filedes_rdpos+=o;
             if (o<1 || m_sync_bufmode_pos>=o) break;                    
           
@@ -693,17 +860,17 @@ public:
 
     if (m_mmap_view||m_mmap_totalbufmode) return false;
     
-#ifdef WDL_WIN32_NATIVE_READ
+#if defined(WDL_WIN32_NATIVE_READ) || defined(WDL_POSIX_ASYNC_READ)
     if (m_async>0)
     {
       WDL_FileRead__ReadEnt *ent;
 
-      if (pos > m_async_readpos || !(ent=m_full.Get(0)) || pos < *(WDL_FILEREAD_POSTYPE *)&ent->m_ol.Offset)
+      if (pos > m_async_readpos || !(ent=m_full.Get(0)) || pos < ent->m_offs)
       {
         m_async_readpos=pos;
       }
 
-      return FALSE;
+      return false;
     }
 #endif
 
@@ -726,6 +893,10 @@ public:
     return SetFilePointer(m_fh,(LONG)(m_file_position&((WDL_FILEREAD_POSTYPE)0xFFFFFFFF)),&high,FILE_BEGIN)==0xFFFFFFFF && GetLastError() != NO_ERROR;
 #elif defined(WDL_POSIX_NATIVE_READ)
     m_filedes_rdpos = m_file_position;
+  #ifdef POSIX_FADV_WILLNEED
+    if (m_bufspace.GetSize()>=WDL_UNBUF_ALIGN*2-1 && !m_filedes_direct && !m_filedes_dontneed) // start reading the new spot in the background
+      posix_fadvise(m_filedes,m_file_position,m_bufspace.GetSize(),POSIX_FADV_WILLNEED);
+  #endif
     return false;
 #else
     return !!fseek(m_fp,m_file_position,SEEK_SET);
@@ -757,6 +928,18 @@ public:
   WDL_FILEREAD_POSTYPE m_filedes_rdpos;
   int m_filedes;
   bool m_filedes_locked;
+  bool m_filedes_direct; // opened with O_DIRECT
+  bool m_filedes_dontneed; // unbuffered without O_DIRECT, drop pages after reading them
+
+  #ifdef WDL_POSIX_ASYNC_READ
+  int m_async; // 1=O_DIRECT, 2=buffered async, -1=O_DIRECT sync
+  WDL_FileAIO *m_aio;
+
+  int m_async_bufsize;
+  WDL_PtrList<WDL_FileRead__ReadEnt> m_empties;
+  WDL_PtrList<WDL_FileRead__ReadEnt> m_pending;
+  WDL_PtrList<WDL_FileRead__ReadEnt> m_full;
+  #endif
 
   int GetHandle() { return m_filedes; }
 #else
@@ -0,0 +1,179 @@
+// Reads every file in a directory with WDL_FileRead in each of its modes and prints the throughput,
+// streaming several files at once (round robin, like a mixer pulling blocks from each track).
+// Every file is checksummed as it is read, and each mode has to match what the first (plain sync) mode read,
+// so a wrong offset or a stale buffer in the async/unbuffered paths fails the run.
+//
+// g++ -O2 -o fileread_bench fileread_bench.cpp -lpthread
+// usage: fileread_bench [-j streams] [-b bufsize] [-n nbufs] [-r readsize] [-c] directory
+//   -c drops each file from the page cache before every pass, so the disk is measured rather than memory
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "wdlstring.h"
+#include "dirscan.h"
+#include "fileread.h"
+
+static double GetTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static void DropFromCache(const char *fn)
+{
+#ifdef POSIX_FADV_DONTNEED
+  int fd=open(fn,O_RDONLY);
+  if (fd>=0)
+  {
+    posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+#endif
+}
+
+// order dependent, so a block read at the wrong offset changes it
+static unsigned long long Checksum(unsigned long long h, const char *p, int len)
+{
+  while (len >= 8)
+  {
+    unsigned long long v;
+    memcpy(&v,p,8);
+    h=(h^v)*0x100000001b3ULL;
+    h^=h>>29;
+    p+=8;
+    len-=8;
+  }
+  while (len-- > 0) h=(h^(unsigned char)*p++)*0x100000001b3ULL;
+  return h;
+}
+
+struct Stream
+{
+  Stream(WDL_FileRead *fr, int file) { m_fr=fr; m_file=file; m_sum=0xcbf29ce484222325ULL; }
+  ~Stream() { delete m_fr; }
+
+  WDL_FileRead *m_fr;
+  int m_file;
+  unsigned long long m_sum;
+};
+
+struct Mode
+{
+  const char *name;
+  int allow_async;
+  int aio_mode; // WDL_FileAIO::DefaultMode()
+};
+
+int main(int argc, char **argv)
+{
+  int streams=16, bufsize=65536, nbufs=4, readsize=16384;
+  bool cold=false;
+  const char *dir=NULL;
+  for (int i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i],"-j") && i+1 < argc) streams=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-b") && i+1 < argc) bufsize=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-n") && i+1 < argc) nbufs=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-r") && i+1 < argc) readsize=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-c")) cold=true;
+    else if (argv[i][0] != '-' && !dir) dir=argv[i];
+    else dir=NULL, i=argc;
+  }
+  if (!dir || streams<1 || bufsize<1 || nbufs<1 || readsize<1)
+  {
+    fprintf(stderr,"usage: %s [-j streams] [-b bufsize] [-n nbufs] [-r readsize] [-c] directory\n",argv[0]);
+    return 1;
+  }
+
+  WDL_PtrList<WDL_FastString> files;
+  WDL_DirScan ds;
+  if (!ds.First(dir)) do
+  {
+    if (ds.GetCurrentIsDirectory()) continue;
+    WDL_FastString *fn=new WDL_FastString;
+    ds.GetCurrentFullFN(fn);
+    files.Add(fn);
+  }
+  while (!ds.Next());
+  if (!files.GetSize())
+  {
+    fprintf(stderr,"no files in %s\n",dir);
+    return 1;
+  }
+
+  static const Mode modes[]=
+  {
+    { "sync", 0, 0 },
+    { "sync unbuffered", WDL_FILE_ASYNC_POSIX-1, 0 },
+#ifdef WDL_POSIX_ASYNC_READ
+    { "async (io_uring)", WDL_FILE_ASYNC_POSIX+2, 0 },
+    { "async (threads)", WDL_FILE_ASYNC_POSIX+2, 1 },
+    { "async unbuffered (io_uring)", WDL_FILE_ASYNC_POSIX+1, 0 },
+    { "async unbuffered (threads)", WDL_FILE_ASYNC_POSIX+1, 1 },
+#else
+    { "async", WDL_FILE_ASYNC_POSIX+2, 0 },
+    { "async unbuffered", WDL_FILE_ASYNC_POSIX+1, 0 },
+#endif
+  };
+
+  char *buf=(char *)malloc(readsize);
+  printf("%d files, %d streams, %d x %d byte buffers, %d byte reads%s\n",files.GetSize(),streams,nbufs,bufsize,readsize,cold?", cold cache":"");
+  printf("%-28s %10s %10s %12s\n","mode","MB","ms","MB/s");
+
+  int rc=0;
+  WDL_TypedBuf<unsigned long long> expect, sums;
+  memset(sums.Resize(files.GetSize()),0,files.GetSize()*sizeof(unsigned long long));
+  for (int m = 0; m < (int)(sizeof(modes)/sizeof(modes[0])); m ++)
+  {
+#ifdef WDL_POSIX_ASYNC_READ
+    WDL_FileAIO::DefaultMode()=modes[m].aio_mode;
+#endif
+    if (cold) for (int i = 0; i < files.GetSize(); i ++) DropFromCache(files.Get(i)->Get());
+
+    WDL_PtrList<Stream> reading;
+    long long total=0;
+    int next=0;
+    const double t0=GetTimeMs();
+    while (next < files.GetSize() || reading.GetSize())
+    {
+      while (reading.GetSize() < streams && next < files.GetSize())
+      {
+        WDL_FileRead *fr=new WDL_FileRead(files.Get(next)->Get(),modes[m].allow_async,bufsize,nbufs);
+        sums.Get()[next]=0;
+        if (fr->IsOpen()) reading.Add(new Stream(fr,next));
+        else delete fr;
+        next++;
+      }
+      for (int i = 0; i < reading.GetSize(); i ++)
+      {
+        Stream *s=reading.Get(i);
+        const int rd=s->m_fr->Read(buf,readsize);
+        total+=rd;
+        if (rd>0) s->m_sum=Checksum(s->m_sum,buf,rd);
+        if (rd<readsize)
+        {
+          sums.Get()[s->m_file]=s->m_sum;
+          reading.Delete(i--,true);
+        }
+      }
+    }
+    const double ms=GetTimeMs()-t0;
+
+    int bad=0;
+    if (!m) memcpy(expect.Resize(files.GetSize()),sums.Get(),files.GetSize()*sizeof(unsigned long long));
+    else for (int i = 0; i < files.GetSize(); i ++) if (sums.Get()[i] != expect.Get()[i]) bad++;
+
+    printf("%-28s %10.1f %10.1f %12.1f",modes[m].name,total/1048576.0,ms,ms>0 ? total/1048576.0*1000.0/ms : 0.0);
+    if (bad) printf("  %d FILES READ WRONG",bad);
+    printf("\n");
+    if (bad) rc=1;
+  }
+  free(buf);
+  files.Empty(true);
+  return rc;
+}
@@ -22,7 +22,8 @@
   This file provides the WDL_FileWrite object, which can be used to create/write files.
   On windows systems it supports writing synchronously, asynchronously, and asynchronously without buffering.
   On windows systems it supports files larger than 4gb.
-  On non-windows systems it acts as a wrapper for fopen()/etc.
+  On linux it supports writing asynchronously too, using io_uring (or a pool of pwrite() threads).
+  On other systems it acts as a wrapper for open()/pwrite() or fopen()/etc.
 
 
 */
@@ -52,9 +53,18 @@
     #include <sys/stat.h>
     #include <sys/errno.h>
     #define WDL_POSIX_NATIVE_WRITE
+    #if defined(__linux__) && !defined(WDL_NO_POSIX_ASYNC_FILEWRITE)
+      #define WDL_POSIX_ASYNC_WRITE
+      #include "fileaio.h"
+    #endif
   #endif
 #endif
 
+#ifndef WDL_FILE_ASYNC_POSIX
+// add to allow_async to get that mode on linux too, where allow_async is otherwise ignored
+#define WDL_FILE_ASYNC_POSIX 0x100
+#endif
+
 
 
 #ifdef _MSC_VER
@@ -97,6 +107,29 @@ public:
   WDL_TypedBuf<char> __buf;
 };
 
+#elif defined(WDL_POSIX_ASYNC_WRITE)
+
+class WDL_FileWrite__WriteEnt
+{
+public:
+  WDL_FileWrite__WriteEnt(int sz)
+  {
+    m_last_writepos=0;
+    m_bufused=0;
+    m_bufsz=sz;
+    m_bufptr = (char *)__buf.Resize(sz+4095);
+    int a=((int)(INT_PTR)m_bufptr)&4095;
+    if (a) m_bufptr += 4096-a;
+  }
+
+  WDL_FILEWRITE_POSTYPE m_last_writepos;
+
+  int m_bufused,m_bufsz;
+  WDL_FileAIO_Req m_req;
+  char *m_bufptr;
+  WDL_TypedBuf<char> __buf;
+};
+
 #endif
 
 #if defined(_WIN32) && !defined(WDL_NO_SUPPORT_UTF8)
@@ -121,8 +154,14 @@ public:
 
 
 public:
+  // linux ignores allow_async unless WDL_FILE_ASYNC_POSIX is added to it, e.g. WDL_FILE_ASYNC_POSIX+1: then it writes with io_uring
   WDL_FileWrite(const char *filename, int allow_async=1, int bufsize=8192, int minbufs=16, int maxbufs=16, bool wantAppendTo=false, bool noFileLocking=false) // async==2 is unbuffered
   {
+  #ifdef WDL_POSIX_ASYNC_WRITE
+    const bool posix_async = allow_async >= WDL_FILE_ASYNC_POSIX-1 && allow_async <= WDL_FILE_ASYNC_POSIX+2;
+  #endif
+    if (allow_async >= WDL_FILE_ASYNC_POSIX-1 && allow_async <= WDL_FILE_ASYNC_POSIX+2) allow_async -= WDL_FILE_ASYNC_POSIX;
+
     m_file_position=0;
     m_file_max_position=0;
     if(!filename)
@@ -134,6 +173,10 @@ public:
       m_filedes_locked=false;
       m_filedes=-1;
       m_bufspace_used=0;
+  #ifdef WDL_POSIX_ASYNC_WRITE
+      m_async=0;
+      m_aio=0;
+  #endif
 #else
       m_fp = NULL;
 #endif
@@ -212,6 +255,10 @@ public:
 #elif defined(WDL_POSIX_NATIVE_WRITE)
     m_bufspace_used=0;
     m_filedes_locked=false;
+  #ifdef WDL_POSIX_ASYNC_WRITE
+    m_async=0;
+    m_aio=0;
+  #endif
     m_filedes=open(filename,O_WRONLY|O_CREAT,0644);
     if (m_filedes>=0)
     {
@@ -250,6 +297,23 @@ public:
       if (m_filedes >= 0 && allow_async>1) fcntl(m_filedes,F_NOCACHE,1);
 #endif
     }
+  #ifdef WDL_POSIX_ASYNC_WRITE
+    if (m_filedes >= 0 && allow_async && posix_async)
+    {
+      m_async = allow_async;
+      m_aio = new WDL_FileAIO(maxbufs);
+      m_async_bufsize=bufsize;
+      m_async_maxbufs=maxbufs;
+      m_async_minbufs=minbufs;
+      int x;
+      for (x = 0; x < m_async_minbufs; x ++)
+      {
+        WDL_FileWrite__WriteEnt *t=new WDL_FileWrite__WriteEnt(m_async_bufsize);
+        m_empties.Add(t);
+      }
+    }
+    else
+  #endif
     if (minbufs * bufsize >= 16384) m_bufspace.Resize((minbufs*bufsize+4095)&~4095);
 #else
     m_fp=fopen(filename,wantAppendTo ? "a+b" : "wb");
@@ -273,6 +337,16 @@ public:
     if (m_fh != INVALID_HANDLE_VALUE) CloseHandle(m_fh);
     m_fh=INVALID_HANDLE_VALUE;
 #elif defined(WDL_POSIX_NATIVE_WRITE)
+  #ifdef WDL_POSIX_ASYNC_WRITE
+   if (m_async)
+   {
+     SyncOutput(true);
+     m_empties.Empty(true);
+     m_pending.Empty(true);
+     delete m_aio;
+     m_aio=0;
+   }
+  #endif
    if (m_filedes >= 0)
    {
      if (m_bufspace.GetSize() > 0 && m_bufspace_used>0)
@@ -380,6 +454,52 @@ public:
       return dw;
     }
 #elif defined(WDL_POSIX_NATIVE_WRITE)
+  #ifdef WDL_POSIX_ASYNC_WRITE
+   if (m_async)
+   {
+     int rdpos = 0;
+     while (len > 0)
+     {
+       if (!m_empties.GetSize())
+       {
+         WDL_FileWrite__WriteEnt *ent=m_pending.Get(0);
+         if (ent && m_aio->Wait(&ent->m_req,false))
+         {
+           m_pending.Delete(0);
+           FinishAsyncWrite(ent);
+           m_empties.Add(ent);
+         }
+       }
+
+       WDL_FileWrite__WriteEnt *ent=m_empties.Get(0);
+       if (!ent)
+       {
+         if (m_pending.GetSize()>=m_async_maxbufs)
+         {
+           SyncOutput(false);
+         }
+
+         if (!(ent=m_empties.Get(0)))
+           m_empties.Add(ent = new WDL_FileWrite__WriteEnt(m_async_bufsize)); // new buffer
+       }
+
+       int ml=ent->m_bufsz-ent->m_bufused;
+       if (ml>len) ml=len;
+       memcpy(ent->m_bufptr+ent->m_bufused,(const char *)buf + rdpos,ml);
+
+       ent->m_bufused+=ml;
+       len-=ml;
+       rdpos+=ml;
+       if (m_file_position+ent->m_bufused > m_file_max_position) m_file_max_position=m_file_position+ent->m_bufused;
+
+       if (ent->m_bufused >= ent->m_bufsz)
+       {
+         if (RunAsyncWrite(ent,true)) m_empties.Delete(0); // if queued remove from list
+       }
+     }
+     return rdpos;
+   }
+  #endif
    if (m_bufspace.GetSize()>0)
    {
      char *rdptr = (char *)buf;
@@ -460,6 +580,13 @@ public:
     return pos;
 #elif defined(WDL_POSIX_NATIVE_WRITE)
     if (m_filedes < 0) return -1;
+  #ifdef WDL_POSIX_ASYNC_WRITE
+    if (m_async)
+    {
+      WDL_FileWrite__WriteEnt *ent=m_empties.Get(0);
+      return m_file_position + (ent ? ent->m_bufused : 0);
+    }
+  #endif
     return m_file_position + m_bufspace_used;
 #else
     if (!m_fp) return -1;
@@ -547,6 +674,52 @@ public:
     }
   }
 
+#elif defined(WDL_POSIX_ASYNC_WRITE)
+
+  bool RunAsyncWrite(WDL_FileWrite__WriteEnt *ent, bool updatePosition) // returns true if ent is added to pending
+  {
+    if (ent && ent->m_bufused>0)
+    {
+      if (updatePosition)
+      {
+        ent->m_last_writepos = m_file_position;
+        m_file_position += ent->m_bufused;
+        if (m_file_position>m_file_max_position) m_file_max_position=m_file_position;
+      }
+      m_aio->Submit(&ent->m_req,m_filedes,ent->m_bufptr,ent->m_bufused,ent->m_last_writepos,true);
+      m_pending.Add(ent);
+      return true;
+    }
+    return false;
+  }
+
+  void FinishAsyncWrite(WDL_FileWrite__WriteEnt *ent)
+  {
+  #ifdef SYNC_FILE_RANGE_WRITE
+    if (m_async>1 && ent->m_req.m_result>0) // start writeback now rather than leaving it in the cache, like FILE_FLAG_WRITE_THROUGH
+      sync_file_range(m_filedes,ent->m_last_writepos,ent->m_req.m_result,SYNC_FILE_RANGE_WRITE);
+  #endif
+    ent->m_bufused=0;
+  }
+
+  void SyncOutput(bool syncall)
+  {
+    if (syncall)
+    {
+      if (RunAsyncWrite(m_empties.Get(0),true)) m_empties.Delete(0);
+    }
+    for (;;)
+    {
+      WDL_FileWrite__WriteEnt *ent=m_pending.Get(0);
+      if (!ent) break;
+      m_pending.Delete(0);
+      m_aio->Wait(&ent->m_req,true);
+      FinishAsyncWrite(ent);
+      m_empties.Add(ent);
+      if (!syncall) break;
+    }
+  }
+
 #endif
 
 
@@ -593,6 +766,15 @@ public:
 #elif defined(WDL_POSIX_NATIVE_WRITE)
 
     if (m_filedes < 0) return true;
+  #ifdef WDL_POSIX_ASYNC_WRITE
+    if (m_async)
+    {
+      SyncOutput(true);
+      m_file_position=pos;
+      if (m_file_position>m_file_max_position) m_file_max_position=m_file_position;
+      return false;
+    }
+  #endif
     if (m_bufspace.GetSize() > 0 && m_bufspace_used>0)
     {
       int v=(int)pwrite(m_filedes,m_bufspace.Get(),m_bufspace_used,m_file_position);
@@ -631,6 +813,16 @@ public:
 
   bool m_filedes_locked;
 
+  #ifdef WDL_POSIX_ASYNC_WRITE
+  int m_async; // 1=async, 2=async, start writeback as each buffer completes
+  WDL_FileAIO *m_aio;
+
+  int m_async_bufsize, m_async_minbufs, m_async_maxbufs;
+
+  WDL_PtrList<WDL_FileWrite__WriteEnt> m_empties;
+  WDL_PtrList<WDL_FileWrite__WriteEnt> m_pending;
+  #endif
+
 #else
   int GetHandle() { return fileno(m_fp); }
  
@@ -0,0 +1,473 @@
+#ifndef _WDL_HASHMAP_H_
+#define _WDL_HASHMAP_H_
+
+#include <string.h>
+#include "heapbuf.h"
+#include "stringpool.h"
+
+
+// Hashed versions of the assocarray.h containers, with the same interface:
+//
+//   WDL_IntHashMap<VAL>     for WDL_IntKeyedArray<VAL>
+//   WDL_PtrHashMap<VAL>     for WDL_PtrKeyedArray<VAL>
+//   WDL_StringHashMap<VAL>  for WDL_StringKeyedArray<VAL>
+//
+// Lookups, Insert() and Delete() are O(1) rather than a binary search and a memmove.
+// The entries are kept in one dense array, indexed by an open addressing (linear
+// probing) table, so GetSize()/EnumeratePtr() work as before, but Enumerate order is
+// not key order: it is insertion order until something is deleted (Delete() moves the
+// last entry into the hole). Use EnumerateSorted()/EnumerateSortedPtr() where the order
+// matters, they sort on the first call after a change.
+//
+// String keys are interned in a WDL_StringPool instead of strdup()ed, pass one to share
+// it between maps, otherwise each map has its own.
+//
+// Hashing and comparing are done by a traits class (see WDL_HashMapIntTraits), which
+// the compiler can inline, rather than by function pointers.
+
+
+template <class KEY, class VAL, class TRAITS> class WDL_HashMapImpl
+{
+  WDL_HashMapImpl(const WDL_HashMapImpl &cp); // use CopyContents()
+
+  WDL_HashMapImpl &operator=(const WDL_HashMapImpl &cp) { CopyContents(cp); return *this; }
+
+public:
+
+  explicit WDL_HashMapImpl(const TRAITS &traits, void (*valdispose)(VAL)=0) : m_traits(traits)
+  {
+    m_valdispose = valdispose;
+    m_sorted_valid = false;
+  }
+
+  ~WDL_HashMapImpl()
+  {
+    DeleteAll();
+  }
+
+  VAL* GetPtr(KEY key, KEY *keyPtrOut=NULL) const
+  {
+    const int i = GetIdx(key);
+    if (i >= 0)
+    {
+      KeyVal* kv = m_data.Get()+i;
+      if (keyPtrOut) *keyPtrOut = kv->key;
+      return &(kv->val);
+    }
+    return 0;
+  }
+
+  bool Exists(KEY key) const
+  {
+    return GetIdx(key) >= 0;
+  }
+
+  // returns the entry's index for EnumeratePtr() etc, valid until the next Delete()
+  int Insert(KEY key, VAL val)
+  {
+    const unsigned int h = m_traits.hash(key);
+    int slot = FindSlot(key,h);
+    int i = slot >= 0 ? m_table.Get()[slot]-1 : -1;
+    if (i >= 0)
+    {
+      KeyVal* kv = m_data.Get()+i;
+      if (m_valdispose) m_valdispose(kv->val);
+      kv->val = val;
+      return i;
+    }
+
+    i = m_data.GetSize();
+    if ((i+1)*2 > m_table.GetSize())
+    {
+      if (!Rehash(m_table.GetSize() ? m_table.GetSize()*2 : 16)) return -1;
+      slot = FindSlot(key,h);
+    }
+    KeyVal* kv = m_data.ResizeOK(i+1,false);
+    if (!kv) return -1;
+    kv += i;
+    kv->key = m_traits.dup(key);
+    kv->val = val;
+    kv->hash = h;
+    m_table.Get()[slot] = i+1;
+    m_sorted_valid = false;
+    return i;
+  }
+
+  void Delete(KEY key)
+  {
+    DeleteByIndex(GetIdx(key));
+  }
+
+  void DeleteByIndex(int idx)
+  {
+    if (idx >= 0 && idx < m_data.GetSize())
+    {
+      KeyVal* kv = m_data.Get()+idx;
+      m_traits.dispose(kv->key);
+      if (m_valdispose) m_valdispose(kv->val);
+      Remove(idx);
+    }
+  }
+
+  void DeleteAll(bool resizedown=false)
+  {
+    int i;
+    for (i = 0; i < m_data.GetSize(); ++i)
+    {
+      KeyVal* kv = m_data.Get()+i;
+      m_traits.dispose(kv->key);
+      if (m_valdispose) m_valdispose(kv->val);
+    }
+    m_data.Resize(0, resizedown);
+    if (resizedown) m_table.Resize(0);
+    else if (m_table.GetSize()) memset(m_table.Get(),0,m_table.GetSize()*sizeof(int));
+    m_sorted.Resize(0, resizedown);
+    m_sorted_valid = false;
+  }
+
+  int GetSize() const
+  {
+    return m_data.GetSize();
+  }
+
+  // not in key order, see EnumerateSortedPtr()
+  VAL* EnumeratePtr(int i, KEY* key=0) const
+  {
+    if (i >= 0 && i < m_data.GetSize())
+    {
+      KeyVal* kv = m_data.Get()+i;
+      if (key) *key = kv->key;
+      return &(kv->val);
+    }
+    return 0;
+  }
+
+  VAL* EnumerateSortedPtr(int i, KEY* key=0) const
+  {
+    if (i < 0 || i >= m_data.GetSize()) return 0;
+    if (!m_sorted_valid) Sort();
+    return EnumeratePtr(m_sorted.Get()[i], key);
+  }
+
+  KEY* ReverseLookupPtr(VAL val) const
+  {
+    int i;
+    for (i = 0; i < m_data.GetSize(); ++i)
+    {
+      KeyVal* kv = m_data.Get()+i;
+      if (kv->val == val) return &kv->key;
+    }
+    return 0;
+  }
+
+  void ChangeKey(KEY oldkey, KEY newkey)
+  {
+    ChangeKeyByIndex(GetIdx(oldkey), newkey, true);
+  }
+
+  // needsort is ignored, the entry is always rehashed. if newkey is already in use,
+  // that entry is deleted.
+  void ChangeKeyByIndex(int idx, KEY newkey, bool needsort)
+  {
+    if (idx >= 0 && idx < m_data.GetSize())
+    {
+      const int dup = GetIdx(newkey);
+      if (dup == idx) return;
+
+      KeyVal kv = m_data.Get()[idx];
+      m_traits.dispose(kv.key);
+      Remove(idx);
+      if (dup >= 0) Delete(newkey);
+
+      void (*valdispose)(VAL) = m_valdispose;
+      m_valdispose = NULL;
+      Insert(newkey, kv.val);
+      m_valdispose = valdispose;
+    }
+  }
+
+  // for compatibility with WDL_AssocArrayImpl, where it is a fast add-block mode
+  void AddUnsorted(KEY key, VAL val) { Insert(key, val); }
+  void Resort() { }
+
+  int GetIdx(KEY key) const
+  {
+    const int slot = FindSlot(key, m_traits.hash(key));
+    return slot >= 0 ? m_table.Get()[slot]-1 : -1;
+  }
+
+  void SetGranul(int gran)
+  {
+    m_data.SetGranul(gran);
+  }
+
+  // keys are rehashed with this map's traits (and dup()ed into its string pool)
+  void CopyContents(const WDL_HashMapImpl &cp)
+  {
+    if (&cp == this) return;
+    DeleteAll();
+    m_valdispose = NULL; // avoid disposing of values twice, since we don't have a valdup, we can't have a fully valid copy
+    const int n=cp.m_data.GetSize();
+    int x;
+    for (x=0;x<n;x++)
+    {
+      const KeyVal *kv=cp.m_data.Get()+x;
+      Insert(kv->key, kv->val);
+    }
+  }
+
+  // keys are reference counted (or plain values), so this is the same as CopyContents()
+  void CopyContentsAsReference(const WDL_HashMapImpl &cp)
+  {
+    CopyContents(cp);
+  }
+
+protected:
+
+  struct KeyVal
+  {
+    KEY key;
+    VAL val;
+    unsigned int hash;
+  };
+  WDL_TypedBuf<KeyVal> m_data;
+  WDL_TypedBuf<int> m_table; // power of 2 size, entries are index+1 into m_data, 0 = empty
+  mutable WDL_TypedBuf<int> m_sorted;
+  mutable bool m_sorted_valid;
+
+  TRAITS m_traits;
+  void (*m_valdispose)(VAL);
+
+  // slot holding key, or the empty slot it would go in (-1 if there is no table yet)
+  int FindSlot(KEY key, unsigned int h) const
+  {
+    const int sz = m_table.GetSize();
+    if (!sz) return -1;
+    const int *tab = m_table.Get();
+    const KeyVal *data = m_data.Get();
+    int i = h & (sz-1);
+    for (;;)
+    {
+      const int e = tab[i];
+      if (!e) return i;
+      const KeyVal *kv = data + e-1;
+      if (kv->hash == h && m_traits.equal(kv->key, key)) return i;
+      i = (i+1)&(sz-1);
+    }
+  }
+
+  int FindSlotOfIndex(int idx) const
+  {
+    const int *tab = m_table.Get();
+    const int mask = m_table.GetSize()-1;
+    int i = m_data.Get()[idx].hash & mask;
+    while (tab[i] != idx+1) i = (i+1)&mask;
+    return i;
+  }
+
+  // drops entry idx (whose key and value are already disposed of), moving the last entry into its place
+  void Remove(int idx)
+  {
+    int *tab = m_table.Get();
+    const int mask = m_table.GetSize()-1;
+    const KeyVal *data = m_data.Get();
+
+    int i = FindSlotOfIndex(idx);
+    tab[i] = 0;
+    for (int j = (i+1)&mask; tab[j]; j = (j+1)&mask)
+    {
+      const int home = data[tab[j]-1].hash & mask;
+      if (((j-home)&mask) >= ((j-i)&mask))
+      {
+        tab[i] = tab[j];
+        tab[j] = 0;
+        i = j;
+      }
+    }
+
+    const int last = m_data.GetSize()-1;
+    if (idx != last)
+    {
+      tab[FindSlotOfIndex(last)] = idx+1;
+      m_data.Get()[idx] = m_data.Get()[last];
+    }
+    m_data.Resize(last,false);
+    m_sorted_valid = false;
+  }
+
+  bool Rehash(int sz)
+  {
+    int *tab = m_table.ResizeOK(sz,false);
+    if (!tab) return false;
+    memset(tab,0,sz*sizeof(int));
+    const KeyVal *data = m_data.Get();
+    for (int x = 0; x < m_data.GetSize(); x ++)
+    {
+      int i = data[x].hash & (sz-1);
+      while (tab[i]) i = (i+1)&(sz-1);
+      tab[i] = x+1;
+    }
+    return true;
+  }
+
+  void Sort() const
+  {
+    const int n = m_data.GetSize();
+    int *idx = m_sorted.Resize(n,false);
+    for (int x = 0; x < n; x ++) idx[x] = x;
+    // merge sort, there is no qsort() with a context pointer everywhere
+    WDL_TypedBuf<int> tmp;
+    int *t = tmp.Resize(n,false);
+    const KeyVal *data = m_data.Get();
+    for (int w = 1; w < n; w *= 2)
+    {
+      for (int lo = 0; lo < n; lo += 2*w)
+      {
+        int a = lo, mid = lo+w < n ? lo+w : n, hi = lo+2*w < n ? lo+2*w : n, b = mid, o = lo;
+        while (a < mid && b < hi) t[o++] = m_traits.cmp(data[idx[b]].key, data[idx[a]].key) < 0 ? idx[b++] : idx[a++];
+        while (a < mid) t[o++] = idx[a++];
+        while (b < hi) t[o++] = idx[b++];
+      }
+      int *sw = idx; idx = t; t = sw;
+    }
+    if (idx != m_sorted.Get()) memcpy(m_sorted.Get(), idx, n*sizeof(int));
+    m_sorted_valid = true;
+  }
+};
+
+
+// WDL_HashMap adds useful functions but cannot contain structs for keys or values
+template <class KEY, class VAL, class TRAITS> class WDL_HashMap : public WDL_HashMapImpl<KEY, VAL, TRAITS>
+{
+public:
+
+  explicit WDL_HashMap(const TRAITS &traits, void (*valdispose)(VAL)=0)
+  : WDL_HashMapImpl<KEY, VAL, TRAITS>(traits, valdispose)
+  {
+  }
+
+  VAL Get(KEY key, VAL notfound=0) const
+  {
+    VAL* p = this->GetPtr(key);
+    if (p) return *p;
+    return notfound;
+  }
+
+  VAL Enumerate(int i, KEY* key=0, VAL notfound=0) const
+  {
+    VAL* p = this->EnumeratePtr(i, key);
+    if (p) return *p;
+    return notfound;
+  }
+
+  VAL EnumerateSorted(int i, KEY* key=0, VAL notfound=0) const
+  {
+    VAL* p = this->EnumerateSortedPtr(i, key);
+    if (p) return *p;
+    return notfound;
+  }
+
+  KEY ReverseLookup(VAL val, KEY notfound=0) const
+  {
+    KEY* p=this->ReverseLookupPtr(val);
+    if (p) return *p;
+    return notfound;
+  }
+};
+
+
+// traits: hash(), equal() and cmp() (for sorted enumeration), dup() and dispose() for stored keys
+struct WDL_HashMapIntTraits
+{
+  unsigned int hash(int k) const { unsigned int h = (unsigned int)k * 0x9E3779B1u; return h ^ (h>>15); }
+  bool equal(int a, int b) const { return a == b; }
+  int cmp(int a, int b) const { return a < b ? -1 : a > b; }
+  int dup(int k) const { return k; }
+  void dispose(int k) const { }
+};
+
+struct WDL_HashMapPtrTraits
+{
+  unsigned int hash(INT_PTR k) const
+  {
+    WDL_UINT64 h = (WDL_UINT64)k * WDL_UINT64_CONST(0x9E3779B97F4A7C15);
+    return (unsigned int)(h ^ (h>>32));
+  }
+  bool equal(INT_PTR a, INT_PTR b) const { return a == b; }
+  int cmp(INT_PTR a, INT_PTR b) const { return a < b ? -1 : a > b; }
+  INT_PTR dup(INT_PTR k) const { return k; }
+  void dispose(INT_PTR k) const { }
+};
+
+// keys are interned in m_pool, which WDL_StringHashMap creates if it isn't given one
+class WDL_HashMapStringTraits
+{
+public:
+  WDL_HashMapStringTraits(bool caseSensitive, WDL_StringPool *pool) : m_casesens(caseSensitive), m_pool(pool) { }
+
+  unsigned int hash(const char *k) const
+  {
+    if (m_casesens) return WDL_StringPool::Hash(k);
+    unsigned int h = 2166136261u;
+    while (*k)
+    {
+      unsigned char c = (unsigned char)*k++;
+      if (c >= 'a' && c <= 'z') c += 'A'-'a';
+      h ^= c;
+      h *= 16777619u;
+    }
+    return h;
+  }
+  bool equal(const char *a, const char *b) const { return a == b || !(m_casesens ? strcmp(a,b) : stricmp(a,b)); }
+  int cmp(const char *a, const char *b) const { return m_casesens ? strcmp(a,b) : stricmp(a,b); }
+  const char *dup(const char *k) const { return m_pool->Add(k); }
+  void dispose(const char *k) const { m_pool->Release(k); }
+
+  bool m_casesens;
+  WDL_StringPool *m_pool;
+};
+
+
+template <class VAL> class WDL_IntHashMap : public WDL_HashMap<int, VAL, WDL_HashMapIntTraits>
+{
+public:
+
+  explicit WDL_IntHashMap(void (*valdispose)(VAL)=0) : WDL_HashMap<int, VAL, WDL_HashMapIntTraits>(WDL_HashMapIntTraits(), valdispose) {}
+  ~WDL_IntHashMap() {}
+};
+
+
+template <class VAL> class WDL_PtrHashMap : public WDL_HashMap<INT_PTR, VAL, WDL_HashMapPtrTraits>
+{
+public:
+
+  explicit WDL_PtrHashMap(void (*valdispose)(VAL)=0) : WDL_HashMap<INT_PTR, VAL, WDL_HashMapPtrTraits>(WDL_HashMapPtrTraits(), valdispose) {}
+  ~WDL_PtrHashMap() {}
+};
+
+
+template <class VAL> class WDL_StringHashMap : public WDL_HashMap<const char *, VAL, WDL_HashMapStringTraits>
+{
+public:
+
+  explicit WDL_StringHashMap(bool caseSensitive=true, void (*valdispose)(VAL)=0, WDL_StringPool *pool=NULL)
+    : WDL_HashMap<const char *, VAL, WDL_HashMapStringTraits>(WDL_HashMapStringTraits(caseSensitive, pool), valdispose)
+  {
+    m_ownpool = pool ? NULL : new WDL_StringPool(false);
+    if (m_ownpool) this->m_traits.m_pool = m_ownpool;
+  }
+
+  ~WDL_StringHashMap()
+  {
+    this->DeleteAll(); // before the pool goes
+    delete m_ownpool;
+  }
+
+  static void freecharptr(char *p) { free(p); }
+
+private:
+  WDL_StringPool *m_ownpool;
+};
+
+
+#endif
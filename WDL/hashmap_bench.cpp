@@ -0,0 +1,122 @@
+// Times WDL_IntHashMap/WDL_StringHashMap (hashmap.h) against WDL_IntKeyedArray/WDL_StringKeyedArray
+// (assocarray.h): random inserts, lookups (half of them misses), enumeration and deletes.
+//
+// g++ -O2 -o hashmap_bench hashmap_bench.cpp
+// usage: hashmap_bench [-n items] [-r rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "assocarray.h"
+#include "hashmap.h"
+
+static double GetTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static int s_sink;
+
+struct Times
+{
+  double insert, lookup, enumerate, del;
+};
+
+static void PrintTimes(const char *name, const Times &t, int n, int rounds)
+{
+  const double sc = 1000000.0 / ((double)n*rounds); // ms per op -> ns per op
+  printf("  %-24s insert %7.1f  lookup %7.1f  enumerate %6.1f  delete %7.1f ns/op\n",
+    name, t.insert*sc, t.lookup*sc, t.enumerate*sc, t.del*sc);
+}
+
+// MAP is filled with keys[0..n), looked up with keys[0..2n) and emptied in a different order than it was filled.
+template <class MAP, class KEY> static void Run(MAP &map, KEY *keys, int n, int rounds, Times *t)
+{
+  for (int r = 0; r < rounds; r ++)
+  {
+    double t0 = GetTimeMs();
+    for (int i = 0; i < n; i ++) map.Insert(keys[i], i);
+    double t1 = GetTimeMs();
+    int sum = 0;
+    for (int i = 0; i < 2*n; i ++) sum += map.Get(keys[i], -1);
+    double t2 = GetTimeMs();
+    KEY k;
+    for (int i = 0; i < map.GetSize(); i ++) sum += map.Enumerate(i, &k);
+    double t3 = GetTimeMs();
+    for (int i = n; i --; ) map.Delete(keys[(i*7919) % n]);
+    double t4 = GetTimeMs();
+    s_sink += sum + map.GetSize();
+
+    t->insert += t1-t0;
+    t->lookup += (t2-t1)/2.0;
+    t->enumerate += t3-t2;
+    t->del += t4-t3;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int n=10000, rounds=10;
+  for (int i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i],"-n") && i+1 < argc) n=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-r") && i+1 < argc) rounds=atoi(argv[++i]);
+    else n=0, i=argc;
+  }
+  if (n<1 || rounds<1)
+  {
+    printf("usage: hashmap_bench [-n items] [-r rounds]\n");
+    return 1;
+  }
+  if (n % 7919 == 0) n++; // the delete order needs n coprime to 7919
+
+  srand(1);
+  int *ikeys = (int *)malloc(2*n*sizeof(int));
+  char **skeys = (char **)malloc(2*n*sizeof(char *));
+  for (int i = 0; i < 2*n; i ++)
+  {
+    ikeys[i] = (int)(((unsigned int)rand()<<16) ^ (unsigned int)rand());
+    char tmp[64];
+    snprintf(tmp,sizeof(tmp),"param/%08x/%d",(unsigned int)ikeys[i],i);
+    skeys[i] = strdup(tmp);
+  }
+
+  printf("%d items, %d rounds\n",n,rounds);
+
+  printf("int keys\n");
+  {
+    Times t = {0};
+    WDL_IntKeyedArray<int> map;
+    Run(map, ikeys, n, rounds, &t);
+    PrintTimes("WDL_IntKeyedArray", t, n, rounds);
+  }
+  {
+    Times t = {0};
+    WDL_IntHashMap<int> map;
+    Run(map, ikeys, n, rounds, &t);
+    PrintTimes("WDL_IntHashMap", t, n, rounds);
+  }
+
+  printf("string keys\n");
+  {
+    Times t = {0};
+    WDL_StringKeyedArray<int> map;
+    Run(map, (const char **)skeys, n, rounds, &t);
+    PrintTimes("WDL_StringKeyedArray", t, n, rounds);
+  }
+  {
+    Times t = {0};
+    WDL_StringHashMap<int> map;
+    Run(map, (const char **)skeys, n, rounds, &t);
+    PrintTimes("WDL_StringHashMap", t, n, rounds);
+  }
+
+  for (int i = 0; i < 2*n; i ++) free(skeys[i]);
+  free(skeys);
+  free(ikeys);
+  return s_sink == 0x7fffffff;
+}
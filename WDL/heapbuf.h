@@ -27,6 +27,9 @@
 
   Also in this file is WDL_TypedBuf which is a templated version WDL_HeapBuf 
   that manages type and type-size.
+
+  SetAllocator() makes a buffer get its memory from a WDL_Allocator (see rtalloc.h)
+  rather than malloc(), for example a WDL_RTPool on an audio thread.
  
 */
 
@@ -43,6 +46,7 @@
 #endif
 
 #include "wdltypes.h"
+#include "rtalloc.h"
 
 class WDL_HeapBuf
 {
@@ -60,10 +64,29 @@ class WDL_HeapBuf
     int GetGranul() const { return m_granul; }
 
     void *ResizeOK(int newsize, bool resizedown = true) { void *p=Resize(newsize, resizedown); return GetSize() == newsize ? p : NULL; }
+
+    // NULL for malloc(). The contents move to the new allocator, returns false (and
+    // changes nothing) if it can't hold them.
+    bool SetAllocator(WDL_Allocator *a)
+    {
+      if (a == m_allocator) return true;
+      void *nbuf=NULL;
+      if (m_alloc > 0)
+      {
+        if (!(nbuf=mem_alloc(a,m_alloc))) return false;
+        if (m_size > 0) memcpy(nbuf,m_buf,m_size);
+        mem_free(m_allocator,m_buf);
+      }
+      m_buf=nbuf;
+      m_allocator=a;
+      return true;
+    }
+    WDL_Allocator *GetAllocator() const { return m_allocator; }
     
     WDL_HeapBuf(const WDL_HeapBuf &cp)
     {
       m_buf=0;
+      m_allocator=0;
       CopyFrom(&cp,true);
     }
     WDL_HeapBuf &operator=(const WDL_HeapBuf &cp)
@@ -75,16 +98,16 @@ class WDL_HeapBuf
 
 
   #ifndef WDL_HEAPBUF_TRACE
-    explicit WDL_HeapBuf(int granul=4096) : m_buf(NULL), m_alloc(0), m_size(0), m_granul(granul)
+    explicit WDL_HeapBuf(int granul=4096) : m_buf(NULL), m_allocator(NULL), m_alloc(0), m_size(0), m_granul(granul)
     {
     }
     ~WDL_HeapBuf()
     {
-      free(m_buf);
+      mem_free(m_allocator,m_buf);
     }
   #else
     explicit WDL_HeapBuf(int granul=4096, const char *tracetype="WDL_HeapBuf"
-      ) : m_buf(NULL), m_alloc(0), m_size(0), m_granul(granul)
+      ) : m_buf(NULL), m_allocator(NULL), m_alloc(0), m_size(0), m_granul(granul)
     {
       m_tracetype = tracetype;
       char tmp[512];
@@ -96,7 +119,7 @@ class WDL_HeapBuf
       char tmp[512];
       wsprintf(tmp,"WDL_HeapBuf: destroying type: %s (alloc=%d, size=%d)\n",m_tracetype,m_alloc,m_size);
       OutputDebugString(tmp);
-      free(m_buf);
+      mem_free(m_allocator,m_buf);
     }
   #endif
 
@@ -116,7 +139,7 @@ class WDL_HeapBuf
 
           int a = newsize; 
           if (a > m_size) a=m_size;
-          void *newbuf = newsize ? malloc(newsize) : 0;
+          void *newbuf = newsize ? mem_alloc(m_allocator,newsize) : 0;
           if (!newbuf && newsize) 
           {
             #ifdef WDL_HEAPBUF_ONMALLOCFAIL
@@ -126,7 +149,7 @@ class WDL_HeapBuf
           }
           if (newbuf&&m_buf) memcpy(newbuf,m_buf,a);
           m_size=m_alloc=newsize;
-          free(m_buf);
+          mem_free(m_allocator,m_buf);
           return m_buf=newbuf;
         #endif
 
@@ -167,16 +190,16 @@ class WDL_HeapBuf
                 #endif
                 if (newalloc <= 0)
                 {
-                  free(m_buf);
+                  mem_free(m_allocator,m_buf);
                   m_buf=0;
                   m_alloc=0;
                   m_size=0;
                   return 0;
                 }
-                void *nbuf=realloc(m_buf,newalloc);
+                void *nbuf=mem_realloc(m_allocator,m_buf,newalloc,m_alloc);
                 if (!nbuf)
                 {
-                  if (!(nbuf=malloc(newalloc))) 
+                  if (m_allocator || !(nbuf=mem_alloc(m_allocator,newalloc))) // an allocator's Realloc() has already tried this
                   {
                     #ifdef WDL_HEAPBUF_ONMALLOCFAIL
                       WDL_HEAPBUF_ONMALLOCFAIL(newalloc);
@@ -188,7 +211,7 @@ class WDL_HeapBuf
                   {
                     int sz=newsize<m_size?newsize:m_size;
                     if (sz>0) memcpy(nbuf,m_buf,sz);
-                    free(m_buf);
+                    mem_free(m_allocator,m_buf);
                   }
                 }
   
@@ -209,7 +232,8 @@ class WDL_HeapBuf
       {
         if (exactCopyOfConfig) // copy all settings
         {
-          free(m_buf);
+          mem_free(m_allocator,m_buf);
+          m_allocator = hb->m_allocator;
 
           #ifdef WDL_HEAPBUF_TRACE
             m_tracetype = hb->m_tracetype;
@@ -217,7 +241,7 @@ class WDL_HeapBuf
           m_granul = hb->m_granul;
 
           m_size=m_alloc=0;
-          m_buf=hb->m_buf && hb->m_alloc>0 ? malloc(m_alloc = hb->m_alloc) : NULL;
+          m_buf=hb->m_buf && hb->m_alloc>0 ? mem_alloc(m_allocator,m_alloc = hb->m_alloc) : NULL;
           #ifdef WDL_HEAPBUF_ONMALLOCFAIL
             if (!m_buf && m_alloc) { WDL_HEAPBUF_ONMALLOCFAIL(m_alloc) } ;
           #endif
@@ -238,7 +262,28 @@ class WDL_HeapBuf
 #ifndef WDL_HEAPBUF_IMPL_ONLY
 
   private:
+    static void *mem_alloc(WDL_Allocator *a, int sz)
+    {
+      if (a) return a->Alloc(sz);
+      WDL_RT_CHECK_ALLOC("WDL_HeapBuf malloc",sz)
+      return malloc(sz);
+    }
+    static void *mem_realloc(WDL_Allocator *a, void *buf, int sz, int oldsz)
+    {
+      if (a) return a->Realloc(buf,sz,oldsz);
+      WDL_RT_CHECK_ALLOC("WDL_HeapBuf realloc",sz)
+      return realloc(buf,sz);
+    }
+    static void mem_free(WDL_Allocator *a, void *buf)
+    {
+      if (!buf) return;
+      if (a) { a->Free(buf); return; }
+      WDL_RT_CHECK_ALLOC("WDL_HeapBuf free",0)
+      free(buf);
+    }
+
     void *m_buf;
+    WDL_Allocator *m_allocator;
     int m_alloc;
     int m_size;
     int m_granul;
@@ -334,6 +379,7 @@ template<class PTRTYPE> class WDL_TypedBuf
     }
 
     void SetGranul(int gran) { m_hb.SetGranul(gran); }
+    bool SetAllocator(WDL_Allocator *a) { return m_hb.SetAllocator(a); }
 
     int Find(PTRTYPE val) const
     {
@@ -18,6 +18,8 @@ JNL_AsyncDNS::JNL_AsyncDNS(int max_cache_entries)
 {
   m_thread_kill=1;
   m_thread=0;
+  m_notify=NULL;
+  m_notify_ctx=NULL;
   m_cache_size=max_cache_entries;
   m_cache=(cache_entry *)::malloc(sizeof(cache_entry)*m_cache_size);
   if (m_cache) memset(m_cache,0,sizeof(cache_entry)*m_cache_size);
@@ -102,6 +104,7 @@ unsigned int JNL_AsyncDNS::_threadfunc(void *_d)
           _this->m_cache[x].resolved=1;
         }
       }
+      if (_this->m_notify) _this->m_notify(_this->m_notify_ctx);
     }
   }
   if (!nowinsock) JNL::close_socketlib();
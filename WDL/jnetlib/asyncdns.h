@@ -13,7 +13,9 @@
 **      try calling resolve() with the same hostname in a few hundred milliseconds 
 **      or so), or -1 on error (i.e. the host can't resolve).
 **   3. call reverse() to do reverse dns (ala resolve()).
-**   4. enjoy.
+**   4. set_notify() to have a function called (from the resolver thread) whenever
+**      something has resolved, rather than polling, e.g. JNL_Reactor::wakeup_func.
+**   5. enjoy.
 */
 
 #ifndef _ASYNCDNS_H_
@@ -47,6 +49,8 @@ public:
   int resolve(const char *hostname, unsigned int *addr); // return 0 on success, 1 on wait, -1 on unresolvable
   int reverse(unsigned int addr, char *hostname); // return 0 on success, 1 on wait, -1 on unresolvable. hostname must be at least 256 bytes.
 
+  void set_notify(void (*func)(void *ctx), void *ctx) { m_notify_ctx=ctx; m_notify=func; } // set before resolving
+
 private:
   typedef struct 
   {
@@ -61,6 +65,8 @@ private:
   cache_entry *m_cache;
   int m_cache_size;
   volatile int m_thread_kill;
+  void (*m_notify)(void *ctx);
+  void *m_notify_ctx;
 #ifdef _WIN32
   HANDLE m_thread;
   static unsigned WINAPI _threadfunc(void *_d);
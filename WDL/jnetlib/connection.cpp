@@ -10,6 +10,21 @@
 #include "netinc.h"
 #include "util.h"
 #include "connection.h"
+#ifdef _WIN32
+  // winsock 1.1 has no WSASend(), the pieces get sent one by one
+  struct jnl_iovec { char *buf; int len; };
+  #define JNL_IOV_SET(v,p,l) { (v).buf=(char *)(p); (v).len=(int)(l); }
+#else
+  #include <poll.h>
+  #include <sys/uio.h>
+  #ifdef __linux__
+    #include <sys/sendfile.h>
+  #endif
+  typedef struct iovec jnl_iovec;
+  #define JNL_IOV_SET(v,p,l) { (v).iov_base=(void *)(p); (v).iov_len=(size_t)(l); }
+#endif
+
+#define JNL_MAX_IOV 16
 
 
 JNL_Connection::JNL_Connection(JNL_IAsyncDNS *dns, int sendbufsize, int recvbufsize)
@@ -33,6 +48,7 @@ JNL_Connection::JNL_Connection(JNL_IAsyncDNS *dns, int sendbufsize, int recvbufs
   m_localinterfacereq=INADDR_ANY;
   m_recv_len=m_recv_pos=0;
   m_send_len=m_send_pos=0;
+  m_send_extents_len=0;
   m_host[0]=0;
   m_saddr = new struct sockaddr_in;
   memset(m_saddr,0,sizeof(struct sockaddr_in));
@@ -104,6 +120,7 @@ JNL_Connection::~JNL_Connection()
     ::closesocket(m_socket);
     m_socket=INVALID_SOCKET;
   }
+  clear_extents();
   if (m_dns_owned) 
   {
     delete m_dns;
@@ -113,7 +130,7 @@ JNL_Connection::~JNL_Connection()
 
 void JNL_Connection::run(int max_send_bytes, int max_recv_bytes, int *bytes_sent, int *bytes_rcvd)
 {
-  int bytes_allowed_to_send=(max_send_bytes<0)?m_send_buffer.GetSize():max_send_bytes;
+  int bytes_allowed_to_send=(max_send_bytes<0)?0x7fffffff:max_send_bytes; // owned buffers and files can be more than the send buffer
   int bytes_allowed_to_recv=(max_recv_bytes<0)?m_recv_buffer.GetSize():max_recv_bytes;
 
   if (bytes_sent) *bytes_sent=0;
@@ -150,7 +167,8 @@ void JNL_Connection::run(int max_send_bytes, int max_recv_bytes, int *bytes_sent
       else { m_state=STATE_CONNECTING; }
     break;
     case STATE_CONNECTING:
-      {		
+      {
+#ifdef _WIN32
         fd_set f[3];
         FD_ZERO(&f[0]);
         FD_ZERO(&f[1]);
@@ -160,13 +178,7 @@ void JNL_Connection::run(int max_send_bytes, int max_recv_bytes, int *bytes_sent
         FD_SET(m_socket,&f[2]);
         struct timeval tv;
         memset(&tv,0,sizeof(tv));
-        if (select(
-#ifdef _WIN32
-          0
-#else
-          m_socket+1
-#endif
-          ,&f[0],&f[1],&f[2],&tv)==-1)
+        if (select(0,&f[0],&f[1],&f[2],&tv)==-1)
         {
           m_errorstr="connecting to host (calling select())";
           m_state=STATE_ERROR;
@@ -180,53 +192,44 @@ void JNL_Connection::run(int max_send_bytes, int max_recv_bytes, int *bytes_sent
           m_errorstr="connecting to host";
           m_state=STATE_ERROR;
         }
+#else
+        // poll() rather than select(), which can't take sockets past FD_SETSIZE
+        struct pollfd pfd;
+        pfd.fd=m_socket;
+        pfd.events=POLLOUT;
+        pfd.revents=0;
+        if (poll(&pfd,1,0)==-1)
+        {
+          m_errorstr="connecting to host (calling poll())";
+          m_state=STATE_ERROR;
+        }
+        else if (pfd.revents&(POLLERR|POLLHUP))
+        {
+          m_errorstr="connecting to host";
+          m_state=STATE_ERROR;
+        }
+        else if (pfd.revents&POLLOUT)
+        {
+          m_state=STATE_CONNECTED;
+        }
+#endif
       }
     break;
     case STATE_CONNECTED:
     case STATE_CLOSING:
-      if (m_send_len>0 && bytes_allowed_to_send>0)
+      while (bytes_allowed_to_send>0 && (m_send_len>0 || m_send_extents.GetSize()))
       {
-        int len=m_send_buffer.GetSize()-m_send_pos;
-        if (len > m_send_len) len=m_send_len;
-        if (len > bytes_allowed_to_send) len=bytes_allowed_to_send;
-        if (len > 0)
-        {
-          int res=::send(m_socket,(char*)m_send_buffer.Get()+m_send_pos,len,0);
-          if (res==-1 && ERRNO != EWOULDBLOCK)
-          {            
-//            m_state=STATE_CLOSED;
-//            return;
-          }
-          if (res>0)
-          {
-            bytes_allowed_to_send-=res;
-            if (bytes_sent) *bytes_sent+=res;
-            m_send_pos+=res;
-            m_send_len-=res;
-          }
-        }
-        if (m_send_pos>=m_send_buffer.GetSize()) 
+        int res=send_queued(bytes_allowed_to_send);
+        if (res<0)
         {
-          m_send_pos=0;
-          if (m_send_len>0)
-          {
-            len=m_send_buffer.GetSize()-m_send_pos;
-            if (len > m_send_len) len=m_send_len;
-            if (len > bytes_allowed_to_send) len=bytes_allowed_to_send;
-            int res=::send(m_socket,(char*)m_send_buffer.Get()+m_send_pos,len,0);
-            if (res==-1 && ERRNO != EWOULDBLOCK)
-            {
-//              m_state=STATE_CLOSED;
-            }
-            if (res>0)
-            {
-              bytes_allowed_to_send-=res;
-              if (bytes_sent) *bytes_sent+=res;
-              m_send_pos+=res;
-              m_send_len-=res;
-            }
-          }
+          m_errorstr="reading file to send";
+          m_state=STATE_ERROR;
+          return;
         }
+        if (!res) break;
+
+        bytes_allowed_to_send-=res;
+        if (bytes_sent) *bytes_sent+=res;
       }
       if (m_recv_len<m_recv_buffer.GetSize())
       {
@@ -277,13 +280,25 @@ void JNL_Connection::run(int max_send_bytes, int max_recv_bytes, int *bytes_sent
       }
       if (m_state == STATE_CLOSING)
       {
-        if (m_send_len < 1) m_state = STATE_CLOSED;
+        if (m_send_len < 1 && !m_send_extents.GetSize()) m_state = STATE_CLOSED;
       }
     break;
     default: break;
   }
 }
 
+int JNL_Connection::get_wanted_events()
+{
+  switch (m_state)
+  {
+    case STATE_CONNECTING: return JNL_EV_WRITE;
+    case STATE_CONNECTED:
+    case STATE_CLOSING:
+      return (m_recv_len<m_recv_buffer.GetSize() ? JNL_EV_READ : 0) | (m_send_len>0 || m_send_extents.GetSize() ? JNL_EV_WRITE : 0);
+    default: return 0;
+  }
+}
+
 void JNL_Connection::close(int quick)
 {
   if (quick || m_state == STATE_RESOLVING || m_state == STATE_CONNECTING)
@@ -298,6 +313,7 @@ void JNL_Connection::close(int quick)
     m_remote_port=0;
     m_recv_len=m_recv_pos=0;
     m_send_len=m_send_pos=0;
+    clear_extents();
     m_host[0]=0;
     memset(m_saddr,0,sizeof(struct sockaddr_in));
   }
@@ -309,12 +325,168 @@ void JNL_Connection::close(int quick)
 
 int JNL_Connection::send_bytes_in_queue(void)
 {
-  return m_send_len;
+  const WDL_INT64 a=m_send_len+m_send_extents_len;
+  return a < 0x7fffffff ? (int)a : 0x7fffffff;
 }
 
 int JNL_Connection::send_bytes_available(void)
 {
-  return m_send_buffer.GetSize()-m_send_len;
+  // owned buffers/files count against the send buffer size, so whoever is filling it waits for them
+  const WDL_INT64 a=m_send_buffer.GetSize()-m_send_len-m_send_extents_len;
+  return a > 0 ? (int)a : 0;
+}
+
+int JNL_Connection::send_owned(void *data, int length, void (*freefunc)(void *))
+{
+  if (!freefunc) freefunc=free;
+  if (length<1)
+  {
+    freefunc(data);
+    return 0;
+  }
+  send_extent e = { (char *)data, freefunc, -1, 0, length };
+  if (!m_send_extents.Add(&e,1))
+  {
+    freefunc(data);
+    return -1;
+  }
+  m_send_extents_len+=length;
+  return 0;
+}
+
+int JNL_Connection::send_file(int fd, WDL_INT64 offset, WDL_INT64 length)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  if (length<1) return 0;
+  if (fd<0 || offset<0) return -1;
+  const int nfd=dup(fd); // the caller can close theirs whenever
+  if (nfd<0) return -1;
+  send_extent e = { NULL, NULL, nfd, offset, length };
+  if (!m_send_extents.Add(&e,1))
+  {
+    ::close(nfd);
+    return -1;
+  }
+  m_send_extents_len+=length;
+  return 0;
+#endif
+}
+
+void JNL_Connection::clear_extents()
+{
+  send_extent *e=m_send_extents.Get();
+  int x;
+  for (x = 0; x < m_send_extents.GetSize(); x ++)
+  {
+    if (e[x].buf) e[x].freefunc(e[x].buf);
+#ifndef _WIN32
+    else ::close(e[x].fd);
+#endif
+  }
+  m_send_extents.Clear();
+  m_send_extents_len=0;
+}
+
+int JNL_Connection::send_queued(int maxlen)
+{
+  // the send buffer (in two pieces if it wraps) and the owned buffers after it go out in one call
+  jnl_iovec iov[JNL_MAX_IOV];
+  int niov=0, tot=0;
+  int left=m_send_len, pos=m_send_pos;
+  while (left>0 && tot<maxlen)
+  {
+    int len=m_send_buffer.GetSize()-pos;
+    if (len > left) len=left;
+    if (len > maxlen-tot) len=maxlen-tot;
+    JNL_IOV_SET(iov[niov],m_send_buffer.Get()+pos,len);
+    niov++;
+    tot+=len;
+    left-=len;
+    pos=0;
+  }
+
+  send_extent *e=m_send_extents.Get();
+  const int ne=m_send_extents.GetSize();
+  int x;
+  for (x = 0; !left && x < ne && e[x].buf && niov < JNL_MAX_IOV && tot<maxlen; x ++)
+  {
+    int len=maxlen-tot;
+    if (len > e[x].len) len=(int)e[x].len;
+    JNL_IOV_SET(iov[niov],e[x].buf+e[x].pos,len);
+    niov++;
+    tot+=len;
+  }
+
+  int res=0;
+  if (niov)
+  {
+#ifdef _WIN32
+    for (x = 0; x < niov; x ++)
+    {
+      const int r=::send(m_socket,iov[x].buf,iov[x].len,0);
+      if (r>0) res+=r;
+      if (r<iov[x].len) break;
+    }
+#elif defined(MSG_MORE)
+    // if a file is next, have the kernel hold this for it rather than sending the header on its own
+    struct msghdr msg;
+    memset(&msg,0,sizeof(msg));
+    msg.msg_iov=iov;
+    msg.msg_iovlen=niov;
+    res=(int)sendmsg(m_socket,&msg,(!left && x < ne && !e[x].buf && tot<maxlen) ? MSG_MORE : 0);
+#else
+    res=(int)writev(m_socket,iov,niov);
+#endif
+  }
+#ifndef _WIN32
+  else if (ne && e[0].fd>=0)
+  {
+    int len=maxlen;
+    if (len > e[0].len) len=(int)e[0].len;
+#ifdef __linux__
+    off_t o=(off_t)e[0].pos;
+    res=(int)sendfile(m_socket,e[0].fd,&o,len);
+    if (!res && len>0) return -1; // the file got shorter
+    if (res<0 && ERRNO!=EINVAL && ERRNO!=ENOSYS) return ERRNO==EWOULDBLOCK || ERRNO==EAGAIN ? 0 : -1;
+    if (res<0)
+#endif
+    {
+      char buf[16384];
+      if (len > (int)sizeof(buf)) len=(int)sizeof(buf);
+      const int rd=(int)pread(e[0].fd,buf,len,(off_t)e[0].pos);
+      if (rd<1) return -1; // the file got shorter, or can't be read
+      res=::send(m_socket,buf,rd,0); // if not all of it goes, the rest gets read again next time
+    }
+  }
+#endif
+  if (res<1) return 0; // the socket is full, or has an error that recv() will find
+
+  int a = res < m_send_len ? res : m_send_len;
+  m_send_pos+=a;
+  if (m_send_pos >= m_send_buffer.GetSize()) m_send_pos-=m_send_buffer.GetSize();
+  m_send_len-=a;
+
+  for (a=res-a; a>0; )
+  {
+    e=m_send_extents.Get();
+    int used = a < e->len ? a : (int)e->len;
+    e->pos+=used;
+    e->len-=used;
+    m_send_extents_len-=used;
+    a-=used;
+    if (e->len<1)
+    {
+      if (e->buf) e->freefunc(e->buf);
+#ifndef _WIN32
+      else ::close(e->fd);
+#endif
+      m_send_extents.Advance(1);
+    }
+  }
+  m_send_extents.Compact();
+  return res;
 }
 
 int JNL_Connection::send(const void *_data, int length)
@@ -324,6 +496,16 @@ int JNL_Connection::send(const void *_data, int length)
   {
     return -1;
   }
+  if (m_send_extents.GetSize())
+  {
+    // after what is already queued, so it can't go in the send buffer. the copy counts against
+    // send_bytes_available() like any owned buffer, so this is bounded by the send buffer size.
+    if (length<1) return 0;
+    void *p=malloc(length);
+    if (!p) return -1;
+    memcpy(p,data,length);
+    return send_owned(p,length);
+  }
   
   int write_pos=m_send_pos+m_send_len;
   if (write_pos >= m_send_buffer.GetSize()) 
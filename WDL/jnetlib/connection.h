@@ -42,6 +42,10 @@
 **      send_bytes_available() to see how much you can write. If you use send()
 **      or send_string() and not enough room is available, both functions will 
 **      return error ( < 0)
+**      send_owned() and send_file() queue data without copying it into the send buffer: a
+**      buffer the connection frees once it is sent, or a range of a file, which goes out with
+**      sendfile() where there is one. Everything goes out in the order it was queued, the send
+**      buffer and any owned buffers after it are written with one writev() (not on win32).
 **   6. Use recv() and recv_line() to get data. If you want to see how much data 
 **      there is, use recv_bytes_available() and recv_lines_available(). If you 
 **      call recv() and not enough data is available, recv() will return how much
@@ -51,6 +55,10 @@
 **      make the socket close after sending all the data sent. 
 **  
 **   8. delete ye' ol' object.
+**
+**   To run a lot of connections without polling each one, add get_socket() to a JNL_Reactor
+**   with get_wanted_events(), and only call run() once the reactor says it is ready (and when
+**   you have queued something to send). get_socket() can change on connect()/close().
 */
 
 #ifndef _CONNECTION_H_
@@ -58,7 +66,9 @@
 
 #include "asyncdns.h"
 #include "netinc.h"
+#include "reactor.h"
 #include "../heapbuf.h"
+#include "../queue.h"
 
 #define JNL_CONNECTION_AUTODNS ((JNL_IAsyncDNS*)-1)
 
@@ -84,6 +94,8 @@ class JNL_IConnection
     virtual int send(const void *data, int length)=0; // returns -1 if not enough room
     virtual int send_bytes(const void *data, int length)=0;
     virtual int send_string(const char *line)=0;      // returns -1 if not enough room
+    virtual int send_owned(void *data, int length, void (*freefunc)(void *)=NULL)=0; // frees data with freefunc (or free()) once sent
+    virtual int send_file(int fd, WDL_INT64 offset, WDL_INT64 length)=0; // fd is dup()ed. returns -1 if not supported
 
     virtual int recv_bytes_available(void)=0;
     virtual int recv_bytes(void *data, int maxlength)=0; // returns actual bytes read
@@ -100,6 +112,9 @@ class JNL_IConnection
     virtual short get_remote_port(void)=0; // this returns the remote port of connection
 
     virtual void set_interface(int useInterface)=0; // call before connect if needed
+
+    virtual SOCKET get_socket()=0; // INVALID_SOCKET if none
+    virtual int get_wanted_events()=0; // JNL_EV_READ|JNL_EV_WRITE for JNL_Reactor, 0 when waiting on DNS
   };
 
   #define JNL_Connection_PARENTDEF : public JNL_IConnection
@@ -135,13 +150,17 @@ class JNL_Connection JNL_Connection_PARENTDEF
     const char *get_errstr() { return m_errorstr; }
 
     void close(int quick=0);
-    void flush_send(void) { m_send_len=m_send_pos=0; }
+    void flush_send(void) { m_send_len=m_send_pos=0; clear_extents(); }
 
     int send_bytes_in_queue(void);
     int send_bytes_available(void);
     int send(const void *data, int length); // returns -1 if not enough room
+                                            // (owned buffers and files still queued use up room, and while any are
+                                            // queued the data is copied into a block of its own after them)
     inline int send_bytes(const void *data, int length) { return send(data, length); }
     int send_string(const char *line);      // returns -1 if not enough room
+    int send_owned(void *data, int length, void (*freefunc)(void *)=NULL); // frees data with freefunc (or free()) once sent
+    int send_file(int fd, WDL_INT64 offset, WDL_INT64 length); // fd is dup()ed. returns -1 if not supported
 
 
     int recv_bytes_available(void);
@@ -160,6 +179,9 @@ class JNL_Connection JNL_Connection_PARENTDEF
   
     void set_interface(int useInterface); // call before connect if needed
 
+    SOCKET get_socket() { return m_socket; }
+    int get_wanted_events();
+
   protected:
     SOCKET m_socket;
     short m_remote_port;
@@ -171,6 +193,17 @@ class JNL_Connection JNL_Connection_PARENTDEF
     int  m_send_pos;
     int  m_send_len;
 
+    // queued after the send buffer by send_owned()/send_file()
+    struct send_extent
+    {
+      char *buf; // NULL for a file
+      void (*freefunc)(void *);
+      int fd;
+      WDL_INT64 pos, len; // offset into buf or fd, bytes left
+    };
+    WDL_TypedQueue<send_extent> m_send_extents;
+    WDL_INT64 m_send_extents_len;
+
     int m_localinterfacereq;
     struct sockaddr_in *m_saddr;
     char m_host[256];
@@ -182,6 +215,8 @@ class JNL_Connection JNL_Connection_PARENTDEF
     const char *m_errorstr;
 
     int getbfromrecv(int pos, int remove); // used by recv_line*
+    void clear_extents();
+    int send_queued(int maxlen); // returns bytes sent, 0 if the socket is full, -1 on error
 
 };
 
@@ -51,6 +51,36 @@ void JNL_HTTPServ::write_bytes(const char *bytes, int length)
   if (m_usechunk) m_con->send_string("\r\n");
 }
 
+static void nofree(void *p) { }
+
+void JNL_HTTPServ::write_owned(char *bytes, int length, void (*freefunc)(void *))
+{
+  // the chunk framing can't be dropped when an owned buffer already fills the send buffer, so it is queued
+  // the same way as the data
+  if (m_usechunk)
+  {
+    char buf[32];
+    const int l=sprintf(buf,"%x\r\n",length);
+    if (m_con->send(buf,l)<0)
+    {
+      char *p=(char *)malloc(l);
+      if (p)
+      {
+        memcpy(p,buf,l);
+        m_con->send_owned(p,l);
+      }
+    }
+  }
+  m_con->send_owned(bytes,length,freefunc);
+  if (m_usechunk) m_con->send_owned((void *)"\r\n",2,nofree);
+}
+
+int JNL_HTTPServ::write_file(int fd, WDL_INT64 offset, WDL_INT64 length)
+{
+  if (m_usechunk) return -1; // the chunk header would be out before we knew if the file could go
+  return m_con->send_file(fd,offset,length);
+}
+
 bool JNL_HTTPServ::want_keepalive_reset()
 {
   if (m_state >= 2 && m_con && m_con->get_state() == JNL_Connection::STATE_CONNECTED)
@@ -45,6 +45,8 @@ class JNL_IHTTPServ
     virtual int bytes_inqueue()=0;
     virtual int bytes_cansend()=0;
     virtual void write_bytes(const char *bytes, int length)=0;
+    virtual void write_owned(char *bytes, int length, void (*freefunc)(void *)=NULL)=0; // bytes are freed with freefunc (or free()) once sent
+    virtual int write_file(int fd, WDL_INT64 offset, WDL_INT64 length)=0; // returns -1 if it can't (chunked, or no file support), nothing is written then
 
     virtual void close(int quick)=0;
 
@@ -89,6 +91,8 @@ class JNL_HTTPServ JNL_HTTPServ_PARENTDEF
     int bytes_inqueue() { if (m_state == 3 || m_state == -1 || m_state ==4) return m_con->send_bytes_in_queue(); else return 0; }
     int bytes_cansend() { if (m_state == 3) return m_con->send_bytes_available() - (m_usechunk?16:0); else return 0; }
     void write_bytes(const char *bytes, int length);
+    void write_owned(char *bytes, int length, void (*freefunc)(void *)=NULL); // bytes are freed with freefunc (or free()) once sent
+    int write_file(int fd, WDL_INT64 offset, WDL_INT64 length); // returns -1 if it can't (chunked, or no file support), nothing is written then
 
     void close(int quick) { m_con->close(quick); m_state=4; }
 
@@ -11,6 +11,7 @@
 **  TCP connections: connection.h
 **  HTTP GET connections: httpget.h
 **  TCP listen: listen.h
+**  Waiting on many sockets: reactor.h
 **
 **  license: 
 **
@@ -43,5 +44,6 @@
 #include "httpget.h"
 #include "httpserv.h"
 #include "listen.h"
+#include "reactor.h"
 
 #endif//_JNETLIB_H_
@@ -35,7 +35,7 @@ JNL_Listen::JNL_Listen(short port, unsigned int which_interface)
     }
     else
     {  
-      if (::listen(m_socket,8)==-1) 
+      if (::listen(m_socket,SOMAXCONN)==-1) 
       {
         closesocket(m_socket);
         m_socket=INVALID_SOCKET;
@@ -63,6 +63,9 @@ JNL_IConnection *JNL_Listen::get_connect(int sendbufsize, int recvbufsize)
   SOCKET s = accept(m_socket, (struct sockaddr *) &saddr, &length);
   if (s != INVALID_SOCKET)
   {
+    // replies are queued whole and then sent, so don't let Nagle hold back their last segment
+    int nodelay=1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, sizeof(nodelay));
     JNL_IConnection *c=new JNL_Connection(NULL,sendbufsize, recvbufsize);
     c->connect(s,&saddr);
     return c;
@@ -13,6 +13,8 @@
 **      buffer sizes the connection should be created with)
 **   3. check is_error() to see if an error has occured
 **   4. call port() if you forget what port the listener is on.
+**   5. get_socket() can be added to a JNL_Reactor for reading, it is readable when
+**      get_connect() has a connection for you.
 **
 */
 
@@ -31,6 +33,7 @@
       virtual JNL_IConnection *get_connect(int sendbufsize=8192, int recvbufsize=8192)=0;
       virtual short port(void)=0;
       virtual int is_error(void)=0;
+      virtual SOCKET get_socket(void)=0;
   };
 
   #define JNL_Listen_PARENTDEF : public JNL_IListen
@@ -51,6 +54,7 @@ class JNL_Listen JNL_Listen_PARENTDEF
     JNL_IConnection *get_connect(int sendbufsize=8192, int recvbufsize=8192);
     short port(void) { return m_port; }
     int is_error(void) { return (m_socket == INVALID_SOCKET); }
+    SOCKET get_socket(void) { return m_socket; }
 
   protected:
     SOCKET m_socket;
@@ -11,6 +11,10 @@
 
 #ifdef _WIN32
 
+// winsock's fd_set holds 64 sockets unless this is defined before it is included, JNL_Reactor needs more
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 4096
+#endif
 #include <windows.h>
 #include <stdio.h>
 #include <time.h>
@@ -37,6 +41,7 @@ typedef int socklen_t;
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -0,0 +1,250 @@
+/*
+** JNetLib
+** Copyright (C) 2008 Cockos Inc
+** Author: Justin Frankel
+** File: reactor.cpp - JNL socket readiness notification implementation
+** License: see jnetlib.h
+*/
+
+#include "netinc.h"
+#include "util.h"
+#include "reactor.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#ifdef _WIN32
+  #ifndef POLLIN
+    #define POLLIN 1
+    #define POLLOUT 4
+    #define POLLERR 8
+    #define POLLHUP 16
+  #endif
+#endif
+
+JNL_Reactor::JNL_Reactor()
+{
+  m_error=0;
+  m_size=0;
+  m_wake[0]=m_wake[1]=INVALID_SOCKET;
+
+#ifdef __linux__
+  m_epfd=epoll_create1(EPOLL_CLOEXEC);
+  m_wake[0]=m_wake[1]=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+  if (m_epfd<0 || m_wake[0]<0) m_error=1;
+  else
+  {
+    struct epoll_event ev;
+    memset(&ev,0,sizeof(ev));
+    ev.events=EPOLLIN;
+    ev.data.ptr=NULL;
+    if (epoll_ctl(m_epfd,EPOLL_CTL_ADD,m_wake[0],&ev)) m_error=1;
+  }
+#else
+
+#ifdef _WIN32
+  // a UDP socket connected to itself, since select() only takes sockets
+  m_wake[0]=m_wake[1]=::socket(AF_INET,SOCK_DGRAM,0);
+  if (m_wake[0]!=INVALID_SOCKET)
+  {
+    struct sockaddr_in sin;
+    memset(&sin,0,sizeof(sin));
+    sin.sin_family=AF_INET;
+    sin.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    socklen_t len=sizeof(sin);
+    if (::bind(m_wake[0],(struct sockaddr *)&sin,sizeof(sin)) ||
+        ::getsockname(m_wake[0],(struct sockaddr *)&sin,&len) ||
+        ::connect(m_wake[0],(struct sockaddr *)&sin,sizeof(sin)))
+    {
+      closesocket(m_wake[0]);
+      m_wake[0]=m_wake[1]=INVALID_SOCKET;
+    }
+    else SET_SOCK_BLOCK(m_wake[0],0);
+  }
+#else
+  int fds[2];
+  if (!pipe(fds))
+  {
+    m_wake[0]=fds[0];
+    m_wake[1]=fds[1];
+    SET_SOCK_BLOCK(m_wake[0],0);
+    SET_SOCK_BLOCK(m_wake[1],0);
+  }
+#endif
+
+  if (m_wake[0]==INVALID_SOCKET) m_error=1;
+  jnl_pollfd *p=m_pollfds.Resize(1);
+  p->fd=m_wake[0];
+  p->events=POLLIN;
+  p->revents=0;
+  m_userdata.Resize(1);
+  m_userdata.Get()[0]=NULL;
+#endif
+}
+
+JNL_Reactor::~JNL_Reactor()
+{
+#ifdef __linux__
+  if (m_epfd>=0) close(m_epfd);
+#endif
+  if (m_wake[1]!=INVALID_SOCKET && m_wake[1]!=m_wake[0]) closesocket(m_wake[1]);
+  if (m_wake[0]!=INVALID_SOCKET) closesocket(m_wake[0]);
+}
+
+int JNL_Reactor::add(SOCKET s, int events, void *userdata)
+{
+  if (m_error || s==INVALID_SOCKET) return -1;
+#ifdef __linux__
+  struct epoll_event ev;
+  memset(&ev,0,sizeof(ev));
+  ev.events=((events&JNL_EV_READ)?EPOLLIN:0) | ((events&JNL_EV_WRITE)?EPOLLOUT:0);
+  ev.data.ptr=userdata;
+  if (epoll_ctl(m_epfd,EPOLL_CTL_ADD,s,&ev)) return -1;
+#else
+#ifdef _WIN32
+  if (m_pollfds.GetSize() >= FD_SETSIZE) return -1; // select() can't take it, the caller polls it instead
+#endif
+  if (m_index.Exists((INT_PTR)s)) return -1;
+  const int idx=m_pollfds.GetSize();
+  jnl_pollfd *p=m_pollfds.ResizeOK(idx+1,false);
+  void **u=m_userdata.ResizeOK(idx+1,false);
+  if (!p || !u) return -1;
+  p+=idx;
+  p->fd=s;
+  p->events=((events&JNL_EV_READ)?POLLIN:0) | ((events&JNL_EV_WRITE)?POLLOUT:0);
+  p->revents=0;
+  u[idx]=userdata;
+  m_index.Insert((INT_PTR)s,idx);
+#endif
+  m_size++;
+  return 0;
+}
+
+int JNL_Reactor::modify(SOCKET s, int events, void *userdata)
+{
+  if (m_error || s==INVALID_SOCKET) return -1;
+#ifdef __linux__
+  struct epoll_event ev;
+  memset(&ev,0,sizeof(ev));
+  ev.events=((events&JNL_EV_READ)?EPOLLIN:0) | ((events&JNL_EV_WRITE)?EPOLLOUT:0);
+  ev.data.ptr=userdata;
+  if (epoll_ctl(m_epfd,EPOLL_CTL_MOD,s,&ev)) return -1;
+#else
+  int *idx=m_index.GetPtr((INT_PTR)s);
+  if (!idx) return -1;
+  m_pollfds.Get()[*idx].events=((events&JNL_EV_READ)?POLLIN:0) | ((events&JNL_EV_WRITE)?POLLOUT:0);
+  m_userdata.Get()[*idx]=userdata;
+#endif
+  return 0;
+}
+
+void JNL_Reactor::remove(SOCKET s)
+{
+  if (m_error || s==INVALID_SOCKET) return;
+#ifdef __linux__
+  struct epoll_event ev; // ignored, but pre-2.6.9 kernels want one
+  if (!epoll_ctl(m_epfd,EPOLL_CTL_DEL,s,&ev)) m_size--;
+#else
+  int *pidx=m_index.GetPtr((INT_PTR)s);
+  if (!pidx) return;
+  const int idx=*pidx;
+  m_index.Delete((INT_PTR)s);
+
+  // move the last one into the hole
+  const int last=m_pollfds.GetSize()-1;
+  if (idx != last)
+  {
+    m_pollfds.Get()[idx]=m_pollfds.Get()[last];
+    m_userdata.Get()[idx]=m_userdata.Get()[last];
+    m_index.Insert((INT_PTR)m_pollfds.Get()[idx].fd,idx);
+  }
+  m_pollfds.Resize(last,false);
+  m_userdata.Resize(last,false);
+  m_size--;
+#endif
+}
+
+void JNL_Reactor::wakeup()
+{
+#ifdef __linux__
+  WDL_UINT64 v=1;
+  if (write(m_wake[1],&v,sizeof(v))<0) { } // already set, or there's nothing to wake
+#elif defined(_WIN32)
+  char c=0;
+  ::send(m_wake[1],&c,1,0);
+#else
+  char c=0;
+  if (write(m_wake[1],&c,1)<0) { } // pipe full, wait() wakes up anyway
+#endif
+}
+
+void JNL_Reactor::drain_wakeup()
+{
+#ifdef __linux__
+  WDL_UINT64 v;
+  if (read(m_wake[0],&v,sizeof(v))<0) { }
+#else
+  char buf[256];
+  while (::recv(m_wake[0],buf,sizeof(buf),0)>0);
+#endif
+}
+
+int JNL_Reactor::wait(JNL_ReactorEvent *evts, int maxevts, int timeout_ms)
+{
+  if (m_error || maxevts<1) return 0;
+
+  int n=0;
+#ifdef __linux__
+  struct epoll_event *ep=m_epevts.ResizeOK(maxevts,false);
+  if (!ep) return 0;
+  const int rv=epoll_wait(m_epfd,ep,maxevts,timeout_ms);
+  for (int x = 0; x < rv; x ++)
+  {
+    if (!ep[x].data.ptr) drain_wakeup();
+    evts[n].userdata=ep[x].data.ptr;
+    evts[n].events=((ep[x].events&EPOLLIN)?JNL_EV_READ:0) | ((ep[x].events&EPOLLOUT)?JNL_EV_WRITE:0) |
+                   ((ep[x].events&(EPOLLERR|EPOLLHUP))?JNL_EV_ERROR:0);
+    n++;
+  }
+#else
+  jnl_pollfd *p=m_pollfds.Get();
+  const int np=m_pollfds.GetSize();
+#ifdef _WIN32
+  // fd_set is an array of FD_SETSIZE sockets here (see netinc.h), add() keeps within that
+  fd_set f[3];
+  FD_ZERO(&f[0]);
+  FD_ZERO(&f[1]);
+  FD_ZERO(&f[2]);
+  int x;
+  for (x = 0; x < np; x ++)
+  {
+    if (p[x].events&POLLIN) FD_SET(p[x].fd,&f[0]);
+    if (p[x].events&POLLOUT) FD_SET(p[x].fd,&f[1]);
+    FD_SET(p[x].fd,&f[2]);
+  }
+  struct timeval tv;
+  tv.tv_sec=timeout_ms/1000;
+  tv.tv_usec=(timeout_ms%1000)*1000;
+  int rv=select(0,&f[0],&f[1],&f[2],timeout_ms<0?NULL:&tv);
+  for (x = 0; x < np && rv>0; x ++)
+  {
+    p[x].revents=(FD_ISSET(p[x].fd,&f[0])?POLLIN:0) | (FD_ISSET(p[x].fd,&f[1])?POLLOUT:0) | (FD_ISSET(p[x].fd,&f[2])?POLLERR:0);
+  }
+#else
+  int rv=poll(p,np,timeout_ms);
+#endif
+  for (int x = 0; x < np && rv>0 && n<maxevts; x ++)
+  {
+    if (!p[x].revents) continue;
+    rv--;
+    if (!x) drain_wakeup();
+    evts[n].userdata=m_userdata.Get()[x];
+    evts[n].events=((p[x].revents&POLLIN)?JNL_EV_READ:0) | ((p[x].revents&POLLOUT)?JNL_EV_WRITE:0) |
+                   ((p[x].revents&(POLLERR|POLLHUP))?JNL_EV_ERROR:0);
+    p[x].revents=0;
+    n++;
+  }
+#endif
+  return n;
+}
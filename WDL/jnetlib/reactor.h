@@ -0,0 +1,90 @@
+/*
+** JNetLib
+** Copyright (C) 2008 Cockos Inc
+** Author: Justin Frankel
+** File: reactor.h - JNL socket readiness notification (epoll on Linux, poll/select elsewhere)
+** License: see jnetlib.h
+**
+** Usage:
+**   1. Create a JNL_Reactor, check is_error().
+**   2. add() each socket with the events you want (JNL_EV_READ and/or JNL_EV_WRITE),
+**      and a userdata pointer that comes back with its events. modify() changes them,
+**      remove() before closing the socket.
+**   3. Call wait() with an array for the events. It blocks until at least one of the sockets
+**      is ready, wakeup() is called, or the timeout (ms, -1 for none) runs out, and returns
+**      the number of events filled in. Events are level triggered, a socket that is still
+**      ready is reported again on the next wait().
+**   4. wakeup() can be called from any thread. wait() reports it as an event with
+**      userdata=NULL. JNL_AsyncDNS::set_notify(JNL_Reactor::wakeup_func, reactor) uses it,
+**      so a reactor loop finds out when a JNL_Connection has finished resolving.
+**
+**   For a JNL_Connection, get_socket() and get_wanted_events() say what to wait for, call
+**   run() when the socket is ready and update the events afterwards. JNL_Listen has
+**   get_socket() too, it is readable when get_connect() has a connection.
+**   WebServerBaseClass does all this itself, see run_wait() there.
+*/
+
+#ifndef _JNL_REACTOR_H_
+#define _JNL_REACTOR_H_
+
+#include "netinc.h"
+#include "../heapbuf.h"
+
+#ifdef __linux__
+  #include <sys/epoll.h>
+#else
+  #include "../hashmap.h"
+  #ifdef _WIN32
+    struct jnl_pollfd { SOCKET fd; short events, revents; }; // select() underneath
+  #else
+    #include <poll.h>
+    typedef struct pollfd jnl_pollfd;
+  #endif
+#endif
+
+#define JNL_EV_READ 1
+#define JNL_EV_WRITE 2
+#define JNL_EV_ERROR 4 // only ever reported, the socket has an error or has hung up
+
+struct JNL_ReactorEvent
+{
+  void *userdata;
+  int events;
+};
+
+class JNL_Reactor
+{
+  public:
+    JNL_Reactor();
+    ~JNL_Reactor();
+
+    int is_error() { return m_error; }
+
+    int add(SOCKET s, int events, void *userdata); // returns 0 on success
+    int modify(SOCKET s, int events, void *userdata);
+    void remove(SOCKET s);
+    int get_size() { return m_size; } // sockets added
+
+    int wait(JNL_ReactorEvent *evts, int maxevts, int timeout_ms);
+
+    void wakeup();
+    static void wakeup_func(void *reactor) { ((JNL_Reactor *)reactor)->wakeup(); }
+
+  protected:
+    int m_error;
+    int m_size;
+    SOCKET m_wake[2]; // [0] is waited on, wakeup() makes it readable
+
+#ifdef __linux__
+    int m_epfd;
+    WDL_TypedBuf<struct epoll_event> m_epevts;
+#else
+    WDL_TypedBuf<jnl_pollfd> m_pollfds; // [0] is m_wake[0]
+    WDL_TypedBuf<void *> m_userdata; // parallel to m_pollfds
+    WDL_PtrHashMap<int> m_index; // socket -> index in m_pollfds
+#endif
+
+    void drain_wakeup();
+};
+
+#endif //_JNL_REACTOR_H_
@@ -107,6 +107,10 @@ SOURCE=.\listen.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\reactor.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\test.cpp
 # End Source File
 # Begin Source File
@@ -147,6 +151,10 @@ SOURCE=.\listen.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\reactor.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\netinc.h
 # End Source File
 # Begin Source File
@@ -25,12 +25,18 @@ WebServerBaseClass::WebServerBaseClass()
   m_listener_rot=0;
   m_timeout_s=30;
   m_max_con=100;
+  m_listeners_added=true;
+  m_last_sweep=0;
+  m_gen_wake=0;
+  m_reactor_evts.Resize(256);
+  m_dns.set_notify(JNL_Reactor::wakeup_func,&m_reactor);
 }
 
 
 void WebServerBaseClass::setMaxConnections(int max_con)
 {
   m_max_con=max_con;
+  update_listeners();
 }
 
 void WebServerBaseClass::setRequestTimeout(int timeout_s)
@@ -45,6 +51,7 @@ int WebServerBaseClass::addListenPort(int port, unsigned int which_interface)
   JNL_IListen *p=new JNL_Listen(port,which_interface);
   m_listeners.Add(p);
   if (p->is_error()) return -1;
+  if (m_listeners_added) m_reactor.add(p->get_socket(),JNL_EV_READ,p);
   return 0;
 }
 
@@ -56,7 +63,7 @@ void WebServerBaseClass::removeListenPort(int port)
     JNL_IListen *p=m_listeners.Get(x);
     if (p->port()==port)
     {
-      m_listeners.Delete(x,true);
+      removeListenIdx(x);
       break;
     }
   }
@@ -64,6 +71,8 @@ void WebServerBaseClass::removeListenPort(int port)
 
 void WebServerBaseClass::removeListenIdx(int idx)
 {
+  JNL_IListen *p=m_listeners.Get(idx);
+  if (p && m_listeners_added) m_reactor.remove(p->get_socket());
   m_listeners.Delete(idx,true);
 }
 
@@ -80,28 +89,140 @@ int WebServerBaseClass::getListenPort(int idx, int *err)
 
 void WebServerBaseClass::attachConnection(JNL_IConnection *con, int port)
 {
-  m_connections.Add(new WS_conInst(con,port));
+  WS_conInst *ci=new WS_conInst(con,port);
+  m_connections.Add(ci);
+  queue_connection(ci); // it may have a request waiting already
+  update_listeners();
+}
+
+void WebServerBaseClass::queue_connection(WS_conInst *con)
+{
+  if (!con->m_queued)
+  {
+    con->m_queued=true;
+    m_torun.Add(con);
+  }
 }
 
-void WebServerBaseClass::run(void)
+void WebServerBaseClass::update_connection(WS_conInst *con)
 {
-  int nl;
-  if (m_connections.GetSize() < m_max_con && (nl=m_listeners.GetSize()))
+  JNL_IConnection *c=con->m_serv.get_con();
+  const SOCKET s=c ? c->get_socket() : INVALID_SOCKET;
+  const int ev=s != INVALID_SOCKET ? c->get_wanted_events() : 0;
+
+  // only registered while it wants something, otherwise a hung up socket would report forever
+  if (con->m_events && (s != con->m_sock || !ev))
   {
-    JNL_IListen *l=m_listeners.Get(m_listener_rot++ % nl);
-    JNL_IConnection *c=l->get_connect();
-    if (c)
+    m_reactor.remove(con->m_sock);
+    con->m_events=0;
+  }
+  if (ev && ev != con->m_events)
+  {
+    if (con->m_events ? m_reactor.modify(s,ev,con) : m_reactor.add(s,ev,con))
     {
-//      char buf[512];
-//      sprintf(buf,"got new connection at %.3f",GetTickCount()/1000.0);
-//      OutputDebugString(buf);
-      attachConnection(c,l->port());
+      con->m_events=0;
+      queue_connection(con); // poll it
     }
+    else con->m_events=ev;
   }
+  con->m_sock=s;
+}
+
+void WebServerBaseClass::close_connection(WS_conInst *con)
+{
+  if (con->m_events) m_reactor.remove(con->m_sock); // before its socket is closed
+  m_connections.Delete(m_connections.Find(con),true);
+  update_listeners();
+}
+
+void WebServerBaseClass::update_listeners()
+{
+  const bool want=m_connections.GetSize() < m_max_con;
+  if (want == m_listeners_added) return;
+  m_listeners_added=want;
   int x;
-  for (x = 0; x < m_connections.GetSize(); x ++)
+  for (x = 0; x < m_listeners.GetSize(); x ++)
+  {
+    JNL_IListen *l=m_listeners.Get(x);
+    if (l->is_error()) continue;
+    if (want) m_reactor.add(l->get_socket(),JNL_EV_READ,l);
+    else m_reactor.remove(l->get_socket());
+  }
+}
+
+int WebServerBaseClass::run_wait(int timeout_ms)
+{
+  int x,n;
+  if (m_reactor.is_error())
   {
-    WS_conInst *ci = m_connections.Get(x);
+    // no reactor, run everything like we used to
+    if (m_connections.GetSize() < m_max_con && (n=m_listeners.GetSize()))
+    {
+      JNL_IListen *l=m_listeners.Get(m_listener_rot++ % n);
+      JNL_IConnection *c=l->get_connect();
+      if (c) attachConnection(c,l->port());
+    }
+    for (x = 0; x < m_connections.GetSize(); x ++) queue_connection(m_connections.Get(x));
+  }
+  else
+  {
+    // connections waiting on a request only time out when run, so run those that are due once a second
+    const time_t now=time(NULL);
+    if (now != m_last_sweep)
+    {
+      m_last_sweep=now;
+      for (x = 0; x < m_connections.GetSize(); x ++)
+      {
+        WS_conInst *ci=m_connections.Get(x);
+        if (now-ci->m_connect_time > m_timeout_s) queue_connection(ci);
+      }
+    }
+
+    const bool had_work=m_torun.GetSize()>0;
+    if (had_work) timeout_ms=0;
+    else if (m_connections.GetSize() && (timeout_ms < 0 || timeout_ms > 1000)) timeout_ms=1000;
+
+    JNL_ReactorEvent *evts=m_reactor_evts.Get();
+    n=m_reactor.wait(evts,m_reactor_evts.GetSize(),timeout_ms);
+
+    // nonblocking generators that had no data wait for wakeGenerators(), or for a pass where nothing else happens
+    if (m_gen_wake || (!n && !had_work))
+    {
+      m_gen_wake=0; // before they're run, so a wake from here on isn't lost
+      for (x = 0; x < m_connections.GetSize(); x ++)
+      {
+        WS_conInst *ci=m_connections.Get(x);
+        if (ci->m_gen_idle) queue_connection(ci);
+      }
+    }
+    for (x = 0; x < n; x ++)
+    {
+      if (!evts[x].userdata) continue; // wakeup()
+
+      JNL_IListen *l=(JNL_IListen *)evts[x].userdata;
+      if (m_listeners.Find(l)>=0)
+      {
+        while (m_connections.GetSize() < m_max_con)
+        {
+          JNL_IConnection *c=l->get_connect();
+          if (!c) break;
+          attachConnection(c,l->port());
+        }
+      }
+      else queue_connection((WS_conInst *)evts[x].userdata);
+    }
+  }
+
+  // running one can queue it again, so run from a copy
+  m_running.Empty();
+  for (x = 0; x < m_torun.GetSize(); x ++) m_running.Add(m_torun.Get(x));
+  m_torun.Empty();
+
+  const int cnt=m_running.GetSize();
+  for (x = 0; x < cnt; x ++)
+  {
+    WS_conInst *ci = m_running.Get(x);
+    ci->m_queued=false;
     int rv = run_connection(ci);
 
     if (rv<0)
@@ -111,20 +232,34 @@ void WebServerBaseClass::run(void)
         time(&ci->m_connect_time);
         delete ci->m_pagegen;
         ci->m_pagegen=0;
+        ci->m_gen_idle=false;
+        queue_connection(ci); // the next request may be in the buffer already
+        update_connection(ci);
         continue;
       }
     }
 
     if (rv)
     {
-      m_connections.Delete(x--,true);
+      close_connection(ci);
+      continue;
     }
+
+    // the reply goes out on the next run, or the page generator may have more data for the room in the send buffer
+    // (a full send buffer waits for the socket, an idle nonblocking generator for a wake)
+    if (ci->m_servstate == 2 ||
+        (ci->m_servstate == 3 && ci->m_pagegen && !ci->m_gen_idle && ci->m_serv.bytes_cansend()>0))
+      queue_connection(ci);
+    update_connection(ci);
   }
+  m_running.Empty();
+  return cnt;
 }
 
 int WebServerBaseClass::run_connection(WS_conInst *con)
 {
   int s=con->m_serv.run();
+  con->m_servstate=s;
   if (s < 0)
   {
     // m_serv.geterrorstr()
@@ -138,6 +273,7 @@ int WebServerBaseClass::run_connection(WS_conInst *con)
   if (s < 3)
   {
     con->m_pagegen=onConnection(&con->m_serv,con->m_port);
+    con->m_file_checked=false;
     return 0;
   }
   if (s < 4)
@@ -148,12 +284,37 @@ int WebServerBaseClass::run_connection(WS_conInst *con)
 
       return !con->m_serv.bytes_inqueue();
     }
+    if (!con->m_file_checked)
+    {
+      con->m_file_checked=true;
+      int fd;
+      WDL_INT64 offs, len;
+      if (con->m_pagegen->GetFile(&fd,&offs,&len) && !con->m_serv.write_file(fd,offs,len))
+      {
+        // that's the page, finish up on the next run, same as without a generator
+        delete con->m_pagegen;
+        con->m_pagegen=NULL;
+        return 0;
+      }
+    }
+
     char buf[16384];
+    con->m_gen_idle=false;
     int l=con->m_serv.bytes_cansend();
     if (l > 0)
     {
-      if (l > (int)sizeof(buf)) l=(int)sizeof(buf);
-      l=con->m_pagegen->GetData(buf,l);
+      char *p=buf;
+      void (*freefunc)(void *)=NULL;
+      if (con->m_pagegen->IsOwnedData())
+      {
+        p=NULL;
+        l=con->m_pagegen->GetOwnedData(&p,&freefunc);
+      }
+      else
+      {
+        if (l > (int)sizeof(buf)) l=(int)sizeof(buf);
+        l=con->m_pagegen->GetData(buf,l);
+      }
       if (l < (con->m_pagegen->IsNonBlocking() ? 0 : 1)) // if nonblocking, this is l < 0, otherwise it's l<1
       {
         if (con->m_serv.canKeepAlive()) 
@@ -164,7 +325,11 @@ int WebServerBaseClass::run_connection(WS_conInst *con)
         return !con->m_serv.bytes_inqueue();
       }
       if (l>0)
-        con->m_serv.write_bytes(buf,l);
+      {
+        if (p == buf) con->m_serv.write_bytes(buf,l);
+        else con->m_serv.write_owned(p,l,freefunc);
+      }
+      else con->m_gen_idle=true;
     }
     return 0;
   }
@@ -37,10 +37,11 @@
     foo.addListenPort(8080);
     while (1)
     {
-      foo.run();
-      Sleep(10);
+      foo.run_wait(100); // blocks until a connection needs something, or 100ms
     }
 
+  (run() followed by a Sleep() still works too, it is run_wait(0))
+
   You will also need to derive from the IPageGenerator interface to provide a data stream, here is an
   example of MemPageGenerator:
 
@@ -64,6 +65,20 @@
         int m_buf_pos;
     };
 
+  Since MemPageGenerator has its data in a malloc()ed buffer already, it could skip the copy and hand it to the
+  connection instead, which frees it once it is sent:
+
+        virtual int IsOwnedData() { return 1; }
+        virtual int GetOwnedData(char **buf, void (**freefunc)(void *))
+        {
+          if (!m_buf) return -1;
+          *buf=m_buf; // freefunc left NULL, free() it
+          m_buf=NULL;
+          return m_buf_size;
+        }
+
+  A generator for a file can return it from GetFile(), to have it sent straight from the file (JNL_FilePageGenerator does).
+
 
 **
 */
@@ -80,8 +95,19 @@ class IPageGenerator
 {
 public:
   virtual ~IPageGenerator() { };
-  virtual int IsNonBlocking() { return 0; } // override this and return 1 if GetData should be allowed to return 0
+  // override this and return 1 if GetData should be allowed to return 0. a generator that returns 0 isn't run again
+  // until WebServerBaseClass::wakeGenerators() is called, or a run_wait() passes with nothing else to do
+  virtual int IsNonBlocking() { return 0; }
   virtual int GetData(char *buf, int size)=0; // return < 0 when done (or 0 if IsNonBlocking() is 1)
+
+  // override these and return 1 from IsOwnedData() to have GetOwnedData() called instead of GetData(). it returns a
+  // buffer that the connection takes over and frees with *freefunc (free() if left NULL) once sent, and its length.
+  virtual int IsOwnedData() { return 0; }
+  virtual int GetOwnedData(char **buf, void (**freefunc)(void *)) { return -1; } // return < 0 when done (or 0 if IsNonBlocking() is 1)
+
+  // asked once before any data: return 1 if the rest of the page is this range of an open file, it is then sent
+  // without copying (sendfile() on linux) and the generator is done. fd only needs to stay open for this call.
+  virtual int GetFile(int *fd, WDL_INT64 *offset, WDL_INT64 *length) { return 0; }
 };
 
 
@@ -104,7 +130,14 @@ public:
   void removeListenIdx(int idx);
 
   // call this a lot :)
-  void run(void);
+  void run(void) { run_wait(0); }
+
+  // waits up to timeout_ms (-1 for as long as it takes) for a listener or connection to be ready, then
+  // accepts and runs only those (and any that have page data to generate). returns the number of connections run.
+  int run_wait(int timeout_ms);
+
+  // call from any thread when nonblocking page generators may have data again, run_wait() returns and runs them
+  void wakeGenerators() { m_gen_wake=1; m_reactor.wakeup(); }
 
   // if you want to manually attach a connection, use this:
   // you need to specify the port it came in on so the web server can build
@@ -133,6 +166,12 @@ protected:
     WS_conInst(JNL_IConnection *c, int which_port) : m_serv(c), m_pagegen(NULL), m_port(which_port)
     {
       time(&m_connect_time);
+      m_sock=INVALID_SOCKET;
+      m_events=0;
+      m_servstate=0;
+      m_queued=false;
+      m_file_checked=false;
+      m_gen_idle=false;
     }
     ~WS_conInst()
     {
@@ -145,18 +184,37 @@ protected:
 
     int m_port; // port this came in on
     time_t m_connect_time;
+
+    SOCKET m_sock; // as added to m_reactor, only while m_events is nonzero
+    int m_events;
+    int m_servstate; // last m_serv.run()
+    bool m_queued; // in m_torun
+    bool m_file_checked; // m_pagegen->GetFile() called
+    bool m_gen_idle; // nonblocking m_pagegen had no data, run again by wakeGenerators() or an idle run_wait()
   };
 
   int run_connection(WS_conInst *con);
 
+  void queue_connection(WS_conInst *con);
+  void update_connection(WS_conInst *con);
+  void close_connection(WS_conInst *con);
+  void update_listeners();
+
   int m_timeout_s;
   int m_max_con;
 
+  JNL_Reactor m_reactor; // before m_dns, which notifies it from its thread
   JNL_AsyncDNS m_dns;
 
   WDL_PtrList<JNL_IListen> m_listeners;
   WDL_PtrList<WS_conInst> m_connections;
   int m_listener_rot;
+  bool m_listeners_added; // to m_reactor, false while at m_max_con
+
+  WDL_PtrList<WS_conInst> m_torun, m_running; // connections to run regardless of socket events
+  WDL_TypedBuf<JNL_ReactorEvent> m_reactor_evts;
+  time_t m_last_sweep;
+  volatile int m_gen_wake; // set by wakeGenerators()
 };
 
 
@@ -173,6 +231,20 @@ class JNL_FilePageGenerator : public IPageGenerator
     virtual ~JNL_FilePageGenerator() { delete m_file; }
     virtual int GetData(char *buf, int size) { return m_file ? m_file->Read(buf,size) : -1; }
 
+#ifndef _WIN32
+    virtual int GetFile(int *fd, WDL_INT64 *offset, WDL_INT64 *length)
+    {
+      if (!m_file || !m_file->IsOpen()) return 0;
+      *fd = m_file->GetHandle();
+  #ifdef O_DIRECT
+      if (*fd < 0 || (fcntl(*fd,F_GETFL) & O_DIRECT)) return 0; // unbuffered, sendfile() wants the page cache
+  #endif
+      *offset = m_file->GetPosition();
+      *length = m_file->GetSize() - *offset;
+      return *fd >= 0 && *length > 0;
+    }
+#endif
+
   private:
 
     WDL_FileRead *m_file;
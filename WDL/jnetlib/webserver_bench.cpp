@@ -0,0 +1,297 @@
+// Measures WebServerBaseClass requests per second: a child process opens a number of idle
+// keep-alive connections (which a server has to carry, but which never send anything) and a few
+// active ones that each send GET requests back to back, and counts the replies.
+//
+// g++ -O2 -o webserver_bench webserver_bench.cpp asyncdns.cpp connection.cpp httpserv.cpp listen.cpp reactor.cpp util.cpp webserver.cpp -lpthread
+// usage: webserver_bench [-m wait|run] [-g copy|owned|file|fileread] [-i idle connections] [-c active connections] [-s reply size] [-t seconds]
+//   -m wait: the server loop sleeps in run_wait(), only ready connections are run (default)
+//   -m run: the server loop calls run() as fast as it can, the way it was driven before run_wait()
+//   (drop -m wait and reactor.cpp to build this against an older jnetlib for comparison)
+//   -g copy: the reply comes from GetData() (default)
+//   -g owned: the reply buffer is handed to the connection with GetOwnedData()
+//   -g file: the reply is a temporary file, sent by JNL_FilePageGenerator with GetFile()
+//   -g fileread: the same file, read by JNL_FilePageGenerator::GetData()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define JNETLIB_WEBSERVER_WANT_UTILS
+#include "jnetlib.h"
+#include "webserver.h"
+
+enum { GEN_COPY, GEN_OWNED, GEN_FILE, GEN_FILEREAD };
+
+static double GetTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static double GetCPUTimeMs() // this process, user+system
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF,&ru);
+  return (ru.ru_utime.tv_sec+ru.ru_stime.tv_sec)*1000.0 + (ru.ru_utime.tv_usec+ru.ru_stime.tv_usec)/1000.0;
+}
+
+static void NoFree(void *p) { }
+
+class BenchPageGenerator : public IPageGenerator
+{
+  public:
+    BenchPageGenerator(const char *buf, int len, bool owned) { m_buf=buf; m_len=len; m_pos=0; m_owned=owned; }
+    virtual int GetData(char *buf, int size)
+    {
+      if (size > m_len-m_pos) size=m_len-m_pos;
+      memcpy(buf,m_buf+m_pos,size);
+      m_pos+=size;
+      return size;
+    }
+
+    // the reply is shared by all of them, so nothing to free
+    virtual int IsOwnedData() { return m_owned; }
+    virtual int GetOwnedData(char **buf, void (**freefunc)(void *))
+    {
+      if (m_pos >= m_len) return -1;
+      *buf=(char *)m_buf;
+      *freefunc=NoFree;
+      m_pos=m_len;
+      return m_len;
+    }
+
+  private:
+    const char *m_buf;
+    int m_len, m_pos;
+    bool m_owned;
+};
+
+class BenchFilePageGenerator : public JNL_FilePageGenerator
+{
+  public:
+    BenchFilePageGenerator(WDL_FileRead *fr) : JNL_FilePageGenerator(fr) { }
+    virtual int GetFile(int *fd, WDL_INT64 *offset, WDL_INT64 *length) { return 0; }
+};
+
+class BenchServer : public WebServerBaseClass
+{
+  public:
+    BenchServer(int replysize, int gen, const char *fn)
+    {
+      m_reply.Resize(replysize);
+      memset(m_reply.Get(),'x',replysize);
+      m_gen=gen;
+      m_fn=fn;
+    }
+    virtual IPageGenerator *onConnection(JNL_HTTPServ *serv, int port)
+    {
+      serv->set_reply_string("HTTP/1.1 200 OK");
+      serv->set_reply_header("Content-Type:text/plain");
+      serv->set_reply_size(m_reply.GetSize());
+      serv->send_reply();
+      if (m_gen == GEN_FILE) return new JNL_FilePageGenerator(new WDL_FileRead(m_fn,0,65536,1));
+      if (m_gen == GEN_FILEREAD) return new BenchFilePageGenerator(new WDL_FileRead(m_fn,0,65536,1));
+      return new BenchPageGenerator(m_reply.Get(),m_reply.GetSize(),m_gen == GEN_OWNED);
+    }
+
+    WDL_TypedBuf<char> m_reply;
+    int m_gen;
+    const char *m_fn;
+};
+
+static SOCKET Connect(int port)
+{
+  SOCKET s=::socket(AF_INET,SOCK_STREAM,0);
+  struct sockaddr_in sin;
+  memset(&sin,0,sizeof(sin));
+  sin.sin_family=AF_INET;
+  sin.sin_port=htons((unsigned short)port);
+  sin.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+  if (s != INVALID_SOCKET && ::connect(s,(struct sockaddr *)&sin,sizeof(sin)))
+  {
+    closesocket(s);
+    s=INVALID_SOCKET;
+  }
+  return s;
+}
+
+// the load generator, returns the number of replies
+static int RunClients(int port, int nidle, int nactive, double seconds)
+{
+  static const char req[]="GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  int x;
+  for (x = 0; x < nidle; x ++)
+  {
+    if (Connect(port) == INVALID_SOCKET) { fprintf(stderr,"idle connection %d failed\n",x); return -1; }
+  }
+
+  WDL_TypedBuf<struct pollfd> fds;
+  WDL_TypedBuf<int> have, bodyleft;
+  WDL_TypedBuf<char> bufs;
+  const int bufsz=65536;
+  struct pollfd *pfd=fds.Resize(nactive);
+  int *h=have.Resize(nactive);
+  int *left=bodyleft.Resize(nactive); // -1 while reading the header
+  for (x = 0; x < nactive; x ++)
+  {
+    pfd[x].fd=Connect(port);
+    pfd[x].events=POLLIN;
+    h[x]=0;
+    left[x]=-1;
+    if (pfd[x].fd == INVALID_SOCKET || ::send(pfd[x].fd,req,sizeof(req)-1,0) != sizeof(req)-1)
+    {
+      fprintf(stderr,"active connection %d failed\n",x);
+      return -1;
+    }
+  }
+  char *b=bufs.Resize(nactive*bufsz);
+
+  int replies=0;
+  const double end=GetTimeMs()+seconds*1000.0;
+  while (GetTimeMs() < end)
+  {
+    if (poll(pfd,nactive,100) < 0) return -1;
+    for (x = 0; x < nactive; x ++)
+    {
+      if (!pfd[x].revents) continue;
+      char *p=b+x*bufsz;
+      int r=::recv(pfd[x].fd,p+h[x],bufsz-1-h[x],0);
+      if (r <= 0) { fprintf(stderr,"active connection %d closed\n",x); return -1; }
+      h[x]+=r;
+
+      for (;;)
+      {
+        int used;
+        if (left[x] < 0)
+        {
+          p[h[x]]=0;
+          const char *hdrend=strstr(p,"\r\n\r\n");
+          if (!hdrend) break;
+          const char *cl=strstr(p,"Content-length:");
+          if (!cl || cl > hdrend) { fprintf(stderr,"reply without length\n"); return -1; }
+          left[x]=atoi(cl+15);
+          used=(int)(hdrend+4-p);
+        }
+        else
+        {
+          // the body is only counted
+          used = h[x] < left[x] ? h[x] : left[x];
+          left[x]-=used;
+        }
+        h[x]-=used;
+        memmove(p,p+used,h[x]);
+        if (left[x])
+        {
+          if (!h[x]) break;
+          continue;
+        }
+
+        replies++;
+        left[x]=-1;
+        ::send(pfd[x].fd,req,sizeof(req)-1,0);
+      }
+    }
+  }
+  return replies;
+}
+
+int main(int argc, char **argv)
+{
+  int usewait=1, gen=GEN_COPY, nidle=1000, nactive=8, replysize=1024, port=0;
+  static const char *gennames[]={ "copy", "owned", "file", "fileread" };
+  double seconds=5.0;
+  int x;
+  for (x = 1; x < argc; x ++)
+  {
+    if (!strcmp(argv[x],"-m") && x+1 < argc) usewait=strcmp(argv[++x],"run");
+    else if (!strcmp(argv[x],"-g") && x+1 < argc)
+    {
+      x++;
+      for (gen = 0; gen < 4 && strcmp(argv[x],gennames[gen]); gen ++);
+      if (gen == 4) nactive=0;
+    }
+    else if (!strcmp(argv[x],"-i") && x+1 < argc) nidle=atoi(argv[++x]);
+    else if (!strcmp(argv[x],"-c") && x+1 < argc) nactive=atoi(argv[++x]);
+    else if (!strcmp(argv[x],"-s") && x+1 < argc) replysize=atoi(argv[++x]);
+    else if (!strcmp(argv[x],"-t") && x+1 < argc) seconds=atof(argv[++x]);
+    else nactive=0;
+  }
+  if (nactive < 1 || nidle < 0 || replysize < 0 || seconds <= 0.0)
+  {
+    fprintf(stderr,"usage: %s [-m wait|run] [-g copy|owned|file|fileread] [-i idle connections] [-c active connections] [-s reply size] [-t seconds]\n",argv[0]);
+    return 1;
+  }
+
+  signal(SIGPIPE,SIG_IGN);
+  JNL::open_socketlib();
+
+  char fn[64];
+  snprintf(fn,sizeof(fn),"/tmp/webserver_bench_%d",(int)getpid());
+  BenchServer server(replysize,gen,fn);
+  if (gen == GEN_FILE || gen == GEN_FILEREAD)
+  {
+    FILE *fp=fopen(fn,"wb");
+    if (!fp || fwrite(server.m_reply.Get(),1,replysize,fp) != (size_t)replysize)
+    {
+      fprintf(stderr,"can't write %s\n",fn);
+      return 1;
+    }
+    fclose(fp);
+  }
+
+  server.setMaxConnections(nidle+nactive+16);
+  for (port = 18000; port < 18100 && server.addListenPort(port,htonl(INADDR_LOOPBACK)); port ++) server.removeListenPort(port);
+  if (port >= 18100)
+  {
+    fprintf(stderr,"no port to listen on\n");
+    return 1;
+  }
+
+  int pipefd[2];
+  if (pipe(pipefd)) return 1;
+  const pid_t pid=fork();
+  if (!pid)
+  {
+    close(pipefd[0]);
+    int replies=RunClients(port,nidle,nactive,seconds);
+    if (write(pipefd[1],&replies,sizeof(replies)) != sizeof(replies)) { }
+    _exit(0);
+  }
+  close(pipefd[1]);
+
+  // serve until the load generator reports back
+  const double cpu_start=GetCPUTimeMs();
+  int replies=-1;
+  for (;;)
+  {
+    struct pollfd pfd={ pipefd[0], POLLIN, 0 };
+    if (poll(&pfd,1,0) > 0)
+    {
+      if (read(pipefd[0],&replies,sizeof(replies)) != sizeof(replies)) replies=-1;
+      break;
+    }
+    if (usewait) server.run_wait(10);
+    else server.run();
+  }
+  const double cpu_ms=GetCPUTimeMs()-cpu_start;
+  kill(pid,SIGKILL);
+  waitpid(pid,NULL,0);
+  if (gen == GEN_FILE || gen == GEN_FILEREAD) unlink(fn);
+
+  if (replies < 0)
+  {
+    fprintf(stderr,"load generator failed\n");
+    return 1;
+  }
+  printf("%s, %s: %d idle + %d active connections, %d byte replies: %.0f requests/s, %.1f MB/s, server CPU %.1f us/request\n",
+    usewait ? "run_wait()" : "run()",gennames[gen],nidle,nactive,replysize,replies/seconds,replies*(double)replysize/seconds/1048576.0,
+    replies>0 ? cpu_ms*1000.0/replies : 0.0);
+  return 0;
+}
@@ -54,20 +54,11 @@ static void LICEJPEG_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
 static void LICEJPEG_term_source(j_decompress_ptr cinfo) {}
 
 
-LICE_IBitmap *LICE_LoadJPGFromResource(HINSTANCE hInst, const char *resid, LICE_IBitmap *bmp)
+LICE_IBitmap *LICE_LoadJPGFromMemory(const void *data_in, int buflen, LICE_IBitmap *bmp)
 {
-#ifdef _WIN32
-  HRSRC hResource = FindResource(hInst, resid, "JPG");
-  if(!hResource) return NULL;
+  if (!data_in || buflen < 8) return 0;
 
-  DWORD imageSize = SizeofResource(hInst, hResource);
-  if(imageSize < 8) return NULL;
-
-  HGLOBAL res = LoadResource(hInst, hResource);
-  const void* pResourceData = LockResource(res);
-  if(!pResourceData) return NULL;
-
-  unsigned char *data = (unsigned char *)pResourceData;
+  const unsigned char *data = (const unsigned char *)data_in;
 
   struct jpeg_decompress_struct cinfo;
   struct my_error_mgr jerr={0,};
@@ -98,7 +89,7 @@ LICE_IBitmap *LICE_LoadJPGFromResource(HINSTANCE hInst, const char *resid, LICE_
   cinfo.src->term_source = LICEJPEG_term_source;
 
   cinfo.src->next_input_byte = data;
-  cinfo.src->bytes_in_buffer = imageSize;
+  cinfo.src->bytes_in_buffer = buflen;
 
   jpeg_read_header(&cinfo, TRUE);
   jpeg_start_decompress(&cinfo);
@@ -164,7 +155,22 @@ LICE_IBitmap *LICE_LoadJPGFromResource(HINSTANCE hInst, const char *resid, LICE_
   jpeg_destroy_decompress(&cinfo);  // we created cinfo.src with some special alloc so I think it gets collected
 
   return bmp;
+}
+
+LICE_IBitmap *LICE_LoadJPGFromResource(HINSTANCE hInst, const char *resid, LICE_IBitmap *bmp)
+{
+#ifdef _WIN32
+  HRSRC hResource = FindResource(hInst, resid, "JPG");
+  if(!hResource) return NULL;
+
+  DWORD imageSize = SizeofResource(hInst, hResource);
+  if(imageSize < 8) return NULL;
+
+  HGLOBAL res = LoadResource(hInst, hResource);
+  const void* pResourceData = LockResource(res);
+  if(!pResourceData) return NULL;
 
+  return LICE_LoadJPGFromMemory(pResourceData, imageSize, bmp);
 #else
   return 0;
 #endif
@@ -13,11 +13,13 @@
 #include "lice_text.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 
 #include "../tinyxml/tinyxml.h"
 #include "../wdlcstring.h"
+#include "../heapbuf.h"
 
 extern "C" int LICE_RGBA_from_SVG(const char* s, int len);
 
@@ -27,6 +29,11 @@ const int SVG_MAT_SZ = sizeof(SVG_ID_MAT);
 
 #define SVGINT(x) ((int)(x+0.5))
 
+#define SVG_PI 3.1415926535897932384626433832795
+
+// vertical samples per pixel row when filling, horizontal coverage is exact
+#define SVG_AA_SUBSAMPLES 8
+
 static void SVGMSet(double m[], double a, double b, double c, double d, double e, double f)
 {
   m[0] = a;
@@ -39,8 +46,8 @@ static void SVGMSet(double m[], double a, double b, double c, double d, double e
 
 static void SVGMMult(double m[], double a, double b, double c, double d, double e, double f)
 {
-  SVGMSet(m, 
-    m[0]*a+m[1]*b,        // 0  
+  SVGMSet(m,
+    m[0]*a+m[1]*b,        // 0
     m[3]*a+m[4]*b,        // 3
     m[0]*c+m[1]*d,        // 1
     m[3]*c+m[4]*d,        // 4
@@ -48,7 +55,7 @@ static void SVGMMult(double m[], double a, double b, double c, double d, double
     m[3]*e+m[4]*f+m[5]);  // 5
 }
 
-static void SVGMTransform(double m[], double* x, double* y)
+static void SVGMTransform(const double m[], double* x, double* y)
 {
   if (memcmp(m, SVG_ID_MAT, SVG_MAT_SZ))
   {
@@ -59,7 +66,7 @@ static void SVGMTransform(double m[], double* x, double* y)
   }
 }
 
-static void SVGMScale(double m[], double* w, double* h)
+static void SVGMScale(const double m[], double* w, double* h)
 {
   if (memcmp(m, SVG_ID_MAT, SVG_MAT_SZ))
   {
@@ -68,112 +75,477 @@ static void SVGMScale(double m[], double* w, double* h)
   }
 }
 
-static void SVGDrawLine(LICE_IBitmap* bmp, double x1, double y1, double x2, double y2, LICE_pixel color, float alpha, bool aa, int linewid=1)
+// average linear scale of the transform, for stroke widths and curve flattening
+static double SVGMScaleFactor(const double m[])
+{
+  return sqrt(fabs(m[0]*m[4]-m[1]*m[3]));
+}
+
+static bool SVGIsSep(char c)
+{
+  return (c == ' ' || c == ',' || c == '\t' || c == '\r' || c == '\n');
+}
+
+static const char* SVGSkipSep(const char* str)
+{
+  while (SVGIsSep(*str)) ++str;
+  return str;
+}
+
+static bool SVGParseNum(const char** str, double* v)
+{
+  const char* s = SVGSkipSep(*str);
+  char* end = 0;
+  *v = strtod(s, &end);
+  if (!end || end == s) return false;
+  *str = end;
+  return true;
+}
+
+// arc flags may be packed without separators, "a5,5 0 015,5"
+static bool SVGParseFlag(const char** str, bool* v)
+{
+  const char* s = SVGSkipSep(*str);
+  if (*s != '0' && *s != '1') return false;
+  *v = (*s == '1');
+  *str = s+1;
+  return true;
+}
+
+
+// flattened outline in bitmap coordinates.
+// MoveTo etc take user coordinates and apply the transform the path was created with.
+class LICE_SVGPath
 {
-  int i;
-  for (i = 0; i < linewid; ++i)
+public:
+
+  WDL_TypedBuf<double> m_pts;     // x,y pairs
+  WDL_TypedBuf<int> m_subpaths;   // first point, number of points, closed
+
+  double m_cx, m_cy;  // current point, user coords
+  double m_sx, m_sy;  // start of current subpath, user coords
+
+  LICE_SVGPath(const double m[] = SVG_ID_MAT)
+  {
+    memcpy(m_m, m, SVG_MAT_SZ);
+    m_scale = SVGMScaleFactor(m);
+    m_cx = m_cy = m_sx = m_sy = 0.0;
+    m_open = false;
+  }
+
+  int GetNumSubpaths() const { return m_subpaths.GetSize()/3; }
+
+  void MoveTo(double x, double y)
+  {
+    m_cx = m_sx = x;
+    m_cy = m_sy = y;
+    SVGMTransform(m_m, &x, &y);
+    StartSubpath();
+    AddPoint(x, y);
+  }
+
+  void LineTo(double x, double y)
   {
-    LICE_FLine(bmp, x1, y1, x2, y2, color, alpha, LICE_BLIT_MODE_COPY, aa);
+    if (!m_open) MoveTo(m_cx, m_cy);
+    m_cx = x;
+    m_cy = y;
+    SVGMTransform(m_m, &x, &y);
+    AddPoint(x, y);
+  }
 
-    if (fabs(y2-y1) > fabs(x2-x1)) 
+  void CubicTo(double x1, double y1, double x2, double y2, double x3, double y3)
+  {
+    if (!m_open) MoveTo(m_cx, m_cy);
+    double x0 = m_cx, y0 = m_cy;
+    m_cx = x3;
+    m_cy = y3;
+    SVGMTransform(m_m, &x0, &y0);
+    SVGMTransform(m_m, &x1, &y1);
+    SVGMTransform(m_m, &x2, &y2);
+    SVGMTransform(m_m, &x3, &y3);
+
+    double len = sqrt((x1-x0)*(x1-x0)+(y1-y0)*(y1-y0))+sqrt((x2-x1)*(x2-x1)+(y2-y1)*(y2-y1))+sqrt((x3-x2)*(x3-x2)+(y3-y2)*(y3-y2));
+    int i, n = (int)(len*0.25)+1;
+    if (n > 256) n = 256;
+    for (i = 1; i < n; ++i)
     {
-      x1 += 1.0;
-      x2 += 1.0;
+      double t = (double)i/(double)n, it = 1.0-t;
+      double a = it*it*it, b = 3.0*it*it*t, c = 3.0*it*t*t, d = t*t*t;
+      AddPoint(a*x0+b*x1+c*x2+d*x3, a*y0+b*y1+c*y2+d*y3);
     }
-    else
+    AddPoint(x3, y3);
+  }
+
+  void QuadTo(double x1, double y1, double x2, double y2)
+  {
+    CubicTo(m_cx+(x1-m_cx)*2.0/3.0, m_cy+(y1-m_cy)*2.0/3.0, x2+(x1-x2)*2.0/3.0, y2+(y1-y2)*2.0/3.0, x2, y2);
+  }
+
+  // SVG elliptical arc from the current point, see SVG 1.1 appendix F.6
+  void ArcTo(double rx, double ry, double rot, bool large, bool sweep, double x2, double y2)
+  {
+    double x1 = m_cx, y1 = m_cy;
+    rx = fabs(rx);
+    ry = fabs(ry);
+    if (rx == 0.0 || ry == 0.0 || (x1 == x2 && y1 == y2))
     {
-      y1 += 1.0;
-      y2 += 1.0;
+      LineTo(x2, y2);
+      return;
     }
+    if (!m_open) MoveTo(m_cx, m_cy);
+
+    double phi = rot*SVG_PI/180.0, cp = cos(phi), sp = sin(phi);
+    double dx = (x1-x2)*0.5, dy = (y1-y2)*0.5;
+    double x1p = cp*dx+sp*dy, y1p = -sp*dx+cp*dy;
+
+    double lambda = x1p*x1p/(rx*rx)+y1p*y1p/(ry*ry);
+    if (lambda > 1.0)
+    {
+      lambda = sqrt(lambda);
+      rx *= lambda;
+      ry *= lambda;
+    }
+
+    double num = rx*rx*ry*ry-rx*rx*y1p*y1p-ry*ry*x1p*x1p;
+    double den = rx*rx*y1p*y1p+ry*ry*x1p*x1p;
+    double co = (num > 0.0 && den > 0.0 ? sqrt(num/den) : 0.0);
+    if (large == sweep) co = -co;
+    double cxp = co*rx*y1p/ry, cyp = -co*ry*x1p/rx;
+    double cx = cp*cxp-sp*cyp+(x1+x2)*0.5, cy = sp*cxp+cp*cyp+(y1+y2)*0.5;
+
+    double t1 = atan2((y1p-cyp)/ry, (x1p-cxp)/rx);
+    double dt = atan2((-y1p-cyp)/ry, (-x1p-cxp)/rx)-t1;
+    if (sweep && dt < 0.0) dt += 2.0*SVG_PI;
+    else if (!sweep && dt > 0.0) dt -= 2.0*SVG_PI;
+
+    int i, n = (int)(fabs(dt)*lice_max(rx, ry)*m_scale*0.25)+2;
+    if (n > 256) n = 256;
+    for (i = 1; i < n; ++i)
+    {
+      double t = t1+dt*(double)i/(double)n;
+      double x = cx+rx*cos(t)*cp-ry*sin(t)*sp;
+      double y = cy+rx*cos(t)*sp+ry*sin(t)*cp;
+      SVGMTransform(m_m, &x, &y);
+      AddPoint(x, y);
+    }
+    m_cx = x2;
+    m_cy = y2;
+    SVGMTransform(m_m, &x2, &y2);
+    AddPoint(x2, y2);
   }
-}
 
-static void SVGDrawRect(LICE_IBitmap* bmp, double x, double y, int w, int h, LICE_pixel color, float alpha, int linewid=1)
-{
-  int xi = SVGINT(x), yi = SVGINT(y);
-  int wi = SVGINT(w), hi = SVGINT(h);
+  void Close()
+  {
+    if (m_open)
+    {
+      m_subpaths.Get()[m_subpaths.GetSize()-1] = 1;
+      m_open = false;
+    }
+    m_cx = m_sx;
+    m_cy = m_sy;
+  }
+
+  // bitmap coordinates, always closed
+  void AddPolygon(const double* pts, int npts)
+  {
+    StartSubpath();
+    int i;
+    for (i = 0; i < npts; ++i) AddPoint(pts[2*i], pts[2*i+1]);
+    Close();
+  }
+
+private:
 
-  int i;
-  for (i = 0; i < linewid; ++i)
+  void StartSubpath()
   {
-    LICE_DrawRect(bmp, xi, yi, wi, hi, color, alpha, LICE_BLIT_MODE_COPY);
-    ++xi;
-    ++yi;
+    int sub[3] = { m_pts.GetSize()/2, 0, 0 };
+    m_subpaths.Add(sub, 3);
+    m_open = true;
   }
+
+  void AddPoint(double x, double y)
+  {
+    int* sub = m_subpaths.Get()+m_subpaths.GetSize()-3;
+    if (sub[1])
+    {
+      const double* last = m_pts.Get()+m_pts.GetSize()-2;
+      if (last[0] == x && last[1] == y) return;
+    }
+    double pt[2] = { x, y };
+    m_pts.Add(pt, 2);
+    ++sub[1];
+  }
+
+  double m_m[6];
+  double m_scale;
+  bool m_open;
+};
+
+
+struct SVGEdge
+{
+  double x0, y0, x1, y1;  // y0 < y1
+  int dir;
+};
+
+static int SVGCompareEdges(const void* a, const void* b)
+{
+  double ya = ((const SVGEdge*)a)->y0, yb = ((const SVGEdge*)b)->y0;
+  return (ya < yb ? -1 : ya > yb ? 1 : 0);
 }
 
-static void SVGDrawCircle(LICE_IBitmap* bmp, double cx, double cy, double r, LICE_pixel color, float alpha, bool aa, int linewid=1)
+// non-premultiplied source-over, so edges blend correctly onto a transparent bitmap
+static void SVGBlendPixel(LICE_pixel* p, LICE_pixel col, double a)
 {
-  int i;
-  for (i = 0; i < linewid; ++i)
+  int sa = (int)(a*(double)LICE_GETA(col)+0.5);
+  if (sa <= 0) return;
+  LICE_pixel d = *p;
+  int da = LICE_GETA(d);
+  if (sa >= 255 || !da)
   {
-    LICE_Circle(bmp, cx, cy, r, color, alpha, LICE_BLIT_MODE_COPY, aa);
-    r += 1.0f;
+    *p = LICE_RGBA(LICE_GETR(col), LICE_GETG(col), LICE_GETB(col), lice_min(sa, 255));
+    return;
   }
+  int dw = da*(255-sa)/255;
+  int oa = sa+dw;
+  *p = LICE_RGBA((LICE_GETR(col)*sa+LICE_GETR(d)*dw)/oa,
+    (LICE_GETG(col)*sa+LICE_GETG(d)*dw)/oa,
+    (LICE_GETB(col)*sa+LICE_GETB(d)*dw)/oa, oa);
 }
 
-static void SVGDrawQBezier(LICE_IBitmap* bmp, double x1, double y1, double x2, double y2, double x3, double y3,
-  LICE_pixel color, float alpha, bool aa, int linewid=1)
+// anti-aliased scanline fill, every subpath is implicitly closed
+static void SVGFillPath(LICE_IBitmap* bmp, const LICE_SVGPath* path, LICE_pixel color, float alpha, bool evenodd)
 {
-  int i;
-  for (i = 0; i < linewid; ++i)
+  int bmpw = bmp->getWidth(), bmph = bmp->getHeight();
+  if (!bmpw || !bmph || !color || alpha <= 0.0f) return;
+
+  WDL_TypedBuf<SVGEdge> edges;
+  double minx = 0.0, maxx = 0.0, miny = 0.0, maxy = 0.0;
+  bool haspts = false;
+
+  const double* pts = path->m_pts.Get();
+  const int* subs = path->m_subpaths.Get();
+  int s, nsubs = path->GetNumSubpaths();
+  for (s = 0; s < nsubs; ++s)
   {
-    LICE_DrawQBezier(bmp, x1, y1, x2, y2, x3, y3, color, alpha, LICE_BLIT_MODE_COPY, aa);
+    const double* sp = pts+2*subs[3*s];
+    int i, n = subs[3*s+1];
+    for (i = 0; i < n; ++i)
+    {
+      const double* p = sp+2*i;
+      const double* q = sp+2*((i+1)%n);
+      if (!haspts)
+      {
+        haspts = true;
+        minx = maxx = p[0];
+        miny = maxy = p[1];
+      }
+      if (p[0] < minx) minx = p[0];
+      if (p[0] > maxx) maxx = p[0];
+      if (p[1] < miny) miny = p[1];
+      if (p[1] > maxy) maxy = p[1];
+      if (p[1] == q[1]) continue;
+
+      SVGEdge e;
+      if (p[1] < q[1])
+      {
+        e.x0 = p[0]; e.y0 = p[1]; e.x1 = q[0]; e.y1 = q[1]; e.dir = 1;
+      }
+      else
+      {
+        e.x0 = q[0]; e.y0 = q[1]; e.x1 = p[0]; e.y1 = p[1]; e.dir = -1;
+      }
+      edges.Add(e);
+    }
+  }
+
+  int nedges = edges.GetSize();
+  if (!nedges) return;
+  qsort(edges.Get(), nedges, sizeof(SVGEdge), SVGCompareEdges);
+
+  int bx0 = lice_max((int)floor(minx), 0), bx1 = lice_min((int)ceil(maxx)+1, bmpw);
+  int by0 = lice_max((int)floor(miny), 0), by1 = lice_min((int)ceil(maxy)+1, bmph);
+  if (bx1 <= bx0 || by1 <= by0) return;
+  int bw = bx1-bx0;
+
+  WDL_TypedBuf<double> covbuf, accbuf;
+  double* cov = covbuf.Resize(bw, false);
+  double* acc = accbuf.Resize(bw+1, false);
+
+  WDL_TypedBuf<int> active;
+  WDL_TypedBuf<double> xings;  // x,dir pairs
+  int nextedge = 0;
+
+  LICE_pixel* bits = bmp->getBits();
+  int span = bmp->getRowSpan();
+  bool flip = bmp->isFlipped();
+
+  int y;
+  for (y = by0; y < by1; ++y)
+  {
+    memset(cov, 0, bw*sizeof(double));
+    memset(acc, 0, (bw+1)*sizeof(double));
+    bool any = false;
 
-    if (fabs(y3-y1) > fabs(x3-x1)) 
+    for (s = 0; s < SVG_AA_SUBSAMPLES; ++s)
     {
-      x1 += 1.0;
-      x2 += 1.0;
-      x3 += 1.0;
+      double sy = (double)y+((double)s+0.5)/(double)SVG_AA_SUBSAMPLES;
+
+      while (nextedge < nedges && edges.Get()[nextedge].y0 <= sy) active.Add(nextedge++);
+
+      xings.Resize(0, false);
+      int a;
+      for (a = 0; a < active.GetSize(); )
+      {
+        const SVGEdge* e = edges.Get()+active.Get()[a];
+        if (e->y1 <= sy)
+        {
+          active.Get()[a] = active.Get()[active.GetSize()-1];
+          active.Resize(active.GetSize()-1, false);
+          continue;
+        }
+        double x[2] = { e->x0+(sy-e->y0)*(e->x1-e->x0)/(e->y1-e->y0), (double)e->dir };
+        // insertion sort by x, the list is short
+        int i = xings.GetSize()/2;
+        xings.Add(x, 2);
+        double* xp = xings.Get();
+        while (i > 0 && xp[2*i-2] > x[0])
+        {
+          xp[2*i] = xp[2*i-2];
+          xp[2*i+1] = xp[2*i-1];
+          --i;
+        }
+        xp[2*i] = x[0];
+        xp[2*i+1] = x[1];
+        ++a;
+      }
+
+      int i, nx = xings.GetSize()/2, wind = 0;
+      const double* xp = xings.Get();
+      double xstart = 0.0;
+      for (i = 0; i < nx; ++i)
+      {
+        bool wasin = (evenodd ? !!(wind&1) : !!wind);
+        wind += (int)xp[2*i+1];
+        bool isin = (evenodd ? !!(wind&1) : !!wind);
+        if (isin == wasin) continue;
+        if (isin)
+        {
+          xstart = xp[2*i];
+          continue;
+        }
+
+        double xa = xstart-(double)bx0, xb = xp[2*i]-(double)bx0;
+        if (xa < 0.0) xa = 0.0;
+        if (xb > (double)bw) xb = (double)bw;
+        if (xb <= xa) continue;
+        int ia = (int)xa, ib = (int)xb;
+        if (ia == ib)
+        {
+          cov[ia] += xb-xa;
+        }
+        else
+        {
+          cov[ia] += (double)(ia+1)-xa;
+          acc[ia+1] += 1.0;
+          acc[ib] -= 1.0;
+          if (ib < bw) cov[ib] += xb-(double)ib;
+        }
+        any = true;
+      }
     }
-    else
+
+    if (!any) continue;
+
+    LICE_pixel* row = bits+(flip ? bmph-1-y : y)*span+bx0;
+    double run = 0.0;
+    int x;
+    for (x = 0; x < bw; ++x)
     {
-      y1 += 1.0;
-      y2 += 1.0;
-      y3 += 1.0;
+      run += acc[x];
+      double c = (run+cov[x])*(1.0/(double)SVG_AA_SUBSAMPLES);
+      if (c > 0.001) SVGBlendPixel(row+x, color, (double)alpha*lice_min(c, 1.0));
     }
   }
 }
 
-static void SVGDrawCBezier(LICE_IBitmap* bmp, double x1, double y1, double x2, double y2, double x3, double y3, double x4, double y4,
-  LICE_pixel color, float alpha, bool aa, int linewid=1)
+static void SVGAddDisc(LICE_SVGPath* outline, double cx, double cy, double r)
 {
-  int i;
-  for (i = 0; i < linewid; ++i)
+  double pts[2*64];
+  int i, n = lice_max(8, lice_min(64, (int)(r*2.0)+6));
+  for (i = 0; i < n; ++i)
   {
-    LICE_DrawCBezier(bmp, x1, y1, x2, y2, x3, y3, x4, y4, color, alpha, LICE_BLIT_MODE_COPY, aa);
+    double t = 2.0*SVG_PI*(double)i/(double)n;
+    pts[2*i] = cx+r*cos(t);
+    pts[2*i+1] = cy+r*sin(t);
+  }
+  outline->AddPolygon(pts, n);
+}
 
-    if (fabs(y4-y1) > fabs(x4-x1)) 
-    {
-      x1 += 1.0;
-      x2 += 1.0;
-      x3 += 1.0;
-      x4 += 1.0;
-    }
-    else
+// outlines every segment as a quad with round joins, for filling with the nonzero rule.
+// all quads and discs wind the same way so overlaps never cancel out.
+static void SVGStrokePath(const LICE_SVGPath* path, double width, LICE_SVGPath* outline)
+{
+  double hw = width*0.5;
+  if (hw <= 0.0) return;
+
+  const double* pts = path->m_pts.Get();
+  const int* subs = path->m_subpaths.Get();
+  int s, nsubs = path->GetNumSubpaths();
+  for (s = 0; s < nsubs; ++s)
+  {
+    const double* sp = pts+2*subs[3*s];
+    int n = subs[3*s+1];
+    bool closed = !!subs[3*s+2];
+    int i, nsegs = (closed ? n : n-1);
+    if (n < 2) continue;
+
+    double prevdx = 0.0, prevdy = 0.0;
+    bool hasprev = false;
+    for (i = 0; i < nsegs; ++i)
     {
-      y1 += 1.0;
-      y2 += 1.0;
-      y3 += 1.0;
-      y4 += 1.0;
+      const double* p = sp+2*i;
+      const double* q = sp+2*((i+1)%n);
+      double dx = q[0]-p[0], dy = q[1]-p[1];
+      double len = sqrt(dx*dx+dy*dy);
+      if (len <= 0.0) continue;
+      dx /= len;
+      dy /= len;
+
+      if (hasprev && dx*prevdx+dy*prevdy < 0.999) SVGAddDisc(outline, p[0], p[1], hw);
+      else if (!hasprev && closed) SVGAddDisc(outline, p[0], p[1], hw);
+      hasprev = true;
+      prevdx = dx;
+      prevdy = dy;
+
+      double nx = -dy*hw, ny = dx*hw;
+      double quad[8] = { p[0]+nx, p[1]+ny, p[0]-nx, p[1]-ny, q[0]-nx, q[1]-ny, q[0]+nx, q[1]+ny };
+      outline->AddPolygon(quad, 4);
     }
   }
 }
 
+struct LICE_SVGStyle
+{
+  LICE_pixel fillcolor;
+  float fillalpha;
+  bool evenodd;
+
+  LICE_pixel strokecolor;
+  float strokealpha;
+  double strokewidth;
+
+  float opacity;
+};
+
 class LICE_SVGState
 {
 public:
 
   LICE_IBitmap* m_bmp;
-  LICE_IBitmap* m_tmpbmp;
   double m_x, m_y;
 
-  LICE_pixel m_strokecolor;
-  float m_strokealpha;
-  int m_strokewidth;
-
-  LICE_pixel m_fillcolor;
-  float m_fillalpha;
+  LICE_SVGStyle m_style;
 
   LICE_CachedFont* m_font;
   LOGFONT m_logfont;
@@ -188,11 +560,12 @@ public:
   void SetXY(double x, double y);
 
   void DrawText(LICE_IBitmap* bmp, const char* str);
+  void DrawPath(const LICE_SVGPath* path);
 
   bool ParseNode(TiXmlNode* xmlnode);
   bool ParseLine(TiXmlElement* xmlelem);
   bool ParseRect(TiXmlElement* xmlelem);
-  bool ParseCircle(TiXmlElement* xmlelem);
+  bool ParseCircle(TiXmlElement* xmlelem, bool ellipse);
   bool ParsePolyline(TiXmlElement* xmlelem, bool close);
   bool ParseText(TiXmlElement* xmlelem);
 
@@ -208,17 +581,18 @@ public:
 LICE_SVGState::LICE_SVGState(LICE_IBitmap* bmp)
 {
   m_bmp = bmp;
-  m_tmpbmp = 0;
 
   m_x = 0.0;
   m_y = 0.0;
 
-  m_strokecolor = 0;
-  m_strokealpha = 1.0f;
-  m_strokewidth = 1;
-
-  m_fillcolor = 0;
-  m_fillalpha = 1.0f;
+  // SVG initial values: black fill, no stroke
+  m_style.fillcolor = LICE_RGBA(0, 0, 0, 255);
+  m_style.fillalpha = 1.0f;
+  m_style.evenodd = false;
+  m_style.strokecolor = 0;
+  m_style.strokealpha = 1.0f;
+  m_style.strokewidth = 1.0;
+  m_style.opacity = 1.0f;
 
   m_font = 0;
   memset(&m_logfont, 0, sizeof(LOGFONT));
@@ -230,7 +604,6 @@ LICE_SVGState::LICE_SVGState(LICE_IBitmap* bmp)
 
 LICE_SVGState::~LICE_SVGState()
 {
-  delete(m_tmpbmp);
   delete(m_font);
 }
 
@@ -250,52 +623,150 @@ void LICE_SVGState::DrawText(LICE_IBitmap* bmp, const char* str)
     HFONT hf = CreateFontIndirect(&m_logfont);
     m_font->SetFromHFont(hf, LICE_FONT_FLAG_OWNS_HFONT);
   }
-  m_font->SetTextColor(m_fillcolor);
+  m_font->SetTextColor(m_style.fillcolor);
 
   RECT r = { SVGINT(m_x), SVGINT(m_y), SVGINT(m_x), SVGINT(m_y) };
   m_font->DrawText(m_bmp, str, -1, &r, m_textflags|DT_NOCLIP);
 }
 
+void LICE_SVGState::DrawPath(const LICE_SVGPath* path)
+{
+  if (m_style.fillcolor && m_style.fillalpha > 0.0f)
+  {
+    SVGFillPath(m_bmp, path, m_style.fillcolor, m_style.fillalpha*m_style.opacity, m_style.evenodd);
+  }
+  if (m_style.strokecolor && m_style.strokealpha > 0.0f)
+  {
+    LICE_SVGPath outline;
+    SVGStrokePath(path, m_style.strokewidth*SVGMScaleFactor(m_ctm), &outline);
+    SVGFillPath(m_bmp, &outline, m_style.strokecolor, m_style.strokealpha*m_style.opacity, false);
+  }
+}
+
 static const char* GetSVGStyleStr(const char* str, const char* name, int* len)
 {
-  const char* s = strstr(str, name);
+  const char* s = str;
+  while ((s = strstr(s, name)))
+  {
+    // don't let "opacity:" match "fill-opacity:"
+    if (s == str || s[-1] == ';' || s[-1] == ' ') break;
+    s += strlen(name);
+  }
   if (s)
   {
     s += strlen(name);
     while (*s == ' ') ++s;
     int i;
     const int MAXLEN = 256;
-    for (i = 0; i < MAXLEN && s[i] && s[i] != ';'; ++i) 
+    for (i = 0; i < MAXLEN && s[i] && s[i] != ';'; ++i)
     {
       // run through
     }
+    while (i > 0 && s[i-1] == ' ') --i;
     if (i && i < MAXLEN) *len = i;
     else s = 0;
   }
   return s;
 }
 
+// a style property if present, otherwise the presentation attribute
+static const char* GetSVGProperty(TiXmlElement* xmlelem, const char* name, int* len)
+{
+  const char* style = xmlelem->Attribute("style");
+  if (style)
+  {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s:", name);
+    const char* s = GetSVGStyleStr(style, buf, len);
+    if (s) return s;
+  }
+  const char* s = xmlelem->Attribute(name);
+  if (s)
+  {
+    while (*s == ' ') ++s;
+    *len = (int)strlen(s);
+    while (*len > 0 && s[*len-1] == ' ') --*len;
+    if (!*len) s = 0;
+  }
+  return s;
+}
+
+// s isn't terminated after len chars when it comes from a style attribute, and the named colour
+// lookup compares whole strings
+static int SVGColorFromStr(const char* s, int len)
+{
+  char buf[256];
+  if (len >= (int)sizeof(buf)) return 0;
+  memcpy(buf, s, len);
+  buf[len] = 0;
+  return LICE_RGBA_from_SVG(buf, len);
+}
+
 bool LICE_SVGState::ParseTransform(TiXmlElement* xmlelem, double prevctm[])
 {
   const char* str = xmlelem->Attribute("transform");
-  while (str && *str == ' ') ++str;
 
   int ntrans = 0;
-  while (str && *str)
+  while (str && *(str = SVGSkipSep(str)))
   {
-    double a = 1.0, b = 0.0, c = 0.0, d = 1.0, e = 0.0, f = 0.0;
+    const char* name = str;
+    while (*str && *str != '(') ++str;
+    if (*str != '(') break;
+    int namelen = (int)(str-name);
+    while (namelen && name[namelen-1] == ' ') --namelen;
+    ++str;
+
+    double v[6];
     int n = 0;
+    while (n < 6 && SVGParseNum(&str, &v[n])) ++n;
+    str = SVGSkipSep(str);
+    if (*str != ')') break;
+    ++str;
 
-    bool ok = (sscanf(str, "matrix(%lf,%lf,%lf,%lf,%lf,%lf) %n", &a, &b, &c, &d, &e, &f, &n) == 6);
-    if (!ok) ok = (sscanf(str, "translate(%lf,%lf) %n", &e, &f, &n) == 2);
-    if (!ok) ok = (sscanf(str, "scale(%lf,%lf) %n", &a, &d, &n) == 2);
-    // todo rotate, skew
-    if (!ok || !n) break;
+    double a = 1.0, b = 0.0, c = 0.0, d = 1.0, e = 0.0, f = 0.0;
+    bool ok = true;
+    if (namelen == 6 && !strncmp(name, "matrix", 6) && n == 6)
+    {
+      a = v[0]; b = v[1]; c = v[2]; d = v[3]; e = v[4]; f = v[5];
+    }
+    else if (namelen == 9 && !strncmp(name, "translate", 9) && (n == 1 || n == 2))
+    {
+      e = v[0];
+      f = (n == 2 ? v[1] : 0.0);
+    }
+    else if (namelen == 5 && !strncmp(name, "scale", 5) && (n == 1 || n == 2))
+    {
+      a = v[0];
+      d = (n == 2 ? v[1] : v[0]);
+    }
+    else if (namelen == 6 && !strncmp(name, "rotate", 6) && (n == 1 || n == 3))
+    {
+      double t = v[0]*SVG_PI/180.0;
+      a = d = cos(t);
+      b = sin(t);
+      c = -b;
+      if (n == 3)  // rotate about (cx,cy)
+      {
+        e = v[1]-a*v[1]-c*v[2];
+        f = v[2]-b*v[1]-d*v[2];
+      }
+    }
+    else if (namelen == 5 && !strncmp(name, "skewX", 5) && n == 1)
+    {
+      c = tan(v[0]*SVG_PI/180.0);
+    }
+    else if (namelen == 5 && !strncmp(name, "skewY", 5) && n == 1)
+    {
+      b = tan(v[0]*SVG_PI/180.0);
+    }
+    else
+    {
+      ok = false;
+    }
+    if (!ok) break;
 
     if (!ntrans++) memcpy(prevctm, m_ctm, SVG_MAT_SZ);
     SVGMMult(m_ctm, a, b, c, d, e, f);
-    str += n;
-    while (*str == ' ') ++str;
   }
 
   return !!ntrans;
@@ -313,26 +784,33 @@ bool LICE_SVGState::ParsePosition(TiXmlElement* xmlelem)
   return true;
 }
 
+// only changes what the element specifies, ParseNode restores the parent's style afterwards
 bool LICE_SVGState::ParseColor(TiXmlElement* xmlelem)
 {
   const char* s;
   int len;
 
-  const char* str = xmlelem->Attribute("style");
-  if (str)
-  {
-    s = GetSVGStyleStr(str, "fill:", &len);
-    if (s) m_fillcolor = LICE_RGBA_from_SVG(s, len);
-    else m_fillcolor = 0;
+  s = GetSVGProperty(xmlelem, "fill", &len);
+  if (s) m_style.fillcolor = SVGColorFromStr(s, len);
+
+  s = GetSVGProperty(xmlelem, "fill-opacity", &len);
+  if (s) m_style.fillalpha = (float)atof(s);
+
+  s = GetSVGProperty(xmlelem, "fill-rule", &len);
+  if (s) m_style.evenodd = (len == 7 && !strncmp(s, "evenodd", 7));
 
-    s = GetSVGStyleStr(str, "stroke:", &len);
-    if (s) m_strokecolor = LICE_RGBA_from_SVG(s, len);
-    else m_strokecolor = 0;
+  s = GetSVGProperty(xmlelem, "stroke", &len);
+  if (s) m_style.strokecolor = SVGColorFromStr(s, len);
+
+  s = GetSVGProperty(xmlelem, "stroke-opacity", &len);
+  if (s) m_style.strokealpha = (float)atof(s);
+
+  s = GetSVGProperty(xmlelem, "stroke-width", &len);
+  if (s && atof(s) >= 0.0) m_style.strokewidth = atof(s);
+
+  s = GetSVGProperty(xmlelem, "opacity", &len);
+  if (s) m_style.opacity *= (float)atof(s);
 
-    s = GetSVGStyleStr(str, "stroke-width:", &len);
-    if (s && *s >= '0' && *s <= '9') m_strokewidth = *s-'0';
-    else m_strokewidth = 1;
-  } 
   return true;
 }
 
@@ -347,7 +825,7 @@ bool LICE_SVGState::ParseFont(TiXmlElement* xmlelem)
   if (str)
   {
     s = GetSVGStyleStr(str, "font-family:", &len);
-    if (s) 
+    if (s)
     {
       lstrcpyn_safe(m_logfont.lfFaceName, s, len);
       m_fontdirty = true;
@@ -400,72 +878,78 @@ bool LICE_SVGState::ParseText(TiXmlElement* xmlelem)
   {
     // no transform for tspan
     ParsePosition(xmlchild);
+    LICE_SVGStyle prevstyle = m_style;
     ParseColor(xmlchild);
     if (!ParseText(xmlchild)) ok = false;
+    m_style = prevstyle;
   }
- 
+
   return ok;
 }
 
 bool LICE_SVGState::ParseRect(TiXmlElement* xmlelem)
 {
   bool ok = false;
-  double w, h;
+  double x = 0.0, y = 0.0, w, h;
+  xmlelem->Attribute("x", &x);
+  xmlelem->Attribute("y", &y);
 
-  double rx = 0.0, ry = 0.0;
-  xmlelem->Attribute("rx", &rx);
-  xmlelem->Attribute("ry", &ry);
+  // a missing radius takes the other one
+  const char* srx = xmlelem->Attribute("rx");
+  const char* sry = xmlelem->Attribute("ry");
+  double rx = (srx ? atof(srx) : sry ? atof(sry) : 0.0);
+  double ry = (sry ? atof(sry) : rx);
+  if (rx < 0.0 || ry < 0.0) rx = ry = 0.0;
 
   ok = (xmlelem->Attribute("width", &w) && xmlelem->Attribute("height", &h));
 
-  if (ok)
+  if (ok && w > 0.0 && h > 0.0)
   {
-    SVGMScale(m_ctm, &w, &h);
-    SVGMScale(m_ctm, &rx, &ry);
-
-    if (m_fillcolor && m_fillalpha > 0.0f)
-    {
-      LICE_FillRect(m_bmp, SVGINT(m_x), SVGINT(m_y), SVGINT(w), SVGINT(h), m_fillcolor, m_fillalpha, LICE_BLIT_MODE_COPY);
-    }
-    if (m_strokecolor && m_strokealpha > 0.0f)
-    {
-      if (rx > 0.0)
-      {
-        LICE_RoundRect(m_bmp, SVGINT(m_x), SVGINT(m_y), SVGINT(w), SVGINT(h), (int) rx, m_strokecolor, m_strokealpha, LICE_BLIT_MODE_COPY, true);
-      }
-      else
-      {
-        SVGDrawRect(m_bmp, m_x, m_y, w, h, m_strokecolor, m_strokealpha, m_strokewidth);
-      }
-    }
+    rx = lice_min(rx, w*0.5);
+    ry = lice_min(ry, h*0.5);
+
+    LICE_SVGPath path(m_ctm);
+    path.MoveTo(x+rx, y);
+    path.LineTo(x+w-rx, y);
+    if (rx > 0.0 && ry > 0.0) path.ArcTo(rx, ry, 0.0, false, true, x+w, y+ry);
+    path.LineTo(x+w, y+h-ry);
+    if (rx > 0.0 && ry > 0.0) path.ArcTo(rx, ry, 0.0, false, true, x+w-rx, y+h);
+    path.LineTo(x+rx, y+h);
+    if (rx > 0.0 && ry > 0.0) path.ArcTo(rx, ry, 0.0, false, true, x, y+h-ry);
+    path.LineTo(x, y+ry);
+    if (rx > 0.0 && ry > 0.0) path.ArcTo(rx, ry, 0.0, false, true, x+rx, y);
+    path.Close();
+    DrawPath(&path);
   }
 
   return ok;
 }
 
-bool LICE_SVGState::ParseCircle(TiXmlElement* xmlelem)
+bool LICE_SVGState::ParseCircle(TiXmlElement* xmlelem, bool ellipse)
 {
   bool ok = false;
 
-  double cx, cy, r = 0.0;
-  ok = !!xmlelem->Attribute("cx", &cx);
-  if (ok) ok = !!xmlelem->Attribute("cy", &cy);
-  if (ok) ok = (!!xmlelem->Attribute("r", &r) && r > 0.0);
+  double cx = 0.0, cy = 0.0, rx = 0.0, ry = 0.0;
+  xmlelem->Attribute("cx", &cx);
+  xmlelem->Attribute("cy", &cy);
+  if (ellipse)
+  {
+    ok = (xmlelem->Attribute("rx", &rx) && xmlelem->Attribute("ry", &ry) && rx > 0.0 && ry > 0.0);
+  }
+  else
+  {
+    ok = (xmlelem->Attribute("r", &rx) && rx > 0.0);
+    ry = rx;
+  }
 
   if (ok)
   {
-    SVGMTransform(m_ctm, &cx, &cy);
-    r = 0.5*floor(r*2.0+0.5);
-
-    if (m_fillcolor && m_fillalpha > 0.0f)
-    {
-      LICE_FillCircle(m_bmp, cx, cy, r, m_fillcolor, m_fillalpha, LICE_BLIT_MODE_COPY, true);
-    }
-    if (m_strokecolor && m_strokealpha > 0.0f)
-    {
-      //LICE_Circle(m_bmp, cx, cy, r, m_strokecolor, m_strokealpha, LICE_BLIT_MODE_COPY, true);
-      SVGDrawCircle(m_bmp, cx, cy, r, m_strokecolor, m_strokealpha, true, m_strokewidth);
-    }
+    LICE_SVGPath path(m_ctm);
+    path.MoveTo(cx+rx, cy);
+    path.ArcTo(rx, ry, 0.0, false, true, cx-rx, cy);
+    path.ArcTo(rx, ry, 0.0, false, true, cx+rx, cy);
+    path.Close();
+    DrawPath(&path);
   }
 
   return ok;
@@ -481,10 +965,17 @@ bool LICE_SVGState::ParseLine(TiXmlElement* xmlelem)
 
   if (ok)
   {
-    SVGMTransform(m_ctm, &x1, &y1);
+    LICE_SVGPath path(m_ctm);
+    path.MoveTo(x1, y1);
+    path.LineTo(x2, y2);
+
+    // a line has no area to fill
+    LICE_pixel fillcolor = m_style.fillcolor;
+    m_style.fillcolor = 0;
+    DrawPath(&path);
+    m_style.fillcolor = fillcolor;
+
     SVGMTransform(m_ctm, &x2, &y2);
-    //LICE_FLine(m_bmp, x1, y1, x2, y2, m_strokecolor, m_strokealpha, LICE_BLIT_MODE_COPY, true);
-    SVGDrawLine(m_bmp, x1, y1, x2, y2, m_strokecolor, m_strokealpha, true, m_strokewidth);
     SetXY(x2, y2);
   }
 
@@ -495,256 +986,148 @@ bool LICE_SVGState::ParsePolyline(TiXmlElement* xmlelem, bool close)
 {
   bool ok = false;
 
-  double firstx = m_x;
-  double firsty = m_y;
+  LICE_SVGPath path(m_ctm);
   int npts = 0;
 
   const char* str = xmlelem->Attribute("points");
-  while (str && *str == ' ') ++str;
-  
-  while (str && *str)
-  {    
-    double x, y;
-    int n = 0;
-
-    ok = (sscanf(str, "%lf,%lf %n", &x, &y, &n) == 2);
-    if (ok)
-    {
-      SVGMTransform(m_ctm, &x, &y);
-      if (!npts++) 
-      {
-        firstx = x;
-        firsty = y;
-      }
-      else 
-      {
-        //LICE_FLine(m_bmp, m_x, m_y, x, y, m_strokecolor, m_strokealpha, LICE_BLIT_MODE_COPY, true);
-        SVGDrawLine(m_bmp, m_x, m_y, x, y, m_strokecolor, m_strokealpha, true, m_strokewidth);
-      }
-      SetXY(x, y);
-    }
-
-    if (!ok || !n) break;
-    str += n;
-    while (*str == ' ') ++str;
-  }
-
-  if (close && npts)
+  double x, y;
+  while (str && SVGParseNum(&str, &x) && SVGParseNum(&str, &y))
   {
-    //LICE_FLine(m_bmp, m_x, m_y, firstx, firsty, m_strokecolor, m_strokealpha, LICE_BLIT_MODE_COPY, true);
-    SVGDrawLine(m_bmp, m_x, m_y, firstx, firsty, m_strokecolor, m_strokealpha, true, m_strokewidth);
-    SetXY(firstx, firsty);
+    if (!npts++) path.MoveTo(x, y);
+    else path.LineTo(x, y);
+    ok = true;
   }
 
-  return ok;
-}
-
-static void AdjRelXY(double* lastx, double* lasty, double* x, double* y, double m[], bool isrel, RECT* r)
-{
-  if (isrel)
+  if (npts)
   {
-    *x += *lastx;
-    *y += *lasty;
+    if (close) path.Close();
+    DrawPath(&path);
+    x = path.m_cx;
+    y = path.m_cy;
+    SVGMTransform(m_ctm, &x, &y);
+    SetXY(x, y);
   }
-  *lastx = *x;
-  *lasty = *y;
-  SVGMTransform(m, x, y);
 
-  if (r)
-  {
-    if (r->left < 0 || *x < r->left) r->left = *x-2;
-    if (r->right < 0 || *x >= r->right) r->right = *x+3;
-    if (r->top < 0 || *y < r->top) r->top = *y-2;
-    if (r->bottom < 0 || *y >= r->bottom) r->bottom = *y+3;
-  }
+  return ok;
 }
 
-static bool RenderSVGPath(const char* str, double m[], RECT* r, 
-  LICE_IBitmap* bmp=0, LICE_pixel color=0xFFFFFFFF, float alpha=1.0f, bool aa=false, int strokewid=1,
-  double* lastx=0, double* lasty=0)
+// SVG path data, all commands absolute and relative, with implicit repeats
+static bool ParseSVGPathData(const char* str, LICE_SVGPath* path)
 {
-  bool allok = true;
-  
-  double firstx, firsty;  // first point on subpath, global coords
-  double prevx, prevy;    // previous point, local coords
-  double x0, y0;          // point at end of previous move, global coords
+  char cmd = 0, prevcmd = 0;
+  double ctrlx = 0.0, ctrly = 0.0;  // last control point, for S and T
 
-  while (str && *str)
+  while (str && *(str = SVGSkipSep(str)))
   {
-    double x1, y1, x2, y2, x3, y3;
-    int n = 0;
-    bool ok = false;
+    if ((*str >= 'a' && *str <= 'z') || (*str >= 'A' && *str <= 'Z')) cmd = *str++;
+    else if (!cmd) return false;
 
-    char c = str[0];
-    bool isrel = (c == tolower(c));
-    ++str;
-    while (*str == ' ') ++str;
+    bool isrel = (cmd >= 'a' && cmd <= 'z');
+    double ox = (isrel ? path->m_cx : 0.0), oy = (isrel ? path->m_cy : 0.0);
+    double v[6];
+    bool ok = true, flags[2];
 
-    switch (toupper(c))
+    switch (toupper(cmd))
     {
       case 'M':
+        ok = (SVGParseNum(&str, &v[0]) && SVGParseNum(&str, &v[1]));
+        if (ok) path->MoveTo(ox+v[0], oy+v[1]);
+        cmd = (isrel ? 'l' : 'L');  // further pairs are lineto
+      break;
+
       case 'L':
-        ok = (sscanf(str, "%lf,%lf %n", &x1, &y1, &n) == 2);
-        if (ok)
-        {          
-          AdjRelXY(&prevx, &prevy, &x1, &y1, m, isrel, r);
-          if (c == 'M')
-          {
-            firstx = x1;
-            firsty = y1;
-          }
-          else if (bmp)
-          {
-            //LICE_FLine(bmp, x0, y0, x1, y1, color, alpha, LICE_BLIT_MODE_COPY, aa);
-            SVGDrawLine(bmp, x0, y0, x1, y1, color, alpha, aa, strokewid);
-          }
-          x0 = x1;
-          y0 = y1;          
-        }
+        ok = (SVGParseNum(&str, &v[0]) && SVGParseNum(&str, &v[1]));
+        if (ok) path->LineTo(ox+v[0], oy+v[1]);
       break;
 
-      case 'Z':
-        ok = true;
-        --str;
-        n = 1;
-        if (ok)
-        {
-          if (bmp && x0 != firstx && y0 != firsty)
-          {
-            //LICE_FLine(bmp, x0, y0, firstx, firsty, color, alpha, LICE_BLIT_MODE_COPY, aa);
-            SVGDrawLine(bmp, x0, y0, firstx, firsty, color, alpha, aa, strokewid);
-            x0 = firstx;
-            y0 = firsty;
-          }
-        }
+      case 'H':
+        ok = SVGParseNum(&str, &v[0]);
+        if (ok) path->LineTo(ox+v[0], path->m_cy);
       break;
 
-      case 'Q':
-        ok = (sscanf(str, "%lf,%lf %lf,%lf %n", &x1, &y1, &x2, &y2, &n) == 4);
-        if (ok)
-        {
-          AdjRelXY(&prevx, &prevy, &x1, &y1, m, isrel, r);
-          AdjRelXY(&prevx, &prevy, &x2, &y2, m, isrel, r);
-          if (bmp)
-          {
-            //LICE_DrawQBezier(bmp, x0, y0, x1, y1, x2, y2, color, alpha, LICE_BLIT_MODE_COPY, aa);
-            SVGDrawQBezier(bmp, x0, y1, x1, y1, x2, y2, color, alpha, aa, strokewid);
-            x0 = x2;
-            y0 = y2;
-          }         
-        }
+      case 'V':
+        ok = SVGParseNum(&str, &v[0]);
+        if (ok) path->LineTo(path->m_cx, oy+v[0]);
       break;
 
       case 'C':
-        ok = (sscanf(str, "%lf,%lf %lf,%lf %lf,%lf %n", &x1, &y1, &x2, &y2, &x3, &y3, &n) == 6);
+      case 'S':
+      {
+        int i = 0;
+        if (toupper(cmd) == 'S')
+        {
+          bool reflect = (toupper(prevcmd) == 'C' || toupper(prevcmd) == 'S');
+          v[0] = (reflect ? 2.0*path->m_cx-ctrlx : path->m_cx)-ox;
+          v[1] = (reflect ? 2.0*path->m_cy-ctrly : path->m_cy)-oy;
+          i = 2;
+        }
+        for (; ok && i < 6; ++i) ok = SVGParseNum(&str, &v[i]);
         if (ok)
         {
-          AdjRelXY(&prevx, &prevy, &x1, &y1, m, isrel, r);
-          AdjRelXY(&prevx, &prevy, &x2, &y2, m, isrel, r);
-          AdjRelXY(&prevx, &prevy, &x3, &y3, m, isrel, r);
-          if (bmp)
-          {
-            //LICE_DrawCBezier(bmp, x0, y0, x1, y1, x2, y2, x3, y3, color, alpha, LICE_BLIT_MODE_COPY, aa);
-            SVGDrawCBezier(bmp, x0, y0, x1, y1, x2, y2, x3, y3, color, alpha, aa, strokewid);
-            x0 = x3;
-            y0 = y3;
-          }
+          ctrlx = ox+v[2];
+          ctrly = oy+v[3];
+          path->CubicTo(ox+v[0], oy+v[1], ctrlx, ctrly, ox+v[4], oy+v[5]);
         }
+      }
       break;
-    }
-
-    if (!ok) allok = false;
-    if (!ok || !n) break;    
-    str += n;
-    while (*str == ' ') ++str;
-  }
-
-  if (lastx) *lastx = x0;
-  if (lasty) *lasty = y0;
-  return allok;
-}
-
-static bool FillSVGScanLine(LICE_IBitmap* dest, LICE_pixel* rowpx, LICE_pixel col, float alpha, RECT* r, int y, int dir)
-{
-  bool prevon = false;
-  bool dofill = false;
 
-  int i, x, xstart;
-  int w = r->right-r->left;
-  for (i = 0; i < w; ++i)
-  {
-    x = (dir < 0 ? w-i-1 : i);
-    bool curon = !!rowpx[x];
-    if (curon != prevon)
-    {
-      if (!curon)
-      {
-        xstart = x;
-      }
-      else
+      case 'Q':
+      case 'T':
       {
-        if (dofill)
+        int i = 0;
+        if (toupper(cmd) == 'T')
         {
-          LICE_Line(dest, r->left+xstart/*+dir*/, y, r->left+x/*-dir*/, y, col, alpha, LICE_BLIT_MODE_COPY, false);
+          bool reflect = (toupper(prevcmd) == 'Q' || toupper(prevcmd) == 'T');
+          v[0] = (reflect ? 2.0*path->m_cx-ctrlx : path->m_cx)-ox;
+          v[1] = (reflect ? 2.0*path->m_cy-ctrly : path->m_cy)-oy;
+          i = 2;
+        }
+        for (; ok && i < 4; ++i) ok = SVGParseNum(&str, &v[i]);
+        if (ok)
+        {
+          ctrlx = ox+v[0];
+          ctrly = oy+v[1];
+          path->QuadTo(ctrlx, ctrly, ox+v[2], oy+v[3]);
         }
-        dofill = !dofill;
       }
-      prevon = curon;
-    }
-  }
+      break;
 
-  return !dofill; // if we ended before hitting the end of a fill, we nicked an edge
-}
+      case 'A':
+        ok = (SVGParseNum(&str, &v[0]) && SVGParseNum(&str, &v[1]) && SVGParseNum(&str, &v[2]) &&
+          SVGParseFlag(&str, &flags[0]) && SVGParseFlag(&str, &flags[1]) &&
+          SVGParseNum(&str, &v[3]) && SVGParseNum(&str, &v[4]));
+        if (ok) path->ArcTo(v[0], v[1], v[2], flags[0], flags[1], ox+v[3], oy+v[4]);
+      break;
 
-static bool FillSVGShape(LICE_IBitmap* dest, LICE_IBitmap* src, LICE_pixel col, float alpha, RECT *r)
-{
-  bool ok = true;
-  
-  LICE_pixel* rowpx = src->getBits();
-  int span = src->getRowSpan();
+      case 'Z':
+        path->Close();
+        prevcmd = cmd;
+        cmd = 0;  // no implicit repeat
+      continue;
 
-  int y;
-  for (y = r->top; y < r->bottom; ++y, rowpx += span)
-  {
-    if (!FillSVGScanLine(dest, rowpx, col, alpha, r, y, 1) && 
-      !FillSVGScanLine(dest, rowpx, col, alpha, r, y, -1))
-    {      
-      ok = false;     
+      default:
+        ok = false;
+      break;
     }
+
+    if (!ok) return false;
+    prevcmd = cmd;
   }
 
-  return ok;
+  return true;
 }
 
 bool LICE_SVGState::ParsePath(TiXmlElement* xmlelem)
 {
-  bool ok = true;
-
-  const char* str = xmlelem->Attribute("d");
-  while (str && *str == ' ') ++str;
-
-  if (m_fillcolor && m_fillalpha > 0.0f)  // fill
-  {
-    RECT r = { -1, -1, -1, -1 };  // bounding box
-    if (ok) ok = RenderSVGPath(str, m_ctm, &r);  // measure
-
-    double m[6];
-    SVGMSet(m, 1.0, 0.0, 0.0, 1.0, -(double)r.left, -(double)r.top);  // translate to tmpbmp on matrix LHS
-    SVGMMult(m, m_ctm[0], m_ctm[3], m_ctm[1], m_ctm[4], m_ctm[2], m_ctm[5]);
+  LICE_SVGPath path(m_ctm);
+  bool ok = ParseSVGPathData(xmlelem->Attribute("d"), &path);
 
-    if (!m_tmpbmp) m_tmpbmp = new LICE_MemBitmap;
-    m_tmpbmp->resize(r.right-r.left, r.bottom-r.top);
-    LICE_Clear(m_tmpbmp, 0);
+  // draw whatever parsed, per the SVG error handling rules
+  DrawPath(&path);
 
-    if (ok) ok = RenderSVGPath(str, m, 0, m_tmpbmp);  // outline to tmpbmp
-    // debug LICE_Blit(m_bmp, m_tmpbmp, r.left, r.top, 0, 0, r.right-r.left, r.bottom-r.top, 1.0f, LICE_BLIT_MODE_COPY|LICE_BLIT_USE_ALPHA);
-    if (ok) ok = FillSVGShape(m_bmp, m_tmpbmp, m_fillcolor, m_fillalpha, &r);  // raytrace to dest
-  }
-
-  if (m_strokecolor && m_strokealpha > 0.0f)  // outline
-  {
-    if (ok) ok = RenderSVGPath(str, m_ctm, 0, m_bmp, m_strokecolor, m_strokealpha, true, m_strokewidth, &m_x, &m_y);
-  }
+  double x = path.m_cx, y = path.m_cy;
+  SVGMTransform(m_ctm, &x, &y);
+  SetXY(x, y);
 
   return ok;
 }
@@ -763,68 +1146,95 @@ bool LICE_SVGState::ParseNode(TiXmlNode* xmlnode)
       const char* name = xmlchild->Value();
       TiXmlElement* xmlelem = xmlchild->ToElement();
 
+      // not rendered
+      if (!stricmp(name, "defs") || !stricmp(name, "title") || !stricmp(name, "desc") ||
+        !stricmp(name, "metadata") || !stricmp(name, "clipPath") || !stricmp(name, "mask")) continue;
+
       double prevctm[6];
       bool transform = ParseTransform(xmlelem, prevctm);
 
+      LICE_SVGStyle prevstyle = m_style;
       ParsePosition(xmlelem);
       ParseColor(xmlelem);
 
       if (!stricmp(name, "svg") || !stricmp(name, "g")) ok = ParseNode(xmlelem);
-      else if (!stricmp(name, "rect")) ok = ParseRect(xmlelem);      
-      else if (!stricmp(name, "circle")) ok = ParseCircle(xmlelem);
-      else if (!stricmp(name, "line")) ok = ParseLine(xmlelem);      
+      else if (!stricmp(name, "rect")) ok = ParseRect(xmlelem);
+      else if (!stricmp(name, "circle")) ok = ParseCircle(xmlelem, false);
+      else if (!stricmp(name, "ellipse")) ok = ParseCircle(xmlelem, true);
+      else if (!stricmp(name, "line")) ok = ParseLine(xmlelem);
       else if (!stricmp(name, "polyline")) ok = ParsePolyline(xmlelem, false);
       else if (!stricmp(name, "polygon")) ok = ParsePolyline(xmlelem, true);
       else if (!stricmp(name, "path")) ok = ParsePath(xmlelem);
       else if (!stricmp(name, "text") || !stricmp(name, "tspan")) ok = ParseText(xmlelem);
       // it's not an error not to recognize a tag
 
-      if (!ok) 
+      if (!ok)
       {
         allok = false;
         // log error and continue
       }
 
+      m_style = prevstyle;
       if (transform) memcpy(m_ctm, prevctm, SVG_MAT_SZ);
     }
   }
 
   return true; //allok;
 }
-        
-static LICE_IBitmap *LICE_RenderSVG(TiXmlDocument* xmldoc, LICE_IBitmap *bmp)
+
+// destw/desth <= 0 renders at the document's own size, otherwise the document is scaled to fill destw x desth
+static LICE_IBitmap *LICE_RenderSVG(TiXmlDocument* xmldoc, LICE_IBitmap *bmp, int destw=0, int desth=0)
 {
   if (!xmldoc) return 0;
 
   TiXmlElement* xmlroot = xmldoc->RootElement();
   if (!xmlroot || stricmp(xmlroot->Value(), "svg")) return 0;
-  
-  int srcw = 0;
-  int srch = 0;
-  if (!xmlroot->Attribute("width", &srcw) || !xmlroot->Attribute("height", &srch)) return 0;
-  if (!srcw || !srch) return 0;
-
-  bool ourbmp = !bmp;
-  if (ourbmp) bmp = new LICE_MemBitmap;
-  LICE_SVGState svgstate(bmp);
 
-/*
-  int destw = bmp->getWidth();
-  int desth = bmp->getHeight();
+  double srcw = 0.0, srch = 0.0;
+  xmlroot->Attribute("width", &srcw);
+  xmlroot->Attribute("height", &srch);
 
-  if (destw && desth) 
+  double vb[4] = { 0.0, 0.0, srcw, srch };  // viewBox, user space that maps onto the bitmap
+  const char* str = xmlroot->Attribute("viewBox");
+  if (str)
   {
-    double xscale = (double)destw/(double)srcw;
-    double yscale = (double)desth/(double)srch;
-    SVGMSet(svgstate.m_ctm, xscale, 0.0, 0.0, yscale, 0.0, 0.0);
+    int i;
+    for (i = 0; i < 4 && SVGParseNum(&str, &vb[i]); ++i)
+    {
+      // run through
+    }
+    if (i < 4 || vb[2] <= 0.0 || vb[3] <= 0.0)
+    {
+      vb[0] = vb[1] = 0.0;
+      vb[2] = srcw;
+      vb[3] = srch;
+    }
   }
-  else
-*/
+  if (srcw <= 0.0 || srch <= 0.0)
+  {
+    srcw = vb[2];
+    srch = vb[3];
+  }
+  if (srcw <= 0.0 || srch <= 0.0 || vb[2] <= 0.0 || vb[3] <= 0.0) return 0;
+
+  if (destw <= 0 || desth <= 0)
   {
-    bmp->resize(srcw, srch);
+    destw = SVGINT(srcw);
+    desth = SVGINT(srch);
   }
+  if (destw <= 0 || desth <= 0) return 0;
+
+  bool ourbmp = !bmp;
+  if (ourbmp) bmp = new LICE_MemBitmap;
+  LICE_SVGState svgstate(bmp);
+
+  double xscale = (double)destw/vb[2];
+  double yscale = (double)desth/vb[3];
+  SVGMSet(svgstate.m_ctm, xscale, 0.0, 0.0, yscale, -vb[0]*xscale, -vb[1]*yscale);
+
+  bmp->resize(destw, desth);
   LICE_Clear(bmp, 0);
-  
+
   if (!svgstate.ParseNode(xmlroot) && ourbmp)
   {
     delete(bmp);
@@ -834,18 +1244,28 @@ static LICE_IBitmap *LICE_RenderSVG(TiXmlDocument* xmldoc, LICE_IBitmap *bmp)
 }
 
 LICE_IBitmap* LICE_LoadSVG(const char* filename, LICE_IBitmap* bmp)
+{
+  return LICE_LoadSVGScaled(filename, 0, 0, bmp);
+}
+
+LICE_IBitmap* LICE_LoadSVGScaled(const char* filename, int destw, int desth, LICE_IBitmap* bmp)
 {
   TiXmlDocument xmldoc;
   xmldoc.SetCondenseWhiteSpace(false);
   if (!xmldoc.LoadFile(filename) || xmldoc.Error()) return 0;
-  return LICE_RenderSVG(&xmldoc, bmp);
+  return LICE_RenderSVG(&xmldoc, bmp, destw, desth);
 }
 
 LICE_IBitmap* LICE_LoadSVGFromBuffer(const char* buffer, int buflen, LICE_IBitmap* bmp)
+{
+  return LICE_LoadSVGFromBufferScaled(buffer, buflen, 0, 0, bmp);
+}
+
+LICE_IBitmap* LICE_LoadSVGFromBufferScaled(const char* buffer, int buflen, int destw, int desth, LICE_IBitmap* bmp)
 {
   TiXmlDocument xmldoc;
   xmldoc.SetCondenseWhiteSpace(false);
-  if (!xmldoc.Parse(buffer) || xmldoc.Error()) return 0;
-  return LICE_RenderSVG(&xmldoc, bmp);
+  xmldoc.Parse(buffer); // returns NULL at the end of the buffer, even when all of it parsed
+  if (xmldoc.Error()) return 0;
+  return LICE_RenderSVG(&xmldoc, bmp, destw, desth);
 }
-
@@ -230,6 +230,7 @@ template<class PTRTYPE> class WDL_PtrList
     }
 
     void Compact() { m_hb.Resize(m_hb.GetSize(),true); }
+    bool SetAllocator(WDL_Allocator *a) { return m_hb.SetAllocator(a); }
 
   private:
     WDL_HeapBuf m_hb;
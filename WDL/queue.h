@@ -129,6 +129,7 @@ public:
   }
 
   void SetGranul(int granul) { m_hb.SetGranul(granul); }
+  bool SetAllocator(WDL_Allocator *a) { return m_hb.SetAllocator(a); }
 
 
 
@@ -275,6 +276,7 @@ public:
   }
 
   void SetGranul(int granul) { m_hb.SetGranul(granul); }
+  bool SetAllocator(WDL_Allocator *a) { return m_hb.SetAllocator(a); }
 
 private:
   WDL_HeapBuf m_hb;
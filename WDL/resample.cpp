@@ -242,6 +242,7 @@ void WDL_Resampler::SetMode(bool interp, int filtercnt, bool sinc, int sinc_size
     delete m_iirfilter;
     m_iirfilter=0;
   }
+  else if (!m_iirfilter) m_iirfilter = new WDL_Resampler_IIRFilter; // now, rather than in ResampleOut() on the audio thread
 }
 
 void WDL_Resampler::SetRates(double rate_in, double rate_out) 
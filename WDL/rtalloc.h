@@ -0,0 +1,193 @@
+/*
+    WDL - rtalloc.h
+    Copyright (C) 2005 and later Cockos Incorporated
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would be
+       appreciated but is not required.
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+    3. This notice may not be removed or altered from any source distribution.
+
+*/
+
+/*
+
+  This file provides WDL_Allocator, the interface WDL_HeapBuf (and so WDL_TypedBuf,
+  WDL_PtrList, WDL_Queue etc) can use instead of malloc()/realloc()/free(). See
+  rtpool.h for a preallocated, lock-free implementation to use on audio threads.
+
+  It also has a debug mode for finding allocations on real-time threads. Compile
+  everything with WDL_RT_MALLOC_TRAP defined, and put a WDL_RTScope on the stack
+  wherever a thread must not allocate (IPlug does this around its process calls):
+
+    void MyPlug::ProcessDoubleReplacing(...)  // already inside a WDL_RTScope
+    {
+      m_buf.Resize(nFrames); // traps if m_buf has to grow from the system heap
+    }
+
+  WDL_HeapBuf checks the thread before it calls the system allocator. To catch every
+  malloc()/free()/new/delete, including the ones in libraries, also define
+  WDL_RT_MALLOC_TRAP_IMPLEMENT in exactly one source file before including this. That
+  wraps the allocator on glibc, and installs a CRT alloc hook on Windows debug builds.
+
+  On glibc the wrappers only take effect in the executable: in a plug-in that a host
+  dlopen()s, the host's malloc() wins symbol resolution and nothing below is called.
+  To check a plug-in, build its processing into an executable that drives it, e.g. the
+  headless build in IPlugExamples/IPlugEffect/headless with WDL_RT_MALLOC_TRAP added to
+  CFLAGS and WDL_RT_MALLOC_TRAP_IMPLEMENT defined in its main file. (The Windows CRT hook
+  works from a DLL, as long as it shares the debug CRT with the code being checked.)
+
+  On a trap, WDL_RT_MALLOC_TRAP_HANDLER(what, size) is called. The default prints the
+  allocation and breaks into the debugger (or aborts), unless WDL_RT_TrapAbort() has
+  been set to false, in which case it only counts it in WDL_RT_TrapCount().
+
+*/
+
+#ifndef _WDL_RTALLOC_H_
+#define _WDL_RTALLOC_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+class WDL_Allocator
+{
+public:
+  virtual ~WDL_Allocator() { }
+
+  // Alloc/Realloc return NULL on failure, Realloc leaves buf alone if it fails. buf may be NULL.
+  virtual void *Alloc(int size)=0;
+  virtual void *Realloc(void *buf, int newsize, int oldsize)=0;
+  virtual void Free(void *buf)=0;
+};
+
+
+#ifdef WDL_RT_MALLOC_TRAP
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <crtdbg.h>
+  #define WDL_RT_THREADLOCAL __declspec(thread)
+#else
+  #include <unistd.h>
+  // initial-exec, or in a shared object every access could go through __tls_get_addr(), which
+  // can itself call malloc() the first time a thread touches the variable.
+  #define WDL_RT_THREADLOCAL __thread __attribute__((tls_model("initial-exec")))
+#endif
+
+// These are inline rather than static so that every file shares one copy.
+inline int &WDL_RT_ThreadDepth() { static WDL_RT_THREADLOCAL int depth; return depth; }
+inline volatile int &WDL_RT_TrapCount() { static volatile int cnt; return cnt; }
+inline bool &WDL_RT_TrapAbort() { static bool ab=true; return ab; }
+
+inline bool WDL_RT_IsRealtimeThread() { return WDL_RT_ThreadDepth() > 0; }
+
+inline void WDL_RT_Trap(const char *what, size_t size)
+{
+  int &depth=WDL_RT_ThreadDepth();
+  const int olddepth=depth;
+  depth=0; // reporting may allocate
+#ifdef _WIN32
+  InterlockedIncrement((LONG *)&WDL_RT_TrapCount());
+  char tmp[256];
+  _snprintf(tmp,sizeof(tmp),"WDL_RT_MALLOC_TRAP: %s(%d) on a real-time thread\n",what,(int)size);
+  tmp[sizeof(tmp)-1]=0;
+  OutputDebugString(tmp);
+  if (WDL_RT_TrapAbort()) { if (IsDebuggerPresent()) DebugBreak(); else abort(); }
+#else
+  __sync_add_and_fetch(&WDL_RT_TrapCount(),1);
+  char tmp[256];
+  const int l=snprintf(tmp,sizeof(tmp),"WDL_RT_MALLOC_TRAP: %s(%d) on a real-time thread\n",what,(int)size);
+  if (l>0) write(2,tmp,l < (int)sizeof(tmp) ? l : (int)sizeof(tmp)-1);
+  if (WDL_RT_TrapAbort()) abort();
+#endif
+  depth=olddepth;
+}
+
+#ifndef WDL_RT_MALLOC_TRAP_HANDLER
+#define WDL_RT_MALLOC_TRAP_HANDLER(what, size) WDL_RT_Trap(what, size);
+#endif
+
+#define WDL_RT_CHECK_ALLOC(what, size) { if (WDL_RT_IsRealtimeThread()) { WDL_RT_MALLOC_TRAP_HANDLER(what, size) } }
+
+// Marks the current thread as real-time while in scope. Scopes can nest, and
+// WDL_RTScope(false) lifts the mark again, for known one-off allocations.
+class WDL_RTScope
+{
+public:
+  explicit WDL_RTScope(bool rt=true) : m_olddepth(WDL_RT_ThreadDepth()) { WDL_RT_ThreadDepth() = rt ? m_olddepth+1 : 0; }
+  ~WDL_RTScope() { WDL_RT_ThreadDepth() = m_olddepth; }
+private:
+  int m_olddepth;
+};
+
+
+#ifdef WDL_RT_MALLOC_TRAP_IMPLEMENT
+
+#if defined(__GLIBC__)
+
+extern "C" {
+  void *__libc_malloc(size_t);
+  void *__libc_calloc(size_t, size_t);
+  void *__libc_realloc(void *, size_t);
+  void *__libc_memalign(size_t, size_t);
+  void __libc_free(void *);
+
+  void *malloc(size_t size) __THROW { WDL_RT_CHECK_ALLOC("malloc",size) return __libc_malloc(size); }
+  void *calloc(size_t n, size_t size) __THROW { WDL_RT_CHECK_ALLOC("calloc",n*size) return __libc_calloc(n,size); }
+  void *realloc(void *p, size_t size) __THROW { WDL_RT_CHECK_ALLOC("realloc",size) return __libc_realloc(p,size); }
+  void *memalign(size_t align, size_t size) __THROW { WDL_RT_CHECK_ALLOC("memalign",size) return __libc_memalign(align,size); }
+  void *aligned_alloc(size_t align, size_t size) __THROW { WDL_RT_CHECK_ALLOC("aligned_alloc",size) return __libc_memalign(align,size); }
+  int posix_memalign(void **p, size_t align, size_t size) __THROW
+  {
+    WDL_RT_CHECK_ALLOC("posix_memalign",size)
+    return (*p=__libc_memalign(align,size)) ? 0 : 12 /* ENOMEM */;
+  }
+  void free(void *p) __THROW { if (p) WDL_RT_CHECK_ALLOC("free",0) __libc_free(p); }
+}
+
+#elif defined(_WIN32) && defined(_DEBUG)
+
+static int __cdecl WDL_RT_CrtAllocHook(int type, void *, size_t size, int blockType, long, const unsigned char *, int)
+{
+  if (blockType != _CRT_BLOCK && WDL_RT_IsRealtimeThread())
+  {
+    static const char *names[] = { "?", "malloc", "realloc", "free" };
+    WDL_RT_MALLOC_TRAP_HANDLER(names[type >= _HOOK_ALLOC && type <= _HOOK_FREE ? type : 0], size)
+  }
+  return TRUE;
+}
+
+static struct WDL_RT_CrtAllocHookInstaller
+{
+  WDL_RT_CrtAllocHookInstaller() { _CrtSetAllocHook(WDL_RT_CrtAllocHook); }
+} s_wdl_rt_crtallochook;
+
+#endif
+
+#endif // WDL_RT_MALLOC_TRAP_IMPLEMENT
+
+#else // !WDL_RT_MALLOC_TRAP
+
+#define WDL_RT_CHECK_ALLOC(what, size)
+
+inline bool WDL_RT_IsRealtimeThread() { return false; }
+
+class WDL_RTScope
+{
+public:
+  explicit WDL_RTScope(bool rt=true) { }
+};
+
+#endif // WDL_RT_MALLOC_TRAP
+
+#endif // _WDL_RTALLOC_H_
@@ -0,0 +1,200 @@
+/*
+    WDL - rtpool.h
+    Copyright (C) 2005 and later Cockos Incorporated
+
+    This software is provided 'as-is', without any express or implied
+    warranty.  In no event will the authors be held liable for any damages
+    arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any purpose,
+    including commercial applications, and to alter it and redistribute it
+    freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not
+       claim that you wrote the original software. If you use this software
+       in a product, an acknowledgment in the product documentation would be
+       appreciated but is not required.
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+    3. This notice may not be removed or altered from any source distribution.
+
+*/
+
+/*
+
+  WDL_RTPool is a WDL_Allocator that never calls the system allocator after it is
+  created, so that containers can grow on an audio thread:
+
+    WDL_RTPool pool(4<<20); // on a non-real-time thread, e.g. in the plug-in constructor
+    m_buf.SetAllocator(&pool);
+    m_resampler.SetAllocator(&pool);
+
+  The pool is one preallocated (and pre-touched) arena. Blocks are powers of two from
+  64 bytes up, each size with its own lock-free free list, so any number of threads can
+  allocate and free at once without locks. Freed blocks are reused for the same size
+  only, the arena isn't compacted. When it runs out Alloc() returns NULL, which
+  WDL_HeapBuf treats like any other failed allocation (the resize doesn't happen).
+
+  The pool must outlive every buffer that uses it.
+
+*/
+
+#ifndef _WDL_RTPOOL_H_
+#define _WDL_RTPOOL_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include "rtalloc.h"
+#include "wdltypes.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define WDL_RTPOOL_MINSHIFT 6   // 64 byte blocks
+#define WDL_RTPOOL_MAXCLASSES 25 // to 1gb
+#define WDL_RTPOOL_HDRSIZE 16   // keeps blocks 16 byte aligned
+
+class WDL_RTPool : public WDL_Allocator
+{
+public:
+  explicit WDL_RTPool(int arenaBytes)
+  {
+    memset((void *)m_freelist,0,sizeof(m_freelist));
+    m_used=m_inuse=m_peak=m_failed=0;
+    m_size=arenaBytes > 0 ? (arenaBytes & ~(WDL_RTPOOL_HDRSIZE-1)) : 0;
+    m_raw=m_size ? (char*)malloc(m_size + WDL_RTPOOL_HDRSIZE) : NULL;
+    if (!m_raw) m_size=0;
+    m_arena=(char *)(((UINT_PTR)m_raw + WDL_RTPOOL_HDRSIZE-1) & ~(UINT_PTR)(WDL_RTPOOL_HDRSIZE-1));
+    if (m_size) memset(m_arena,0,m_size); // fault the pages in now rather than on the audio thread
+  }
+  virtual ~WDL_RTPool() { free(m_raw); }
+
+  virtual void *Alloc(int size)
+  {
+    const int cls=SizeClass(size);
+    if (cls<0) { Failed(); return NULL; }
+
+    Block *b=Pop(cls);
+    if (!b)
+    {
+      const int blocksz=1<<(cls+WDL_RTPOOL_MINSHIFT);
+      int offs;
+      do
+      {
+        offs=load32(&m_used);
+        if (offs > m_size - blocksz) { Failed(); return NULL; }
+      }
+      while (!cas32(&m_used,offs,offs+blocksz));
+      b=(Block*)(m_arena+offs);
+      b->cls=cls;
+    }
+    const int blocksz=1<<(b->cls+WDL_RTPOOL_MINSHIFT);
+    const int inuse=add32(&m_inuse,blocksz);
+    int peak;
+    while (inuse > (peak=load32(&m_peak)) && !cas32(&m_peak,peak,inuse));
+    return (char*)b + WDL_RTPOOL_HDRSIZE;
+  }
+
+  virtual void *Realloc(void *buf, int newsize, int oldsize)
+  {
+    if (!buf) return Alloc(newsize);
+    if (newsize <= BlockSize(buf)) return buf;
+    void *nbuf=Alloc(newsize);
+    if (nbuf)
+    {
+      memcpy(nbuf,buf,oldsize < newsize ? oldsize : newsize);
+      Free(buf);
+    }
+    return nbuf;
+  }
+
+  virtual void Free(void *buf)
+  {
+    if (!buf) return;
+    Block *b=(Block*)((char*)buf - WDL_RTPOOL_HDRSIZE);
+    add32(&m_inuse,-(1<<(b->cls+WDL_RTPOOL_MINSHIFT)));
+    Push(b);
+  }
+
+  bool Owns(const void *buf) const { return buf >= m_arena && buf < m_arena + m_size; }
+  int BlockSize(const void *buf) const { return (1<<(((const Block*)((const char*)buf - WDL_RTPOOL_HDRSIZE))->cls+WDL_RTPOOL_MINSHIFT)) - WDL_RTPOOL_HDRSIZE; }
+
+  int GetArenaSize() const { return m_size; }
+  int GetArenaUsed() const { return m_used; } // carved into blocks so far
+  int GetBytesInUse() const { return m_inuse; } // in allocated blocks, including headers
+  int GetPeakBytesInUse() const { return m_peak; }
+  int GetFailedAllocs() const { return m_failed; }
+
+private:
+  struct Block
+  {
+    int cls;
+    volatile int next; // free list link, offset/WDL_RTPOOL_HDRSIZE+1 of the next free block or 0
+    int pad[2];
+  };
+
+  static int SizeClass(int size)
+  {
+    if (size < 0 || size > (1<<(WDL_RTPOOL_MAXCLASSES-1+WDL_RTPOOL_MINSHIFT)) - WDL_RTPOOL_HDRSIZE) return -1;
+    int cls=0;
+    while ((1<<(cls+WDL_RTPOOL_MINSHIFT)) - WDL_RTPOOL_HDRSIZE < size) cls++;
+    return cls;
+  }
+
+  // The list heads pair a block index with a count of pushes, so a block that is popped
+  // and pushed back between another thread's read and its compare-and-swap can't be
+  // mistaken for an unchanged list.
+  Block *Pop(int cls)
+  {
+    volatile WDL_UINT64 *head=m_freelist+cls;
+    for (;;)
+    {
+      const WDL_UINT64 h=load64(head);
+      const int idx=(int)(h & 0xffffffff);
+      if (!idx) return NULL;
+      Block *b=(Block*)(m_arena + (idx-1)*WDL_RTPOOL_HDRSIZE);
+      // b may be popped and reused by another thread before the CAS, which then fails
+      const WDL_UINT64 nh=(h & ~(WDL_UINT64)0xffffffff) | (unsigned int)load32(&b->next);
+      if (cas64(head,h,nh)) return b;
+    }
+  }
+
+  void Push(Block *b)
+  {
+    volatile WDL_UINT64 *head=m_freelist+b->cls;
+    const int idx=(int)(((char*)b - m_arena)/WDL_RTPOOL_HDRSIZE) + 1;
+    for (;;)
+    {
+      const WDL_UINT64 h=load64(head);
+      store32(&b->next,(int)(h & 0xffffffff));
+      const WDL_UINT64 nh=(((h>>32)+1)<<32) | (unsigned int)idx;
+      if (cas64(head,h,nh)) return;
+    }
+  }
+
+  void Failed() { add32(&m_failed,1); }
+
+#ifdef _WIN32
+  static bool cas32(volatile int *p, int oldv, int newv) { return InterlockedCompareExchange((LONG*)p,newv,oldv) == oldv; }
+  static bool cas64(volatile WDL_UINT64 *p, WDL_UINT64 oldv, WDL_UINT64 newv) { return (WDL_UINT64)InterlockedCompareExchange64((LONGLONG*)p,(LONGLONG)newv,(LONGLONG)oldv) == oldv; }
+  static int add32(volatile int *p, int v) { return InterlockedExchangeAdd((LONG*)p,v) + v; }
+  static WDL_UINT64 load64(volatile WDL_UINT64 *p) { return (WDL_UINT64)InterlockedCompareExchange64((LONGLONG*)p,0,0); }
+  static int load32(volatile int *p) { return *p; }
+  static void store32(volatile int *p, int v) { *p=v; }
+#else
+  static bool cas32(volatile int *p, int oldv, int newv) { return __sync_bool_compare_and_swap(p,oldv,newv); }
+  static bool cas64(volatile WDL_UINT64 *p, WDL_UINT64 oldv, WDL_UINT64 newv) { return __sync_bool_compare_and_swap(p,oldv,newv); }
+  static int add32(volatile int *p, int v) { return __sync_add_and_fetch(p,v); }
+  static WDL_UINT64 load64(volatile WDL_UINT64 *p) { return __atomic_load_n(p,__ATOMIC_ACQUIRE); }
+  static int load32(volatile int *p) { return __atomic_load_n(p,__ATOMIC_RELAXED); }
+  static void store32(volatile int *p, int v) { __atomic_store_n(p,v,__ATOMIC_RELAXED); }
+#endif
+
+  volatile WDL_UINT64 m_freelist[WDL_RTPOOL_MAXCLASSES];
+  char *m_raw, *m_arena;
+  int m_size;
+  volatile int m_used, m_inuse, m_peak, m_failed;
+};
+
+#endif // _WDL_RTPOOL_H_
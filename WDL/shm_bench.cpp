@@ -0,0 +1,146 @@
+// Measures the round trip time of WDL_SHM_Connection: a child process echoes every message back,
+// the parent times each one and checks that it came back as sent (every message is different). Both sides sleep in poll() on GetWaitEvent() between messages, the
+// way a real host/plug-in pair would.
+//
+// g++ -O2 -o shm_bench shm_bench.cpp shm_connection.cpp -I.
+// add -DWDL_SHM_NO_RING to measure the plain socket transport instead
+// usage: shm_bench [-s msgsize] [-n count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "shm_connection.h"
+
+static double GetTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+// message i, a different byte stream for each one so a stale or misplaced block shows up
+static void FillMsg(unsigned char *msg, int msgsize, int i)
+{
+  unsigned int x = (unsigned int)i*2654435761u + 1;
+  for (int k = 0; k < msgsize; k ++)
+  {
+    x = x*1103515245u + 12345u;
+    msg[k] = (unsigned char)(x>>24);
+  }
+}
+
+static int CmpDouble(const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// runs con until it has at least want bytes to read, false if the connection went away
+static bool WaitFor(WDL_SHM_Connection *con, int want)
+{
+  for (;;)
+  {
+    if (con->Run() < 0) return false;
+    if (con->recv_queue.Available() >= want && !con->send_queue.Available()) return true;
+    if (con->send_queue.Available()) continue; // ring was full, keep pushing
+
+    SWELL_InternalObjectHeader_SocketEvent *se = (SWELL_InternalObjectHeader_SocketEvent *)con->GetWaitEvent();
+    struct pollfd pfd = { se->socket[0], POLLIN, 0 };
+    poll(&pfd,1,100);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int msgsize=64, count=20000;
+  for (int i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i],"-s") && i+1 < argc) msgsize=atoi(argv[++i]);
+    else if (!strcmp(argv[i],"-n") && i+1 < argc) count=atoi(argv[++i]);
+    else count=0, i=argc;
+  }
+  if (msgsize<1 || count<1)
+  {
+    printf("usage: shm_bench [-s msgsize] [-n count]\n");
+    return 1;
+  }
+
+  char name[64];
+  snprintf(name,sizeof(name),"shm_bench_%d",(int)getpid());
+
+  WDL_SHM_Connection *master = new WDL_SHM_Connection(false,name);
+  const pid_t pid = fork();
+  if (pid < 0) return 1;
+  if (!pid)
+  {
+    WDL_SHM_Connection slave(true,name);
+    for (;;)
+    {
+      if (!WaitFor(&slave,msgsize)) break;
+      while (slave.recv_queue.Available() >= msgsize)
+      {
+        slave.send_queue.Add(slave.recv_queue.Get(),msgsize);
+        slave.recv_queue.Advance(msgsize);
+      }
+      slave.recv_queue.Compact();
+    }
+    _exit(0);
+  }
+
+  unsigned char *msg = (unsigned char *)malloc(msgsize);
+  FillMsg(msg,msgsize,-1);
+  double *rt = (double *)malloc(count*sizeof(double));
+  int bad=0;
+
+  // the first exchange also waits for the child to connect
+  master->send_queue.Add(msg,msgsize);
+  if (!WaitFor(master,msgsize))
+  {
+    printf("connection failed\n");
+    return 1;
+  }
+  master->recv_queue.Clear();
+
+  const double start = GetTimeMs();
+  for (int i = 0; i < count; i ++)
+  {
+    FillMsg(msg,msgsize,i); // before the clock starts
+    const double t0 = GetTimeMs();
+    master->send_queue.Add(msg,msgsize);
+    if (!WaitFor(master,msgsize))
+    {
+      printf("connection lost\n");
+      return 1;
+    }
+    rt[i] = GetTimeMs()-t0;
+    if (memcmp(master->recv_queue.Get(),msg,msgsize)) bad++;
+    master->recv_queue.Advance(msgsize);
+    master->recv_queue.Compact();
+  }
+  const double total = GetTimeMs()-start;
+
+  delete master;
+  kill(pid,SIGTERM); // the socket transport only notices a closed peer through its timeout
+  waitpid(pid,NULL,0);
+
+  qsort(rt,count,sizeof(double),CmpDouble);
+#ifdef WDL_SHM_RING
+  printf("shared memory ring, ");
+#else
+  printf("socket, ");
+#endif
+  printf("%d byte messages, %d round trips\n",msgsize,count);
+  printf("  avg %.1f us  p50 %.1f us  p99 %.1f us  max %.1f us  (%.0f round trips/s)\n",
+    total*1000.0/count, rt[count/2]*1000.0, rt[(int)(count*0.99)]*1000.0, rt[count-1]*1000.0, count*1000.0/total);
+  if (bad) printf("  %d echoes differed from what was sent\n",bad);
+
+  free(rt);
+  free(msg);
+  return bad ? 1 : 0;
+}
@@ -250,6 +250,32 @@ int WDL_SHM_Connection::Run()
 #endif
 #include "swell/swell-internal.h"
 
+#ifdef WDL_SHM_RING
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+
+#define SHM_MINSIZE 4096
+#define SHM_MAXSIZE (64<<20)
+#define SHM_RING_MAGIC 0x52534457 // "WDSR", first thing the master sends on the socket
+
+// start of the shared memory, the two rings follow. chan[x] is read by whichChan=x.
+// the read and write pointers only ever increase (wrapping around at 4GB, hence unsigned), each is written by one side only.
+struct WDL_SHM_RingHdr
+{
+  int size; // bytes per direction, a power of two
+  int pad0[15];
+  struct
+  {
+    unsigned int rdptr;
+    int pad1[15];
+    unsigned int wrptr;
+    int pad2[15];
+  } chan[2];
+};
+#endif
+
 static void sigpipehandler(int sig) { }
 
 // socket version
@@ -290,6 +316,16 @@ WDL_SHM_Connection::WDL_SHM_Connection(bool whichChan, // first created must be
   m_waitevt=0;
   m_whichChan = whichChan;
 
+#ifdef WDL_SHM_RING
+  m_shmsize = SHM_MINSIZE;
+  while (m_shmsize < shmsize && m_shmsize < SHM_MAXSIZE) m_shmsize*=2;
+  m_ringstate = RING_NONE;
+  m_ringmem = NULL;
+  m_ringmapsize = 0;
+  m_efd[0] = m_efd[1] = -1;
+  m_waitfd = -1;
+#endif
+
   struct sockaddr_un *addr = (struct sockaddr_un *)m_sockaddr;
   addr->sun_family = AF_UNIX;
   strcpy(addr->sun_path,m_tempfn.Get());
@@ -344,6 +380,9 @@ WDL_SHM_Connection::WDL_SHM_Connection(bool whichChan, // first created must be
 
       // clean up the filesystem, our connection has been made
       unlink(m_tempfn.Get());
+#ifdef WDL_SHM_RING
+      m_ringstate = RING_PENDING; // the master's first message sets up the ring
+#endif
     }
   } 
 
@@ -360,6 +399,9 @@ WDL_SHM_Connection::WDL_SHM_Connection(bool whichChan, // first created must be
 
 WDL_SHM_Connection::~WDL_SHM_Connection()
 {
+#ifdef WDL_SHM_RING
+  closeRing();
+#endif
   if (m_listen_socket>=0 || m_socket>=0)
   {
     if (m_socket>=0) close(m_socket);
@@ -414,6 +456,9 @@ int WDL_SHM_Connection::Run()
         se->socket[0]=s;
       }
       m_socket=s;
+#ifdef WDL_SHM_RING
+      sendRingSetup();
+#endif
     }
     else 
     {
@@ -429,6 +474,21 @@ int WDL_SHM_Connection::Run()
 
   bool sendcnt=false;
   bool recvcnt=false;
+
+#ifdef WDL_SHM_RING
+  if (m_ringstate == RING_PENDING)
+  {
+    recvRingSetup();
+    if (m_ringstate == RING_PENDING) return 0;
+  }
+  if (m_ringstate == RING_ACTIVE)
+  {
+    const int rv = runRing();
+    if (rv >= -1) return rv;
+    goto abortClose;
+  }
+#endif
+
   for (;;)
   {
     bool hadAct=false;
@@ -483,6 +543,9 @@ int WDL_SHM_Connection::Run()
   return sendcnt||recvcnt;
 
 abortClose:
+#ifdef WDL_SHM_RING
+  closeRing();
+#endif
   if (m_whichChan) return -1;
 
   acquireListener();
@@ -519,4 +582,270 @@ void WDL_SHM_Connection::acquireListener()
     m_listen_socket = s;
   }
 }
+
+#ifdef WDL_SHM_RING
+
+void WDL_SHM_Connection::sendRingSetup()
+{
+  int hdr[2] = { SHM_RING_MAGIC, 0 }; // hdr[1]=0 tells the other side to stay on the socket
+  int shmfd = -1;
+  closeRing();
+
+  m_efd[0] = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+  m_efd[1] = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+  if (m_efd[0]>=0 && m_efd[1]>=0)
+  {
+    static int cnt;
+    char name[128];
+    snprintf(name,sizeof(name),"/WDL_SHM.%d.%d",(int)getpid(),cnt++);
+    shmfd = shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+    if (shmfd>=0) shm_unlink(name); // only the descriptors keep it now, so nothing is left behind after a crash
+  }
+
+  m_ringmapsize = (int)sizeof(WDL_SHM_RingHdr) + m_shmsize*2;
+  if (shmfd>=0 && !ftruncate(shmfd,m_ringmapsize))
+  {
+    void *p = mmap(NULL,m_ringmapsize,PROT_READ|PROT_WRITE,MAP_SHARED,shmfd,0);
+    if (p != MAP_FAILED)
+    {
+      m_ringmem = (unsigned char *)p;
+      ((WDL_SHM_RingHdr *)m_ringmem)->size = m_shmsize;
+      hdr[1] = m_shmsize;
+    }
+  }
+
+  struct iovec iov = { hdr, sizeof(hdr) };
+  struct msghdr msg;
+  memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  union { struct cmsghdr align; char buf[CMSG_SPACE(3*sizeof(int))]; } cbuf;
+  if (hdr[1])
+  {
+    const int fds[3] = { shmfd, m_efd[0], m_efd[1] };
+    memset(&cbuf,0,sizeof(cbuf));
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm),fds,sizeof(fds));
+  }
+
+  // if this fails the other side never sees the magic, and treats whatever comes next as data
+  const bool sent = sendmsg(m_socket,&msg,MSG_NOSIGNAL) == (int)sizeof(hdr);
+  if (shmfd>=0) close(shmfd);
+
+  if (sent && hdr[1]) 
+  {
+    m_ringstate = RING_ACTIVE;
+    setupRingWait();
+  }
+  else closeRing();
+}
+
+void WDL_SHM_Connection::recvRingSetup()
+{
+  int hdr[2];
+  struct iovec iov = { hdr, sizeof(hdr) };
+  struct msghdr msg;
+  union { struct cmsghdr align; char buf[CMSG_SPACE(3*sizeof(int))]; } cbuf;
+  memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+
+  const int n = recvmsg(m_socket,&msg,MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+  if (n<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)) return;
+
+  int fds[3] = { -1, -1, -1 };
+  for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg,cm))
+  {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+    {
+      int nfds = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      int *p = (int *)CMSG_DATA(cm);
+      for (int x = 0; x < nfds; x ++)
+      {
+        if (x < 3) fds[x] = p[x];
+        else close(p[x]);
+      }
+    }
+  }
+
+  m_ringstate = RING_NONE;
+  if (n == (int)sizeof(hdr) && hdr[0] == SHM_RING_MAGIC)
+  {
+    const int sz = hdr[1];
+    struct stat st;
+    if (sz >= SHM_MINSIZE && sz <= SHM_MAXSIZE && !(sz&(sz-1)) && fds[0]>=0 && fds[1]>=0 && fds[2]>=0 &&
+        !fstat(fds[0],&st) && st.st_size >= (off_t)sizeof(WDL_SHM_RingHdr) + sz*2)
+    {
+      m_ringmapsize = (int)sizeof(WDL_SHM_RingHdr) + sz*2;
+      void *p = mmap(NULL,m_ringmapsize,PROT_READ|PROT_WRITE,MAP_SHARED,fds[0],0);
+      if (p != MAP_FAILED && ((WDL_SHM_RingHdr *)p)->size == sz)
+      {
+        m_ringmem = (unsigned char *)p;
+        m_efd[0] = fds[1];
+        m_efd[1] = fds[2];
+        fds[1] = fds[2] = -1;
+        m_ringstate = RING_ACTIVE;
+        setupRingWait();
+      }
+      else if (p != MAP_FAILED) munmap(p,m_ringmapsize);
+    }
+  }
+  else if (n > 0)
+  {
+    recv_queue.Add(hdr,n); // a master without the ring, this is its first data
+  }
+
+  for (int x = 0; x < 3; x ++) if (fds[x]>=0) close(fds[x]);
+}
+
+void WDL_SHM_Connection::setupRingWait()
+{
+  // waiting on both means a blocked reader still wakes up when the other side goes away
+  m_waitfd = epoll_create1(EPOLL_CLOEXEC);
+  if (m_waitfd>=0)
+  {
+    struct epoll_event ev;
+    memset(&ev,0,sizeof(ev));
+    ev.events = EPOLLIN;
+    if (epoll_ctl(m_waitfd,EPOLL_CTL_ADD,m_efd[m_whichChan],&ev) < 0)
+    {
+      close(m_waitfd);
+      m_waitfd=-1;
+    }
+    else
+    {
+      ev.events = EPOLLIN|EPOLLRDHUP;
+      epoll_ctl(m_waitfd,EPOLL_CTL_ADD,m_socket,&ev);
+    }
+  }
+  if (m_waitevt)
+  {
+    SWELL_InternalObjectHeader_SocketEvent *se = (SWELL_InternalObjectHeader_SocketEvent*)m_waitevt;
+    se->socket[0] = m_waitfd>=0 ? m_waitfd : m_efd[m_whichChan];
+  }
+}
+
+void WDL_SHM_Connection::closeRing()
+{
+  if (m_ringmem) munmap(m_ringmem,m_ringmapsize);
+  m_ringmem = NULL;
+  if (m_waitfd>=0) close(m_waitfd);
+  m_waitfd = -1;
+  for (int x = 0; x < 2; x ++)
+  {
+    if (m_efd[x]>=0) close(m_efd[x]);
+    m_efd[x] = -1;
+  }
+  if (m_ringstate == RING_ACTIVE && m_waitevt && m_socket>=0)
+  {
+    SWELL_InternalObjectHeader_SocketEvent *se = (SWELL_InternalObjectHeader_SocketEvent*)m_waitevt;
+    se->socket[0] = m_socket;
+  }
+  m_ringstate = RING_NONE;
+}
+
+// returns -2 if the other side has gone
+int WDL_SHM_Connection::runRing()
+{
+  // reset the eventfd. if it was set the other side is alive, otherwise check the socket:
+  // nothing is sent on it once the ring is up, so if it's readable the other side has closed it
+  WDL_UINT64 v;
+  if (read(m_efd[m_whichChan],&v,sizeof(v)) < 0)
+  {
+    char c;
+    const int sr = recv(m_socket,&c,1,MSG_DONTWAIT);
+    if (sr==0 || (sr<0 && errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)) return -2;
+  }
+
+  WDL_SHM_RingHdr *hdr = (WDL_SHM_RingHdr *)m_ringmem;
+  const int shm_size = (m_ringmapsize - (int)sizeof(WDL_SHM_RingHdr))/2;
+  bool sendcnt=false;
+  bool recvcnt=false;
+
+  // process writes
+  const int send_avail=send_queue.Available();
+  if (send_avail>0)
+  {
+    const int wc = !m_whichChan;
+    unsigned char *data=m_ringmem+sizeof(WDL_SHM_RingHdr)+shm_size*wc;
+    const unsigned int rdptr = __atomic_load_n(&hdr->chan[wc].rdptr,__ATOMIC_ACQUIRE);
+    const unsigned int wrptr = hdr->chan[wc].wrptr; // only we write it
+    int wrlen = shm_size - (int)(wrptr-rdptr);
+    if (wrlen > send_avail) wrlen=send_avail;
+    if (wrlen > 0)
+    {
+      const int idx = wrptr & (shm_size-1);
+      int l = shm_size - idx;
+      if (l > wrlen) l = wrlen;
+      memcpy(data+idx,send_queue.Get(),l);
+      if (l < wrlen) memcpy(data,(char*)send_queue.Get() + l,wrlen-l);
+
+      __atomic_store_n(&hdr->chan[wc].wrptr,wrptr+(unsigned int)wrlen,__ATOMIC_RELEASE);
+
+      send_queue.Advance(wrlen);
+      send_queue.Compact();
+      sendcnt=true;
+    }
+  }
+
+  // process reads
+  {
+    const int wc = m_whichChan;
+    unsigned char *data=m_ringmem+sizeof(WDL_SHM_RingHdr)+shm_size*wc;
+    const unsigned int rdptr = hdr->chan[wc].rdptr; // only we write it
+    const unsigned int wrptr = __atomic_load_n(&hdr->chan[wc].wrptr,__ATOMIC_ACQUIRE);
+    if (wrptr-rdptr > (unsigned int)shm_size) return -2; // corrupt
+    const int rdlen = (int)(wrptr-rdptr);
+
+    if (rdlen > 0)
+    {
+      const int idx = rdptr & (shm_size-1);
+      int l = shm_size - idx;
+      if (l > rdlen) l = rdlen;
+      recv_queue.Add(data+idx,l);
+      if (l < rdlen) recv_queue.Add(data,rdlen-l);
+
+      __atomic_store_n(&hdr->chan[wc].rdptr,wrptr,__ATOMIC_RELEASE);
+      recvcnt=true;
+    }
+  }
+
+  // new data for the other side, or room for it to write more
+  if (sendcnt||recvcnt)
+  {
+    v=1;
+    if (write(m_efd[!m_whichChan],&v,sizeof(v)) < 0) { }
+  }
+
+  if (m_timeout_sec>0)
+  {
+    time_t now = time(NULL);
+    if (recvcnt) 
+    {
+      m_last_recvt=now; 
+      m_timeout_cnt=0;
+    }
+    else if (now > m_timeout_sec+m_last_recvt) 
+    {
+      if (m_timeout_cnt >= 3) return -1;
+      m_timeout_cnt++;
+      m_last_recvt=now; 
+    }
+    
+    if (sendcnt||send_queue.GetSize()) m_next_keepalive = now + (m_timeout_sec+1)/2;
+  }
+
+  return sendcnt||recvcnt;
+}
+
+#endif // WDL_SHM_RING
+
 #endif
@@ -14,6 +14,13 @@
 #include "wdltypes.h"
 #include "queue.h"
 
+// On Linux the data moves through a shared memory ring (one per direction) rather than the
+// socket, which is kept to set the ring up and to notice when the other side goes away.
+// Both sides must be built the same way, define WDL_SHM_NO_RING to stay on the socket.
+#if defined(__linux__) && !defined(WDL_SHM_NO_RING)
+#define WDL_SHM_RING
+#endif
+
 class WDL_SHM_Connection
 {
 public:
@@ -80,6 +87,23 @@ private:
   void acquireListener();
   WDL_String m_lockfn;
   int m_lockhandle;
+
+#ifdef WDL_SHM_RING
+  int m_shmsize; // ring size (each direction) the master offers
+
+  enum { RING_NONE=0, RING_PENDING, RING_ACTIVE };
+  int m_ringstate; // RING_NONE = socket only
+  unsigned char *m_ringmem;
+  int m_ringmapsize;
+  int m_efd[2]; // eventfd, [m_whichChan] is signalled when the other side did something useful
+  int m_waitfd; // epoll on m_efd[m_whichChan] and m_socket, which is what GetWaitEvent() waits on
+
+  void sendRingSetup();
+  void recvRingSetup();
+  void setupRingWait();
+  void closeRing();
+  int runRing();
+#endif
 #endif
 
 };
@@ -162,6 +162,37 @@ int SHM_MsgReplyConnection::Send(int type, const void *msg, int msglen,
   return -1;
 }
 
+int SHM_MsgReplyConnection::SendRequest(int type, const void *msg, int msglen, const void *secondchunk, int secondchunklen)
+{
+  if (!m_shm||m_has_had_error) return 0;
+
+  m_shmmutex.Enter();
+  int msgid = ++m_lastmsgid;
+  if (!msgid) msgid = ++m_lastmsgid;
+  m_shmmutex.Leave();
+
+  // no reply buffer, so Send() only queues and flushes it
+  Send(type,msg,msglen,NULL,0,&msgid,secondchunk,secondchunklen);
+  return m_has_had_error ? 0 : msgid;
+}
+
+int SHM_MsgReplyConnection::GetReply(int msgID, void *replybuf, int maxretbuflen)
+{
+  WaitingMessage *wmsg=NULL;
+  bool r = RunInternal(msgID,&wmsg);
+  if (!wmsg) return r ? -2 : -1;
+
+  int rv = wmsg->m_msgdata.GetSize();
+  if (rv > maxretbuflen) rv=maxretbuflen;
+  if (rv>0) memcpy(replybuf,wmsg->m_msgdata.Get(),rv);
+
+  m_shmmutex.Enter();
+  wmsg->_next = m_spares;
+  m_spares=wmsg;
+  m_shmmutex.Leave();
+  return rv;
+}
+
 void SHM_MsgReplyConnection::Wait(HANDLE extraEvt)
 {
   HANDLE evt=m_shm ? m_shm->GetWaitEvent() : extraEvt;
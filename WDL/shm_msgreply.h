@@ -63,6 +63,15 @@ public:
   void Reply(int msgID, const void *msg, int msglen);
   void Wait(HANDLE extraEvt=NULL);
 
+  // Send() in two halves, for callers that have to bound their own wait (Send() waits ~30ms before
+  // it first asks IdleProc). SendRequest() returns the ID to pass to GetReply(), 0 on error.
+  // GetReply() runs the connection and returns the length of the reply once it has arrived, -1 if it
+  // hasn't yet, -2 on error. Wait on GetWaitEvent() in between. IdleProc isn't used, and a reply
+  // that's never collected stays queued until the connection goes away.
+  int SendRequest(int type, const void *msg, int msglen, const void *secondchunk=NULL, int secondchunklen=0);
+  int GetReply(int msgID, void *replybuf, int maxretbuflen);
+  HANDLE GetWaitEvent() { return m_shm ? m_shm->GetWaitEvent() : NULL; }
+
   const char *GetUniqueString() { return m_uniq; }
 
   void ReturnSpares(WaitingMessage *msglist);
@@ -3,18 +3,140 @@
 
 
 #include "wdlstring.h"
-#include "assocarray.h"
+#include "heapbuf.h"
 #include "mutex.h"
 
+// WDL_StringPool keeps one reference counted copy of each string added to it.
+// Add() returns the pool's copy, which stays valid until it has been Release()d
+// as many times as it was added. Pooled strings can be compared by pointer,
+// and carry their hash (GetHash()), which WDL_StringHashMap uses for its keys.
 class WDL_StringPool
 {
-  friend class WDL_PooledString;
 public:
-  WDL_StringPool(bool wantMutex) : m_strings(true) { m_mutex = wantMutex ? new WDL_Mutex : NULL; };
-  ~WDL_StringPool() { delete m_mutex; }
+  WDL_StringPool(bool wantMutex) : m_count(0) { m_mutex = wantMutex ? new WDL_Mutex : NULL; }
+  ~WDL_StringPool()
+  {
+    Ent **tab = m_table.Get();
+    for (int i = 0; i < m_table.GetSize(); i ++) free(tab[i]);
+    delete m_mutex;
+  }
+
+  const char *Add(const char *str)
+  {
+    if (!str) str="";
+    const unsigned int h = Hash(str);
+    WDL_MutexLock lock(m_mutex);
+    int slot = Find(str,h);
+    Ent *e = slot>=0 ? m_table.Get()[slot] : NULL;
+    if (e)
+    {
+      e->refcnt++;
+      return e->str;
+    }
+
+    const int len = (int)strlen(str);
+    e = (Ent *)malloc(sizeof(Ent) + len);
+    if (!e) return NULL;
+    e->refcnt = 1;
+    e->hash = h;
+    memcpy(e->str,str,len+1);
+
+    if ((m_count+1)*2 > m_table.GetSize())
+    {
+      Grow();
+      slot = Find(str,h);
+    }
+    m_table.Get()[slot] = e;
+    m_count++;
+    return e->str;
+  }
+
+  // For a string that came from this pool, cheaper than Add().
+  void AddRef(const char *pooled)
+  {
+    WDL_MutexLock lock(m_mutex);
+    GetEnt(pooled)->refcnt++;
+  }
+
+  void Release(const char *pooled)
+  {
+    if (!pooled) return;
+    WDL_MutexLock lock(m_mutex);
+    Ent *e = GetEnt(pooled);
+    if (--e->refcnt > 0) return;
+
+    // linear probing, so move later entries of the cluster back rather than leave a tombstone
+    Ent **tab = m_table.Get();
+    const int mask = m_table.GetSize()-1;
+    int i = e->hash & mask;
+    while (tab[i] != e) i = (i+1)&mask;
+    tab[i] = NULL;
+    for (int j = (i+1)&mask; tab[j]; j = (j+1)&mask)
+    {
+      const int home = tab[j]->hash & mask;
+      if (((j-home)&mask) >= ((j-i)&mask))
+      {
+        tab[i] = tab[j];
+        tab[j] = NULL;
+        i = j;
+      }
+    }
+    m_count--;
+    free(e);
+  }
+
+  int GetSize() const { return m_count; } // distinct strings
+
+  static unsigned int GetHash(const char *pooled) { return GetEnt(pooled)->hash; }
+
+  static unsigned int Hash(const char *str) // FNV-1a
+  {
+    unsigned int h = 2166136261u;
+    while (*str) { h ^= (unsigned char)*str++; h *= 16777619u; }
+    return h;
+  }
 
 private:
-  WDL_StringKeyedArray<int> m_strings;
+  struct Ent
+  {
+    int refcnt;
+    unsigned int hash;
+    char str[1];
+  };
+
+  static Ent *GetEnt(const char *pooled) { return (Ent *)(pooled - (INT_PTR)&((Ent *)0)->str); }
+
+  // slot holding str, or the empty slot it would go in (-1 if the table is empty)
+  int Find(const char *str, unsigned int h) const
+  {
+    const int sz = m_table.GetSize();
+    if (!sz) return -1;
+    Ent **tab = m_table.Get();
+    int i = h & (sz-1);
+    while (tab[i] && (tab[i]->hash != h || strcmp(tab[i]->str,str))) i = (i+1)&(sz-1);
+    return i;
+  }
+
+  void Grow()
+  {
+    const int oldsz = m_table.GetSize();
+    WDL_TypedBuf<Ent *> old;
+    if (oldsz) old.Set(m_table.Get(),oldsz);
+    const int sz = oldsz ? oldsz*2 : 64;
+    Ent **tab = m_table.Resize(sz,false);
+    memset(tab,0,sz*sizeof(Ent *));
+    for (int x = 0; x < oldsz; x ++)
+    {
+      Ent *e = old.Get()[x];
+      if (!e) continue;
+      int i = e->hash & (sz-1);
+      while (tab[i]) i = (i+1)&(sz-1);
+      tab[i] = e;
+    }
+  }
+
+  WDL_TypedBuf<Ent *> m_table;
+  int m_count;
 protected:
   WDL_Mutex *m_mutex;
 
@@ -33,29 +155,10 @@ public:
     if (!value) value="";
     if (strcmp(value,m_val))
     {
-      WDL_MutexLock(m_pool->m_mutex); // may or may not actually be a mutex
-
       const char *oldval = m_val;
-
-      if (*value)
-      {
-        // set to new value
-        const char *keyptr=NULL;
-        int * ref = m_pool->m_strings.GetPtr(value,&keyptr);
-        if (ref)
-        {
-          ++*ref;
-          m_val=keyptr;
-        }
-        else m_pool->m_strings.Insert(value,1,&m_val);
-      }
-      else m_val="";
-
-      if (oldval[0])
-      {
-        int *oldref = m_pool->m_strings.GetPtr(oldval);
-        if (oldref && --*oldref<=0) m_pool->m_strings.Delete(oldval);
-      }
+      m_val = *value ? m_pool->Add(value) : "";
+      if (!m_val) m_val = "";
+      if (oldval[0]) m_pool->Release(oldval);
     }
   }
 
@@ -8,6 +8,9 @@
 
   on timingPrint(), C:\\timings.txt will be overwritten.
 
+  wdl_timing_now_ns() is always available (it doesn't need TIMING): a monotonic clock in
+  nanoseconds since an arbitrary point, cheap enough to call around every audio block.
+
 */
 
 #ifndef _TIMING_H_
@@ -40,4 +43,45 @@ void _timingLeave(int);
 #define timingEnter(x)
 #endif
 
+
+#include "wdltypes.h"
+
+#ifdef _WIN32
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <mach/mach_time.h>
+#else
+  #include <time.h>
+#endif
+
+#ifdef _MSC_VER
+  #define WDL_TIMING_INLINE __inline
+#else
+  #define WDL_TIMING_INLINE inline
+#endif
+
+static WDL_TIMING_INLINE WDL_UINT64 wdl_timing_now_ns(void)
+{
+#ifdef _WIN32
+  static double s_scale;
+  LARGE_INTEGER now;
+  if (!s_scale)
+  {
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    s_scale = 1000000000.0 / (double)freq.QuadPart;
+  }
+  QueryPerformanceCounter(&now);
+  return (WDL_UINT64) ((double)now.QuadPart * s_scale);
+#elif defined(__APPLE__)
+  static mach_timebase_info_data_t s_tb;
+  if (!s_tb.denom) mach_timebase_info(&s_tb);
+  return mach_absolute_time() * s_tb.numer / s_tb.denom;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (WDL_UINT64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
 #endif
\ No newline at end of file
@@ -7,6 +7,8 @@ static int wdl_atomic_incr(int *v) { return (int) InterlockedIncrement((LONG *)v
 static int wdl_atomic_decr(int *v) { return (int) InterlockedDecrement((LONG *)v); }
 static int wdl_atomic_incr(volatile int *v) { return (int) InterlockedIncrement((LONG *)v); }
 static int wdl_atomic_decr(volatile int *v) { return (int) InterlockedDecrement((LONG *)v); }
+static int wdl_atomic_get(volatile int *v) { return (int) InterlockedCompareExchange((LONG *)v,0,0); }
+static void wdl_atomic_set(volatile int *v, int x) { InterlockedExchange((LONG *)v,x); }
 
 #elif (!defined(__APPLE__) || !defined(__ppc__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 2))))
 
@@ -14,6 +16,12 @@ static int wdl_atomic_incr(int *v) { return __sync_add_and_fetch(v,1); }
 static int wdl_atomic_decr(int *v) { return __sync_add_and_fetch(v,~0); }
 static int wdl_atomic_incr(volatile int *v) { return __sync_add_and_fetch(v,1); }
 static int wdl_atomic_decr(volatile int *v) { return __sync_add_and_fetch(v,~0); }
+static int wdl_atomic_get(volatile int *v) { return __sync_add_and_fetch(v,0); }
+#ifdef __ATOMIC_SEQ_CST
+static void wdl_atomic_set(volatile int *v, int x) { __atomic_store_n(v,x,__ATOMIC_SEQ_CST); }
+#else
+static void wdl_atomic_set(volatile int *v, int x) { __sync_synchronize(); __sync_lock_test_and_set(v,x); }
+#endif
 
 #elif defined(__APPLE__)
 // used by GCC < 4.2 on OSX
@@ -23,6 +31,8 @@ static int wdl_atomic_incr(int *v) { return (int) OSAtomicIncrement32Barrier((in
 static int wdl_atomic_decr(int *v) { return (int) OSAtomicDecrement32Barrier((int32_t*)v); }
 static int wdl_atomic_incr(volatile int *v) { return (int) OSAtomicIncrement32Barrier((int32_t*)v); }
 static int wdl_atomic_decr(volatile int *v) { return (int) OSAtomicDecrement32Barrier((int32_t*)v); }
+static int wdl_atomic_get(volatile int *v) { return (int) OSAtomicAdd32Barrier(0,(int32_t*)v); }
+static void wdl_atomic_set(volatile int *v, int x) { OSMemoryBarrier(); *v = x; OSMemoryBarrier(); }
 #else
 
 // unsupported! 